@@ -14,6 +14,7 @@
 #include "pose_imu_calibration/PoseIMUCalibration.h"
 #include "pose_graph/PoseGraph.h"
 #include "pose_graph/PoseGraphViz.h"
+#include "sparse_graph/BAProblem.h"
 
 namespace px
 {
@@ -830,18 +831,7 @@ SelfMultiCamCalibration::runLimitedBA(const SparseGraphPtr& graph,
                                       SparseGraphViz& graphViz) const
 {
     // run bundle adjustment
-    ceres::Problem problem;
-
-    ceres::Solver::Options options;
-    options.linear_solver_type = ceres::SPARSE_NORMAL_CHOLESKY;
-    options.max_num_iterations = 1000;
-    options.num_threads = 8;
-    options.num_linear_solver_threads = 8;
-
-    // visualize sparse graph at end of each optimization iteration
-    GraphVizCallback callback(graphViz);
-    options.callbacks.push_back(&callback);
-    options.update_state_every_iteration = true;
+    BAProblem problem;
 
     std::vector<Eigen::Quaterniond, Eigen::aligned_allocator<Eigen::Quaterniond> > q_sys_cam;
     std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > t_sys_cam;
@@ -880,7 +870,7 @@ SelfMultiCamCalibration::runLimitedBA(const SparseGraphPtr& graph,
                                                                               feature->ray(),
                                                                               SYSTEM_CAMERA_TRANSFORM | SCENE_POINT);
 
-                    problem.AddResidualBlock(costFunction, lossFunction,
+                    problem.addResidualBlock(costFunction, lossFunction,
                                              q_sys_cam.at(cameraId).coeffs().data(),
                                              t_sys_cam.at(cameraId).data(),
                                              scenePoint->pointData());
@@ -894,12 +884,23 @@ SelfMultiCamCalibration::runLimitedBA(const SparseGraphPtr& graph,
         ceres::LocalParameterization* quaternionParameterization =
             new EigenQuaternionParameterization;
 
-        problem.SetParameterization(q_sys_cam.at(i).coeffs().data(),
-                                    quaternionParameterization);
+        problem.problem().SetParameterization(q_sys_cam.at(i).coeffs().data(),
+                                              quaternionParameterization);
     }
 
+    ceres::Solver::Options options;
+    problem.setLinearSolver(ceres::SPARSE_SCHUR, options);
+    options.max_num_iterations = 1000;
+    options.num_threads = 8;
+    options.num_linear_solver_threads = 8;
+
+    // visualize sparse graph at end of each optimization iteration
+    GraphVizCallback callback(graphViz);
+    options.callbacks.push_back(&callback);
+    options.update_state_every_iteration = true;
+
     ceres::Solver::Summary summary;
-    ceres::Solve(options, &problem, &summary);
+    ceres::Solve(options, &problem.problem(), &summary);
 
     ROS_INFO_STREAM(summary.BriefReport());
 
@@ -928,18 +929,7 @@ SelfMultiCamCalibration::runBA(const SparseGraphPtr& graph,
                                const boost::shared_ptr<SparseGraphViz>& graphViz) const
 {
     // run bundle adjustment
-    ceres::Problem problem;
-
-    ceres::Solver::Options options;
-    options.linear_solver_type = ceres::SPARSE_NORMAL_CHOLESKY;
-    options.max_num_iterations = 1000;
-    options.num_threads = 8;
-    options.num_linear_solver_threads = 8;
-
-    // visualize sparse graph at end of each optimization iteration
-    GraphVizCallback callback(*graphViz);
-    options.callbacks.push_back(&callback);
-    options.update_state_every_iteration = true;
+    BAProblem problem;
 
     std::vector<Eigen::Quaterniond, Eigen::aligned_allocator<Eigen::Quaterniond> > q_sys_cam;
     std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > t_sys_cam;
@@ -978,7 +968,7 @@ SelfMultiCamCalibration::runBA(const SparseGraphPtr& graph,
                                                                               feature->ray(),
                                                                               SYSTEM_POSE | SCENE_POINT);
 
-                    problem.AddResidualBlock(costFunction, lossFunction,
+                    problem.addResidualBlock(costFunction, lossFunction,
                                              frameSet->systemPose()->rotationData(),
                                              frameSet->systemPose()->translationData(),
                                              scenePoint->pointData());
@@ -988,13 +978,24 @@ SelfMultiCamCalibration::runBA(const SparseGraphPtr& graph,
             ceres::LocalParameterization* quaternionParameterization =
                 new EigenQuaternionParameterization;
 
-            problem.SetParameterization(frameSet->systemPose()->rotationData(),
-                                        quaternionParameterization);
+            problem.problem().SetParameterization(frameSet->systemPose()->rotationData(),
+                                                  quaternionParameterization);
         }
     }
 
+    ceres::Solver::Options options;
+    problem.setLinearSolver(ceres::SPARSE_SCHUR, options);
+    options.max_num_iterations = 1000;
+    options.num_threads = 8;
+    options.num_linear_solver_threads = 8;
+
+    // visualize sparse graph at end of each optimization iteration
+    GraphVizCallback callback(*graphViz);
+    options.callbacks.push_back(&callback);
+    options.update_state_every_iteration = true;
+
     ceres::Solver::Summary summary;
-    ceres::Solve(options, &problem, &summary);
+    ceres::Solve(options, &problem.problem(), &summary);
 
     ROS_INFO_STREAM(summary.BriefReport());
 
@@ -0,0 +1,173 @@
+#include <boost/program_options.hpp>
+#include <cstdio>
+#include <iostream>
+
+#include "camera_models/CostFunctionFactory.h"
+#include "camera_systems/CameraSystem.h"
+#include "cauldron/EigenQuaternionParameterization.h"
+#include "cauldron/EigenUtils.h"
+#include "ceres/ceres.h"
+#include "sparse_graph/BAProblem.h"
+#include "sparse_graph/SparseGraph.h"
+
+// Runs bundle adjustment over the system poses and scene points of a
+// recorded sparse graph with each linear solver, starting from the
+// recorded state every time, and reports the time to convergence.
+bool
+benchmark(const std::string& graphFilename,
+          const px::CameraSystem& cameraSystem,
+          ceres::LinearSolverType linearSolverType,
+          ceres::PreconditionerType preconditionerType,
+          int maxIterations)
+{
+    px::SparseGraph graph;
+    if (!graph.readFromBinaryFile(graphFilename))
+    {
+        std::cout << "# ERROR: Failed to read sparse graph." << std::endl;
+        return false;
+    }
+
+    std::vector<Eigen::Quaterniond, Eigen::aligned_allocator<Eigen::Quaterniond> > q_sys_cam;
+    std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > t_sys_cam;
+    for (int i = 0; i < cameraSystem.cameraCount(); ++i)
+    {
+        Eigen::Matrix4d H_inv = px::invertHomogeneousTransform(cameraSystem.getGlobalCameraPose(i));
+
+        q_sys_cam.push_back(Eigen::Quaterniond(H_inv.block<3,3>(0,0)));
+        t_sys_cam.push_back(H_inv.block<3,1>(0,3));
+    }
+
+    px::BAProblem problem;
+
+    size_t nPoses = 0;
+    for (size_t i = 0; i < graph.frameSetSegments().size(); ++i)
+    {
+        px::FrameSetSegment& segment = graph.frameSetSegment(i);
+
+        for (size_t j = 0; j < segment.size(); ++j)
+        {
+            px::FrameSetPtr& frameSet = segment.at(j);
+
+            bool observed = false;
+            for (size_t k = 0; k < frameSet->frames().size(); ++k)
+            {
+                px::FramePtr& frame = frameSet->frames().at(k);
+                int cameraId = frame->cameraId();
+
+                std::vector<px::Point2DFeaturePtr>& features = frame->features2D();
+                for (size_t l = 0; l < features.size(); ++l)
+                {
+                    px::Point2DFeaturePtr& feature = features.at(l);
+                    px::Point3DFeaturePtr& scenePoint = feature->feature3D();
+
+                    ceres::LossFunction* lossFunction = new ceres::HuberLoss(0.0000055555);
+
+                    ceres::CostFunction* costFunction =
+                        px::CostFunctionFactory::instance()->generateCostFunction(q_sys_cam.at(cameraId),
+                                                                                  t_sys_cam.at(cameraId),
+                                                                                  feature->ray(),
+                                                                                  px::SYSTEM_POSE | px::SCENE_POINT);
+
+                    problem.addResidualBlock(costFunction, lossFunction,
+                                             frameSet->systemPose()->rotationData(),
+                                             frameSet->systemPose()->translationData(),
+                                             scenePoint->pointData());
+
+                    observed = true;
+                }
+            }
+
+            if (!observed)
+            {
+                continue;
+            }
+
+            ceres::LocalParameterization* quaternionParameterization =
+                new px::EigenQuaternionParameterization;
+
+            problem.problem().SetParameterization(frameSet->systemPose()->rotationData(),
+                                                  quaternionParameterization);
+
+            ++nPoses;
+        }
+    }
+
+    ceres::Solver::Options options;
+    problem.setLinearSolver(linearSolverType, options);
+    if (linearSolverType == ceres::ITERATIVE_SCHUR)
+    {
+        options.preconditioner_type = preconditionerType;
+    }
+    options.max_num_iterations = maxIterations;
+    options.num_threads = 8;
+    options.num_linear_solver_threads = 8;
+
+    ceres::Solver::Summary summary;
+    ceres::Solve(options, &problem.problem(), &summary);
+
+    std::string name = ceres::LinearSolverTypeToString(linearSolverType);
+    if (linearSolverType == ceres::ITERATIVE_SCHUR)
+    {
+        name += std::string("/") + ceres::PreconditionerTypeToString(preconditionerType);
+    }
+
+    if (!summary.error.empty())
+    {
+        printf("%-30s error: %s\n", name.c_str(), summary.error.c_str());
+        return false;
+    }
+
+    printf("%-30s poses: %6lu | points: %7lu | iterations: %4d | "
+           "cost: %12.6e -> %12.6e | linear solver: %8.3f s | total: %8.3f s | %s\n",
+           name.c_str(), nPoses, problem.scenePointCount(),
+           summary.num_successful_steps + summary.num_unsuccessful_steps,
+           summary.initial_cost, summary.final_cost,
+           summary.linear_solver_time_in_seconds, summary.total_time_in_seconds,
+           ceres::SolverTerminationTypeToString(summary.termination_type));
+
+    return true;
+}
+
+int
+main(int argc, char** argv)
+{
+    std::string graphFilename;
+    std::string extrinsicFilename;
+    int nCams;
+    int maxIterations;
+
+    //========= Handling Program options =========
+    boost::program_options::options_description desc("Allowed options");
+    desc.add_options()
+        ("help", "produce help message")
+        ("input,i", boost::program_options::value<std::string>(&graphFilename)->default_value("int_map.sg"), "Sparse graph file.")
+        ("extrinsics,e", boost::program_options::value<std::string>(&extrinsicFilename)->default_value("int_camera_system_extrinsics.txt"), "Extrinsic calibration file.")
+        ("camera-count", boost::program_options::value<int>(&nCams)->default_value(4), "Number of cameras in camera system.")
+        ("iterations", boost::program_options::value<int>(&maxIterations)->default_value(1000), "Maximum number of solver iterations.")
+        ;
+
+    boost::program_options::variables_map vm;
+    boost::program_options::store(boost::program_options::parse_command_line(argc, argv, desc), vm);
+    boost::program_options::notify(vm);
+
+    if (vm.count("help"))
+    {
+        std::cout << desc << std::endl;
+        return 1;
+    }
+
+    px::CameraSystem cameraSystem(nCams);
+    if (!cameraSystem.readFromTextFile(extrinsicFilename))
+    {
+        std::cout << "# ERROR: Failed to read extrinsic file." << std::endl;
+        return 1;
+    }
+
+    benchmark(graphFilename, cameraSystem, ceres::SPARSE_NORMAL_CHOLESKY, ceres::JACOBI, maxIterations);
+    benchmark(graphFilename, cameraSystem, ceres::SPARSE_SCHUR, ceres::JACOBI, maxIterations);
+    benchmark(graphFilename, cameraSystem, ceres::ITERATIVE_SCHUR, ceres::SCHUR_JACOBI, maxIterations);
+    benchmark(graphFilename, cameraSystem, ceres::ITERATIVE_SCHUR, ceres::CLUSTER_JACOBI, maxIterations);
+    benchmark(graphFilename, cameraSystem, ceres::ITERATIVE_SCHUR, ceres::CLUSTER_TRIDIAGONAL, maxIterations);
+
+    return 0;
+}
@@ -101,6 +101,24 @@ public:
     //%output p
     //%output J
 
+    // Lift a batch of n points from the image plane to the sphere.
+    // Points are stored in structure-of-arrays layout: (u[i], v[i])
+    // is lifted to (X[i], Y[i], Z[i]).
+    virtual void liftSphere(size_t n, const double* u, const double* v,
+                            double* X, double* Y, double* Z) const;
+    //%output X
+    //%output Y
+    //%output Z
+
+    // Projects a batch of n 3D points to the image plane.
+    // Points are stored in structure-of-arrays layout: (X[i], Y[i], Z[i])
+    // is projected to (u[i], v[i]).
+    virtual void spaceToPlane(size_t n,
+                              const double* X, const double* Y, const double* Z,
+                              double* u, double* v) const;
+    //%output u
+    //%output v
+
     virtual void undistToPlane(const Eigen::Vector2d& p_u, Eigen::Vector2d& p) const = 0;
     //%output p
 
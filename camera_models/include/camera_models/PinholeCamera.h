@@ -59,6 +59,13 @@ public:
         double m_cy;
     };
 
+    enum UndistortionMethod
+    {
+        RECURSIVE, // fixed number of fixed-point iterations (default)
+        NEWTON,    // Newton's method with convergence check
+        GRID       // precomputed undistortion grid refined by Newton's method
+    };
+
     PinholeCamera();
 
     /**
@@ -106,6 +113,20 @@ public:
     //%output p
     //%output J
 
+    // Lift a batch of points from the image plane to the sphere
+    void liftSphere(size_t n, const double* u, const double* v,
+                    double* X, double* Y, double* Z) const;
+    //%output X
+    //%output Y
+    //%output Z
+
+    // Projects a batch of 3D points to the image plane
+    void spaceToPlane(size_t n,
+                      const double* X, const double* Y, const double* Z,
+                      double* u, double* v) const;
+    //%output u
+    //%output v
+
     void undistToPlane(const Eigen::Vector2d& p_u, Eigen::Vector2d& p) const;
     //%output p
 
@@ -140,11 +161,39 @@ public:
 
     std::string parametersToString(void) const;
 
+    // Method used to invert the distortion model in liftProjective.
+    // The undistortion grid is rebuilt whenever the parameters change.
+    UndistortionMethod undistortionMethod(void) const;
+    void setUndistortionMethod(UndistortionMethod method);
+
 private:
+    // AVX2 implementations of the batched liftSphere and spaceToPlane,
+    // which are selected at run time. Return the number of points done.
+    size_t liftSphereAVX2(size_t n, const double* u, const double* v,
+                          double* X, double* Y, double* Z) const;
+    size_t spaceToPlaneAVX2(size_t n,
+                            const double* X, const double* Y, const double* Z,
+                            double* u, double* v) const;
+
+    void undistortRecursive(const Eigen::Vector2d& p_d, Eigen::Vector2d& p_u) const;
+    void undistortNewton(const Eigen::Vector2d& p_d, Eigen::Vector2d& p_u) const;
+    bool interpolateUndistortionGrid(const Eigen::Vector2d& p, Eigen::Vector2d& p_u) const;
+
+    void buildUndistortionGrid(void);
+
     Parameters m_parameters;
 
     double m_inv_K11, m_inv_K13, m_inv_K22, m_inv_K23;
     bool m_noDistortion;
+
+    UndistortionMethod m_undistortionMethod;
+
+    // undistorted normalised coordinates sampled every
+    // k_undistortionGridStep pixels
+    std::vector<double> m_undistortionGridX;
+    std::vector<double> m_undistortionGridY;
+    int m_undistortionGridCols;
+    int m_undistortionGridRows;
 };
 
 typedef boost::shared_ptr<PinholeCamera> PinholeCameraPtr;
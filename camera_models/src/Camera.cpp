@@ -165,6 +165,56 @@ Camera::estimateExtrinsics(const std::vector<cv::Point3f>& objectPoints,
     cv::solvePnP(objectPoints, Ms, cv::Mat::eye(3, 3, CV_64F), cv::noArray(), rvec, tvec);
 }
 
+/**
+ * \brief Lifts a batch of points from the image plane to the unit sphere
+ *
+ * The default implementation lifts one point at a time; camera models
+ * override it with vectorized implementations.
+ *
+ * \param n number of points
+ * \param u, v image coordinates
+ * \param X, Y, Z coordinates of the points on the sphere
+ */
+void
+Camera::liftSphere(size_t n, const double* u, const double* v,
+                   double* X, double* Y, double* Z) const
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        Eigen::Vector3d P;
+        liftSphere(Eigen::Vector2d(u[i], v[i]), P);
+
+        X[i] = P(0);
+        Y[i] = P(1);
+        Z[i] = P(2);
+    }
+}
+
+/**
+ * \brief Projects a batch of 3D points to the image plane
+ *
+ * The default implementation projects one point at a time; camera models
+ * override it with vectorized implementations.
+ *
+ * \param n number of points
+ * \param X, Y, Z 3D point coordinates
+ * \param u, v image coordinates
+ */
+void
+Camera::spaceToPlane(size_t n,
+                     const double* X, const double* Y, const double* Z,
+                     double* u, double* v) const
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        Eigen::Vector2d p;
+        spaceToPlane(Eigen::Vector3d(X[i], Y[i], Z[i]), p);
+
+        u[i] = p(0);
+        v[i] = p(1);
+    }
+}
+
 double
 Camera::reprojectionDist(const Eigen::Vector3d& P1, const Eigen::Vector3d& P2) const
 {
@@ -243,8 +293,6 @@ Camera::projectPoints(const std::vector<cv::Point3f>& objectPoints,
                       std::vector<cv::Point2f>& imagePoints) const
 {
     // project 3D object points to the image plane
-    imagePoints.reserve(objectPoints.size());
-
     //double
     cv::Mat R0;
     cv::Rodrigues(rvec, R0);
@@ -257,20 +305,31 @@ Camera::projectPoints(const std::vector<cv::Point3f>& objectPoints,
     Eigen::Vector3d t;
     t << tvec.at<double>(0), tvec.at<double>(1), tvec.at<double>(2);
 
-    for (size_t i = 0; i < objectPoints.size(); ++i)
+    size_t n = objectPoints.size();
+
+    // Rotate and translate into structure-of-arrays buffers
+    std::vector<double> X(n), Y(n), Z(n);
+    for (size_t i = 0; i < n; ++i)
     {
         const cv::Point3f& objectPoint = objectPoints.at(i);
 
-        // Rotate and translate
         Eigen::Vector3d P;
         P << objectPoint.x, objectPoint.y, objectPoint.z;
 
         P = R * P + t;
 
-        Eigen::Vector2d p;
-        spaceToPlane(P, p);
+        X.at(i) = P(0);
+        Y.at(i) = P(1);
+        Z.at(i) = P(2);
+    }
 
-        imagePoints.push_back(cv::Point2f(p(0), p(1)));
+    std::vector<double> u(n), v(n);
+    spaceToPlane(n, X.data(), Y.data(), Z.data(), u.data(), v.data());
+
+    imagePoints.reserve(imagePoints.size() + n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        imagePoints.push_back(cv::Point2f(u.at(i), v.at(i)));
     }
 }
 
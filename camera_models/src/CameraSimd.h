@@ -0,0 +1,107 @@
+#ifndef CAMERASIMD_H
+#define CAMERASIMD_H
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CAMERA_MODELS_X86
+#include <immintrin.h>
+
+namespace px
+{
+
+// Number of doubles processed per SIMD lane group.
+static const size_t k_simdWidth = 4;
+
+// The library is built for the baseline instruction set, and the AVX2
+// batch implementations are selected at run time if the CPU supports them.
+inline bool
+cpuSupportsAVX2(void)
+{
+    static const bool supported = (__builtin_cpu_init(), __builtin_cpu_supports("avx2") != 0);
+
+    return supported;
+}
+
+/**
+ * \brief Apply radial-tangential distortion to 4 points on the normalised plane
+ *
+ * Vectorized counterpart of PinholeCamera::distortion and CataCamera::distortion.
+ *
+ * \param mx_u, my_u undistorted coordinates of the points on the normalised plane
+ * \param dx_u, dy_u to obtain the distorted points: p_d = p_u + d_u
+ */
+inline __attribute__((target("avx2"))) void
+distortionAVX(const __m256d& mx_u, const __m256d& my_u,
+              const __m256d& k1, const __m256d& k2,
+              const __m256d& p1, const __m256d& p2,
+              __m256d& dx_u, __m256d& dy_u)
+{
+    const __m256d two = _mm256_set1_pd(2.0);
+
+    __m256d mx2_u = _mm256_mul_pd(mx_u, mx_u);
+    __m256d my2_u = _mm256_mul_pd(my_u, my_u);
+    __m256d mxy_u = _mm256_mul_pd(two, _mm256_mul_pd(mx_u, my_u));
+    __m256d rho2_u = _mm256_add_pd(mx2_u, my2_u);
+    __m256d rad_dist_u = _mm256_mul_pd(rho2_u,
+                                       _mm256_add_pd(k1, _mm256_mul_pd(k2, rho2_u)));
+
+    // d_u(0) = mx_u * rad_dist_u + 2 * p1 * mxy_u + p2 * (rho2_u + 2 * mx2_u)
+    dx_u = _mm256_add_pd(_mm256_mul_pd(mx_u, rad_dist_u),
+                         _mm256_add_pd(_mm256_mul_pd(p1, mxy_u),
+                                       _mm256_mul_pd(p2, _mm256_add_pd(rho2_u, _mm256_mul_pd(two, mx2_u)))));
+
+    // d_u(1) = my_u * rad_dist_u + 2 * p2 * mxy_u + p1 * (rho2_u + 2 * my2_u)
+    dy_u = _mm256_add_pd(_mm256_mul_pd(my_u, rad_dist_u),
+                         _mm256_add_pd(_mm256_mul_pd(p2, mxy_u),
+                                       _mm256_mul_pd(p1, _mm256_add_pd(rho2_u, _mm256_mul_pd(two, my2_u)))));
+}
+
+/**
+ * \brief Apply radial-tangential distortion to 4 points on the normalised plane
+ *        and calculate the Jacobian of the distorted points p_u + d_u
+ *
+ * The Jacobian is symmetric, so only dxdmx, dxdmy (= dydmx) and dydmy
+ * are returned.
+ */
+inline __attribute__((target("avx2"))) void
+distortionAVX(const __m256d& mx_u, const __m256d& my_u,
+              const __m256d& k1, const __m256d& k2,
+              const __m256d& p1, const __m256d& p2,
+              __m256d& dx_u, __m256d& dy_u,
+              __m256d& dxdmx, __m256d& dxdmy, __m256d& dydmy)
+{
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d two = _mm256_set1_pd(2.0);
+    const __m256d four = _mm256_set1_pd(4.0);
+    const __m256d six = _mm256_set1_pd(6.0);
+
+    distortionAVX(mx_u, my_u, k1, k2, p1, p2, dx_u, dy_u);
+
+    __m256d mx2_u = _mm256_mul_pd(mx_u, mx_u);
+    __m256d my2_u = _mm256_mul_pd(my_u, my_u);
+    __m256d mxy_u = _mm256_mul_pd(mx_u, my_u);
+    __m256d rho2_u = _mm256_add_pd(mx2_u, my2_u);
+    __m256d rad_dist_u = _mm256_mul_pd(rho2_u,
+                                       _mm256_add_pd(k1, _mm256_mul_pd(k2, rho2_u)));
+
+    // 2 * k1 + 4 * k2 * rho2_u
+    __m256d c = _mm256_add_pd(_mm256_mul_pd(two, k1),
+                              _mm256_mul_pd(four, _mm256_mul_pd(k2, rho2_u)));
+
+    dxdmx = _mm256_add_pd(_mm256_add_pd(one, rad_dist_u),
+                          _mm256_add_pd(_mm256_mul_pd(c, mx2_u),
+                                        _mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(two, p1), my_u),
+                                                      _mm256_mul_pd(_mm256_mul_pd(six, p2), mx_u))));
+    dxdmy = _mm256_add_pd(_mm256_mul_pd(c, mxy_u),
+                          _mm256_mul_pd(two, _mm256_add_pd(_mm256_mul_pd(p1, mx_u),
+                                                           _mm256_mul_pd(p2, my_u))));
+    dydmy = _mm256_add_pd(_mm256_add_pd(one, rad_dist_u),
+                          _mm256_add_pd(_mm256_mul_pd(c, my2_u),
+                                        _mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(six, p1), my_u),
+                                                      _mm256_mul_pd(_mm256_mul_pd(two, p2), mx_u))));
+}
+
+}
+
+#endif
+
+#endif
@@ -9,6 +9,8 @@
 #include <opencv2/core/eigen.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 
+#include "CameraSimd.h"
+
 namespace px
 {
 
@@ -754,6 +756,186 @@ CataCamera::spaceToPlane(const Eigen::Vector3d& P, Eigen::Vector2d& p,
          dvdx, dvdy, dvdz;
 }
 
+/**
+ * \brief Lifts a batch of points from the image plane to the unit sphere
+ *
+ * \param n number of points
+ * \param u, v image coordinates
+ * \param X, Y, Z coordinates of the points on the sphere
+ */
+void
+CataCamera::liftSphere(size_t n, const double* u, const double* v,
+                       double* X, double* Y, double* Z) const
+{
+    size_t i = 0;
+
+#ifdef CAMERA_MODELS_X86
+    if (cpuSupportsAVX2())
+    {
+        i = liftSphereAVX2(n, u, v, X, Y, Z);
+    }
+#endif
+
+    for (; i < n; ++i)
+    {
+        Eigen::Vector3d P;
+        CataCamera::liftSphere(Eigen::Vector2d(u[i], v[i]), P);
+
+        X[i] = P(0);
+        Y[i] = P(1);
+        Z[i] = P(2);
+    }
+}
+
+#ifdef CAMERA_MODELS_X86
+/**
+ * \brief AVX2 implementation of the batched liftSphere
+ *
+ * \return number of points lifted, a multiple of k_simdWidth
+ */
+__attribute__((target("avx2"))) size_t
+CataCamera::liftSphereAVX2(size_t n, const double* u, const double* v,
+                           double* X, double* Y, double* Z) const
+{
+    size_t i = 0;
+
+    const __m256d inv_K11 = _mm256_set1_pd(m_inv_K11);
+    const __m256d inv_K13 = _mm256_set1_pd(m_inv_K13);
+    const __m256d inv_K22 = _mm256_set1_pd(m_inv_K22);
+    const __m256d inv_K23 = _mm256_set1_pd(m_inv_K23);
+    const __m256d k1 = _mm256_set1_pd(m_parameters.k1());
+    const __m256d k2 = _mm256_set1_pd(m_parameters.k2());
+    const __m256d p1 = _mm256_set1_pd(m_parameters.p1());
+    const __m256d p2 = _mm256_set1_pd(m_parameters.p2());
+    const __m256d xi = _mm256_set1_pd(m_parameters.xi());
+    const __m256d one_minus_xi2 = _mm256_set1_pd(1.0 - m_parameters.xi() * m_parameters.xi());
+    const __m256d one = _mm256_set1_pd(1.0);
+
+    for (; i + k_simdWidth <= n; i += k_simdWidth)
+    {
+        // Lift points to normalised plane
+        __m256d mx_d = _mm256_add_pd(_mm256_mul_pd(inv_K11, _mm256_loadu_pd(u + i)), inv_K13);
+        __m256d my_d = _mm256_add_pd(_mm256_mul_pd(inv_K22, _mm256_loadu_pd(v + i)), inv_K23);
+
+        __m256d mx_u = mx_d;
+        __m256d my_u = my_d;
+
+        if (!m_noDistortion)
+        {
+            // Recursive distortion model
+            for (int j = 0; j < 6; ++j)
+            {
+                __m256d dx_u, dy_u;
+                distortionAVX(mx_u, my_u, k1, k2, p1, p2, dx_u, dy_u);
+
+                mx_u = _mm256_sub_pd(mx_d, dx_u);
+                my_u = _mm256_sub_pd(my_d, dy_u);
+            }
+        }
+
+        // Lift normalised points to the sphere (inv_hslash)
+        // lambda = (xi + sqrt(1 + (1 - xi^2) * rho2)) / (1 + rho2)
+        __m256d rho2_u = _mm256_add_pd(_mm256_mul_pd(mx_u, mx_u), _mm256_mul_pd(my_u, my_u));
+        __m256d lambda = _mm256_div_pd(_mm256_add_pd(xi, _mm256_sqrt_pd(_mm256_add_pd(one, _mm256_mul_pd(one_minus_xi2, rho2_u)))),
+                                       _mm256_add_pd(one, rho2_u));
+
+        _mm256_storeu_pd(X + i, _mm256_mul_pd(lambda, mx_u));
+        _mm256_storeu_pd(Y + i, _mm256_mul_pd(lambda, my_u));
+        _mm256_storeu_pd(Z + i, _mm256_sub_pd(lambda, xi));
+    }
+
+    return i;
+}
+#endif
+
+/**
+ * \brief Projects a batch of 3D points to the image plane
+ *
+ * \param n number of points
+ * \param X, Y, Z 3D point coordinates
+ * \param u, v image coordinates
+ */
+void
+CataCamera::spaceToPlane(size_t n,
+                         const double* X, const double* Y, const double* Z,
+                         double* u, double* v) const
+{
+    size_t i = 0;
+
+#ifdef CAMERA_MODELS_X86
+    if (cpuSupportsAVX2())
+    {
+        i = spaceToPlaneAVX2(n, X, Y, Z, u, v);
+    }
+#endif
+
+    for (; i < n; ++i)
+    {
+        Eigen::Vector2d p;
+        CataCamera::spaceToPlane(Eigen::Vector3d(X[i], Y[i], Z[i]), p);
+
+        u[i] = p(0);
+        v[i] = p(1);
+    }
+}
+
+#ifdef CAMERA_MODELS_X86
+/**
+ * \brief AVX2 implementation of the batched spaceToPlane
+ *
+ * \return number of points projected, a multiple of k_simdWidth
+ */
+__attribute__((target("avx2"))) size_t
+CataCamera::spaceToPlaneAVX2(size_t n,
+                             const double* X, const double* Y, const double* Z,
+                             double* u, double* v) const
+{
+    size_t i = 0;
+
+    const __m256d gamma1 = _mm256_set1_pd(m_parameters.gamma1());
+    const __m256d gamma2 = _mm256_set1_pd(m_parameters.gamma2());
+    const __m256d u0 = _mm256_set1_pd(m_parameters.u0());
+    const __m256d v0 = _mm256_set1_pd(m_parameters.v0());
+    const __m256d k1 = _mm256_set1_pd(m_parameters.k1());
+    const __m256d k2 = _mm256_set1_pd(m_parameters.k2());
+    const __m256d p1 = _mm256_set1_pd(m_parameters.p1());
+    const __m256d p2 = _mm256_set1_pd(m_parameters.p2());
+    const __m256d xi = _mm256_set1_pd(m_parameters.xi());
+    const __m256d one = _mm256_set1_pd(1.0);
+
+    for (; i + k_simdWidth <= n; i += k_simdWidth)
+    {
+        __m256d Px = _mm256_loadu_pd(X + i);
+        __m256d Py = _mm256_loadu_pd(Y + i);
+        __m256d Pz = _mm256_loadu_pd(Z + i);
+
+        // Project points to the normalised plane
+        __m256d norm = _mm256_sqrt_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(Px, Px),
+                                                                   _mm256_mul_pd(Py, Py)),
+                                                    _mm256_mul_pd(Pz, Pz)));
+        __m256d inv_z = _mm256_div_pd(one, _mm256_add_pd(Pz, _mm256_mul_pd(xi, norm)));
+        __m256d mx_d = _mm256_mul_pd(Px, inv_z);
+        __m256d my_d = _mm256_mul_pd(Py, inv_z);
+
+        if (!m_noDistortion)
+        {
+            // Apply distortion
+            __m256d dx_u, dy_u;
+            distortionAVX(mx_d, my_d, k1, k2, p1, p2, dx_u, dy_u);
+
+            mx_d = _mm256_add_pd(mx_d, dx_u);
+            my_d = _mm256_add_pd(my_d, dy_u);
+        }
+
+        // Apply generalised projection matrix
+        _mm256_storeu_pd(u + i, _mm256_add_pd(_mm256_mul_pd(gamma1, mx_d), u0));
+        _mm256_storeu_pd(v + i, _mm256_add_pd(_mm256_mul_pd(gamma2, my_d), v0));
+    }
+
+    return i;
+}
+#endif
+
 /** 
  * \brief Projects an undistorted 2D point p_u to the image plane
  *
@@ -850,24 +1032,34 @@ CataCamera::initUndistortMap(cv::Mat& map1, cv::Mat& map2) const
     cv::Mat mapX = cv::Mat::zeros(imageSize, CV_32F);
     cv::Mat mapY = cv::Mat::zeros(imageSize, CV_32F);
 
+    double xi = m_parameters.xi();
+
+    // Project one image row at a time using the batched projection
+    std::vector<double> X(imageSize.width), Y(imageSize.width), Z(imageSize.width);
+    std::vector<double> pu(imageSize.width), pv(imageSize.width);
+
     for (int v = 0; v < imageSize.height; ++v)
     {
+        double my_u = m_inv_K22 * v + m_inv_K23;
+
         for (int u = 0; u < imageSize.width; ++u)
         {
             double mx_u = m_inv_K11 * u + m_inv_K13;
-            double my_u = m_inv_K22 * v + m_inv_K23;
-
-            double xi = m_parameters.xi();
             double d2 = mx_u * mx_u + my_u * my_u;
 
-            Eigen::Vector3d P;
-            P << mx_u, my_u, 1.0 - xi * (d2 + 1.0) / (xi + sqrt(1.0 + (1.0 - xi * xi) * d2));
+            X.at(u) = mx_u;
+            Y.at(u) = my_u;
+            Z.at(u) = 1.0 - xi * (d2 + 1.0) / (xi + sqrt(1.0 + (1.0 - xi * xi) * d2));
+        }
 
-            Eigen::Vector2d p;
-            spaceToPlane(P, p);
+        spaceToPlane(imageSize.width, X.data(), Y.data(), Z.data(), pu.data(), pv.data());
 
-            mapX.at<float>(v,u) = p(0);
-            mapY.at<float>(v,u) = p(1);
+        float* mapXRow = mapX.ptr<float>(v);
+        float* mapYRow = mapY.ptr<float>(v);
+        for (int u = 0; u < imageSize.width; ++u)
+        {
+            mapXRow[u] = pu.at(u);
+            mapYRow[u] = pv.at(u);
         }
     }
 
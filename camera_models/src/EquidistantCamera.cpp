@@ -1,5 +1,6 @@
 #include "camera_models/EquidistantCamera.h"
 
+#include <algorithm>
 #include <cmath>
 #include <cstdio>
 #include <Eigen/Dense>
@@ -9,6 +10,8 @@
 #include <opencv2/core/eigen.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 
+#include "CameraSimd.h"
+
 namespace px
 {
 
@@ -258,6 +261,9 @@ EquidistantCamera::EquidistantCamera()
  , m_inv_K13(0.0)
  , m_inv_K22(1.0)
  , m_inv_K23(0.0)
+ , m_useLiftTable(false)
+ , m_liftTableStep(0.0)
+ , m_liftTableMaxR(0.0)
 {
 
 }
@@ -270,6 +276,9 @@ EquidistantCamera::EquidistantCamera(const std::string& cameraName,
                                      double u0, double v0)
  : m_parameters(cameraName, cameraType, imageWidth, imageHeight,
                 k2, k3, k4, k5, mu, mv, u0, v0)
+ , m_useLiftTable(false)
+ , m_liftTableStep(0.0)
+ , m_liftTableMaxR(0.0)
 {
     // Inverse camera projection matrix parameters
     m_inv_K11 = 1.0 / m_parameters.mu();
@@ -280,6 +289,9 @@ EquidistantCamera::EquidistantCamera(const std::string& cameraName,
 
 EquidistantCamera::EquidistantCamera(const EquidistantCamera::Parameters& params)
  : m_parameters(params)
+ , m_useLiftTable(false)
+ , m_liftTableStep(0.0)
+ , m_liftTableMaxR(0.0)
 {
     // Inverse camera projection matrix parameters
     m_inv_K11 = 1.0 / m_parameters.mu();
@@ -456,7 +468,7 @@ EquidistantCamera::liftProjective(const Eigen::Vector2d& p, Eigen::Vector3d& P)
 
     // Obtain a projective ray
     double theta, phi;
-    backprojectSymmetric(p_u, theta, phi);
+    backprojectSymmetricCached(p_u, theta, phi);
 
     P(0) = sin(theta) * cos(phi);
     P(1) = sin(theta) * sin(phi);
@@ -503,6 +515,237 @@ EquidistantCamera::spaceToPlane(const Eigen::Vector3d& P, Eigen::Vector2d& p,
          m_parameters.mv() * p_u(1) + m_parameters.v0();
 }
 
+/**
+ * \brief Lifts a batch of points from the image plane to the unit sphere
+ *
+ * The incidence angle theta is found with a vectorized Newton iteration on
+ * r(theta) = |p_u| instead of the companion-matrix eigenvalue solver used
+ * by backprojectSymmetric.
+ *
+ * \param n number of points
+ * \param u, v image coordinates
+ * \param X, Y, Z coordinates of the points on the sphere
+ */
+void
+EquidistantCamera::liftSphere(size_t n, const double* u, const double* v,
+                              double* X, double* Y, double* Z) const
+{
+    size_t i = 0;
+
+#ifdef CAMERA_MODELS_X86
+    if (cpuSupportsAVX2())
+    {
+        i = liftSphereAVX2(n, u, v, X, Y, Z);
+    }
+#endif
+
+    for (; i < n; ++i)
+    {
+        Eigen::Vector3d P;
+        EquidistantCamera::liftSphere(Eigen::Vector2d(u[i], v[i]), P);
+
+        X[i] = P(0);
+        Y[i] = P(1);
+        Z[i] = P(2);
+    }
+}
+
+#ifdef CAMERA_MODELS_X86
+/**
+ * \brief AVX2 implementation of the batched liftSphere
+ *
+ * \return number of points lifted, a multiple of k_simdWidth
+ */
+__attribute__((target("avx2"))) size_t
+EquidistantCamera::liftSphereAVX2(size_t n, const double* u, const double* v,
+                                  double* X, double* Y, double* Z) const
+{
+    size_t i = 0;
+
+    const __m256d inv_K11 = _mm256_set1_pd(m_inv_K11);
+    const __m256d inv_K13 = _mm256_set1_pd(m_inv_K13);
+    const __m256d inv_K22 = _mm256_set1_pd(m_inv_K22);
+    const __m256d inv_K23 = _mm256_set1_pd(m_inv_K23);
+    const __m256d k2 = _mm256_set1_pd(m_parameters.k2());
+    const __m256d k3 = _mm256_set1_pd(m_parameters.k3());
+    const __m256d k4 = _mm256_set1_pd(m_parameters.k4());
+    const __m256d k5 = _mm256_set1_pd(m_parameters.k5());
+    const __m256d dk2 = _mm256_set1_pd(3.0 * m_parameters.k2());
+    const __m256d dk3 = _mm256_set1_pd(5.0 * m_parameters.k3());
+    const __m256d dk4 = _mm256_set1_pd(7.0 * m_parameters.k4());
+    const __m256d dk5 = _mm256_set1_pd(9.0 * m_parameters.k5());
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d signMask = _mm256_set1_pd(-0.0);
+    const __m256d tol = _mm256_set1_pd(1e-12);
+
+    double theta[k_simdWidth], rho[k_simdWidth], mx[k_simdWidth], my[k_simdWidth];
+
+    for (; i + k_simdWidth <= n; i += k_simdWidth)
+    {
+        // Lift points to normalised plane
+        __m256d mx_u = _mm256_add_pd(_mm256_mul_pd(inv_K11, _mm256_loadu_pd(u + i)), inv_K13);
+        __m256d my_u = _mm256_add_pd(_mm256_mul_pd(inv_K22, _mm256_loadu_pd(v + i)), inv_K23);
+        __m256d rho_u = _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(mx_u, mx_u),
+                                                     _mm256_mul_pd(my_u, my_u)));
+
+        // Solve r(theta) = rho_u with Newton's method. r(theta) is increasing
+        // and concave over the valid field of view, so starting from the
+        // undistorted solution theta = rho_u converges to the smallest root.
+        __m256d theta_u = rho_u;
+        __m256d residual;
+        for (int j = 0; j < 20; ++j)
+        {
+            __m256d theta2 = _mm256_mul_pd(theta_u, theta_u);
+
+            // r(theta) = theta * (1 + k2 theta^2 + k3 theta^4 + k4 theta^6 + k5 theta^8)
+            __m256d r = _mm256_add_pd(_mm256_mul_pd(k5, theta2), k4);
+            r = _mm256_add_pd(_mm256_mul_pd(r, theta2), k3);
+            r = _mm256_add_pd(_mm256_mul_pd(r, theta2), k2);
+            r = _mm256_add_pd(_mm256_mul_pd(r, theta2), one);
+            r = _mm256_mul_pd(r, theta_u);
+
+            residual = _mm256_sub_pd(r, rho_u);
+            if (_mm256_movemask_pd(_mm256_cmp_pd(_mm256_andnot_pd(signMask, residual), tol, _CMP_GT_OQ)) == 0)
+            {
+                break;
+            }
+
+            // dr/dtheta = 1 + 3 k2 theta^2 + 5 k3 theta^4 + 7 k4 theta^6 + 9 k5 theta^8
+            __m256d dr = _mm256_add_pd(_mm256_mul_pd(dk5, theta2), dk4);
+            dr = _mm256_add_pd(_mm256_mul_pd(dr, theta2), dk3);
+            dr = _mm256_add_pd(_mm256_mul_pd(dr, theta2), dk2);
+            dr = _mm256_add_pd(_mm256_mul_pd(dr, theta2), one);
+
+            theta_u = _mm256_sub_pd(theta_u, _mm256_div_pd(residual, dr));
+        }
+
+        // As in backprojectSymmetric, fall back to theta = rho_u
+        // if r(theta) = rho_u has no solution.
+        __m256d converged = _mm256_cmp_pd(_mm256_andnot_pd(signMask, residual), tol, _CMP_LE_OQ);
+        theta_u = _mm256_blendv_pd(rho_u, theta_u, converged);
+
+        _mm256_storeu_pd(theta, theta_u);
+        _mm256_storeu_pd(rho, rho_u);
+        _mm256_storeu_pd(mx, mx_u);
+        _mm256_storeu_pd(my, my_u);
+
+        // AVX has no trigonometric instructions
+        for (size_t k = 0; k < k_simdWidth; ++k)
+        {
+            double sinTheta = sin(theta[k]);
+
+            if (rho[k] < 1e-10)
+            {
+                X[i + k] = sinTheta;
+                Y[i + k] = 0.0;
+            }
+            else
+            {
+                X[i + k] = sinTheta * mx[k] / rho[k];
+                Y[i + k] = sinTheta * my[k] / rho[k];
+            }
+            Z[i + k] = cos(theta[k]);
+        }
+    }
+
+    return i;
+}
+#endif
+
+/**
+ * \brief Projects a batch of 3D points to the image plane
+ *
+ * \param n number of points
+ * \param X, Y, Z 3D point coordinates
+ * \param u, v image coordinates
+ */
+void
+EquidistantCamera::spaceToPlane(size_t n,
+                                const double* X, const double* Y, const double* Z,
+                                double* u, double* v) const
+{
+    size_t i = 0;
+
+#ifdef CAMERA_MODELS_X86
+    if (cpuSupportsAVX2())
+    {
+        i = spaceToPlaneAVX2(n, X, Y, Z, u, v);
+    }
+#endif
+
+    for (; i < n; ++i)
+    {
+        Eigen::Vector2d p;
+        EquidistantCamera::spaceToPlane(Eigen::Vector3d(X[i], Y[i], Z[i]), p);
+
+        u[i] = p(0);
+        v[i] = p(1);
+    }
+}
+
+#ifdef CAMERA_MODELS_X86
+/**
+ * \brief AVX2 implementation of the batched spaceToPlane
+ *
+ * \return number of points projected, a multiple of k_simdWidth
+ */
+__attribute__((target("avx2"))) size_t
+EquidistantCamera::spaceToPlaneAVX2(size_t n,
+                                    const double* X, const double* Y, const double* Z,
+                                    double* u, double* v) const
+{
+    size_t i = 0;
+
+    const __m256d mu = _mm256_set1_pd(m_parameters.mu());
+    const __m256d mv = _mm256_set1_pd(m_parameters.mv());
+    const __m256d u0 = _mm256_set1_pd(m_parameters.u0());
+    const __m256d v0 = _mm256_set1_pd(m_parameters.v0());
+    const __m256d k2 = _mm256_set1_pd(m_parameters.k2());
+    const __m256d k3 = _mm256_set1_pd(m_parameters.k3());
+    const __m256d k4 = _mm256_set1_pd(m_parameters.k4());
+    const __m256d k5 = _mm256_set1_pd(m_parameters.k5());
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d eps = _mm256_set1_pd(1e-10);
+    const __m256d zero = _mm256_setzero_pd();
+
+    double theta[k_simdWidth];
+
+    for (; i + k_simdWidth <= n; i += k_simdWidth)
+    {
+        __m256d Px = _mm256_loadu_pd(X + i);
+        __m256d Py = _mm256_loadu_pd(Y + i);
+        __m256d rxy = _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(Px, Px),
+                                                   _mm256_mul_pd(Py, Py)));
+
+        // AVX has no trigonometric instructions
+        for (size_t k = 0; k < k_simdWidth; ++k)
+        {
+            theta[k] = atan2(hypot(X[i + k], Y[i + k]), Z[i + k]);
+        }
+
+        __m256d theta_u = _mm256_loadu_pd(theta);
+        __m256d theta2 = _mm256_mul_pd(theta_u, theta_u);
+
+        // r(theta) = theta * (1 + k2 theta^2 + k3 theta^4 + k4 theta^6 + k5 theta^8)
+        __m256d r = _mm256_add_pd(_mm256_mul_pd(k5, theta2), k4);
+        r = _mm256_add_pd(_mm256_mul_pd(r, theta2), k3);
+        r = _mm256_add_pd(_mm256_mul_pd(r, theta2), k2);
+        r = _mm256_add_pd(_mm256_mul_pd(r, theta2), one);
+        r = _mm256_mul_pd(r, theta_u);
+
+        // p_u = r(theta) * (cos(phi), sin(phi)) = r(theta) / rxy * (X, Y)
+        __m256d scale = _mm256_blendv_pd(zero, _mm256_div_pd(r, rxy),
+                                         _mm256_cmp_pd(rxy, eps, _CMP_GE_OQ));
+
+        // Apply generalised projection matrix
+        _mm256_storeu_pd(u + i, _mm256_add_pd(_mm256_mul_pd(mu, _mm256_mul_pd(scale, Px)), u0));
+        _mm256_storeu_pd(v + i, _mm256_add_pd(_mm256_mul_pd(mv, _mm256_mul_pd(scale, Py)), v0));
+    }
+
+    return i;
+}
+#endif
+
 /** 
  * \brief Projects an undistorted 2D point p_u to the image plane
  *
@@ -547,7 +790,7 @@ EquidistantCamera::initUndistortMap(cv::Mat& map1, cv::Mat& map2) const
             double my_u = m_inv_K22 * v + m_inv_K23;
 
             double theta, phi;
-            backprojectSymmetric(Eigen::Vector2d(mx_u, my_u), theta, phi);
+            backprojectSymmetricCached(Eigen::Vector2d(mx_u, my_u), theta, phi);
 
             Eigen::Vector3d P;
             P << sin(theta) * cos(phi), sin(theta) * sin(phi), cos(theta);
@@ -645,6 +888,11 @@ EquidistantCamera::setParameters(const EquidistantCamera::Parameters& parameters
     m_inv_K13 = -m_parameters.u0() / m_parameters.mu();
     m_inv_K22 = 1.0 / m_parameters.mv();
     m_inv_K23 = -m_parameters.v0() / m_parameters.mv();
+
+    if (m_useLiftTable)
+    {
+        buildLiftTable();
+    }
 }
 
 void
@@ -751,6 +999,29 @@ EquidistantCamera::parametersToString(void) const
     return oss.str();
 }
 
+bool
+EquidistantCamera::useLiftTable(void) const
+{
+    return m_useLiftTable;
+}
+
+void
+EquidistantCamera::setUseLiftTable(bool useLiftTable)
+{
+    m_useLiftTable = useLiftTable;
+
+    if (m_useLiftTable)
+    {
+        buildLiftTable();
+    }
+    else
+    {
+        m_liftTable.clear();
+        m_liftTableStep = 0.0;
+        m_liftTableMaxR = 0.0;
+    }
+}
+
 void
 EquidistantCamera::fitCircle(const std::vector<cv::Point2d>& points,
                              double& centerX, double& centerY, double& radius) const
@@ -979,4 +1250,126 @@ EquidistantCamera::backprojectSymmetric(const Eigen::Vector2d& p_u,
     }
 }
 
+
+/**
+ * \brief Same as backprojectSymmetric, but looks up theta in the
+ *        precomputed theta(r) table if available
+ *
+ * Linear interpolation in the table is followed by a single Newton step
+ * on r(theta) - |p_u| which brings theta to within numerical precision
+ * of the exact solution.
+ */
+void
+EquidistantCamera::backprojectSymmetricCached(const Eigen::Vector2d& p_u,
+                                              double& theta, double& phi) const
+{
+    double p_u_norm = p_u.norm();
+
+    if (!m_useLiftTable || p_u_norm >= m_liftTableMaxR)
+    {
+        backprojectSymmetric(p_u, theta, phi);
+        return;
+    }
+
+    if (p_u_norm < 1e-10)
+    {
+        phi = 0.0;
+    }
+    else
+    {
+        phi = atan2(p_u(1), p_u(0));
+    }
+
+    double x = p_u_norm / m_liftTableStep;
+    size_t idx = static_cast<size_t>(x);
+    double alpha = x - idx;
+
+    theta = (1.0 - alpha) * m_liftTable.at(idx) + alpha * m_liftTable.at(idx + 1);
+
+    double k2 = m_parameters.k2();
+    double k3 = m_parameters.k3();
+    double k4 = m_parameters.k4();
+    double k5 = m_parameters.k5();
+
+    double theta2 = theta * theta;
+    double dr = 1.0 + theta2 * (3.0 * k2 + theta2 * (5.0 * k3 + theta2 * (7.0 * k4 + theta2 * 9.0 * k5)));
+
+    theta -= (r(k2, k3, k4, k5, theta) - p_u_norm) / dr;
+}
+
+/**
+ * \brief Builds the theta(r) lookup table used by backprojectSymmetricCached
+ *
+ * The table spans the distorted radii of the image corners, limited to the
+ * range over which r(theta) is monotonically increasing so that each entry
+ * has a unique solution. Radii outside the table fall back to the exact
+ * solver.
+ */
+void
+EquidistantCamera::buildLiftTable(void)
+{
+    const int kTableSize = 4096;
+
+    m_liftTable.clear();
+    m_liftTableStep = 0.0;
+    m_liftTableMaxR = 0.0;
+
+    if (m_parameters.mu() == 0.0 || m_parameters.mv() == 0.0)
+    {
+        return;
+    }
+
+    double k2 = m_parameters.k2();
+    double k3 = m_parameters.k3();
+    double k4 = m_parameters.k4();
+    double k5 = m_parameters.k5();
+
+    // maximum distorted radius over the image
+    double maxR = 0.0;
+    for (int i = 0; i < 4; ++i)
+    {
+        double u = (i % 2) * m_parameters.imageWidth();
+        double v = (i / 2) * m_parameters.imageHeight();
+
+        Eigen::Vector2d p_u(m_inv_K11 * u + m_inv_K13,
+                            m_inv_K22 * v + m_inv_K23);
+
+        maxR = std::max(maxR, p_u.norm());
+    }
+
+    // Restrict the table to the part of r(theta) where it is monotonic
+    // and not too flat; near the turning point, theta(r) becomes too steep
+    // to interpolate accurately.
+    double thetaStep = M_PI / kTableSize;
+    for (double theta = thetaStep; theta <= M_PI; theta += thetaStep)
+    {
+        double theta2 = theta * theta;
+        double dr = 1.0 + theta2 * (3.0 * k2 + theta2 * (5.0 * k3 + theta2 * (7.0 * k4 + theta2 * 9.0 * k5)));
+
+        if (dr <= 0.25)
+        {
+            maxR = std::min(maxR, r(k2, k3, k4, k5, theta - thetaStep));
+            break;
+        }
+    }
+
+    if (maxR <= 0.0)
+    {
+        return;
+    }
+
+    m_liftTableStep = maxR / (kTableSize - 1);
+    m_liftTable.resize(kTableSize);
+    for (int i = 0; i < kTableSize; ++i)
+    {
+        double theta, phi;
+        backprojectSymmetric(Eigen::Vector2d(i * m_liftTableStep, 0.0), theta, phi);
+
+        m_liftTable.at(i) = theta;
+    }
+
+    // the last entry is only used for interpolation
+    m_liftTableMaxR = maxR - m_liftTableStep;
+}
+
 }
@@ -8,9 +8,14 @@
 #include <opencv2/core/eigen.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 
+#include "CameraSimd.h"
+
 namespace px
 {
 
+// spacing in pixels between the nodes of the undistortion grid
+static const int k_undistortionGridStep = 8;
+
 PinholeCamera::Parameters::Parameters()
  : Camera::Parameters(PINHOLE)
  , m_k1(0.0)
@@ -268,6 +273,9 @@ PinholeCamera::PinholeCamera()
  , m_inv_K22(1.0)
  , m_inv_K23(0.0)
  , m_noDistortion(true)
+ , m_undistortionMethod(RECURSIVE)
+ , m_undistortionGridCols(0)
+ , m_undistortionGridRows(0)
 {
 
 }
@@ -279,6 +287,9 @@ PinholeCamera::PinholeCamera(const std::string& cameraName,
                              double fx, double fy, double cx, double cy)
  : m_parameters(cameraName, cameraType, imageWidth, imageHeight,
                 k1, k2, p1, p2, fx, fy, cx, cy)
+ , m_undistortionMethod(RECURSIVE)
+ , m_undistortionGridCols(0)
+ , m_undistortionGridRows(0)
 {
     if ((m_parameters.k1() == 0.0) &&
         (m_parameters.k2() == 0.0) &&
@@ -301,6 +312,9 @@ PinholeCamera::PinholeCamera(const std::string& cameraName,
 
 PinholeCamera::PinholeCamera(const PinholeCamera::Parameters& params)
  : m_parameters(params)
+ , m_undistortionMethod(RECURSIVE)
+ , m_undistortionGridCols(0)
+ , m_undistortionGridRows(0)
 {
     if ((m_parameters.k1() == 0.0) &&
         (m_parameters.k2() == 0.0) &&
@@ -476,64 +490,39 @@ PinholeCamera::liftSphere(const Eigen::Vector2d& p, Eigen::Vector3d& P) const
 void
 PinholeCamera::liftProjective(const Eigen::Vector2d& p, Eigen::Vector3d& P) const
 {
-    double mx_d, my_d,mx2_d, mxy_d, my2_d, mx_u, my_u;
-    double rho2_d, rho4_d, radDist_d, Dx_d, Dy_d, inv_denom_d;
-    double lambda;
-
     // Lift points to normalised plane
-    mx_d = m_inv_K11 * p(0) + m_inv_K13;
-    my_d = m_inv_K22 * p(1) + m_inv_K23;
+    Eigen::Vector2d p_d(m_inv_K11 * p(0) + m_inv_K13,
+                        m_inv_K22 * p(1) + m_inv_K23);
+
+    Eigen::Vector2d p_u;
 
     if (m_noDistortion)
     {
-        mx_u = mx_d;
-        my_u = my_d;
+        p_u = p_d;
     }
     else
     {
-        if (0)
-        {
-            double k1 = m_parameters.k1();
-            double k2 = m_parameters.k2();
-            double p1 = m_parameters.p1();
-            double p2 = m_parameters.p2();
-
-            // Apply inverse distortion model
-            // proposed by Heikkila
-            mx2_d = mx_d*mx_d;
-            my2_d = my_d*my_d;
-            mxy_d = mx_d*my_d;
-            rho2_d = mx2_d+my2_d;
-            rho4_d = rho2_d*rho2_d;
-            radDist_d = k1*rho2_d+k2*rho4_d;
-            Dx_d = mx_d*radDist_d + p2*(rho2_d+2*mx2_d) + 2*p1*mxy_d;
-            Dy_d = my_d*radDist_d + p1*(rho2_d+2*my2_d) + 2*p2*mxy_d;
-            inv_denom_d = 1/(1+4*k1*rho2_d+6*k2*rho4_d+8*p1*my_d+8*p2*mx_d);
-
-            mx_u = mx_d - inv_denom_d*Dx_d;
-            my_u = my_d - inv_denom_d*Dy_d;
-        }
-        else
+        switch (m_undistortionMethod)
         {
-            // Recursive distortion model
-            int n = 8;
-            Eigen::Vector2d d_u;
-            distortion(Eigen::Vector2d(mx_d, my_d), d_u);
-            // Approximate value
-            mx_u = mx_d - d_u(0);
-            my_u = my_d - d_u(1);
-
-            for (int i = 1; i < n; ++i)
+        case RECURSIVE:
+            undistortRecursive(p_d, p_u);
+            break;
+        case GRID:
+            if (!interpolateUndistortionGrid(p, p_u))
             {
-                distortion(Eigen::Vector2d(mx_u, my_u), d_u);
-                mx_u = mx_d - d_u(0);
-                my_u = my_d - d_u(1);
+                p_u = p_d;
             }
+            undistortNewton(p_d, p_u);
+            break;
+        case NEWTON:
+        default:
+            p_u = p_d;
+            undistortNewton(p_d, p_u);
         }
     }
 
     // Obtain a projective ray
-    P << mx_u, my_u, 1.0;
+    P << p_u(0), p_u(1), 1.0;
 }
 
 
@@ -634,6 +623,249 @@ PinholeCamera::spaceToPlane(const Eigen::Vector3d& P, Eigen::Vector2d& p,
          dvdx, dvdy, dvdz;
 }
 
+/**
+ * \brief Lifts a batch of points from the image plane to the unit sphere
+ *
+ * \param n number of points
+ * \param u, v image coordinates
+ * \param X, Y, Z coordinates of the points on the sphere
+ */
+void
+PinholeCamera::liftSphere(size_t n, const double* u, const double* v,
+                          double* X, double* Y, double* Z) const
+{
+    size_t i = 0;
+
+#ifdef CAMERA_MODELS_X86
+    if (cpuSupportsAVX2())
+    {
+        i = liftSphereAVX2(n, u, v, X, Y, Z);
+    }
+#endif
+
+    for (; i < n; ++i)
+    {
+        Eigen::Vector3d P;
+        PinholeCamera::liftSphere(Eigen::Vector2d(u[i], v[i]), P);
+
+        X[i] = P(0);
+        Y[i] = P(1);
+        Z[i] = P(2);
+    }
+}
+
+#ifdef CAMERA_MODELS_X86
+/**
+ * \brief AVX2 implementation of the batched liftSphere
+ *
+ * \return number of points lifted, a multiple of k_simdWidth
+ */
+__attribute__((target("avx2"))) size_t
+PinholeCamera::liftSphereAVX2(size_t n, const double* u, const double* v,
+                              double* X, double* Y, double* Z) const
+{
+    size_t i = 0;
+
+    const __m256d inv_K11 = _mm256_set1_pd(m_inv_K11);
+    const __m256d inv_K13 = _mm256_set1_pd(m_inv_K13);
+    const __m256d inv_K22 = _mm256_set1_pd(m_inv_K22);
+    const __m256d inv_K23 = _mm256_set1_pd(m_inv_K23);
+    const __m256d k1 = _mm256_set1_pd(m_parameters.k1());
+    const __m256d k2 = _mm256_set1_pd(m_parameters.k2());
+    const __m256d p1 = _mm256_set1_pd(m_parameters.p1());
+    const __m256d p2 = _mm256_set1_pd(m_parameters.p2());
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d tol2 = _mm256_set1_pd(1e-24);
+    const __m256d detTol = _mm256_set1_pd(1e-12);
+    const __m256d signMask = _mm256_set1_pd(-0.0);
+
+    for (; i + k_simdWidth <= n; i += k_simdWidth)
+    {
+        // Lift points to normalised plane
+        __m256d mx_d = _mm256_add_pd(_mm256_mul_pd(inv_K11, _mm256_loadu_pd(u + i)), inv_K13);
+        __m256d my_d = _mm256_add_pd(_mm256_mul_pd(inv_K22, _mm256_loadu_pd(v + i)), inv_K23);
+
+        __m256d mx_u = mx_d;
+        __m256d my_u = my_d;
+
+        if (!m_noDistortion)
+        {
+            if (m_undistortionMethod == RECURSIVE)
+            {
+                // Recursive distortion model
+                for (int j = 0; j < 8; ++j)
+                {
+                    __m256d dx_u, dy_u;
+                    distortionAVX(mx_u, my_u, k1, k2, p1, p2, dx_u, dy_u);
+
+                    mx_u = _mm256_sub_pd(mx_d, dx_u);
+                    my_u = _mm256_sub_pd(my_d, dy_u);
+                }
+            }
+            else
+            {
+                // Newton's method; the undistortion grid only provides a better
+                // initial estimate, so it is not needed in the vectorized path.
+                // As in undistortNewton, a lane stops iterating once it has
+                // converged or its Jacobian is close to singular.
+                __m256d active = _mm256_cmp_pd(zero, zero, _CMP_EQ_OQ);
+
+                for (int j = 0; j < 20; ++j)
+                {
+                    __m256d dx_u, dy_u, dxdmx, dxdmy, dydmy;
+                    distortionAVX(mx_u, my_u, k1, k2, p1, p2,
+                                  dx_u, dy_u, dxdmx, dxdmy, dydmy);
+
+                    __m256d ex = _mm256_sub_pd(_mm256_add_pd(mx_u, dx_u), mx_d);
+                    __m256d ey = _mm256_sub_pd(_mm256_add_pd(my_u, dy_u), my_d);
+
+                    __m256d err2 = _mm256_add_pd(_mm256_mul_pd(ex, ex), _mm256_mul_pd(ey, ey));
+
+                    __m256d det = _mm256_sub_pd(_mm256_mul_pd(dxdmx, dydmy),
+                                                _mm256_mul_pd(dxdmy, dxdmy));
+
+                    active = _mm256_and_pd(active, _mm256_cmp_pd(err2, tol2, _CMP_GE_OQ));
+                    active = _mm256_and_pd(active, _mm256_cmp_pd(_mm256_andnot_pd(signMask, det),
+                                                                 detTol, _CMP_GE_OQ));
+                    if (_mm256_movemask_pd(active) == 0)
+                    {
+                        break;
+                    }
+
+                    __m256d inv_det = _mm256_div_pd(one, det);
+
+                    // the steps of inactive lanes are masked to zero
+                    __m256d sx = _mm256_mul_pd(inv_det, _mm256_sub_pd(_mm256_mul_pd(dydmy, ex),
+                                                                      _mm256_mul_pd(dxdmy, ey)));
+                    __m256d sy = _mm256_mul_pd(inv_det, _mm256_sub_pd(_mm256_mul_pd(dxdmx, ey),
+                                                                      _mm256_mul_pd(dxdmy, ex)));
+
+                    mx_u = _mm256_sub_pd(mx_u, _mm256_and_pd(active, sx));
+                    my_u = _mm256_sub_pd(my_u, _mm256_and_pd(active, sy));
+                }
+            }
+        }
+
+        // Lanes which have diverged to a non-finite value are lifted by the
+        // scalar implementation instead.
+        __m256d finite = _mm256_and_pd(_mm256_cmp_pd(_mm256_sub_pd(mx_u, mx_u), zero, _CMP_EQ_OQ),
+                                       _mm256_cmp_pd(_mm256_sub_pd(my_u, my_u), zero, _CMP_EQ_OQ));
+        int finiteMask = _mm256_movemask_pd(finite);
+
+        // Normalise the projective ray (mx_u, my_u, 1)
+        __m256d norm = _mm256_sqrt_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(mx_u, mx_u),
+                                                                   _mm256_mul_pd(my_u, my_u)),
+                                                    one));
+        __m256d inv_norm = _mm256_div_pd(one, norm);
+
+        _mm256_storeu_pd(X + i, _mm256_mul_pd(mx_u, inv_norm));
+        _mm256_storeu_pd(Y + i, _mm256_mul_pd(my_u, inv_norm));
+        _mm256_storeu_pd(Z + i, inv_norm);
+
+        if (finiteMask != 0xF)
+        {
+            for (size_t j = 0; j < k_simdWidth; ++j)
+            {
+                if (finiteMask & (1 << j))
+                {
+                    continue;
+                }
+
+                Eigen::Vector3d P;
+                PinholeCamera::liftSphere(Eigen::Vector2d(u[i + j], v[i + j]), P);
+
+                X[i + j] = P(0);
+                Y[i + j] = P(1);
+                Z[i + j] = P(2);
+            }
+        }
+    }
+
+    return i;
+}
+#endif
+
+/**
+ * \brief Projects a batch of 3D points to the image plane
+ *
+ * \param n number of points
+ * \param X, Y, Z 3D point coordinates
+ * \param u, v image coordinates
+ */
+void
+PinholeCamera::spaceToPlane(size_t n,
+                            const double* X, const double* Y, const double* Z,
+                            double* u, double* v) const
+{
+    size_t i = 0;
+
+#ifdef CAMERA_MODELS_X86
+    if (cpuSupportsAVX2())
+    {
+        i = spaceToPlaneAVX2(n, X, Y, Z, u, v);
+    }
+#endif
+
+    for (; i < n; ++i)
+    {
+        Eigen::Vector2d p;
+        PinholeCamera::spaceToPlane(Eigen::Vector3d(X[i], Y[i], Z[i]), p);
+
+        u[i] = p(0);
+        v[i] = p(1);
+    }
+}
+
+#ifdef CAMERA_MODELS_X86
+/**
+ * \brief AVX2 implementation of the batched spaceToPlane
+ *
+ * \return number of points projected, a multiple of k_simdWidth
+ */
+__attribute__((target("avx2"))) size_t
+PinholeCamera::spaceToPlaneAVX2(size_t n,
+                                const double* X, const double* Y, const double* Z,
+                                double* u, double* v) const
+{
+    size_t i = 0;
+
+    const __m256d fx = _mm256_set1_pd(m_parameters.fx());
+    const __m256d fy = _mm256_set1_pd(m_parameters.fy());
+    const __m256d cx = _mm256_set1_pd(m_parameters.cx());
+    const __m256d cy = _mm256_set1_pd(m_parameters.cy());
+    const __m256d k1 = _mm256_set1_pd(m_parameters.k1());
+    const __m256d k2 = _mm256_set1_pd(m_parameters.k2());
+    const __m256d p1 = _mm256_set1_pd(m_parameters.p1());
+    const __m256d p2 = _mm256_set1_pd(m_parameters.p2());
+    const __m256d one = _mm256_set1_pd(1.0);
+
+    for (; i + k_simdWidth <= n; i += k_simdWidth)
+    {
+        // Project points to the normalised plane
+        __m256d inv_z = _mm256_div_pd(one, _mm256_loadu_pd(Z + i));
+        __m256d mx_d = _mm256_mul_pd(_mm256_loadu_pd(X + i), inv_z);
+        __m256d my_d = _mm256_mul_pd(_mm256_loadu_pd(Y + i), inv_z);
+
+        if (!m_noDistortion)
+        {
+            // Apply distortion
+            __m256d dx_u, dy_u;
+            distortionAVX(mx_d, my_d, k1, k2, p1, p2, dx_u, dy_u);
+
+            mx_d = _mm256_add_pd(mx_d, dx_u);
+            my_d = _mm256_add_pd(my_d, dy_u);
+        }
+
+        // Apply generalised projection matrix
+        _mm256_storeu_pd(u + i, _mm256_add_pd(_mm256_mul_pd(fx, mx_d), cx));
+        _mm256_storeu_pd(v + i, _mm256_add_pd(_mm256_mul_pd(fy, my_d), cy));
+    }
+
+    return i;
+}
+#endif
+
 /**
  * \brief Projects an undistorted 2D point p_u to the image plane
  *
@@ -722,6 +954,151 @@ PinholeCamera::distortion(const Eigen::Vector2d& p_u, Eigen::Vector2d& d_u,
          dydmx, dydmy;
 }
 
+/**
+ * \brief Inverts the distortion model with a fixed number of
+ *        fixed-point iterations p_u = p_d - d(p_u)
+ *
+ * \param p_d distorted coordinates of point on the normalised plane
+ * \param p_u undistorted coordinates of point on the normalised plane
+ */
+void
+PinholeCamera::undistortRecursive(const Eigen::Vector2d& p_d, Eigen::Vector2d& p_u) const
+{
+    // Recursive distortion model
+    int n = 8;
+    Eigen::Vector2d d_u;
+    distortion(p_d, d_u);
+    // Approximate value
+    p_u = p_d - d_u;
+
+    for (int i = 1; i < n; ++i)
+    {
+        distortion(p_u, d_u);
+        p_u = p_d - d_u;
+    }
+}
+
+/**
+ * \brief Inverts the distortion model by solving p_u + d(p_u) = p_d
+ *        with Newton's method
+ *
+ * \param p_d distorted coordinates of point on the normalised plane
+ * \param p_u initial estimate on input, undistorted coordinates of point
+ *            on the normalised plane on output
+ */
+void
+PinholeCamera::undistortNewton(const Eigen::Vector2d& p_d, Eigen::Vector2d& p_u) const
+{
+    const int kMaxIterations = 20;
+    const double kTol = 1e-12;
+
+    for (int i = 0; i < kMaxIterations; ++i)
+    {
+        Eigen::Vector2d d_u;
+        Eigen::Matrix2d J;
+        distortion(p_u, d_u, J);
+
+        Eigen::Vector2d err = p_u + d_u - p_d;
+        if (err.squaredNorm() < kTol * kTol)
+        {
+            break;
+        }
+
+        double det = J(0,0) * J(1,1) - J(0,1) * J(1,0);
+        if (fabs(det) < 1e-12)
+        {
+            break;
+        }
+
+        p_u(0) -= (J(1,1) * err(0) - J(0,1) * err(1)) / det;
+        p_u(1) -= (J(0,0) * err(1) - J(1,0) * err(0)) / det;
+    }
+}
+
+/**
+ * \brief Looks up an estimate of the undistorted coordinates of an image
+ *        point by bilinear interpolation in the undistortion grid
+ *
+ * \param p image coordinates
+ * \param p_u undistorted coordinates of point on the normalised plane
+ * \return false if the grid is not available or p lies outside it
+ */
+bool
+PinholeCamera::interpolateUndistortionGrid(const Eigen::Vector2d& p, Eigen::Vector2d& p_u) const
+{
+    if (m_undistortionGridCols < 2 || m_undistortionGridRows < 2)
+    {
+        return false;
+    }
+
+    double x = p(0) / k_undistortionGridStep;
+    double y = p(1) / k_undistortionGridStep;
+
+    if (x < 0.0 || y < 0.0 ||
+        x >= m_undistortionGridCols - 1 || y >= m_undistortionGridRows - 1)
+    {
+        return false;
+    }
+
+    int c = static_cast<int>(x);
+    int r = static_cast<int>(y);
+    double a = x - c;
+    double b = y - r;
+
+    int i00 = r * m_undistortionGridCols + c;
+    int i01 = i00 + 1;
+    int i10 = i00 + m_undistortionGridCols;
+    int i11 = i10 + 1;
+
+    p_u << (1.0 - b) * ((1.0 - a) * m_undistortionGridX.at(i00) + a * m_undistortionGridX.at(i01)) +
+           b * ((1.0 - a) * m_undistortionGridX.at(i10) + a * m_undistortionGridX.at(i11)),
+           (1.0 - b) * ((1.0 - a) * m_undistortionGridY.at(i00) + a * m_undistortionGridY.at(i01)) +
+           b * ((1.0 - a) * m_undistortionGridY.at(i10) + a * m_undistortionGridY.at(i11));
+
+    return true;
+}
+
+/**
+ * \brief Builds the undistortion grid used by the GRID undistortion method
+ *
+ * The grid covers the image with nodes every k_undistortionGridStep pixels,
+ * each solved to full precision with Newton's method.
+ */
+void
+PinholeCamera::buildUndistortionGrid(void)
+{
+    m_undistortionGridX.clear();
+    m_undistortionGridY.clear();
+    m_undistortionGridCols = 0;
+    m_undistortionGridRows = 0;
+
+    if (m_parameters.imageWidth() <= 0 || m_parameters.imageHeight() <= 0)
+    {
+        return;
+    }
+
+    m_undistortionGridCols = m_parameters.imageWidth() / k_undistortionGridStep + 2;
+    m_undistortionGridRows = m_parameters.imageHeight() / k_undistortionGridStep + 2;
+
+    m_undistortionGridX.resize(m_undistortionGridCols * m_undistortionGridRows);
+    m_undistortionGridY.resize(m_undistortionGridCols * m_undistortionGridRows);
+
+    for (int r = 0; r < m_undistortionGridRows; ++r)
+    {
+        for (int c = 0; c < m_undistortionGridCols; ++c)
+        {
+            Eigen::Vector2d p_d(m_inv_K11 * c * k_undistortionGridStep + m_inv_K13,
+                                m_inv_K22 * r * k_undistortionGridStep + m_inv_K23);
+
+            Eigen::Vector2d p_u = p_d;
+            undistortNewton(p_d, p_u);
+
+            m_undistortionGridX.at(r * m_undistortionGridCols + c) = p_u(0);
+            m_undistortionGridY.at(r * m_undistortionGridCols + c) = p_u(1);
+        }
+    }
+}
+
 void
 PinholeCamera::initUndistortMap(cv::Mat& map1, cv::Mat& map2) const
 {
@@ -730,21 +1107,28 @@ PinholeCamera::initUndistortMap(cv::Mat& map1, cv::Mat& map2) const
     cv::Mat mapX = cv::Mat::zeros(imageSize, CV_32F);
     cv::Mat mapY = cv::Mat::zeros(imageSize, CV_32F);
 
+    // Project one image row at a time using the batched projection
+    std::vector<double> X(imageSize.width), Y(imageSize.width), Z(imageSize.width, 1.0);
+    std::vector<double> pu(imageSize.width), pv(imageSize.width);
+
     for (int v = 0; v < imageSize.height; ++v)
     {
+        double my_u = m_inv_K22 * v + m_inv_K23;
+
         for (int u = 0; u < imageSize.width; ++u)
         {
-            double mx_u = m_inv_K11 * u + m_inv_K13;
-            double my_u = m_inv_K22 * v + m_inv_K23;
-
-            Eigen::Vector3d P;
-            P << mx_u, my_u, 1.0;
+            X.at(u) = m_inv_K11 * u + m_inv_K13;
+            Y.at(u) = my_u;
+        }
 
-            Eigen::Vector2d p;
-            spaceToPlane(P, p);
+        spaceToPlane(imageSize.width, X.data(), Y.data(), Z.data(), pu.data(), pv.data());
 
-            mapX.at<float>(v,u) = p(0);
-            mapY.at<float>(v,u) = p(1);
+        float* mapXRow = mapX.ptr<float>(v);
+        float* mapYRow = mapY.ptr<float>(v);
+        for (int u = 0; u < imageSize.width; ++u)
+        {
+            mapXRow[u] = pu.at(u);
+            mapYRow[u] = pv.at(u);
         }
     }
 
@@ -845,6 +1229,11 @@ PinholeCamera::setParameters(const PinholeCamera::Parameters& parameters)
     m_inv_K13 = -m_parameters.cx() / m_parameters.fx();
     m_inv_K22 = 1.0 / m_parameters.fy();
     m_inv_K23 = -m_parameters.cy() / m_parameters.fy();
+
+    if (m_undistortionMethod == GRID)
+    {
+        buildUndistortionGrid();
+    }
 }
 
 void
@@ -952,4 +1341,28 @@ PinholeCamera::parametersToString(void) const
     return oss.str();
 }
 
+PinholeCamera::UndistortionMethod
+PinholeCamera::undistortionMethod(void) const
+{
+    return m_undistortionMethod;
+}
+
+void
+PinholeCamera::setUndistortionMethod(UndistortionMethod method)
+{
+    m_undistortionMethod = method;
+
+    if (m_undistortionMethod == GRID)
+    {
+        buildUndistortionGrid();
+    }
+    else
+    {
+        m_undistortionGridX.clear();
+        m_undistortionGridY.clear();
+        m_undistortionGridCols = 0;
+        m_undistortionGridRows = 0;
+    }
+}
+
 }
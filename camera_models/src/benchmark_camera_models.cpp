@@ -0,0 +1,136 @@
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/program_options.hpp>
+#include <cstdio>
+#include <iostream>
+
+#include "camera_models/CataCamera.h"
+#include "camera_models/EquidistantCamera.h"
+#include "camera_models/PinholeCamera.h"
+#include "CameraSimd.h"
+
+// Measures lift and projection throughput in points per second for
+// per-point virtual calls and for the batched structure-of-arrays API.
+void
+benchmark(const px::CameraConstPtr& camera, const std::string& name,
+          int nPoints, int nIterations)
+{
+    std::vector<double> u(nPoints), v(nPoints);
+    for (int i = 0; i < nPoints; ++i)
+    {
+        u.at(i) = static_cast<double>(rand()) / RAND_MAX * (camera->imageWidth() - 1);
+        v.at(i) = static_cast<double>(rand()) / RAND_MAX * (camera->imageHeight() - 1);
+    }
+
+    std::vector<double> X(nPoints), Y(nPoints), Z(nPoints);
+    std::vector<double> u_est(nPoints), v_est(nPoints);
+
+    // per-point lift
+    boost::posix_time::ptime tsStart = boost::posix_time::microsec_clock::universal_time();
+    for (int j = 0; j < nIterations; ++j)
+    {
+        for (int i = 0; i < nPoints; ++i)
+        {
+            Eigen::Vector3d P;
+            camera->liftSphere(Eigen::Vector2d(u.at(i), v.at(i)), P);
+
+            X.at(i) = P(0);
+            Y.at(i) = P(1);
+            Z.at(i) = P(2);
+        }
+    }
+    double tLiftSingle = (boost::posix_time::microsec_clock::universal_time() - tsStart).total_microseconds() * 1e-6;
+
+    // batched lift
+    tsStart = boost::posix_time::microsec_clock::universal_time();
+    for (int j = 0; j < nIterations; ++j)
+    {
+        camera->liftSphere(nPoints, u.data(), v.data(),
+                           X.data(), Y.data(), Z.data());
+    }
+    double tLiftBatch = (boost::posix_time::microsec_clock::universal_time() - tsStart).total_microseconds() * 1e-6;
+
+    // per-point projection
+    tsStart = boost::posix_time::microsec_clock::universal_time();
+    for (int j = 0; j < nIterations; ++j)
+    {
+        for (int i = 0; i < nPoints; ++i)
+        {
+            Eigen::Vector2d p;
+            camera->spaceToPlane(Eigen::Vector3d(X.at(i), Y.at(i), Z.at(i)), p);
+
+            u_est.at(i) = p(0);
+            v_est.at(i) = p(1);
+        }
+    }
+    double tProjSingle = (boost::posix_time::microsec_clock::universal_time() - tsStart).total_microseconds() * 1e-6;
+
+    // batched projection
+    tsStart = boost::posix_time::microsec_clock::universal_time();
+    for (int j = 0; j < nIterations; ++j)
+    {
+        camera->spaceToPlane(nPoints, X.data(), Y.data(), Z.data(),
+                             u_est.data(), v_est.data());
+    }
+    double tProjBatch = (boost::posix_time::microsec_clock::universal_time() - tsStart).total_microseconds() * 1e-6;
+
+    double nTotal = static_cast<double>(nPoints) * nIterations;
+
+    printf("%-14s lift: %8.2f Mpts/s (per-point) %8.2f Mpts/s (batch) | "
+           "project: %8.2f Mpts/s (per-point) %8.2f Mpts/s (batch)\n",
+           name.c_str(),
+           nTotal / tLiftSingle * 1e-6, nTotal / tLiftBatch * 1e-6,
+           nTotal / tProjSingle * 1e-6, nTotal / tProjBatch * 1e-6);
+}
+
+int
+main(int argc, char** argv)
+{
+    int nPoints;
+    int nIterations;
+
+    //========= Handling Program options =========
+    boost::program_options::options_description desc("Allowed options");
+    desc.add_options()
+        ("help", "produce help message")
+        ("points,n", boost::program_options::value<int>(&nPoints)->default_value(2000), "Number of points per batch")
+        ("iterations,i", boost::program_options::value<int>(&nIterations)->default_value(500), "Number of batches")
+        ;
+
+    boost::program_options::variables_map vm;
+    boost::program_options::store(boost::program_options::parse_command_line(argc, argv, desc), vm);
+    boost::program_options::notify(vm);
+
+    if (vm.count("help"))
+    {
+        std::cout << desc << std::endl;
+        return 1;
+    }
+
+#ifdef CAMERA_MODELS_X86
+    if (px::cpuSupportsAVX2())
+    {
+        std::cout << "# AVX2: enabled" << std::endl;
+    }
+    else
+#endif
+    {
+        std::cout << "# AVX2: disabled" << std::endl;
+    }
+
+    px::CameraPtr pinhole(new px::PinholeCamera("camera", "pinhole", 752, 480,
+                                                -0.3, 0.1, 0.001, -0.002,
+                                                450.0, 450.0, 376.0, 240.0));
+    benchmark(pinhole, "pinhole", nPoints, nIterations);
+
+    px::CameraPtr equidistant(new px::EquidistantCamera("camera", "equidistant", 1280, 800,
+                                                        -0.01648, -0.00203, 0.00069, -0.00048,
+                                                        419.22826, 420.42160, 655.45487, 389.66377));
+    benchmark(equidistant, "kannala-brandt", nPoints, nIterations);
+
+    px::CameraPtr cata(new px::CataCamera("camera", "mei", 752, 480,
+                                          1.4, -0.3, 0.1, 0.001, -0.002,
+                                          800.0, 800.0, 376.0, 240.0));
+    benchmark(cata, "mei", nPoints, nIterations);
+
+    return 0;
+}
@@ -0,0 +1,80 @@
+#ifndef CAMERABATCHTEST_H
+#define CAMERABATCHTEST_H
+
+#include <cmath>
+#include <Eigen/Dense>
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "camera_models/Camera.h"
+
+namespace px
+{
+
+// 103 points so that the non-vectorized remainder of the batched
+// functions is also exercised
+static const size_t k_batchPointCount = 103;
+
+// Check the batched liftSphere against the per-point implementation.
+inline void
+expectBatchLiftSphere(const Camera& camera,
+                      const std::vector<double>& u, const std::vector<double>& v)
+{
+    size_t n = u.size();
+
+    std::vector<double> X_est(n), Y_est(n), Z_est(n);
+    camera.liftSphere(n, u.data(), v.data(), X_est.data(), Y_est.data(), Z_est.data());
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        Eigen::Vector3d P_est;
+        camera.liftSphere(Eigen::Vector2d(u.at(i), v.at(i)), P_est);
+
+        EXPECT_TRUE(std::isfinite(X_est.at(i)));
+        EXPECT_TRUE(std::isfinite(Y_est.at(i)));
+        EXPECT_TRUE(std::isfinite(Z_est.at(i)));
+
+        EXPECT_NEAR(P_est(0), X_est.at(i), 1e-8);
+        EXPECT_NEAR(P_est(1), Y_est.at(i), 1e-8);
+        EXPECT_NEAR(P_est(2), Z_est.at(i), 1e-8);
+    }
+}
+
+// Project random points in front of the camera, at a depth of at least
+// minDepth, with the batched spaceToPlane, and lift the image points back
+// with the batched liftSphere. Both are checked against the per-point
+// implementations.
+inline void
+expectBatchConsistent(const Camera& camera, double minDepth)
+{
+    size_t n = k_batchPointCount;
+
+    std::vector<double> X(n), Y(n), Z(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        Eigen::Vector3d P = Eigen::Vector3d::Random();
+        P(2) = fabs(P(2)) + minDepth;
+
+        X.at(i) = P(0);
+        Y.at(i) = P(1);
+        Z.at(i) = P(2);
+    }
+
+    std::vector<double> u_est(n), v_est(n);
+    camera.spaceToPlane(n, X.data(), Y.data(), Z.data(), u_est.data(), v_est.data());
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        Eigen::Vector2d p_est;
+        camera.spaceToPlane(Eigen::Vector3d(X.at(i), Y.at(i), Z.at(i)), p_est);
+
+        EXPECT_NEAR(p_est(0), u_est.at(i), 1e-8);
+        EXPECT_NEAR(p_est(1), v_est.at(i), 1e-8);
+    }
+
+    expectBatchLiftSphere(camera, u_est, v_est);
+}
+
+}
+
+#endif
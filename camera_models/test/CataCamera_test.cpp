@@ -3,6 +3,7 @@
 #include <iostream>
 
 #include "camera_models/CataCamera.h"
+#include "CameraBatchTest.h"
 
 namespace px
 {
@@ -88,6 +89,15 @@ TEST(CataCamera, consistency)
     }
 }
 
+TEST(CataCamera, batch)
+{
+    CataCamera camera("camera", "mei", 1280, 800,
+                      0.894975, -0.344504, 0.0984552, -0.00403995, 0.00610364,
+                      758.355, 757.615, 646.72, 395.001);
+
+    expectBatchConsistent(camera, 0.0);
+}
+
 }
 
 int main(int argc, char **argv)
@@ -3,6 +3,7 @@
 #include <iostream>
 
 #include "camera_models/EquidistantCamera.h"
+#include "CameraBatchTest.h"
 
 namespace px
 {
@@ -88,6 +89,56 @@ TEST(EquidistantCamera, consistency)
     }
 }
 
+TEST(EquidistantCamera, batch)
+{
+    EquidistantCamera camera("camera", "kannala-brandt", 1280, 800,
+                             -0.01648, -0.00203, 0.00069, -0.00048,
+                             419.22826, 420.42160, 655.45487, 389.66377);
+
+    expectBatchConsistent(camera, 0.0);
+}
+
+TEST(EquidistantCamera, liftTable)
+{
+    EquidistantCamera camera("camera", "kannala-brandt", 1280, 800,
+                             -0.01648, -0.00203, 0.00069, -0.00048,
+                             419.22826, 420.42160, 655.45487, 389.66377);
+
+    EquidistantCamera cameraLUT(camera.getParameters());
+    cameraLUT.setUseLiftTable(true);
+
+    for (int k = 0; k < 2; ++k)
+    {
+        if (k == 1)
+        {
+            // The table must be rebuilt when the parameters change.
+            std::vector<double> params;
+            camera.writeParameters(params);
+            params.at(0) = -0.02;
+            params.at(4) = 400.0;
+
+            camera.readParameters(params);
+            cameraLUT.readParameters(params);
+        }
+
+        for (int v = 0; v < camera.imageHeight(); v += 7)
+        {
+            for (int u = 0; u < camera.imageWidth(); u += 7)
+            {
+                Eigen::Vector2d p(u + 0.5, v + 0.5);
+
+                Eigen::Vector3d P, P_est;
+                camera.liftProjective(p, P);
+                cameraLUT.liftProjective(p, P_est);
+
+                // angular error between the exact and table-based rays
+                double err = P.normalized().cross(P_est.normalized()).norm();
+                ASSERT_LT(err, 1e-9);
+            }
+        }
+    }
+}
+
 }
 
 int main(int argc, char **argv)
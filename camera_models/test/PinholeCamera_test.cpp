@@ -1,8 +1,10 @@
+#include <cmath>
 #include <Eigen/Dense>
 #include <gtest/gtest.h>
 #include <iostream>
 
 #include "camera_models/PinholeCamera.h"
+#include "CameraBatchTest.h"
 
 namespace px
 {
@@ -84,6 +86,79 @@ TEST(PinholeCamera, consistency)
     EXPECT_NEAR(P(2), P_est(2), 1e-8);
 }
 
+TEST(PinholeCamera, batch)
+{
+    PinholeCamera camera("camera", "pinhole", 752, 480,
+                         -0.473, 0.273, -0.001, 0.001,
+                         712.557492, 714.825860, 370.075592, 244.759309);
+
+    expectBatchConsistent(camera, 2.0);
+}
+
+TEST(PinholeCamera, batchNewton)
+{
+    PinholeCamera camera("camera", "pinhole", 752, 480,
+                         -0.473, 0.273, -0.001, 0.001,
+                         712.557492, 714.825860, 370.075592, 244.759309);
+
+    EXPECT_EQ(PinholeCamera::RECURSIVE, camera.undistortionMethod());
+
+    camera.setUndistortionMethod(PinholeCamera::NEWTON);
+
+    // pixels up to two image widths outside the image, where the Jacobian
+    // of the distortion model becomes singular for some lanes
+    std::vector<double> u(k_batchPointCount), v(k_batchPointCount);
+    for (size_t i = 0; i < u.size(); ++i)
+    {
+        Eigen::Vector2d p = Eigen::Vector2d::Random();
+
+        u.at(i) = camera.imageWidth() * (0.5 + 2.5 * p(0));
+        v.at(i) = camera.imageHeight() * (0.5 + 2.5 * p(1));
+    }
+
+    expectBatchLiftSphere(camera, u, v);
+}
+
+TEST(PinholeCamera, undistortion)
+{
+    PinholeCamera camera("camera", "pinhole", 752, 480,
+                         -0.473, 0.273, -0.001, 0.001,
+                         712.557492, 714.825860, 370.075592, 244.759309);
+
+    PinholeCamera::UndistortionMethod methods[2] = {PinholeCamera::NEWTON,
+                                                    PinholeCamera::GRID};
+
+    for (int k = 0; k < 2; ++k)
+    {
+        camera.setUndistortionMethod(methods[k]);
+
+        // The image border is where the distortion is strongest.
+        for (int v = 0; v < camera.imageHeight(); v += 3)
+        {
+            for (int u = 0; u < camera.imageWidth(); u += 3)
+            {
+                if (u > 0 && v > 0 &&
+                    u < camera.imageWidth() - 3 && v < camera.imageHeight() - 3 &&
+                    (u % 21 != 0 || v % 21 != 0))
+                {
+                    continue;
+                }
+
+                Eigen::Vector2d p(u + 0.5, v + 0.5);
+
+                Eigen::Vector3d P_est;
+                camera.liftProjective(p, P_est);
+
+                Eigen::Vector2d p_est;
+                camera.spaceToPlane(P_est, p_est);
+
+                ASSERT_NEAR(p(0), p_est(0), 1e-6);
+                ASSERT_NEAR(p(1), p_est(1), 1e-6);
+            }
+        }
+    }
+}
+
 }
 
 int main(int argc, char **argv)
@@ -0,0 +1,139 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <boost/thread.hpp>
+#include <deque>
+
+namespace px
+{
+
+/**
+ * \brief FIFO queue with a fixed capacity for passing data between
+ *        pipeline stages running in different threads
+ *
+ * push() blocks while the queue is full, which throttles the producer
+ * to the rate of the consumer instead of dropping data. After close()
+ * is called, push() fails and pop() returns the remaining elements
+ * before failing.
+ */
+template <class T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity = 1);
+
+    size_t capacity(void) const;
+    size_t size(void);
+
+    bool push(const T& data);
+    bool pop(T& data);
+
+    void close(void);
+    bool closed(void);
+
+private:
+    const size_t k_capacity;
+
+    std::deque<T> m_queue;
+    bool m_closed;
+
+    boost::mutex m_globalMutex;
+    boost::condition_variable m_notFullCond;
+    boost::condition_variable m_notEmptyCond;
+};
+
+template <class T>
+BoundedQueue<T>::BoundedQueue(size_t capacity)
+ : k_capacity(capacity > 0 ? capacity : 1)
+ , m_closed(false)
+{
+
+}
+
+template <class T>
+size_t
+BoundedQueue<T>::capacity(void) const
+{
+    return k_capacity;
+}
+
+template <class T>
+size_t
+BoundedQueue<T>::size(void)
+{
+    boost::lock_guard<boost::mutex> lock(m_globalMutex);
+
+    return m_queue.size();
+}
+
+template <class T>
+bool
+BoundedQueue<T>::push(const T& data)
+{
+    boost::unique_lock<boost::mutex> lock(m_globalMutex);
+
+    while (!m_closed && m_queue.size() >= k_capacity)
+    {
+        m_notFullCond.wait(lock);
+    }
+
+    if (m_closed)
+    {
+        return false;
+    }
+
+    m_queue.push_back(data);
+
+    m_notEmptyCond.notify_one();
+
+    return true;
+}
+
+template <class T>
+bool
+BoundedQueue<T>::pop(T& data)
+{
+    boost::unique_lock<boost::mutex> lock(m_globalMutex);
+
+    while (!m_closed && m_queue.empty())
+    {
+        m_notEmptyCond.wait(lock);
+    }
+
+    if (m_queue.empty())
+    {
+        return false;
+    }
+
+    data = m_queue.front();
+    m_queue.pop_front();
+
+    m_notFullCond.notify_one();
+
+    return true;
+}
+
+template <class T>
+void
+BoundedQueue<T>::close(void)
+{
+    boost::lock_guard<boost::mutex> lock(m_globalMutex);
+
+    m_closed = true;
+
+    m_notFullCond.notify_all();
+    m_notEmptyCond.notify_all();
+}
+
+template <class T>
+bool
+BoundedQueue<T>::closed(void)
+{
+    boost::lock_guard<boost::mutex> lock(m_globalMutex);
+
+    return m_closed;
+}
+
+}
+
+#endif
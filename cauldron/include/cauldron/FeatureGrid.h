@@ -0,0 +1,67 @@
+#ifndef FEATUREGRID_H
+#define FEATUREGRID_H
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/features2d/features2d.hpp>
+#include <vector>
+
+namespace px
+{
+
+/**
+ * \brief Uniform grid over image locations of features
+ *
+ * The feature indices of all cells are stored in a single array ordered
+ * by cell, so that the features in a window around a given location can
+ * be found without a dense feature-to-feature mask.
+ */
+class FeatureGrid
+{
+public:
+    explicit FeatureGrid(float cellSize = 32.0f);
+
+    void build(const std::vector<cv::Point2f>& points);
+
+    size_t size(void) const;
+
+    // Indices of all features with |dx| < radius and |dy| < radius
+    // from center.
+    void query(const cv::Point2f& center, float radius,
+               std::vector<int>& indices) const;
+
+    /**
+     * \brief Match descriptors against the descriptors of the features
+     *        in the grid
+     *
+     * Each query descriptor is only compared against the features within
+     * radius pixels of its predicted location. Queries whose predicted
+     * location is NaN are not matched.
+     *
+     * \param maxDistanceRatio reject matches whose distance ratio between
+     *        the best and second best candidates exceeds this value;
+     *        disabled if <= 0
+     */
+    void matchDescriptors(const cv::Mat& queryDescriptors,
+                          const std::vector<cv::Point2f>& predictedPoints,
+                          const cv::Mat& trainDescriptors,
+                          float radius, float maxDistanceRatio,
+                          std::vector<cv::DMatch>& matches) const;
+
+private:
+    const float k_cellSize;
+
+    cv::Point2f m_origin;
+    int m_cols;
+    int m_rows;
+
+    std::vector<cv::Point2f> m_points;
+
+    // feature indices of cell i are
+    // m_cellIndices[m_cellStart[i]] ... m_cellIndices[m_cellStart[i+1] - 1]
+    std::vector<int> m_cellStart;
+    std::vector<int> m_cellIndices;
+};
+
+}
+
+#endif
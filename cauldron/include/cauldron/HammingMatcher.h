@@ -0,0 +1,62 @@
+#ifndef HAMMINGMATCHER_H
+#define HAMMINGMATCHER_H
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/features2d/features2d.hpp>
+#include <vector>
+
+namespace px
+{
+
+/**
+ * \brief Brute-force matcher for binary descriptors such as ORB and BRIEF
+ *
+ * Produces the same matches as cv::BFMatcher with cv::NORM_HAMMING.
+ * Descriptors are rows of CV_8U matrices. Distances between 256-bit
+ * descriptors are computed 4 train descriptors at a time with AVX2, and
+ * other distances with 64-bit popcounts. The AVX2 and POPCNT variants are
+ * selected at run time if the CPU supports them.
+ */
+class HammingMatcher
+{
+public:
+    /**
+     * \param crossCheck only return matches (i,j) from match() for which
+     *        query descriptor i is also the best match of train descriptor j
+     */
+    explicit HammingMatcher(bool crossCheck = false);
+
+    static int distance(const unsigned char* a, const unsigned char* b,
+                        int nBytes);
+
+    // Find the best match for each query descriptor. If a mask is given,
+    // query descriptor i is only compared with train descriptor j
+    // if mask(i,j) is non-zero.
+    void match(const cv::Mat& queryDescriptors,
+               const cv::Mat& trainDescriptors,
+               std::vector<cv::DMatch>& matches,
+               const cv::Mat& mask = cv::Mat()) const;
+
+    // Find the k best matches for each query descriptor, sorted by
+    // increasing distance. If compactResult is true, query descriptors
+    // without any match are omitted.
+    void knnMatch(const cv::Mat& queryDescriptors,
+                  const cv::Mat& trainDescriptors,
+                  std::vector<std::vector<cv::DMatch> >& matches,
+                  int k,
+                  const cv::Mat& mask = cv::Mat(),
+                  bool compactResult = false) const;
+
+private:
+    // Compute the distances between a query descriptor and all
+    // train descriptors.
+    static void computeDistances(const unsigned char* query,
+                                 const cv::Mat& trainDescriptors,
+                                 int* distances);
+
+    bool m_crossCheck;
+};
+
+}
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <boost/exception_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <deque>
+#include <vector>
+
+namespace px
+{
+
+class TaskGroup;
+
+/**
+ * \brief Fixed-size pool of long-lived worker threads
+ *
+ * Tasks are usually submitted through a TaskGroup, which allows the
+ * submitting thread to wait for their completion. While waiting, a
+ * thread executes queued tasks of the same group itself, so nested task
+ * groups (e.g. per-camera tasks that spawn per-match tasks) cannot
+ * deadlock and never use more threads than the pool provides. Since a
+ * waiting thread never picks up tasks of other groups, its stack depth
+ * is bounded by the nesting depth of the task groups.
+ */
+class ThreadPool
+{
+public:
+    /**
+     * \param nThreads number of worker threads; 0 uses one thread per core
+     * \param pinThreads pin worker thread i to core i (Linux only)
+     */
+    explicit ThreadPool(size_t nThreads = 0, bool pinThreads = false);
+    ~ThreadPool();
+
+    size_t threadCount(void) const;
+
+    // Queue a task for execution by a worker thread.
+    void submit(const boost::function<void ()>& task);
+
+    // Execute the oldest queued task in the calling thread. If a group is
+    // given, only tasks of this group are considered.
+    // Returns false if no such task was queued.
+    bool runPendingTask(const TaskGroup* group = 0);
+
+    // Process-wide pool shared by all modules. The arguments only take
+    // effect on the first call.
+    static ThreadPool& instance(size_t nThreads = 0, bool pinThreads = false);
+
+private:
+    friend class TaskGroup;
+
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+
+    class Task
+    {
+    public:
+        const TaskGroup* group;
+        boost::function<void ()> function;
+    };
+
+    void submit(const TaskGroup* group, const boost::function<void ()>& task);
+
+    void workerLoop(void);
+
+    std::vector<boost::shared_ptr<boost::thread> > m_threads;
+
+    std::deque<Task> m_tasks;
+    boost::mutex m_tasksMutex;
+    boost::condition_variable m_tasksCond;
+    bool m_stop;
+};
+
+/**
+ * \brief Set of tasks executed by a ThreadPool that can be waited on
+ *        as a whole
+ *
+ * If a task throws, the remaining tasks still run, and the first
+ * exception is rethrown by wait(). The destructor waits for all tasks
+ * that have not completed yet, and discards any exception.
+ */
+class TaskGroup
+{
+public:
+    explicit TaskGroup(ThreadPool& pool = ThreadPool::instance());
+    ~TaskGroup();
+
+    void run(const boost::function<void ()>& task);
+
+    // Block until all tasks in the group have completed,
+    // executing queued tasks of the group in the meantime.
+    // Rethrows the first exception thrown by a task since the last call.
+    void wait(void);
+
+private:
+    TaskGroup(const TaskGroup&);
+    TaskGroup& operator=(const TaskGroup&);
+
+    void waitForTasks(void);
+    void execute(const boost::function<void ()>& task);
+
+    ThreadPool& m_pool;
+
+    size_t m_nPendingTasks;
+    boost::exception_ptr m_exception;
+    boost::mutex m_mutex;
+    boost::condition_variable m_cond;
+};
+
+}
+
+#endif
@@ -0,0 +1,207 @@
+#include "cauldron/FeatureGrid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "cauldron/HammingMatcher.h"
+
+namespace px
+{
+
+FeatureGrid::FeatureGrid(float cellSize)
+ : k_cellSize(cellSize)
+ , m_cols(0)
+ , m_rows(0)
+{
+
+}
+
+void
+FeatureGrid::build(const std::vector<cv::Point2f>& points)
+{
+    m_points = points;
+    m_cellStart.clear();
+    m_cellIndices.clear();
+    m_cols = 0;
+    m_rows = 0;
+
+    if (m_points.empty())
+    {
+        return;
+    }
+
+    float xMin = m_points.front().x;
+    float xMax = xMin;
+    float yMin = m_points.front().y;
+    float yMax = yMin;
+    for (size_t i = 1; i < m_points.size(); ++i)
+    {
+        const cv::Point2f& pt = m_points.at(i);
+
+        xMin = std::min(xMin, pt.x);
+        xMax = std::max(xMax, pt.x);
+        yMin = std::min(yMin, pt.y);
+        yMax = std::max(yMax, pt.y);
+    }
+
+    m_origin = cv::Point2f(xMin, yMin);
+    m_cols = static_cast<int>((xMax - xMin) / k_cellSize) + 1;
+    m_rows = static_cast<int>((yMax - yMin) / k_cellSize) + 1;
+
+    // counting sort of feature indices by cell
+    std::vector<int> cellIds(m_points.size());
+    m_cellStart.assign(m_cols * m_rows + 1, 0);
+    for (size_t i = 0; i < m_points.size(); ++i)
+    {
+        const cv::Point2f& pt = m_points.at(i);
+
+        int c = static_cast<int>((pt.x - m_origin.x) / k_cellSize);
+        int r = static_cast<int>((pt.y - m_origin.y) / k_cellSize);
+
+        cellIds.at(i) = r * m_cols + c;
+        ++m_cellStart.at(cellIds.at(i) + 1);
+    }
+
+    for (size_t i = 1; i < m_cellStart.size(); ++i)
+    {
+        m_cellStart.at(i) += m_cellStart.at(i - 1);
+    }
+
+    std::vector<int> cellFill(m_cellStart.begin(), m_cellStart.end() - 1);
+    m_cellIndices.resize(m_points.size());
+    for (size_t i = 0; i < m_points.size(); ++i)
+    {
+        m_cellIndices.at(cellFill.at(cellIds.at(i))++) = i;
+    }
+}
+
+size_t
+FeatureGrid::size(void) const
+{
+    return m_points.size();
+}
+
+void
+FeatureGrid::query(const cv::Point2f& center, float radius,
+                   std::vector<int>& indices) const
+{
+    indices.clear();
+
+    if (m_points.empty())
+    {
+        return;
+    }
+
+    float cMin = std::floor((center.x - radius - m_origin.x) / k_cellSize);
+    float cMax = std::floor((center.x + radius - m_origin.x) / k_cellSize);
+    float rMin = std::floor((center.y - radius - m_origin.y) / k_cellSize);
+    float rMax = std::floor((center.y + radius - m_origin.y) / k_cellSize);
+
+    if (cMax < 0.0f || rMax < 0.0f || cMin >= m_cols || rMin >= m_rows)
+    {
+        return;
+    }
+
+    int c0 = std::max(static_cast<int>(cMin), 0);
+    int c1 = std::min(static_cast<int>(cMax), m_cols - 1);
+    int r0 = std::max(static_cast<int>(rMin), 0);
+    int r1 = std::min(static_cast<int>(rMax), m_rows - 1);
+
+    for (int r = r0; r <= r1; ++r)
+    {
+        for (int c = c0; c <= c1; ++c)
+        {
+            int cellId = r * m_cols + c;
+
+            for (int i = m_cellStart.at(cellId); i < m_cellStart.at(cellId + 1); ++i)
+            {
+                int idx = m_cellIndices.at(i);
+
+                cv::Point2f diff = m_points.at(idx) - center;
+                if (std::abs(diff.x) < radius && std::abs(diff.y) < radius)
+                {
+                    indices.push_back(idx);
+                }
+            }
+        }
+    }
+}
+
+void
+FeatureGrid::matchDescriptors(const cv::Mat& queryDescriptors,
+                              const std::vector<cv::Point2f>& predictedPoints,
+                              const cv::Mat& trainDescriptors,
+                              float radius, float maxDistanceRatio,
+                              std::vector<cv::DMatch>& matches) const
+{
+    matches.clear();
+
+    if (queryDescriptors.empty() || trainDescriptors.empty())
+    {
+        return;
+    }
+
+    bool binary = (queryDescriptors.depth() == CV_8U);
+
+    std::vector<int> candidates;
+    for (int i = 0; i < queryDescriptors.rows; ++i)
+    {
+        const cv::Point2f& pt = predictedPoints.at(i);
+        if (pt.x != pt.x || pt.y != pt.y)
+        {
+            continue;
+        }
+
+        query(pt, radius, candidates);
+
+        cv::DMatch bestMatch(i, -1, std::numeric_limits<float>::max());
+        float secondBestDistance = std::numeric_limits<float>::max();
+        for (size_t j = 0; j < candidates.size(); ++j)
+        {
+            float distance;
+            if (binary)
+            {
+                distance = HammingMatcher::distance(queryDescriptors.ptr<unsigned char>(i),
+                                                    trainDescriptors.ptr<unsigned char>(candidates.at(j)),
+                                                    queryDescriptors.cols);
+            }
+            else
+            {
+                distance = cv::norm(queryDescriptors.row(i),
+                                    trainDescriptors.row(candidates.at(j)),
+                                    cv::NORM_L2);
+            }
+
+            if (distance < bestMatch.distance)
+            {
+                secondBestDistance = bestMatch.distance;
+
+                bestMatch.trainIdx = candidates.at(j);
+                bestMatch.distance = distance;
+            }
+            else if (distance < secondBestDistance)
+            {
+                secondBestDistance = distance;
+            }
+        }
+
+        if (bestMatch.trainIdx == -1)
+        {
+            continue;
+        }
+
+        if (maxDistanceRatio > 0.0f)
+        {
+            if (candidates.size() < 2 ||
+                bestMatch.distance / secondBestDistance > maxDistanceRatio)
+            {
+                continue;
+            }
+        }
+
+        matches.push_back(bestMatch);
+    }
+}
+
+}
@@ -0,0 +1,359 @@
+#include "cauldron/HammingMatcher.h"
+
+#include <limits>
+#include <stdint.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#define HAMMINGMATCHER_X86
+#include <immintrin.h>
+#endif
+
+namespace px
+{
+
+namespace
+{
+
+inline int
+popcount64(uint64_t x)
+{
+    return __builtin_popcountll(x);
+}
+
+// Inlined into the variants below, so that the popcounts are compiled for
+// the instruction set of each variant.
+inline __attribute__((always_inline)) int
+distanceBytes(const unsigned char* a, const unsigned char* b, int nBytes)
+{
+    int dist = 0;
+
+    int i = 0;
+    for (; i + 8 <= nBytes; i += 8)
+    {
+        uint64_t x, y;
+        memcpy(&x, a + i, 8);
+        memcpy(&y, b + i, 8);
+
+        dist += popcount64(x ^ y);
+    }
+    for (; i < nBytes; ++i)
+    {
+        dist += popcount64(a[i] ^ b[i]);
+    }
+
+    return dist;
+}
+
+int
+distanceGeneric(const unsigned char* a, const unsigned char* b, int nBytes)
+{
+    return distanceBytes(a, b, nBytes);
+}
+
+#ifdef HAMMINGMATCHER_X86
+// The library is built for the baseline instruction set, and the POPCNT
+// and AVX2 variants are selected at run time if the CPU supports them.
+bool
+cpuSupportsPopcnt(void)
+{
+    static const bool supported = (__builtin_cpu_init(), __builtin_cpu_supports("popcnt") != 0);
+
+    return supported;
+}
+
+bool
+cpuSupportsAVX2(void)
+{
+    static const bool supported = cpuSupportsPopcnt() && __builtin_cpu_supports("avx2") != 0;
+
+    return supported;
+}
+
+__attribute__((target("popcnt"))) int
+distancePopcnt(const unsigned char* a, const unsigned char* b, int nBytes)
+{
+    return distanceBytes(a, b, nBytes);
+}
+
+// Per-byte popcount of a 256-bit vector using a nibble lookup table.
+inline __attribute__((target("avx2,popcnt"))) __m256i
+popcountBytesAVX(const __m256i& v)
+{
+    const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                         0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i lowMask = _mm256_set1_epi8(0x0f);
+
+    __m256i lo = _mm256_and_si256(v, lowMask);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), lowMask);
+
+    return _mm256_add_epi8(_mm256_shuffle_epi8(lut, lo),
+                           _mm256_shuffle_epi8(lut, hi));
+}
+
+// Hamming distances between a 256-bit query descriptor and
+// 4 256-bit train descriptors.
+inline __attribute__((target("avx2,popcnt"))) void
+distances256x4AVX(const __m256i& q,
+                  const unsigned char* t0, const unsigned char* t1,
+                  const unsigned char* t2, const unsigned char* t3,
+                  int* distances)
+{
+    const __m256i zero = _mm256_setzero_si256();
+
+    // each 64-bit lane holds the popcount of 8 bytes
+    __m256i s0 = _mm256_sad_epu8(popcountBytesAVX(_mm256_xor_si256(q, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(t0)))), zero);
+    __m256i s1 = _mm256_sad_epu8(popcountBytesAVX(_mm256_xor_si256(q, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(t1)))), zero);
+    __m256i s2 = _mm256_sad_epu8(popcountBytesAVX(_mm256_xor_si256(q, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(t2)))), zero);
+    __m256i s3 = _mm256_sad_epu8(popcountBytesAVX(_mm256_xor_si256(q, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(t3)))), zero);
+
+    // interleave to 32-bit lanes [s0 s1 s0 s1 ...] and [s2 s3 s2 s3 ...]
+    __m256i s01 = _mm256_or_si256(s0, _mm256_slli_epi64(s1, 32));
+    __m256i s23 = _mm256_or_si256(s2, _mm256_slli_epi64(s3, 32));
+
+    // 128-bit lanes: [s0 s1 s2 s3] of the even and odd 64-bit partial sums
+    __m256i sum = _mm256_add_epi32(_mm256_unpacklo_epi64(s01, s23),
+                                   _mm256_unpackhi_epi64(s01, s23));
+
+    __m128i total = _mm_add_epi32(_mm256_castsi256_si128(sum),
+                                  _mm256_extracti128_si256(sum, 1));
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(distances), total);
+}
+
+__attribute__((target("avx2,popcnt"))) void
+computeDistancesAVX2(const unsigned char* query,
+                     const cv::Mat& trainDescriptors,
+                     int* distances)
+{
+    int nBytes = trainDescriptors.cols;
+    int nTrain = trainDescriptors.rows;
+
+    int j = 0;
+    if (nBytes == 32)
+    {
+        __m256i q = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(query));
+
+        for (; j + 4 <= nTrain; j += 4)
+        {
+            distances256x4AVX(q,
+                              trainDescriptors.ptr<unsigned char>(j),
+                              trainDescriptors.ptr<unsigned char>(j + 1),
+                              trainDescriptors.ptr<unsigned char>(j + 2),
+                              trainDescriptors.ptr<unsigned char>(j + 3),
+                              distances + j);
+        }
+    }
+    for (; j < nTrain; ++j)
+    {
+        distances[j] = distanceBytes(query, trainDescriptors.ptr<unsigned char>(j), nBytes);
+    }
+}
+#endif
+
+// Insert a match into a list of at most k matches sorted by distance.
+void
+insertMatch(const cv::DMatch& match, int k, std::vector<cv::DMatch>& matches)
+{
+    if (static_cast<int>(matches.size()) == k &&
+        match.distance >= matches.back().distance)
+    {
+        return;
+    }
+
+    std::vector<cv::DMatch>::iterator it = matches.begin();
+    while (it != matches.end() && it->distance <= match.distance)
+    {
+        ++it;
+    }
+    matches.insert(it, match);
+
+    if (static_cast<int>(matches.size()) > k)
+    {
+        matches.pop_back();
+    }
+}
+
+}
+
+HammingMatcher::HammingMatcher(bool crossCheck)
+ : m_crossCheck(crossCheck)
+{
+
+}
+
+int
+HammingMatcher::distance(const unsigned char* a, const unsigned char* b,
+                         int nBytes)
+{
+#ifdef HAMMINGMATCHER_X86
+    if (cpuSupportsPopcnt())
+    {
+        return distancePopcnt(a, b, nBytes);
+    }
+#endif
+
+    return distanceGeneric(a, b, nBytes);
+}
+
+void
+HammingMatcher::computeDistances(const unsigned char* query,
+                                 const cv::Mat& trainDescriptors,
+                                 int* distances)
+{
+    int (*distanceFn)(const unsigned char*, const unsigned char*, int) = &distanceGeneric;
+
+#ifdef HAMMINGMATCHER_X86
+    if (cpuSupportsAVX2())
+    {
+        computeDistancesAVX2(query, trainDescriptors, distances);
+        return;
+    }
+
+    if (cpuSupportsPopcnt())
+    {
+        distanceFn = &distancePopcnt;
+    }
+#endif
+
+    int nBytes = trainDescriptors.cols;
+    for (int j = 0; j < trainDescriptors.rows; ++j)
+    {
+        distances[j] = distanceFn(query, trainDescriptors.ptr<unsigned char>(j), nBytes);
+    }
+}
+
+void
+HammingMatcher::match(const cv::Mat& queryDescriptors,
+                      const cv::Mat& trainDescriptors,
+                      std::vector<cv::DMatch>& matches,
+                      const cv::Mat& mask) const
+{
+    matches.clear();
+
+    if (queryDescriptors.empty() || trainDescriptors.empty())
+    {
+        return;
+    }
+
+    CV_Assert(queryDescriptors.type() == CV_8U &&
+              trainDescriptors.type() == CV_8U &&
+              queryDescriptors.cols == trainDescriptors.cols);
+
+    int nTrain = trainDescriptors.rows;
+
+    std::vector<int> distances(nTrain);
+
+    // best match of each train descriptor for cross-checking
+    std::vector<cv::DMatch> trainMatches;
+    if (m_crossCheck)
+    {
+        trainMatches.assign(nTrain, cv::DMatch(-1, -1, std::numeric_limits<float>::max()));
+    }
+
+    std::vector<cv::DMatch> queryMatches;
+    queryMatches.reserve(queryDescriptors.rows);
+    for (int i = 0; i < queryDescriptors.rows; ++i)
+    {
+        computeDistances(queryDescriptors.ptr<unsigned char>(i),
+                         trainDescriptors, distances.data());
+
+        const unsigned char* maskRow = mask.empty() ? 0 : mask.ptr<unsigned char>(i);
+
+        int bestIdx = -1;
+        int bestDistance = std::numeric_limits<int>::max();
+        for (int j = 0; j < nTrain; ++j)
+        {
+            if (maskRow && !maskRow[j])
+            {
+                continue;
+            }
+
+            if (distances.at(j) < bestDistance)
+            {
+                bestIdx = j;
+                bestDistance = distances.at(j);
+            }
+
+            if (m_crossCheck && distances.at(j) < trainMatches.at(j).distance)
+            {
+                trainMatches.at(j) = cv::DMatch(j, i, distances.at(j));
+            }
+        }
+
+        if (bestIdx != -1)
+        {
+            queryMatches.push_back(cv::DMatch(i, bestIdx, bestDistance));
+        }
+    }
+
+    if (!m_crossCheck)
+    {
+        matches.swap(queryMatches);
+        return;
+    }
+
+    matches.reserve(queryMatches.size());
+    for (size_t i = 0; i < queryMatches.size(); ++i)
+    {
+        const cv::DMatch& match = queryMatches.at(i);
+
+        if (trainMatches.at(match.trainIdx).trainIdx == match.queryIdx)
+        {
+            matches.push_back(match);
+        }
+    }
+}
+
+void
+HammingMatcher::knnMatch(const cv::Mat& queryDescriptors,
+                         const cv::Mat& trainDescriptors,
+                         std::vector<std::vector<cv::DMatch> >& matches,
+                         int k,
+                         const cv::Mat& mask,
+                         bool compactResult) const
+{
+    matches.clear();
+
+    if (queryDescriptors.empty() || trainDescriptors.empty())
+    {
+        return;
+    }
+
+    CV_Assert(queryDescriptors.type() == CV_8U &&
+              trainDescriptors.type() == CV_8U &&
+              queryDescriptors.cols == trainDescriptors.cols);
+
+    int nTrain = trainDescriptors.rows;
+
+    std::vector<int> distances(nTrain);
+
+    matches.reserve(queryDescriptors.rows);
+    for (int i = 0; i < queryDescriptors.rows; ++i)
+    {
+        computeDistances(queryDescriptors.ptr<unsigned char>(i),
+                         trainDescriptors, distances.data());
+
+        const unsigned char* maskRow = mask.empty() ? 0 : mask.ptr<unsigned char>(i);
+
+        std::vector<cv::DMatch> queryMatches;
+        queryMatches.reserve(k + 1);
+        for (int j = 0; j < nTrain; ++j)
+        {
+            if (maskRow && !maskRow[j])
+            {
+                continue;
+            }
+
+            insertMatch(cv::DMatch(i, j, distances.at(j)), k, queryMatches);
+        }
+
+        if (compactResult && queryMatches.empty())
+        {
+            continue;
+        }
+
+        matches.push_back(queryMatches);
+    }
+}
+
+}
@@ -0,0 +1,248 @@
+#include "cauldron/ThreadPool.h"
+
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace px
+{
+
+ThreadPool::ThreadPool(size_t nThreads, bool pinThreads)
+ : m_stop(false)
+{
+    size_t nCores = boost::thread::hardware_concurrency();
+    if (nCores == 0)
+    {
+        nCores = 1;
+    }
+
+    if (nThreads == 0)
+    {
+        nThreads = nCores;
+    }
+
+    m_threads.resize(nThreads);
+    for (size_t i = 0; i < nThreads; ++i)
+    {
+        m_threads.at(i) = boost::make_shared<boost::thread>(boost::bind(&ThreadPool::workerLoop, this));
+
+#ifdef __linux__
+        if (pinThreads)
+        {
+            cpu_set_t cpuSet;
+            CPU_ZERO(&cpuSet);
+            CPU_SET(i % nCores, &cpuSet);
+
+            pthread_setaffinity_np(m_threads.at(i)->native_handle(),
+                                   sizeof(cpu_set_t), &cpuSet);
+        }
+#endif
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        boost::lock_guard<boost::mutex> lock(m_tasksMutex);
+        m_stop = true;
+    }
+    m_tasksCond.notify_all();
+
+    for (size_t i = 0; i < m_threads.size(); ++i)
+    {
+        m_threads.at(i)->join();
+    }
+}
+
+size_t
+ThreadPool::threadCount(void) const
+{
+    return m_threads.size();
+}
+
+void
+ThreadPool::submit(const boost::function<void ()>& task)
+{
+    submit(0, task);
+}
+
+bool
+ThreadPool::runPendingTask(const TaskGroup* group)
+{
+    boost::function<void ()> task;
+
+    {
+        boost::lock_guard<boost::mutex> lock(m_tasksMutex);
+
+        std::deque<Task>::iterator it = m_tasks.begin();
+        if (group)
+        {
+            while (it != m_tasks.end() && it->group != group)
+            {
+                ++it;
+            }
+        }
+
+        if (it == m_tasks.end())
+        {
+            return false;
+        }
+
+        task.swap(it->function);
+        m_tasks.erase(it);
+    }
+
+    task();
+
+    return true;
+}
+
+ThreadPool&
+ThreadPool::instance(size_t nThreads, bool pinThreads)
+{
+    static ThreadPool pool(nThreads, pinThreads);
+
+    return pool;
+}
+
+void
+ThreadPool::submit(const TaskGroup* group, const boost::function<void ()>& task)
+{
+    {
+        boost::lock_guard<boost::mutex> lock(m_tasksMutex);
+
+        m_tasks.push_back(Task());
+        m_tasks.back().group = group;
+        m_tasks.back().function = task;
+    }
+    m_tasksCond.notify_one();
+}
+
+void
+ThreadPool::workerLoop(void)
+{
+    while (true)
+    {
+        boost::function<void ()> task;
+
+        {
+            boost::unique_lock<boost::mutex> lock(m_tasksMutex);
+
+            while (!m_stop && m_tasks.empty())
+            {
+                m_tasksCond.wait(lock);
+            }
+
+            if (m_tasks.empty())
+            {
+                // m_stop is set and all tasks have been executed
+                return;
+            }
+
+            task.swap(m_tasks.front().function);
+            m_tasks.pop_front();
+        }
+
+        task();
+    }
+}
+
+TaskGroup::TaskGroup(ThreadPool& pool)
+ : m_pool(pool)
+ , m_nPendingTasks(0)
+{
+
+}
+
+TaskGroup::~TaskGroup()
+{
+    waitForTasks();
+}
+
+void
+TaskGroup::run(const boost::function<void ()>& task)
+{
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+        ++m_nPendingTasks;
+    }
+
+    m_pool.submit(this, boost::bind(&TaskGroup::execute, this, task));
+}
+
+void
+TaskGroup::wait(void)
+{
+    waitForTasks();
+
+    boost::exception_ptr exception;
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+        exception = m_exception;
+        m_exception = boost::exception_ptr();
+    }
+
+    if (exception)
+    {
+        boost::rethrow_exception(exception);
+    }
+}
+
+void
+TaskGroup::waitForTasks(void)
+{
+    while (true)
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(m_mutex);
+
+            if (m_nPendingTasks == 0)
+            {
+                return;
+            }
+        }
+
+        // Help out instead of blocking while tasks of this group
+        // are queued.
+        if (m_pool.runPendingTask(this))
+        {
+            continue;
+        }
+
+        // All remaining tasks of this group are being executed
+        // by other threads.
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+        while (m_nPendingTasks != 0)
+        {
+            m_cond.wait(lock);
+        }
+        return;
+    }
+}
+
+void
+TaskGroup::execute(const boost::function<void ()>& task)
+{
+    boost::exception_ptr exception;
+    try
+    {
+        task();
+    }
+    catch (...)
+    {
+        exception = boost::current_exception();
+    }
+
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    if (exception && !m_exception)
+    {
+        m_exception = exception;
+    }
+    --m_nPendingTasks;
+    m_cond.notify_all();
+}
+
+}
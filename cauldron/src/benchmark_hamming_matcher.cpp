@@ -0,0 +1,164 @@
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/program_options.hpp>
+#include <cstdio>
+#include <iostream>
+
+#include "cauldron/HammingMatcher.h"
+
+void
+randomDescriptors(int nDescriptors, int nBytes, cv::Mat& dtors)
+{
+    dtors.create(nDescriptors, nBytes, CV_8U);
+    for (int i = 0; i < nDescriptors; ++i)
+    {
+        unsigned char* dtor = dtors.ptr<unsigned char>(i);
+        for (int j = 0; j < nBytes; ++j)
+        {
+            dtor[j] = rand() & 0xff;
+        }
+    }
+}
+
+bool
+equal(const std::vector<cv::DMatch>& matches1,
+      const std::vector<cv::DMatch>& matches2)
+{
+    if (matches1.size() != matches2.size())
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < matches1.size(); ++i)
+    {
+        if (matches1.at(i).queryIdx != matches2.at(i).queryIdx ||
+            matches1.at(i).trainIdx != matches2.at(i).trainIdx ||
+            matches1.at(i).distance != matches2.at(i).distance)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Compares brute-force match and 2-NN match times of px::HammingMatcher
+// with cv::BFMatcher(cv::NORM_HAMMING) on random binary descriptors.
+void
+benchmark(const cv::Mat& queryDtors, const cv::Mat& trainDtors,
+          bool crossCheck, int nIterations)
+{
+    cv::BFMatcher cvMatcher(cv::NORM_HAMMING, crossCheck);
+    px::HammingMatcher pxMatcher(crossCheck);
+
+    std::vector<cv::DMatch> cvMatches, pxMatches;
+
+    boost::posix_time::ptime tsStart = boost::posix_time::microsec_clock::universal_time();
+    for (int j = 0; j < nIterations; ++j)
+    {
+        cvMatcher.match(queryDtors, trainDtors, cvMatches);
+    }
+    double tMatchCV = (boost::posix_time::microsec_clock::universal_time() - tsStart).total_microseconds() * 1e-3 / nIterations;
+
+    tsStart = boost::posix_time::microsec_clock::universal_time();
+    for (int j = 0; j < nIterations; ++j)
+    {
+        pxMatcher.match(queryDtors, trainDtors, pxMatches);
+    }
+    double tMatchPX = (boost::posix_time::microsec_clock::universal_time() - tsStart).total_microseconds() * 1e-3 / nIterations;
+
+    printf("match%-12s  cv: %8.2f ms  px: %8.2f ms  speedup: %5.2fx  %s\n",
+           crossCheck ? " (cross)" : "",
+           tMatchCV, tMatchPX, tMatchCV / tMatchPX,
+           equal(cvMatches, pxMatches) ? "identical" : "MISMATCH");
+
+    if (crossCheck)
+    {
+        return;
+    }
+
+    std::vector<std::vector<cv::DMatch> > cvKnnMatches, pxKnnMatches;
+
+    tsStart = boost::posix_time::microsec_clock::universal_time();
+    for (int j = 0; j < nIterations; ++j)
+    {
+        cvMatcher.knnMatch(queryDtors, trainDtors, cvKnnMatches, 2);
+    }
+    double tKnnCV = (boost::posix_time::microsec_clock::universal_time() - tsStart).total_microseconds() * 1e-3 / nIterations;
+
+    tsStart = boost::posix_time::microsec_clock::universal_time();
+    for (int j = 0; j < nIterations; ++j)
+    {
+        pxMatcher.knnMatch(queryDtors, trainDtors, pxKnnMatches, 2);
+    }
+    double tKnnPX = (boost::posix_time::microsec_clock::universal_time() - tsStart).total_microseconds() * 1e-3 / nIterations;
+
+    // ties may be ordered differently, so only compare distances
+    bool identical = (cvKnnMatches.size() == pxKnnMatches.size());
+    for (size_t i = 0; identical && i < cvKnnMatches.size(); ++i)
+    {
+        if (cvKnnMatches.at(i).size() != pxKnnMatches.at(i).size())
+        {
+            identical = false;
+            break;
+        }
+
+        for (size_t k = 0; k < cvKnnMatches.at(i).size(); ++k)
+        {
+            if (cvKnnMatches.at(i).at(k).distance != pxKnnMatches.at(i).at(k).distance)
+            {
+                identical = false;
+                break;
+            }
+        }
+    }
+
+    printf("knnMatch (k=2)     cv: %8.2f ms  px: %8.2f ms  speedup: %5.2fx  %s\n",
+           tKnnCV, tKnnPX, tKnnCV / tKnnPX,
+           identical ? "identical" : "MISMATCH");
+}
+
+int
+main(int argc, char** argv)
+{
+    int nQuery;
+    int nTrain;
+    int nBytes;
+    int nIterations;
+
+    //========= Handling Program options =========
+    boost::program_options::options_description desc("Allowed options");
+    desc.add_options()
+        ("help", "produce help message")
+        ("query,q", boost::program_options::value<int>(&nQuery)->default_value(2000), "Number of query descriptors")
+        ("train,t", boost::program_options::value<int>(&nTrain)->default_value(2000), "Number of train descriptors")
+        ("bytes,b", boost::program_options::value<int>(&nBytes)->default_value(32), "Descriptor size in bytes")
+        ("iterations,i", boost::program_options::value<int>(&nIterations)->default_value(20), "Number of iterations")
+        ;
+
+    boost::program_options::variables_map vm;
+    boost::program_options::store(boost::program_options::parse_command_line(argc, argv, desc), vm);
+    boost::program_options::notify(vm);
+
+    if (vm.count("help"))
+    {
+        std::cout << desc << std::endl;
+        return 1;
+    }
+
+#ifdef __AVX2__
+    std::cout << "# AVX2: enabled" << std::endl;
+#else
+    std::cout << "# AVX2: disabled" << std::endl;
+#endif
+    std::cout << "# " << nQuery << " x " << nTrain << " descriptors, "
+              << nBytes << " bytes" << std::endl;
+
+    cv::Mat queryDtors, trainDtors;
+    randomDescriptors(nQuery, nBytes, queryDtors);
+    randomDescriptors(nTrain, nBytes, trainDtors);
+
+    benchmark(queryDtors, trainDtors, false, nIterations);
+    benchmark(queryDtors, trainDtors, true, nIterations);
+
+    return 0;
+}
@@ -0,0 +1,193 @@
+#include <algorithm>
+#include <cmath>
+#include <gtest/gtest.h>
+#include <limits>
+#include <opencv2/core/core.hpp>
+
+#include "cauldron/FeatureGrid.h"
+#include "cauldron/HammingMatcher.h"
+
+namespace px
+{
+
+namespace
+{
+
+void
+generatePoints(int nPoints, std::vector<cv::Point2f>& points)
+{
+    cv::RNG rng(0);
+
+    points.resize(nPoints);
+    for (int i = 0; i < nPoints; ++i)
+    {
+        points.at(i) = cv::Point2f(rng.uniform(0.0f, 752.0f),
+                                   rng.uniform(0.0f, 480.0f));
+    }
+}
+
+}
+
+TEST(FeatureGrid, query)
+{
+    std::vector<cv::Point2f> points;
+    generatePoints(500, points);
+
+    FeatureGrid grid(32.0f);
+    grid.build(points);
+
+    ASSERT_EQ(points.size(), grid.size());
+
+    // windows inside, across and outside the borders of the grid
+    cv::RNG rng(1);
+    for (int k = 0; k < 100; ++k)
+    {
+        cv::Point2f center(rng.uniform(-100.0f, 852.0f),
+                           rng.uniform(-100.0f, 580.0f));
+        float radius = rng.uniform(1.0f, 100.0f);
+
+        std::vector<int> indices;
+        grid.query(center, radius, indices);
+        std::sort(indices.begin(), indices.end());
+
+        std::vector<int> indicesRef;
+        for (size_t i = 0; i < points.size(); ++i)
+        {
+            cv::Point2f diff = points.at(i) - center;
+            if (std::abs(diff.x) < radius && std::abs(diff.y) < radius)
+            {
+                indicesRef.push_back(i);
+            }
+        }
+
+        EXPECT_TRUE(indices == indicesRef);
+    }
+}
+
+TEST(FeatureGrid, empty)
+{
+    FeatureGrid grid;
+    grid.build(std::vector<cv::Point2f>());
+
+    EXPECT_EQ(0, grid.size());
+
+    std::vector<int> indices(1, 0);
+    grid.query(cv::Point2f(0.0f, 0.0f), 100.0f, indices);
+
+    EXPECT_TRUE(indices.empty());
+}
+
+TEST(FeatureGrid, matchDescriptors)
+{
+    std::vector<cv::Point2f> points;
+    generatePoints(500, points);
+
+    cv::RNG rng(2);
+
+    cv::Mat trainDescriptors(points.size(), 32, CV_8U);
+    rng.fill(trainDescriptors, cv::RNG::UNIFORM, 0, 256);
+
+    cv::Mat queryDescriptors(200, 32, CV_8U);
+    rng.fill(queryDescriptors, cv::RNG::UNIFORM, 0, 256);
+
+    std::vector<cv::Point2f> predictedPoints;
+    generatePoints(queryDescriptors.rows, predictedPoints);
+    predictedPoints.at(0).x = std::numeric_limits<float>::quiet_NaN();
+
+    float radius = 48.0f;
+
+    FeatureGrid grid(radius);
+    grid.build(points);
+
+    std::vector<cv::DMatch> matches;
+    grid.matchDescriptors(queryDescriptors, predictedPoints, trainDescriptors,
+                          radius, 0.0f, matches);
+
+    // brute-force matching restricted to the same windows
+    std::vector<cv::DMatch> matchesRef;
+    for (int i = 1; i < queryDescriptors.rows; ++i)
+    {
+        cv::DMatch bestMatch(i, -1, std::numeric_limits<float>::max());
+        for (size_t j = 0; j < points.size(); ++j)
+        {
+            cv::Point2f diff = points.at(j) - predictedPoints.at(i);
+            if (std::abs(diff.x) >= radius || std::abs(diff.y) >= radius)
+            {
+                continue;
+            }
+
+            float distance = HammingMatcher::distance(queryDescriptors.ptr<unsigned char>(i),
+                                                      trainDescriptors.ptr<unsigned char>(j),
+                                                      queryDescriptors.cols);
+            if (distance < bestMatch.distance)
+            {
+                bestMatch.trainIdx = j;
+                bestMatch.distance = distance;
+            }
+        }
+
+        if (bestMatch.trainIdx != -1)
+        {
+            matchesRef.push_back(bestMatch);
+        }
+    }
+
+    ASSERT_EQ(matchesRef.size(), matches.size());
+    for (size_t i = 0; i < matches.size(); ++i)
+    {
+        const cv::DMatch& match = matches.at(i);
+
+        EXPECT_EQ(matchesRef.at(i).queryIdx, match.queryIdx);
+        EXPECT_EQ(matchesRef.at(i).distance, match.distance);
+
+        // ties may resolve to another feature within the window
+        cv::Point2f diff = points.at(match.trainIdx) - predictedPoints.at(match.queryIdx);
+        EXPECT_LT(std::abs(diff.x), radius);
+        EXPECT_LT(std::abs(diff.y), radius);
+    }
+}
+
+TEST(FeatureGrid, matchDescriptorsRatioTest)
+{
+    // two train features close to the predicted location, one of which
+    // is a near-duplicate of the query descriptor
+    std::vector<cv::Point2f> points;
+    points.push_back(cv::Point2f(100.0f, 100.0f));
+    points.push_back(cv::Point2f(110.0f, 100.0f));
+    points.push_back(cv::Point2f(400.0f, 400.0f));
+
+    cv::RNG rng(3);
+
+    cv::Mat trainDescriptors(points.size(), 32, CV_8U);
+    rng.fill(trainDescriptors, cv::RNG::UNIFORM, 0, 256);
+
+    cv::Mat queryDescriptors(2, 32, CV_8U);
+    trainDescriptors.row(1).copyTo(queryDescriptors.row(0));
+    queryDescriptors.at<unsigned char>(0, 0) ^= 1;
+
+    // ambiguous query: both candidates are random
+    cv::Mat ambiguousDescriptor = queryDescriptors.row(1);
+    rng.fill(ambiguousDescriptor, cv::RNG::UNIFORM, 0, 256);
+
+    std::vector<cv::Point2f> predictedPoints(2, cv::Point2f(105.0f, 100.0f));
+
+    FeatureGrid grid(32.0f);
+    grid.build(points);
+
+    std::vector<cv::DMatch> matches;
+    grid.matchDescriptors(queryDescriptors, predictedPoints, trainDescriptors,
+                          32.0f, 0.7f, matches);
+
+    ASSERT_EQ(1, matches.size());
+    EXPECT_EQ(0, matches.front().queryIdx);
+    EXPECT_EQ(1, matches.front().trainIdx);
+    EXPECT_EQ(1.0f, matches.front().distance);
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,154 @@
+#include <gtest/gtest.h>
+#include <opencv2/core/core.hpp>
+#include <opencv2/features2d/features2d.hpp>
+
+#include "cauldron/HammingMatcher.h"
+
+namespace px
+{
+
+namespace
+{
+
+// Generate train descriptors, and query descriptors which are copies of
+// randomly chosen train descriptors with a few bits flipped, so that the
+// best match of each query descriptor is unique.
+void
+generateDescriptors(int nBytes, int nQuery, int nTrain,
+                    cv::Mat& queryDescriptors, cv::Mat& trainDescriptors)
+{
+    cv::RNG rng(0);
+
+    trainDescriptors.create(nTrain, nBytes, CV_8U);
+    rng.fill(trainDescriptors, cv::RNG::UNIFORM, 0, 256);
+
+    queryDescriptors.create(nQuery, nBytes, CV_8U);
+    for (int i = 0; i < nQuery; ++i)
+    {
+        trainDescriptors.row(rng.uniform(0, nTrain)).copyTo(queryDescriptors.row(i));
+
+        int nFlips = rng.uniform(0, 8);
+        for (int j = 0; j < nFlips; ++j)
+        {
+            queryDescriptors.at<unsigned char>(i, rng.uniform(0, nBytes)) ^=
+                1 << rng.uniform(0, 8);
+        }
+    }
+}
+
+}
+
+TEST(HammingMatcher, distance)
+{
+    cv::Mat queryDescriptors, trainDescriptors;
+    generateDescriptors(61, 20, 20, queryDescriptors, trainDescriptors);
+
+    for (int i = 0; i < queryDescriptors.rows; ++i)
+    {
+        for (int j = 0; j < trainDescriptors.rows; ++j)
+        {
+            EXPECT_EQ(cv::norm(queryDescriptors.row(i), trainDescriptors.row(j), cv::NORM_HAMMING),
+                      HammingMatcher::distance(queryDescriptors.ptr<unsigned char>(i),
+                                               trainDescriptors.ptr<unsigned char>(j),
+                                               queryDescriptors.cols));
+        }
+    }
+}
+
+TEST(HammingMatcher, match)
+{
+    // 32-byte descriptors use the vectorized path if available, and the
+    // number of train descriptors is not a multiple of 4 so that the
+    // remainder is also exercised
+    int descriptorSizes[2] = {32, 61};
+
+    for (int k = 0; k < 2; ++k)
+    {
+        cv::Mat queryDescriptors, trainDescriptors;
+        generateDescriptors(descriptorSizes[k], 200, 301,
+                            queryDescriptors, trainDescriptors);
+
+        std::vector<cv::DMatch> matches;
+        HammingMatcher(false).match(queryDescriptors, trainDescriptors, matches);
+
+        std::vector<cv::DMatch> matchesRef;
+        cv::BFMatcher(cv::NORM_HAMMING, false).match(queryDescriptors, trainDescriptors, matchesRef);
+
+        ASSERT_EQ(matchesRef.size(), matches.size());
+        for (size_t i = 0; i < matches.size(); ++i)
+        {
+            EXPECT_EQ(matchesRef.at(i).queryIdx, matches.at(i).queryIdx);
+            EXPECT_EQ(matchesRef.at(i).trainIdx, matches.at(i).trainIdx);
+            EXPECT_EQ(matchesRef.at(i).distance, matches.at(i).distance);
+        }
+    }
+}
+
+TEST(HammingMatcher, matchCrossCheck)
+{
+    cv::Mat queryDescriptors, trainDescriptors;
+    generateDescriptors(32, 200, 301, queryDescriptors, trainDescriptors);
+
+    std::vector<cv::DMatch> matches;
+    HammingMatcher(true).match(queryDescriptors, trainDescriptors, matches);
+
+    std::vector<cv::DMatch> matchesRef;
+    cv::BFMatcher(cv::NORM_HAMMING, true).match(queryDescriptors, trainDescriptors, matchesRef);
+
+    ASSERT_EQ(matchesRef.size(), matches.size());
+    for (size_t i = 0; i < matches.size(); ++i)
+    {
+        EXPECT_EQ(matchesRef.at(i).queryIdx, matches.at(i).queryIdx);
+        EXPECT_EQ(matchesRef.at(i).trainIdx, matches.at(i).trainIdx);
+        EXPECT_EQ(matchesRef.at(i).distance, matches.at(i).distance);
+    }
+}
+
+TEST(HammingMatcher, knnMatch)
+{
+    cv::Mat queryDescriptors, trainDescriptors;
+    generateDescriptors(32, 200, 301, queryDescriptors, trainDescriptors);
+
+    // only allow every other train descriptor for odd query descriptors
+    cv::Mat mask(queryDescriptors.rows, trainDescriptors.rows, CV_8U, cv::Scalar(1));
+    for (int i = 1; i < mask.rows; i += 2)
+    {
+        for (int j = 0; j < mask.cols; j += 2)
+        {
+            mask.at<unsigned char>(i, j) = 0;
+        }
+    }
+
+    std::vector<std::vector<cv::DMatch> > matches;
+    HammingMatcher().knnMatch(queryDescriptors, trainDescriptors, matches, 3, mask);
+
+    std::vector<std::vector<cv::DMatch> > matchesRef;
+    cv::BFMatcher(cv::NORM_HAMMING).knnMatch(queryDescriptors, trainDescriptors, matchesRef, 3, mask);
+
+    ASSERT_EQ(matchesRef.size(), matches.size());
+    for (size_t i = 0; i < matches.size(); ++i)
+    {
+        ASSERT_EQ(matchesRef.at(i).size(), matches.at(i).size());
+        for (size_t j = 0; j < matches.at(i).size(); ++j)
+        {
+            const cv::DMatch& match = matches.at(i).at(j);
+
+            // the second and third best matches may be tied, so only
+            // their distances are compared
+            EXPECT_EQ(matchesRef.at(i).at(j).queryIdx, match.queryIdx);
+            EXPECT_EQ(matchesRef.at(i).at(j).distance, match.distance);
+            EXPECT_NE(0, mask.at<unsigned char>(match.queryIdx, match.trainIdx));
+            EXPECT_EQ(cv::norm(queryDescriptors.row(match.queryIdx),
+                               trainDescriptors.row(match.trainIdx), cv::NORM_HAMMING),
+                      match.distance);
+        }
+    }
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
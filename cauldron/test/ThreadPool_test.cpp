@@ -0,0 +1,120 @@
+#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
+#include <gtest/gtest.h>
+#include <stdexcept>
+
+#include "cauldron/ThreadPool.h"
+
+namespace px
+{
+
+namespace
+{
+
+void
+increment(int* counter, boost::mutex* mutex)
+{
+    boost::lock_guard<boost::mutex> lock(*mutex);
+    ++(*counter);
+}
+
+void
+throwError(void)
+{
+    throw std::runtime_error("task failed");
+}
+
+void
+nestedTasks(ThreadPool* pool, int depth, int* counter, boost::mutex* mutex)
+{
+    increment(counter, mutex);
+
+    if (depth == 0)
+    {
+        return;
+    }
+
+    TaskGroup group(*pool);
+    for (int i = 0; i < 4; ++i)
+    {
+        group.run(boost::bind(&nestedTasks, pool, depth - 1, counter, mutex));
+    }
+    group.wait();
+}
+
+}
+
+TEST(ThreadPool, taskGroup)
+{
+    ThreadPool pool(4);
+
+    int counter = 0;
+    boost::mutex mutex;
+
+    TaskGroup group(pool);
+    for (int i = 0; i < 1000; ++i)
+    {
+        group.run(boost::bind(&increment, &counter, &mutex));
+    }
+    group.wait();
+
+    EXPECT_EQ(1000, counter);
+}
+
+TEST(ThreadPool, nestedTaskGroups)
+{
+    // more nested waiters than worker threads
+    ThreadPool pool(2);
+
+    int counter = 0;
+    boost::mutex mutex;
+
+    TaskGroup group(pool);
+    for (int i = 0; i < 4; ++i)
+    {
+        group.run(boost::bind(&nestedTasks, &pool, 4, &counter, &mutex));
+    }
+    group.wait();
+
+    // 4 trees of 1 + 4 + 16 + 64 + 256 tasks
+    EXPECT_EQ(4 * 341, counter);
+}
+
+TEST(ThreadPool, exception)
+{
+    ThreadPool pool(2);
+
+    int counter = 0;
+    boost::mutex mutex;
+
+    TaskGroup group(pool);
+    for (int i = 0; i < 100; ++i)
+    {
+        group.run(boost::bind(&increment, &counter, &mutex));
+        if (i % 10 == 0)
+        {
+            group.run(&throwError);
+        }
+    }
+
+    EXPECT_THROW(group.wait(), std::runtime_error);
+
+    // the remaining tasks still run, and the exception is only
+    // rethrown once
+    EXPECT_EQ(100, counter);
+    EXPECT_NO_THROW(group.wait());
+
+    // the destructor does not block or throw on a failed task
+    {
+        TaskGroup failedGroup(pool);
+        failedGroup.run(&throwError);
+    }
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -1,8 +1,14 @@
 #ifndef DYNOCMAP_H_
 #define DYNOCMAP_H_
 
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/multi_array.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
 #include <boost/thread/thread.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/weak_ptr.hpp>
 #include <geometry_msgs/Pose.h>
 #include <opencv2/core/core.hpp>
 #include <pcl_ros/point_cloud.h>
@@ -10,6 +16,7 @@
 #include <sensor_msgs/PointCloud2.h>
 #include <string>
 
+#include "dynocmap/DynocMapSnapshot.h"
 #include "dynocmap/OccupancyTile.h"
 #include "dynocmap/OcTree.h"
 #include "dynocmap_msgs/DynocMap.h"
@@ -19,6 +26,7 @@ namespace px
 
 // forward declarations
 class OcTreeCache;
+class TileArchive;
 
 class DynocMap
 {
@@ -34,26 +42,72 @@ public:
     DynocMap(double resolution, const SensorModelPtr& sensorModel,
              const std::string& diskCacheDir, bool enableCaching = true);
 
+    ~DynocMap();
+
     void clear(void);
     void recenter(const Eigen::Vector3d& center);
 
+    // Start moving the map window to center in the background, and return
+    // true if a window started by an earlier call has been switched to.
+    // Until then, the map stays centered at its previous position. Tiles
+    // which the window is heading into, given the velocity and a lookahead
+    // time in seconds, are prefetched into the memory cache.
+    bool recenterAsync(const Eigen::Vector3d& center,
+                       const Eigen::Vector3d& velocity = Eigen::Vector3d::Zero(),
+                       double lookahead = 2.0);
+
+    // Block until a window started by recenterAsync has been switched to.
+    void waitForRecenter(void);
+
+    // Block until a window started by recenterAsync has been loaded, or
+    // until timeout seconds have passed, without switching to it. Return
+    // false if no window has been loaded.
+    bool waitForRecenterLoaded(double timeout);
+
+    // If bundleRays is set, the scan is integrated as a batch update (see
+    // OcTree::insertScan): endpoints are binned into voxels and one ray is
+    // cast per voxel. Free space along each ray is updated once per scan,
+    // and the occupied updates are scaled by the number of endpoints in
+    // the voxel, as if a ray was cast to each endpoint.
     void insertScan(const geometry_msgs::Pose& sensorPose,
                     const std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> >& scanEndpoints,
-                    Frame frame);
+                    Frame frame, bool bundleRays = false);
 
     template<typename PointT>
     void insertScan(const geometry_msgs::Pose& sensorPose,
                     const pcl::PointCloud<PointT>& cloud,
-                    Frame frame);
+                    Frame frame, bool bundleRays = false);
 
     void castRay(const geometry_msgs::Pose& sensorPose,
                  const Eigen::Vector3d& endpoint, Frame frame);
     void castRays(const Eigen::Matrix4d& sensorPose, const cv::Mat& depthImage,
-                  const Eigen::Matrix3d& cameraMatrix, bool usePyramid = true);
+                  const Eigen::Matrix3d& cameraMatrix, bool usePyramid = true,
+                  int nThreads = 1);
 
     void updateCell(const Eigen::Vector3d& pos, double prob);
     void updateCell(const Eigen::Vector3i& pos, double prob);
 
+    // Return true if a cell within the axis-aligned box, or within radius
+    // of the segment from start to end, is occupied. If unknownIsOccupied
+    // is set, cells which have not been observed as free, including cells
+    // outside the map, count as occupied.
+    bool isBoxOccupied(const Eigen::Vector3d& boxMin, const Eigen::Vector3d& boxMax,
+                       bool unknownIsOccupied = false) const;
+    bool isSweptSphereOccupied(const Eigen::Vector3d& start, const Eigen::Vector3d& end,
+                               double radius, bool unknownIsOccupied = false) const;
+
+    // Latest published snapshot of the map, which can be queried from any
+    // thread. Publishing copies the tiles changed since the previous
+    // snapshot, so snapshots are only published by calling publishSnapshot,
+    // unless automatic publishing is enabled with setSnapshotInterval.
+    DynocMapSnapshotConstPtr snapshot(void) const;
+    void publishSnapshot(void);
+
+    // Publish a snapshot after scans or depth images are inserted, and
+    // after the map window changes, at most once every interval seconds.
+    // A negative interval, the default, disables automatic publishing.
+    void setSnapshotInterval(double interval);
+
     double resolution(void) const;
     Eigen::Vector3d center(void) const;
     double mapWidth(void) const;
@@ -64,13 +118,33 @@ public:
     bool read(const boost::multi_array<char, 1>& data);
     bool write(boost::multi_array<char, 1>& data) const;
 
+    // Only keyframes can be read, since an incremental update does not hold
+    // the whole map. Returns false for incremental updates, which are
+    // applied with readDelta or decoded with readTiles instead.
     bool read(const dynocmap_msgs::DynocMap& msg);
+
+    // Read a keyframe, or apply an incremental update on top of the map.
+    // Returns false, leaving the map unchanged, if the update is not based
+    // on the update last read or covers a different map window.
+    bool readDelta(const dynocmap_msgs::DynocMap& msg);
     bool write(dynocmap_msgs::DynocMap& msg, const std::string& frameId = "") const;
 
+    // Write an incremental update which holds only the tiles changed since
+    // the previous update, or all tiles every keyframeInterval updates.
+    bool writeDelta(dynocmap_msgs::DynocMap& msg, const std::string& frameId = "",
+                    int keyframeInterval = 10);
+
+    // Decode the tiles of a map message, which may be an incremental update.
+    // An incremental update only applies on top of the update whose seq is
+    // its base_seq.
+    static std::vector<OccupancyTile, Eigen::aligned_allocator<OccupancyTile> > readTiles(const dynocmap_msgs::DynocMap& msg);
+
 private:
     int mapGridWidth(void) const;
     int tileGridWidth(void) const;
 
+    void publishSnapshotIfDue(void);
+
     void addRowNorth(void);
     void addRowSouth(void);
     void addColumnEast(void);
@@ -81,10 +155,34 @@ private:
     void fillEmptyTiles(void);
     void buildMapTree(void);
     void prefetch(void);
-
-    std::string getTileFilename(double resolution, int depthLevel,
-                                const Eigen::Vector3i& tileCenter,
-                                const std::string& cacheDir) const;
+    // Prefetch the tiles of the window around center which are not in the map.
+    void prefetch(const Eigen::Vector3d& center);
+
+    // Number of tiles by which the window moves if recentered at center.
+    Eigen::Vector3i windowShift(const Eigen::Vector3d& center) const;
+    // Center of the tile with the given index in a window centered at
+    // mapCenter which has no grid offset.
+    Eigen::Vector3i windowTileCenter(const Eigen::Vector3i& mapCenter, int index) const;
+    bool isInWindow(const Eigen::Vector3i& tileCenter) const;
+
+    void startRecenter(const Eigen::Vector3i& d);
+    void loadPendingWindow(void);
+    bool commitPendingWindow(bool wait);
+    void cancelRecenter(void);
+
+    // Write tiles which have left the map window to the tile archive.
+    void unloadTiles(std::vector<OcTreePtr> tiles) const;
+    // Block until the tiles of the previous window have been written, so
+    // that they are not read back before.
+    void waitForUnload(void);
+
+    // Remove all tiles from the tile archive in the disk cache directory,
+    // which is opened or created on the first call. Other files in the
+    // directory are left alone.
+    void resetDiskCache(bool enableMemoryCaching);
+
+    std::string getTileName(double resolution, int depthLevel,
+                            const Eigen::Vector3i& tileCenter) const;
     Eigen::Vector3i gridCoordsToTileCenter(const Eigen::Vector3i& p,
                                            bool addOffset) const;
 
@@ -109,7 +207,47 @@ private:
 
     OcTreePtr m_mapTree;
 
+    boost::shared_ptr<TileArchive> m_tileArchive;
     boost::shared_ptr<OcTreeCache> m_memoryCache;
+
+    class PublishedTile
+    {
+    public:
+        PublishedTile()
+         : modificationCount(0) {};
+
+        boost::weak_ptr<OcTree> tile;
+        size_t modificationCount;
+    };
+
+    // state of tiles at the last incremental update, keyed by tile name
+    boost::unordered_map<std::string, PublishedTile> m_publishedTiles;
+    // seq of the update last written, or last read
+    unsigned int m_updateSeq;
+
+    class PendingWindow
+    {
+    public:
+        Eigen::Vector3i center;
+        std::vector<OcTreePtr> grid;
+        std::vector<Eigen::Vector3i> tileCenters;
+    };
+
+    // window which is being loaded by the recenter thread
+    PendingWindow m_pendingWindow;
+    bool m_recenterReady;
+    boost::mutex m_recenterMutex;
+    boost::condition_variable m_recenterCond;
+    boost::shared_ptr<boost::thread> m_recenterThread;
+
+    // thread which writes the tiles of the previous window if there is no
+    // memory cache to hand them to
+    boost::shared_ptr<boost::thread> m_unloadThread;
+
+    mutable boost::mutex m_snapshotMutex;
+    DynocMapSnapshotConstPtr m_snapshot;
+    double m_snapshotInterval;
+    boost::posix_time::ptime m_snapshotTime;
 };
 
 typedef boost::shared_ptr<DynocMap> DynocMapPtr;
@@ -118,14 +256,32 @@ template<typename PointT>
 void
 DynocMap::insertScan(const geometry_msgs::Pose& sensorPose,
                      const pcl::PointCloud<PointT>& cloud,
-                     Frame frame)
+                     Frame frame, bool bundleRays)
 {
+    if (bundleRays)
+    {
+        std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > scanEndpoints;
+        scanEndpoints.reserve(cloud.size());
+
+        for (size_t i = 0; i < cloud.size(); ++i)
+        {
+            const PointT& point = cloud.at(i);
+
+            scanEndpoints.push_back(Eigen::Vector3d(point.x, point.y, point.z));
+        }
+
+        insertScan(sensorPose, scanEndpoints, frame, true);
+        return;
+    }
+
     for (size_t i = 0; i < cloud.size(); ++i)
     {
         const PointT& point = cloud.at(i);
 
         castRay(sensorPose, Eigen::Vector3d(point.x, point.y, point.z), frame);
     }
+
+    publishSnapshotIfDue();
 }
 
 }
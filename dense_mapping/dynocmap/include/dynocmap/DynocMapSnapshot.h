@@ -0,0 +1,86 @@
+#ifndef DYNOCMAPSNAPSHOT_H_
+#define DYNOCMAPSNAPSHOT_H_
+
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <Eigen/Dense>
+#include <vector>
+
+#include "dynocmap/OcTree.h"
+
+namespace px
+{
+
+/**
+ * \brief Read-only view of a DynocMap at one update
+ *
+ * A snapshot holds its own copies of the map tiles, and is never modified
+ * after it has been published. It can be queried from any thread while
+ * the map is being updated. Tiles which have not changed between updates
+ * are shared by consecutive snapshots.
+ */
+class DynocMapSnapshot
+{
+public:
+    enum CellState
+    {
+        UNKNOWN,
+        FREE,
+        OCCUPIED
+    };
+
+    DynocMapSnapshot();
+
+    // Number of the map update the snapshot was taken at.
+    unsigned int epoch(void) const;
+
+    double resolution(void) const;
+    Eigen::Vector3d center(void) const;
+    double mapWidth(void) const;
+
+    CellState cellState(const Eigen::Vector3d& pos) const;
+    CellState cellState(const Eigen::Vector3i& pos) const;
+    bool isOccupied(const Eigen::Vector3d& pos) const;
+
+    void queryOccupancy(const std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> >& points,
+                        std::vector<CellState>& states) const;
+
+    // Walk the cells along a ray up to maxRange, and return the center of
+    // the first occupied cell in hit. Return false if no cell is occupied.
+    bool raycastFirstHit(const Eigen::Vector3d& origin, const Eigen::Vector3d& direction,
+                         double maxRange, Eigen::Vector3d& hit) const;
+
+    // Collision checks as in DynocMap.
+    bool isBoxOccupied(const Eigen::Vector3d& boxMin, const Eigen::Vector3d& boxMax,
+                       bool unknownIsOccupied = false) const;
+    bool isSweptSphereOccupied(const Eigen::Vector3d& start, const Eigen::Vector3d& end,
+                               double radius, bool unknownIsOccupied = false) const;
+
+private:
+    friend class DynocMap;
+
+    class Tile
+    {
+    public:
+        Tile()
+         : modificationCount(0) {};
+
+        // tile of the map which was copied
+        boost::weak_ptr<OcTree> source;
+        size_t modificationCount;
+        OcTreePtr copy;
+    };
+
+    unsigned int m_epoch;
+
+    std::vector<Tile> m_tiles;
+
+    // map tree built from the tile copies
+    OcTreePtr m_tree;
+};
+
+typedef boost::shared_ptr<const DynocMapSnapshot> DynocMapSnapshotConstPtr;
+
+}
+
+#endif
@@ -1,25 +1,34 @@
 #ifndef OCNODE_H_
 #define OCNODE_H_
 
-#include <boost/enable_shared_from_this.hpp>
 #include <boost/shared_ptr.hpp>
-#include <vector>
 
 namespace px
 {
 
 class OcNode;
 typedef boost::shared_ptr<OcNode> OcNodePtr;
-typedef boost::weak_ptr<OcNode> OcNodeWPtr;
 
-class OcNode: public boost::enable_shared_from_this<OcNode>
+class OcTree;
+
+/**
+ * \brief Octree node
+ *
+ * Nodes are owned by the OcNodePool of their tree. The 8 children of a
+ * node are stored next to each other in the pool and are allocated and
+ * accessed through OcTree.
+ *
+ * Inner nodes summarize the occupancy of the leafs below them: their
+ * log-odds hold the maximum and their interim log-odds the minimum
+ * log-odds of these leafs.
+ */
+class OcNode
 {
 public:
     OcNode();
-    OcNode(OcNodePtr parent, int index);
-
-    int index(void) const;
 
+    // Log-odds of a leaf. For an inner node, this is the maximum log-odds
+    // of the leafs below it.
     void setLogOdds(double logOdds);
     double getLogOdds(void) const;
 
@@ -28,31 +37,37 @@ public:
 
     double getProbability(void) const;
 
-    void split(void);
-    bool isLeaf(void) const;
-
-    std::vector<OcNodePtr>& children(void);
-    const std::vector<OcNodePtr>& children(void) const;
-    OcNodePtr child(int index) const;
-    void setChild(int index, const OcNodePtr& childNode);
+    // Maximum and minimum log-odds of the leafs below the node, or the
+    // log-odds of the node if it is a leaf.
+    double getMaxLogOdds(void) const;
+    double getMinLogOdds(void) const;
 
-    OcNodeWPtr parent(void) const;
+    bool isLeaf(void) const;
 
     void setUpdated(bool updated);
     bool isUpdated(void) const;
 
 private:
-    OcNodePtr sharedPtr(void);
-
-    bool m_leaf;
-    std::vector<OcNodePtr> m_child;
-    OcNodeWPtr m_parent;
-
-    int m_index;
-    double m_logOdds;
-    double m_interimLogOdds;
-
-    bool m_isUpdated;
+    friend class OcTree;
+    friend class OcNodePool;
+
+    enum
+    {
+        UPDATED = 0x1,
+        // the node stands in for the root of another tree
+        LINK = 0x2
+    };
+
+    union
+    {
+        OcNode* m_children;
+        OcTree* m_link;
+    };
+
+    float m_logOdds;
+    float m_interimLogOdds;
+
+    unsigned char m_flags;
 };
 
 }
@@ -0,0 +1,58 @@
+#ifndef OCNODEPOOL_H_
+#define OCNODEPOOL_H_
+
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/shared_array.hpp>
+#include <vector>
+
+#include "dynocmap/OcNode.h"
+
+namespace px
+{
+
+/**
+ * \brief Storage for the nodes of an octree
+ *
+ * Nodes are allocated in blocks of 8 siblings from chunks of contiguous
+ * memory. Chunks grow geometrically up to maxBlocksPerChunk blocks so
+ * that small trees stay small. Nodes never move, and are only released
+ * together with the pool.
+ */
+class OcNodePool: public boost::enable_shared_from_this<OcNodePool>
+{
+public:
+    explicit OcNodePool(size_t maxBlocksPerChunk = 4096);
+
+    OcNode* root(void);
+
+    // Allocate the 8 children of a node.
+    OcNode* allocateChildren(void);
+
+    size_t nodeCount(void) const;
+
+    // Bytes of memory held by the pool.
+    size_t memoryUsage(void) const;
+
+    // Number of leaf updates made to the nodes of the pool.
+    size_t modificationCount(void) const;
+    void markModified(void);
+
+private:
+    const size_t k_maxBlocksPerChunk;
+
+    OcNode m_root;
+
+    std::vector<boost::shared_array<OcNode> > m_chunks;
+    size_t m_chunkBlocks;
+    size_t m_chunkBlocksUsed;
+    size_t m_nBlocks;
+    size_t m_nBlocksReserved;
+
+    size_t m_modificationCount;
+};
+
+typedef boost::shared_ptr<OcNodePool> OcNodePoolPtr;
+
+}
+
+#endif
@@ -1,7 +1,9 @@
 #ifndef OCTREE_H_
 #define OCTREE_H_
 
+#include <boost/cstdint.hpp>
 #include <boost/multi_array.hpp>
+#include <boost/unordered_map.hpp>
 #include <boost/unordered_set.hpp>
 #include <Eigen/Dense>
 #include <geometry_msgs/Pose.h>
@@ -11,6 +13,7 @@
 
 #include "dynocmap/OccupancyCell.h"
 #include "dynocmap/OcNode.h"
+#include "dynocmap/OcNodePool.h"
 #include "dynocmap_msgs/DynocMapTile.h"
 
 namespace px
@@ -43,8 +46,42 @@ public:
     OcNodePtr findNode(const Eigen::Vector3d& pos, int maxDepth = -1);
     OcNodePtr findNode(const Eigen::Vector3i& pos, int maxDepth = -1);
 
+    // Log-odds of the leaf at pos, found without modifying the tree.
+    // Return false if the leaf has not been allocated.
+    bool leafLogOdds(const Eigen::Vector3i& pos, double& logOdds) const;
+
+    // Deep copy of the tree, including the sub-trees which are linked
+    // into it.
+    OcTreePtr clone(void) const;
+
+    // Collision checks which return true if a leaf within the axis-aligned
+    // box, or within radius of the segment from start to end, is occupied.
+    // If unknownIsOccupied is set, leafs which have not been observed as
+    // free count as occupied. The checks descend only into nodes whose
+    // occupancy summaries leave the result open.
+    bool isBoxOccupied(const Eigen::Vector3d& boxMin, const Eigen::Vector3d& boxMax,
+                       bool unknownIsOccupied = false) const;
+    bool isSweptSphereOccupied(const Eigen::Vector3d& start, const Eigen::Vector3d& end,
+                               double radius, bool unknownIsOccupied = false) const;
+
+    // Recompute the occupancy summaries of all inner nodes, or of the
+    // nodes above the leaf at pos. Ray casting and scan insertion keep the
+    // summaries up to date, but updates of nodes returned by insertNode or
+    // findNode are only summarized by calling updateSummaries.
+    void updateSummaries(void);
+    void updateSummaries(const Eigen::Vector3i& pos);
+
     size_t maximumLeafCount(void) const;
 
+    // Number of nodes and bytes of node storage of the tree
+    // and its sub-trees.
+    size_t nodeCount(void) const;
+    size_t memoryUsage(void) const;
+
+    // Number of leaf updates made to the tree and its sub-trees since
+    // the tree was created or read.
+    size_t modificationCount(void) const;
+
     std::vector<OccupancyCell, Eigen::aligned_allocator<OccupancyCell> > leafs(void) const;
     std::vector<OccupancyCell, Eigen::aligned_allocator<OccupancyCell> > obstacles(void) const;
 
@@ -72,13 +109,40 @@ public:
                  Frame frame, SensorModelPtr& sensorModel);
     void castRay(const Eigen::Matrix4d& sensorPose, const Eigen::Vector3d& endpoint,
                  Frame frame, SensorModelPtr& sensorModel);
+    // Rays are traversed by nThreads tasks of the process-wide
+    // px::ThreadPool (0: one task per pool thread).
     void castRays(const Eigen::Matrix4d& sensorPose, const cv::Mat& depthImage,
                   const Eigen::Matrix3d& cameraMatrix, SensorModelPtr& sensorModel,
-                  bool usePyramid = true);
+                  bool usePyramid = true, int nThreads = 1);
+
+    // Integrate a scan as a batch update. Endpoints are binned into
+    // voxels, and a single ray is cast to the mean endpoint of each voxel.
+    // The occupied updates of the ray are scaled by the number of endpoints
+    // in the voxel, which, as log-odds are clamped, is the same as applying
+    // them once per endpoint. Free space along the ray is updated once.
+    void insertScan(const geometry_msgs::Pose& sensorPose,
+                    const std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> >& scanEndpoints,
+                    Frame frame, SensorModelPtr& sensorModel, int nThreads = 1);
+    void insertScan(const Eigen::Matrix4d& sensorPose,
+                    const std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> >& scanEndpoints,
+                    Frame frame, SensorModelPtr& sensorModel, int nThreads = 1);
+
+    // Wall-clock time in ms spent by the last castRays or insertScan call
+    // in ray traversal, in merging the updates of the traversal tasks,
+    // and in the serial update of the tree. Only ray traversal and
+    // merging run in parallel.
+    void batchUpdateTimes(double& tTraversal, double& tMerge, double& tUpdate) const;
 
     bool read(const boost::multi_array<char, 1>& data);
     bool write(boost::multi_array<char, 1>& data) const;
 
+    // Read a tree in either the plain or the compressed encoding.
+    bool read(const char* data, size_t size);
+
+    // Versioned, compressed encoding in which leaf log-odds are quantized
+    // to bitsPerLeaf (8 or 16) bits and runs of equal leafs are collapsed.
+    bool writeCompressed(std::vector<char>& data, int bitsPerLeaf = 16) const;
+
     bool read(const std::string& filename);
     bool write(const std::string& filename) const;
 
@@ -91,25 +155,74 @@ private:
     Eigen::Vector3i childCoords(const Eigen::Vector3i& parentCoords,
                                 int childIndex, int parentWidth) const;
 
+    // Return the child of a node with the given index. If the child links
+    // to the root of a sub-tree, return that root instead.
+    OcNode* child(OcNode* node, int index) const;
+    const OcNode* child(const OcNode* node, int index) const;
+
+    // If node links to the root of a sub-tree, replace node with that root
+    // and pool with the pool of the sub-tree.
+    void resolveLink(OcNode*& node, OcNodePool*& pool) const;
+
+    void split(OcNode* node, OcNodePool* pool) const;
+
+    OcNodePtr nodePtr(OcNode* node, OcNodePool* pool) const;
+
+    // Find the node containing pos at maxDepth, or at the bottom of the
+    // tree if maxDepth is negative, together with the pool it belongs to.
+    OcNode* lookupNode(const Eigen::Vector3i& pos, int maxDepth, OcNodePool*& pool) const;
+
+    // Pack the coordinates of a leaf relative to the corner of the tree
+    // into 21 bits each.
+    boost::uint64_t leafKey(const Eigen::Vector3i& pos) const;
+    Eigen::Vector3i leafCoords(boost::uint64_t key) const;
+
+    OcNode* insertLeaf(const Eigen::Vector3i& pos, OcNodePool*& pool);
+
+    void updateLeaf(OcNode* node, OcNodePool* pool, const Eigen::Vector3i& coords,
+                    double logodds);
+
+    template<typename Region>
+    bool isRegionOccupied(const Region& region, bool unknownIsOccupied) const;
+    bool isOccupied(double logOdds, bool unknownIsOccupied) const;
+
+    // Set the summary of an inner node from its children.
+    void updateNodeSummary(OcNode* node) const;
+    // Recompute the summaries below node, not including sub-trees.
+    void updateSubtreeSummaries(OcNode* node) const;
+    // Recompute the summaries of the nodes above the given leafs.
+    void updatePathSummaries(std::vector<Eigen::Vector3i>& leafCoords);
+    void updatePathSummaries(OcNode* node, const Eigen::Vector3i& nodeCoords, int nodeWidth,
+                             std::vector<Eigen::Vector3i>::iterator first,
+                             std::vector<Eigen::Vector3i>::iterator last) const;
+
     int getFirstIntersectedNode(const Eigen::Vector3d& t0, const Eigen::Vector3d& tm) const;
-    int getNextIntersectedNode(const Eigen::Vector3d& tm, int x, int y, int z);
+    int getNextIntersectedNode(const Eigen::Vector3d& tm, int x, int y, int z) const;
 
     std::vector<cv::Mat> buildDepthImagePyramid(const cv::Mat& depthImage) const;
 
     void initBatchUpdate(void);
     void finalizeBatchUpdate(void);
 
+    bool readCompressed(const char* data, size_t size);
+
+    // Breadth-first bitstream of split nodes, and the leafs at the
+    // bottom of the tree in the same order.
+    void writeStructure(std::vector<char>& data, std::vector<const OcNode*>& leafs) const;
+    bool readStructure(const char* data, size_t size, size_t& mark,
+                       std::vector<OcNode*>& leafs);
+
     class LabeledNode
     {
     public:
-        LabeledNode(const OcNodePtr& _node, const Eigen::Vector3i& _coords)
-         : node(_node.get())
+        LabeledNode(const OcNode* _node, const Eigen::Vector3i& _coords)
+         : node(_node)
          , coords(_coords)
         {
 
         }
 
-        OcNode* node;
+        const OcNode* node;
         Eigen::Vector3i coords;
     };
 
@@ -119,11 +232,12 @@ private:
         EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
         TraversalNode(const Eigen::Vector3d& _t0, const Eigen::Vector3d& _t1,
-                      const OcNodePtr& _node,
+                      OcNode* _node, OcNodePool* _pool,
                       const Eigen::Vector3i& _gridCoords)
          : t0(_t0)
          , t1(_t1)
          , node(_node)
+         , pool(_pool)
          , gridCoords(_gridCoords)
         {
 
@@ -131,22 +245,72 @@ private:
 
         Eigen::Vector3d t0;
         Eigen::Vector3d t1;
-        OcNodePtr node;
+        OcNode* node;
+        OcNodePool* pool;
         Eigen::Vector3i gridCoords;
     };
 
+    // Find the leafs traversed by a ray and their log-odds updates.
+    // If createNodes is false, the tree is not modified and only the grid
+    // coordinates of the leafs are valid.
+    void traceRay(const Eigen::Matrix4d& sensorPose, const Eigen::Vector3d& endpointLocal,
+                  SensorModel& sensorModel, bool createNodes,
+                  std::vector<TraversalNode>& leafs, std::vector<double>& logOdds);
+
+    // maximum log-odds update of each leaf, keyed by leafKey
+    typedef boost::unordered_map<boost::uint64_t, double> LeafUpdateMap;
+
+    // Cast rays to endpoints given in the sensor frame as part of a batch update.
+    // If hitCounts is not empty, the occupied updates of the ray to
+    // endpoint i are scaled by hitCounts[i].
+    void castRaysBatch(const Eigen::Matrix4d& sensorPose,
+                       const std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> >& endpoints,
+                       const std::vector<int>& hitCounts,
+                       SensorModelPtr& sensorModel, int nThreads);
+
+    // Updates are split into one map per partition of the leaf keys,
+    // so that the maps of all tasks can be merged partition by partition.
+    void castRaysThread(const Eigen::Matrix4d& sensorPose,
+                        const std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> >& endpoints,
+                        const std::vector<int>& hitCounts,
+                        SensorModelPtr sensorModel, int threadIdx, int nThreads,
+                        std::vector<LeafUpdateMap>& updates);
+
+    // Merge the updates of all castRays tasks in a partition into the
+    // map of the first task.
+    void mergeUpdatesPartition(size_t partitionIdx);
+
+    // Scale the occupied updates of a ray cast to hitCount endpoints.
+    void scaleHitLogOdds(std::vector<double>& logOdds, int hitCount) const;
+
     double m_resolution;
     int m_treeHeight;
 
     Eigen::Vector3i m_center;
 
-    OcNodePtr m_root;
+    OcNodePoolPtr m_pool;
+
+    // sub-trees whose roots are linked into this tree
+    std::vector<OcTreePtr> m_subTrees;
 
     double m_logOddsMax;
     double m_logOddsMin;
     double m_logOddsOccThresh;
 
     bool m_batchUpdate;
+
+    // leafs updated since the batch update was started, each listed once,
+    // and their grid coordinates
+    std::vector<OcNode*> m_dirtyLeafs;
+    std::vector<Eigen::Vector3i> m_dirtyLeafCoords;
+
+    // updates of castRays tasks which are yet to be merged,
+    // indexed by task and partition
+    std::vector<std::vector<LeafUpdateMap> > m_threadUpdates;
+
+    double m_tTraversal;
+    double m_tMerge;
+    double m_tUpdate;
 };
 
 }
@@ -1,11 +1,13 @@
 #include "dynocmap/DynocMap.h"
 
+#include <algorithm>
 #include <boost/filesystem.hpp>
 #include <cmath>
 #include <vector>
 
 #include "OcTreeCache.h"
 #include "OcUtils.h"
+#include "TileArchive.h"
 
 namespace px
 {
@@ -16,6 +18,10 @@ DynocMap::DynocMap()
  , m_tileTreeHeight(0)
  , m_mapTreeHeight(0)
  , m_mapGridOffset(Eigen::Vector3i::Zero())
+ , m_updateSeq(0)
+ , m_recenterReady(false)
+ , m_snapshot(boost::make_shared<DynocMapSnapshot>())
+ , m_snapshotInterval(-1.0)
 {
 
 }
@@ -28,40 +34,33 @@ DynocMap::DynocMap(double resolution, const SensorModelPtr& sensorModel,
  , m_sensorModel(sensorModel)
  , m_diskCacheDir(diskCacheDir)
  , m_mapGridOffset(Eigen::Vector3i::Zero())
+ , m_updateSeq(0)
+ , m_recenterReady(false)
+ , m_snapshot(boost::make_shared<DynocMapSnapshot>())
+ , m_snapshotInterval(-1.0)
 {
-    if (boost::filesystem::exists(diskCacheDir.c_str()) &&
-        boost::filesystem::is_directory(diskCacheDir.c_str()))
-    {
-        boost::filesystem::remove_all(diskCacheDir.c_str());
-    }
-    boost::filesystem::create_directory(diskCacheDir.c_str());
-
     m_tileTreeHeight = static_cast<int>(ceilf(log2(sensorModel->maxRange() / resolution))) + 1;
 
     int nTiles = cube(mapGridWidth());
     m_mapGrid.resize(nTiles);
 
-    if (enableMemoryCaching)
-    {
-        int cacheTreeHeight = m_mapTreeHeight + 1;
-        int cacheGridWidth =  1 << (cacheTreeHeight - 1);
-
-        m_memoryCache = boost::make_shared<OcTreeCache>(cube(cacheGridWidth));
-    }
+    resetDiskCache(enableMemoryCaching);
 
     fillEmptyTiles();
     buildMapTree();
 }
 
+DynocMap::~DynocMap()
+{
+    cancelRecenter();
+}
+
 void
 DynocMap::clear(void)
 {
-    if (boost::filesystem::exists(m_diskCacheDir.c_str()) &&
-        boost::filesystem::is_directory(m_diskCacheDir.c_str()))
-    {
-        boost::filesystem::remove_all(m_diskCacheDir.c_str());
-    }
-    boost::filesystem::create_directory(m_diskCacheDir.c_str());
+    cancelRecenter();
+
+    resetDiskCache(m_memoryCache.get() != 0);
 
     int width = mapGridWidth();
     int nTiles = width * width * width;
@@ -77,14 +76,10 @@ DynocMap::clear(void)
 void
 DynocMap::recenter(const Eigen::Vector3d& center)
 {
-    Eigen::Vector3i centerI = pointToGridCoords(center, m_resolution);
+    waitForRecenter();
+    waitForUnload();
 
-    Eigen::Vector3i d = centerI - m_center;
-
-    for (int i = 0; i < 3; ++i)
-    {
-        d(i) = static_cast<int>(round(static_cast<double>(d(i)) / static_cast<double>(tileGridWidth())));
-    }
+    Eigen::Vector3i d = windowShift(center);
 
     if (d == Eigen::Vector3i::Zero())
     {
@@ -165,16 +160,78 @@ DynocMap::recenter(const Eigen::Vector3d& center)
     prefetch();
 }
 
+bool
+DynocMap::recenterAsync(const Eigen::Vector3d& center,
+                        const Eigen::Vector3d& velocity,
+                        double lookahead)
+{
+    bool recentered = commitPendingWindow(false);
+
+    if (!m_recenterThread)
+    {
+        Eigen::Vector3i d = windowShift(center);
+
+        if (d != Eigen::Vector3i::Zero())
+        {
+            startRecenter(d);
+        }
+    }
+
+    prefetch(center + velocity * lookahead);
+
+    return recentered;
+}
+
+void
+DynocMap::waitForRecenter(void)
+{
+    commitPendingWindow(true);
+}
+
+bool
+DynocMap::waitForRecenterLoaded(double timeout)
+{
+    if (!m_recenterThread)
+    {
+        return false;
+    }
+
+    boost::system_time deadline = boost::get_system_time() +
+                                  boost::posix_time::milliseconds(static_cast<long>(timeout * 1000.0));
+
+    boost::unique_lock<boost::mutex> lock(m_recenterMutex);
+
+    while (!m_recenterReady)
+    {
+        if (!m_recenterCond.timed_wait(lock, deadline))
+        {
+            break;
+        }
+    }
+
+    return m_recenterReady;
+}
+
 void
 DynocMap::insertScan(const geometry_msgs::Pose& sensorPose,
                      const std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> >& scanEndpoints,
-                     Frame frame)
+                     Frame frame, bool bundleRays)
 {
-    for (std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> >::const_iterator it = scanEndpoints.begin();
-         it != scanEndpoints.end(); ++it)
+    if (bundleRays)
     {
-        castRay(sensorPose, *it, frame);
+        m_mapTree->insertScan(sensorPose, scanEndpoints, (OcTree::Frame)frame,
+                              m_sensorModel);
     }
+    else
+    {
+        for (std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> >::const_iterator it = scanEndpoints.begin();
+             it != scanEndpoints.end(); ++it)
+        {
+            castRay(sensorPose, *it, frame);
+        }
+    }
+
+    publishSnapshotIfDue();
 }
 
 void
@@ -293,14 +350,23 @@ DynocMap::castRay(const geometry_msgs::Pose& sensorPose, const Eigen::Vector3d&
 
 void
 DynocMap::castRays(const Eigen::Matrix4d& sensorPose, const cv::Mat& depthImage,
-                   const Eigen::Matrix3d& cameraMatrix, bool usePyramid)
+                   const Eigen::Matrix3d& cameraMatrix, bool usePyramid,
+                   int nThreads)
 {
     m_mapTree->castRays(sensorPose, depthImage, cameraMatrix,
-                        m_sensorModel, usePyramid);
+                        m_sensorModel, usePyramid, nThreads);
+
+    publishSnapshotIfDue();
 }
 
 void
 DynocMap::updateCell(const Eigen::Vector3d& pos, double prob)
+{
+    updateCell(pointToGridCoords(pos, m_resolution), prob);
+}
+
+void
+DynocMap::updateCell(const Eigen::Vector3i& pos, double prob)
 {
     OcNodePtr node = m_mapTree->findNode(pos);
 
@@ -310,19 +376,115 @@ DynocMap::updateCell(const Eigen::Vector3d& pos, double prob)
     }
 
     m_mapTree->updateLogOdds(node, prob);
+    m_mapTree->updateSummaries(pos);
+}
+
+bool
+DynocMap::isBoxOccupied(const Eigen::Vector3d& boxMin, const Eigen::Vector3d& boxMax,
+                        bool unknownIsOccupied) const
+{
+    return m_mapTree->isBoxOccupied(boxMin, boxMax, unknownIsOccupied);
+}
+
+bool
+DynocMap::isSweptSphereOccupied(const Eigen::Vector3d& start, const Eigen::Vector3d& end,
+                                double radius, bool unknownIsOccupied) const
+{
+    return m_mapTree->isSweptSphereOccupied(start, end, radius, unknownIsOccupied);
+}
+
+DynocMapSnapshotConstPtr
+DynocMap::snapshot(void) const
+{
+    boost::lock_guard<boost::mutex> lock(m_snapshotMutex);
+
+    return m_snapshot;
 }
 
 void
-DynocMap::updateCell(const Eigen::Vector3i& pos, double prob)
+DynocMap::publishSnapshot(void)
 {
-    OcNodePtr node = m_mapTree->findNode(pos);
+    DynocMapSnapshotConstPtr prevSnapshot = snapshot();
 
-    if (!node)
+    boost::shared_ptr<DynocMapSnapshot> newSnapshot = boost::make_shared<DynocMapSnapshot>();
+    newSnapshot->m_epoch = prevSnapshot->m_epoch + 1;
+
+    // tiles of the previous snapshot, keyed by the map tile they were
+    // copied from
+    boost::unordered_map<const OcTree*, const DynocMapSnapshot::Tile*> prevTiles;
+    for (size_t i = 0; i < prevSnapshot->m_tiles.size(); ++i)
     {
-        node = m_mapTree->insertNode(pos);
+        const DynocMapSnapshot::Tile& tile = prevSnapshot->m_tiles.at(i);
+
+        OcTreePtr source = tile.source.lock();
+        if (source)
+        {
+            prevTiles[source.get()] = &tile;
+        }
     }
 
-    m_mapTree->updateLogOdds(node, prob);
+    std::vector<OcTreePtr> copies;
+    copies.reserve(m_mapGrid.size());
+    newSnapshot->m_tiles.resize(m_mapGrid.size());
+
+    // only tiles which changed since the previous snapshot are copied
+    for (size_t i = 0; i < m_mapGrid.size(); ++i)
+    {
+        const OcTreePtr& tile = m_mapGrid.at(i);
+
+        DynocMapSnapshot::Tile& snapshotTile = newSnapshot->m_tiles.at(i);
+        snapshotTile.source = tile;
+        snapshotTile.modificationCount = tile->modificationCount();
+
+        boost::unordered_map<const OcTree*, const DynocMapSnapshot::Tile*>::const_iterator it = prevTiles.find(tile.get());
+        if (it != prevTiles.end() &&
+            it->second->modificationCount == snapshotTile.modificationCount)
+        {
+            snapshotTile.copy = it->second->copy;
+        }
+        else
+        {
+            snapshotTile.copy = tile->clone();
+        }
+
+        copies.push_back(snapshotTile.copy);
+    }
+
+    if (!copies.empty())
+    {
+        newSnapshot->m_tree = boost::make_shared<OcTree>(m_center, copies);
+    }
+
+    boost::lock_guard<boost::mutex> lock(m_snapshotMutex);
+
+    m_snapshot = newSnapshot;
+}
+
+void
+DynocMap::setSnapshotInterval(double interval)
+{
+    m_snapshotInterval = interval;
+}
+
+void
+DynocMap::publishSnapshotIfDue(void)
+{
+    if (m_snapshotInterval < 0.0)
+    {
+        return;
+    }
+
+    boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+
+    if (!m_snapshotTime.is_not_a_date_time() &&
+        (now - m_snapshotTime).total_microseconds() * 1e-6 < m_snapshotInterval)
+    {
+        return;
+    }
+
+    m_snapshotTime = now;
+
+    publishSnapshot();
 }
 
 double
@@ -385,6 +547,14 @@ DynocMap::write(boost::multi_array<char, 1>& data) const
 bool
 DynocMap::read(const dynocmap_msgs::DynocMap& msg)
 {
+    cancelRecenter();
+
+    // incremental updates do not hold the whole map
+    if (!msg.keyframe)
+    {
+        return false;
+    }
+
     m_resolution = msg.resolution;
     m_tileTreeHeight = msg.tile_tree_height;
     m_mapTreeHeight = msg.map_tree_height;
@@ -420,6 +590,75 @@ DynocMap::read(const dynocmap_msgs::DynocMap& msg)
 
     m_memoryCache.reset();
 
+    m_updateSeq = msg.seq;
+
+    publishSnapshotIfDue();
+
+    return true;
+}
+
+bool
+DynocMap::readDelta(const dynocmap_msgs::DynocMap& msg)
+{
+    if (msg.keyframe)
+    {
+        return read(msg);
+    }
+
+    if (msg.base_seq != m_updateSeq ||
+        msg.resolution != m_resolution ||
+        msg.tile_tree_height != m_tileTreeHeight ||
+        msg.map_tree_height != m_mapTreeHeight ||
+        msg.center_grid_x != m_center(0) ||
+        msg.center_grid_y != m_center(1) ||
+        msg.center_grid_z != m_center(2))
+    {
+        return false;
+    }
+
+    cancelRecenter();
+
+    // decode all tiles before the map is changed
+    std::vector<std::pair<int, OcTreePtr> > tiles;
+    tiles.reserve(msg.tiles.size());
+
+    for (size_t i = 0; i < msg.tiles.size(); ++i)
+    {
+        OcTreePtr tile = boost::make_shared<OcTree>();
+        if (!tile->read(msg.tiles.at(i)))
+        {
+            return false;
+        }
+
+        int index = -1;
+        for (size_t j = 0; j < m_mapGrid.size(); ++j)
+        {
+            if (m_mapGrid.at(j)->gridCenter() == tile->gridCenter())
+            {
+                index = j;
+                break;
+            }
+        }
+
+        if (index < 0)
+        {
+            return false;
+        }
+
+        tiles.push_back(std::make_pair(index, tile));
+    }
+
+    for (size_t i = 0; i < tiles.size(); ++i)
+    {
+        m_mapGrid.at(tiles.at(i).first) = tiles.at(i).second;
+    }
+
+    m_mapTree = boost::make_shared<OcTree>(m_center, m_mapGrid);
+
+    m_updateSeq = msg.seq;
+
+    publishSnapshotIfDue();
+
     return true;
 }
 
@@ -436,6 +675,10 @@ DynocMap::write(dynocmap_msgs::DynocMap& msg, const std::string& frameId) const
     msg.center_grid_y = m_center(1);
     msg.center_grid_z = m_center(2);
 
+    msg.seq = m_updateSeq;
+    msg.base_seq = m_updateSeq;
+    msg.keyframe = true;
+
     int width = mapGridWidth();
     int nTiles = width * width * width;
 
@@ -477,6 +720,316 @@ DynocMap::write(dynocmap_msgs::DynocMap& msg, const std::string& frameId) const
     return true;
 }
 
+bool
+DynocMap::writeDelta(dynocmap_msgs::DynocMap& msg, const std::string& frameId,
+                     int keyframeInterval)
+{
+    bool keyframe = keyframeInterval <= 1 || m_updateSeq % keyframeInterval == 0;
+
+    if (keyframe)
+    {
+        if (!write(msg, frameId))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        msg.header.stamp = ros::Time::now();
+        msg.header.frame_id = frameId;
+
+        msg.resolution = m_resolution;
+        msg.tile_tree_height = m_tileTreeHeight;
+        msg.map_tree_height = m_mapTreeHeight;
+        msg.center_grid_x = m_center(0);
+        msg.center_grid_y = m_center(1);
+        msg.center_grid_z = m_center(2);
+
+        msg.tiles.clear();
+    }
+
+    msg.base_seq = m_updateSeq;
+    ++m_updateSeq;
+    msg.seq = m_updateSeq;
+    msg.keyframe = keyframe;
+
+    // Tiles which were reloaded or have entered the map window since the
+    // last update are treated as changed.
+    boost::unordered_map<std::string, PublishedTile> publishedTiles;
+
+    int width = mapGridWidth();
+    int nTiles = width * width * width;
+
+    for (int i = 0; i < nTiles; ++i)
+    {
+        const OcTreePtr& tile = m_mapGrid.at(i);
+
+        int c = i % width;
+        int r = (i / width) % width;
+        int s = i / (width * width);
+
+        Eigen::Vector3i tileCenter;
+        tileCenter = gridCoordsToTileCenter(Eigen::Vector3i(c, r, s), true);
+
+        std::string tileName;
+        tileName = getTileName(m_resolution, m_tileTreeHeight, tileCenter);
+
+        boost::unordered_map<std::string, PublishedTile>::const_iterator it = m_publishedTiles.find(tileName);
+
+        if (!keyframe &&
+            (it == m_publishedTiles.end() ||
+             it->second.tile.lock() != tile ||
+             it->second.modificationCount != tile->modificationCount()))
+        {
+            msg.tiles.push_back(dynocmap_msgs::DynocMapTile());
+            tile->write(msg.tiles.back());
+        }
+
+        PublishedTile& publishedTile = publishedTiles[tileName];
+        publishedTile.tile = tile;
+        publishedTile.modificationCount = tile->modificationCount();
+    }
+
+    m_publishedTiles.swap(publishedTiles);
+
+    return true;
+}
+
+std::vector<OccupancyTile, Eigen::aligned_allocator<OccupancyTile> >
+DynocMap::readTiles(const dynocmap_msgs::DynocMap& msg)
+{
+    std::vector<OccupancyTile, Eigen::aligned_allocator<OccupancyTile> > otiles(msg.tiles.size());
+
+    for (size_t i = 0; i < msg.tiles.size(); ++i)
+    {
+        OcTree src;
+        src.read(msg.tiles.at(i));
+
+        OccupancyTile& dst = otiles.at(i);
+
+        dst.resolution() = msg.resolution;
+        dst.tileGridWidth() = src.gridWidth();
+        dst.tileGridCenter() = src.gridCenter();
+        dst.cells() = src.leafs();
+        dst.obstacles() = src.obstacles();
+    }
+
+    return otiles;
+}
+
+Eigen::Vector3i
+DynocMap::windowShift(const Eigen::Vector3d& center) const
+{
+    Eigen::Vector3i centerI = pointToGridCoords(center, m_resolution);
+
+    Eigen::Vector3i d = centerI - m_center;
+
+    for (int i = 0; i < 3; ++i)
+    {
+        d(i) = static_cast<int>(round(static_cast<double>(d(i)) / static_cast<double>(tileGridWidth())));
+    }
+
+    return d;
+}
+
+Eigen::Vector3i
+DynocMap::windowTileCenter(const Eigen::Vector3i& mapCenter, int index) const
+{
+    int width = mapGridWidth();
+
+    if (width == 1)
+    {
+        return mapCenter;
+    }
+
+    Eigen::Vector3i p(index % width, (index / width) % width, index / (width * width));
+
+    return (p - Eigen::Vector3i::Constant(width / 2)) * tileGridWidth() +
+           Eigen::Vector3i::Constant(tileGridWidth() / 2) + mapCenter;
+}
+
+bool
+DynocMap::isInWindow(const Eigen::Vector3i& tileCenter) const
+{
+    int width = mapGridWidth();
+
+    if (width == 1)
+    {
+        return tileCenter == m_center;
+    }
+
+    Eigen::Vector3i d = tileCenter - m_center - Eigen::Vector3i::Constant(tileGridWidth() / 2);
+
+    for (int i = 0; i < 3; ++i)
+    {
+        if (d(i) < -(width / 2) * tileGridWidth() ||
+            d(i) > (width / 2 - 1) * tileGridWidth())
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void
+DynocMap::startRecenter(const Eigen::Vector3i& d)
+{
+    int nTiles = cube(mapGridWidth());
+
+    m_pendingWindow.center = m_center + d * tileGridWidth();
+    m_pendingWindow.grid.assign(nTiles, OcTreePtr());
+    m_pendingWindow.tileCenters.resize(nTiles);
+
+    // tiles which remain in the window are shared with the current map
+    // tree, and keep receiving updates until the windows are swapped
+    for (int i = 0; i < nTiles; ++i)
+    {
+        Eigen::Vector3i tileCenter = windowTileCenter(m_pendingWindow.center, i);
+
+        m_pendingWindow.tileCenters.at(i) = tileCenter;
+
+        if (!isInWindow(tileCenter))
+        {
+            continue;
+        }
+
+        for (int j = 0; j < nTiles; ++j)
+        {
+            const OcTreePtr& tile = m_mapGrid.at(j);
+            if (tile && tile->gridCenter() == tileCenter)
+            {
+                m_pendingWindow.grid.at(i) = tile;
+                break;
+            }
+        }
+    }
+
+    // tiles of the previous window may be loaded again
+    waitForUnload();
+
+    m_recenterReady = false;
+    m_recenterThread = boost::make_shared<boost::thread>(&DynocMap::loadPendingWindow, this);
+}
+
+void
+DynocMap::loadPendingWindow(void)
+{
+    for (size_t i = 0; i < m_pendingWindow.grid.size(); ++i)
+    {
+        if (!m_pendingWindow.grid.at(i))
+        {
+            loadTile(m_pendingWindow.grid.at(i), m_pendingWindow.tileCenters.at(i));
+        }
+    }
+
+    // The map tree is built when the windows are swapped, since the
+    // summaries of its top-level nodes are computed from tiles which the
+    // mapping thread is still updating.
+    {
+        boost::lock_guard<boost::mutex> lock(m_recenterMutex);
+
+        m_recenterReady = true;
+    }
+    m_recenterCond.notify_all();
+}
+
+bool
+DynocMap::commitPendingWindow(bool wait)
+{
+    if (!m_recenterThread)
+    {
+        return false;
+    }
+
+    if (!wait)
+    {
+        boost::lock_guard<boost::mutex> lock(m_recenterMutex);
+
+        if (!m_recenterReady)
+        {
+            return false;
+        }
+    }
+
+    m_recenterThread->join();
+    m_recenterThread.reset();
+
+    // tiles which leave the window are unloaded once they are no longer
+    // part of the map tree
+    std::vector<OcTreePtr> outgoingTiles;
+    for (size_t i = 0; i < m_mapGrid.size(); ++i)
+    {
+        const OcTreePtr& tile = m_mapGrid.at(i);
+
+        if (std::find(m_pendingWindow.grid.begin(), m_pendingWindow.grid.end(), tile) ==
+            m_pendingWindow.grid.end())
+        {
+            outgoingTiles.push_back(tile);
+        }
+    }
+
+    m_center = m_pendingWindow.center;
+    m_mapGridOffset.setZero();
+    m_mapGrid.swap(m_pendingWindow.grid);
+
+    buildMapTree();
+
+    m_pendingWindow.grid.clear();
+
+    // Handing tiles to the memory cache is cheap, but writing them to the
+    // archive is not, and is done in the background.
+    if (m_memoryCache)
+    {
+        unloadTiles(outgoingTiles);
+    }
+    else
+    {
+        waitForUnload();
+
+        m_unloadThread = boost::make_shared<boost::thread>(&DynocMap::unloadTiles, this, outgoingTiles);
+    }
+
+    return true;
+}
+
+void
+DynocMap::cancelRecenter(void)
+{
+    waitForUnload();
+
+    if (!m_recenterThread)
+    {
+        return;
+    }
+
+    m_recenterThread->join();
+    m_recenterThread.reset();
+
+    m_pendingWindow.grid.clear();
+}
+
+void
+DynocMap::unloadTiles(std::vector<OcTreePtr> tiles) const
+{
+    for (size_t i = 0; i < tiles.size(); ++i)
+    {
+        unloadTile(tiles.at(i), tiles.at(i)->gridCenter());
+    }
+}
+
+void
+DynocMap::waitForUnload(void)
+{
+    if (!m_unloadThread)
+    {
+        return;
+    }
+
+    m_unloadThread->join();
+    m_unloadThread.reset();
+}
+
 int
 DynocMap::mapGridWidth(void) const
 {
@@ -715,11 +1268,18 @@ void
 DynocMap::buildMapTree(void)
 {
     m_mapTree = boost::make_shared<OcTree>(m_center, m_mapGrid);
+
+    publishSnapshotIfDue();
 }
 
 void
 DynocMap::prefetch(void)
 {
+    if (!m_memoryCache)
+    {
+        return;
+    }
+
     int cacheTreeHeight = m_mapTreeHeight + 1;
     int cacheWidth =  1 << (cacheTreeHeight - 1);
 
@@ -752,31 +1312,78 @@ DynocMap::prefetch(void)
                 Eigen::Vector3i tileCenter;
                 tileCenter = gridCoordsToTileCenter(Eigen::Vector3i(i, j, k), false);
 
-                std::string tileFilename;
-                tileFilename = getTileFilename(m_resolution, m_tileTreeHeight,
-                                               tileCenter, m_diskCacheDir);
+                std::string tileName;
+                tileName = getTileName(m_resolution, m_tileTreeHeight, tileCenter);
 
-                m_memoryCache->lookup(tileFilename);
+                m_memoryCache->prefetch(tileName);
             }
         }
     }
 }
 
-std::string
-DynocMap::getTileFilename(double resolution, int treeHeight,
-                          const Eigen::Vector3i& tileCenter,
-                          const std::string& cacheDir) const
+void
+DynocMap::prefetch(const Eigen::Vector3d& center)
 {
-    std::ostringstream oss;
-    oss << cacheDir;
-    if (cacheDir.at(cacheDir.size() - 1) != '/')
+    if (!m_memoryCache)
     {
-        oss << "/";
+        return;
     }
+
+    // tiles of the window around center which are not in the map yet
+    Eigen::Vector3i windowCenter = m_center + windowShift(center) * tileGridWidth();
+
+    for (int i = 0; i < cube(mapGridWidth()); ++i)
+    {
+        Eigen::Vector3i tileCenter = windowTileCenter(windowCenter, i);
+
+        if (isInWindow(tileCenter))
+        {
+            continue;
+        }
+
+        m_memoryCache->prefetch(getTileName(m_resolution, m_tileTreeHeight, tileCenter));
+    }
+}
+
+void
+DynocMap::resetDiskCache(bool enableMemoryCaching)
+{
+    // pending writes of the memory cache go to the archive before it
+    // is cleared
+    m_memoryCache.reset();
+
+    if (!m_tileArchive)
+    {
+        boost::filesystem::create_directories(m_diskCacheDir);
+
+        boost::filesystem::path archivePath(m_diskCacheDir);
+        archivePath /= "tiles.dat";
+
+        m_tileArchive = boost::make_shared<TileArchive>();
+        m_tileArchive->open(archivePath.string());
+    }
+
+    // tiles of an earlier map would be mistaken for tiles of this map
+    m_tileArchive->clear();
+
+    if (enableMemoryCaching)
+    {
+        int cacheTreeHeight = m_mapTreeHeight + 1;
+        int cacheGridWidth =  1 << (cacheTreeHeight - 1);
+
+        m_memoryCache = boost::make_shared<OcTreeCache>(m_tileArchive, cube(cacheGridWidth));
+    }
+}
+
+std::string
+DynocMap::getTileName(double resolution, int treeHeight,
+                      const Eigen::Vector3i& tileCenter) const
+{
+    std::ostringstream oss;
     oss.setf(std::ios::fixed, std::ios::floatfield);
     oss.precision(3);
     oss << "node_" << resolution << "_" << treeHeight << "_"
-        << tileCenter(0) << "_" << tileCenter(1) << "_" << tileCenter(2) << ".dat";
+        << tileCenter(0) << "_" << tileCenter(1) << "_" << tileCenter(2);
 
     return oss.str();
 }
@@ -833,9 +1440,8 @@ void
 DynocMap::loadTile(OcTreePtr& tile,
                    const Eigen::Vector3i& tileCenterGridCoords) const
 {
-    std::string tileFilename;
-    tileFilename = getTileFilename(m_resolution, m_tileTreeHeight,
-                                   tileCenterGridCoords, m_diskCacheDir);
+    std::string tileName;
+    tileName = getTileName(m_resolution, m_tileTreeHeight, tileCenterGridCoords);
 
     if (!m_memoryCache)
     {
@@ -845,14 +1451,14 @@ DynocMap::loadTile(OcTreePtr& tile,
                                               tileCenterGridCoords);
         }
 
-        if (boost::filesystem::exists(tileFilename))
+        if (m_tileArchive && m_tileArchive->contains(tileName))
         {
-            tile->read(tileFilename);
+            m_tileArchive->read(tileName, *tile);
         }
     }
     else
     {
-        tile = m_memoryCache->get(tileFilename);
+        tile = m_memoryCache->get(tileName);
 
         if (!tile)
         {
@@ -871,11 +1477,17 @@ DynocMap::unloadTile(OcTreePtr& tile,
         return;
     }
 
-    std::string tileFilename;
-    tileFilename = getTileFilename(m_resolution, m_tileTreeHeight,
-                                   tileCenterGridCoords, m_diskCacheDir);
+    std::string tileName;
+    tileName = getTileName(m_resolution, m_tileTreeHeight, tileCenterGridCoords);
 
-    m_memoryCache->cache(tileFilename, tile);
+    if (m_memoryCache)
+    {
+        m_memoryCache->cache(tileName, tile);
+    }
+    else if (m_tileArchive)
+    {
+        m_tileArchive->write(tileName, *tile);
+    }
 
     tile.reset();
 }
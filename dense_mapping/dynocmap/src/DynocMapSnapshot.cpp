@@ -0,0 +1,191 @@
+#include "dynocmap/DynocMapSnapshot.h"
+
+#include <cmath>
+#include <limits>
+
+#include "OcUtils.h"
+
+namespace px
+{
+
+DynocMapSnapshot::DynocMapSnapshot()
+ : m_epoch(0)
+{
+
+}
+
+unsigned int
+DynocMapSnapshot::epoch(void) const
+{
+    return m_epoch;
+}
+
+double
+DynocMapSnapshot::resolution(void) const
+{
+    if (!m_tree)
+    {
+        return 0.0;
+    }
+
+    return m_tree->resolution();
+}
+
+Eigen::Vector3d
+DynocMapSnapshot::center(void) const
+{
+    if (!m_tree)
+    {
+        return Eigen::Vector3d::Zero();
+    }
+
+    return m_tree->center();
+}
+
+double
+DynocMapSnapshot::mapWidth(void) const
+{
+    if (!m_tree)
+    {
+        return 0.0;
+    }
+
+    return m_tree->width();
+}
+
+DynocMapSnapshot::CellState
+DynocMapSnapshot::cellState(const Eigen::Vector3d& pos) const
+{
+    if (!m_tree)
+    {
+        return UNKNOWN;
+    }
+
+    return cellState(pointToGridCoords(pos, m_tree->resolution()));
+}
+
+DynocMapSnapshot::CellState
+DynocMapSnapshot::cellState(const Eigen::Vector3i& pos) const
+{
+    double logOdds;
+    if (!m_tree || !m_tree->leafLogOdds(pos, logOdds))
+    {
+        return UNKNOWN;
+    }
+
+    if (logOdds > m_tree->logOddsOccThresh())
+    {
+        return OCCUPIED;
+    }
+    else if (logOdds < 0.0)
+    {
+        return FREE;
+    }
+
+    return UNKNOWN;
+}
+
+bool
+DynocMapSnapshot::isOccupied(const Eigen::Vector3d& pos) const
+{
+    return cellState(pos) == OCCUPIED;
+}
+
+void
+DynocMapSnapshot::queryOccupancy(const std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> >& points,
+                                 std::vector<CellState>& states) const
+{
+    states.resize(points.size());
+
+    for (size_t i = 0; i < points.size(); ++i)
+    {
+        states.at(i) = cellState(points.at(i));
+    }
+}
+
+bool
+DynocMapSnapshot::raycastFirstHit(const Eigen::Vector3d& origin, const Eigen::Vector3d& direction,
+                                  double maxRange, Eigen::Vector3d& hit) const
+{
+    if (!m_tree || direction.norm() == 0.0)
+    {
+        return false;
+    }
+
+    double resolution = m_tree->resolution();
+
+    Eigen::Vector3d d = direction.normalized();
+    Eigen::Vector3i cell = pointToGridCoords(origin, resolution);
+
+    // distance along the ray to the next cell boundary, and between
+    // cell boundaries, for each axis
+    Eigen::Vector3i step;
+    Eigen::Vector3d tMax;
+    Eigen::Vector3d tDelta;
+    for (int i = 0; i < 3; ++i)
+    {
+        if (d(i) > 0.0)
+        {
+            step(i) = 1;
+            tMax(i) = ((cell(i) + 1) * resolution - origin(i)) / d(i);
+            tDelta(i) = resolution / d(i);
+        }
+        else if (d(i) < 0.0)
+        {
+            step(i) = -1;
+            tMax(i) = (cell(i) * resolution - origin(i)) / d(i);
+            tDelta(i) = -resolution / d(i);
+        }
+        else
+        {
+            step(i) = 0;
+            tMax(i) = std::numeric_limits<double>::infinity();
+            tDelta(i) = std::numeric_limits<double>::infinity();
+        }
+    }
+
+    double t = 0.0;
+    while (t <= maxRange)
+    {
+        if (cellState(cell) == OCCUPIED)
+        {
+            hit = gridCoordsToPoint(cell, resolution) +
+                  Eigen::Vector3d::Constant(resolution / 2.0);
+            return true;
+        }
+
+        int axis;
+        t = tMax.minCoeff(&axis);
+
+        cell(axis) += step(axis);
+        tMax(axis) += tDelta(axis);
+    }
+
+    return false;
+}
+
+bool
+DynocMapSnapshot::isBoxOccupied(const Eigen::Vector3d& boxMin, const Eigen::Vector3d& boxMax,
+                                bool unknownIsOccupied) const
+{
+    if (!m_tree)
+    {
+        return unknownIsOccupied;
+    }
+
+    return m_tree->isBoxOccupied(boxMin, boxMax, unknownIsOccupied);
+}
+
+bool
+DynocMapSnapshot::isSweptSphereOccupied(const Eigen::Vector3d& start, const Eigen::Vector3d& end,
+                                        double radius, bool unknownIsOccupied) const
+{
+    if (!m_tree)
+    {
+        return unknownIsOccupied;
+    }
+
+    return m_tree->isSweptSphereOccupied(start, end, radius, unknownIsOccupied);
+}
+
+}
@@ -1,40 +1,19 @@
 #include "dynocmap/OcNode.h"
 
-#include <boost/make_shared.hpp>
 #include <cmath>
 
 namespace px
 {
 
 OcNode::OcNode()
- : m_leaf(true)
- , m_child(8)
- , m_index(-1)
- , m_logOdds(0.0)
- , m_interimLogOdds(0.0)
- , m_isUpdated(false)
+ : m_children(0)
+ , m_logOdds(0.0f)
+ , m_interimLogOdds(0.0f)
+ , m_flags(0)
 {
 
 }
 
-OcNode::OcNode(OcNodePtr parent, int index)
- : m_leaf(true)
- , m_child(8)
- , m_parent(parent)
- , m_index(index)
- , m_logOdds(0.0)
- , m_interimLogOdds(0.0)
- , m_isUpdated(false)
-{
-
-}
-
-int
-OcNode::index(void) const
-{
-    return m_index;
-}
-
 void
 OcNode::setLogOdds(double logOdds)
 {
@@ -67,74 +46,46 @@ OcNode::getProbability(void) const
     return e / (1 + e);
 }
 
-void
-OcNode::split(void)
-{
-    if (m_leaf)
-    {
-        for (int i = 0; i < 8; ++i)
-        {
-            m_child.at(i) = boost::make_shared<OcNode>(sharedPtr(), i);
-        }
-        m_leaf = false;
-    }
-}
-
-bool
-OcNode::isLeaf(void) const
-{
-    return m_leaf;
-}
-
-std::vector<OcNodePtr>&
-OcNode::children(void)
-{
-    return m_child;
-}
-
-const std::vector<OcNodePtr>&
-OcNode::children(void) const
-{
-    return m_child;
-}
-
-OcNodePtr
-OcNode::child(int index) const
+double
+OcNode::getMaxLogOdds(void) const
 {
-    return m_child[index];
+    return m_logOdds;
 }
 
-void
-OcNode::setChild(int index, const OcNodePtr& childNode)
+double
+OcNode::getMinLogOdds(void) const
 {
-    m_child[index] = childNode;
+    if (isLeaf())
+    {
+        return m_logOdds;
+    }
 
-    childNode->m_parent = shared_from_this();
-    childNode->m_index = index;
+    return m_interimLogOdds;
 }
 
-OcNodeWPtr
-OcNode::parent(void) const
+bool
+OcNode::isLeaf(void) const
 {
-    return m_parent;
+    return m_children == 0;
 }
 
 void
 OcNode::setUpdated(bool updated)
 {
-    m_isUpdated = updated;
+    if (updated)
+    {
+        m_flags |= UPDATED;
+    }
+    else
+    {
+        m_flags &= ~UPDATED;
+    }
 }
 
 bool
 OcNode::isUpdated(void) const
 {
-    return m_isUpdated;
-}
-
-OcNodePtr
-OcNode::sharedPtr(void)
-{
-    return shared_from_this();
+    return (m_flags & UPDATED) != 0;
 }
 
 }
@@ -0,0 +1,73 @@
+#include "dynocmap/OcNodePool.h"
+
+#include <algorithm>
+
+namespace px
+{
+
+OcNodePool::OcNodePool(size_t maxBlocksPerChunk)
+ : k_maxBlocksPerChunk(maxBlocksPerChunk > 0 ? maxBlocksPerChunk : 1)
+ , m_chunkBlocks(0)
+ , m_chunkBlocksUsed(0)
+ , m_nBlocks(0)
+ , m_nBlocksReserved(0)
+ , m_modificationCount(0)
+{
+
+}
+
+OcNode*
+OcNodePool::root(void)
+{
+    return &m_root;
+}
+
+OcNode*
+OcNodePool::allocateChildren(void)
+{
+    if (m_chunkBlocksUsed == m_chunkBlocks)
+    {
+        // double the pool size with each chunk
+        m_chunkBlocks = std::min(std::max(m_nBlocksReserved, static_cast<size_t>(1)),
+                                 k_maxBlocksPerChunk);
+        m_chunkBlocksUsed = 0;
+
+        m_chunks.push_back(boost::shared_array<OcNode>(new OcNode[m_chunkBlocks * 8]));
+        m_nBlocksReserved += m_chunkBlocks;
+    }
+
+    OcNode* children = m_chunks.back().get() + m_chunkBlocksUsed * 8;
+
+    ++m_chunkBlocksUsed;
+    ++m_nBlocks;
+
+    return children;
+}
+
+size_t
+OcNodePool::nodeCount(void) const
+{
+    return 1 + m_nBlocks * 8;
+}
+
+size_t
+OcNodePool::memoryUsage(void) const
+{
+    return sizeof(OcNodePool) +
+           m_chunks.capacity() * sizeof(boost::shared_array<OcNode>) +
+           m_nBlocksReserved * 8 * sizeof(OcNode);
+}
+
+size_t
+OcNodePool::modificationCount(void) const
+{
+    return m_modificationCount;
+}
+
+void
+OcNodePool::markModified(void)
+{
+    ++m_modificationCount;
+}
+
+}
@@ -1,15 +1,244 @@
 #include "dynocmap/OcTree.h"
 
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/foreach.hpp>
 #include <boost/make_shared.hpp>
 #include <cmath>
 #include <cstdio>
+#include <cstring>
 #include <eigen_conversions/eigen_msg.h>
+#include <limits>
 
 #include "OcUtils.h"
+#include "cauldron/ThreadPool.h"
 
 const size_t kHeaderSize = sizeof(double) * 4 + sizeof(int) * 4;
 
+// The compressed encoding starts with a magic number and a version, which
+// cannot be mistaken for the resolution at the start of the plain encoding.
+const char kCompressedMagic[4] = {'O', 'C', 'T', 'Z'};
+const unsigned char kCompressedVersion = 1;
+
+namespace
+{
+
+template<typename T>
+void
+appendValue(std::vector<char>& data, const T& value)
+{
+    const char* bytes = reinterpret_cast<const char*>(&value);
+    data.insert(data.end(), bytes, bytes + sizeof(T));
+}
+
+template<typename T>
+bool
+extractValue(const char* data, size_t size, size_t& mark, T& value)
+{
+    if (mark + sizeof(T) > size)
+    {
+        return false;
+    }
+
+    memcpy(&value, data + mark, sizeof(T));
+    mark += sizeof(T);
+
+    return true;
+}
+
+// unsigned LEB128
+void
+appendVarint(std::vector<char>& data, boost::uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        data.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    data.push_back(static_cast<char>(value));
+}
+
+bool
+extractVarint(const char* data, size_t size, size_t& mark, boost::uint32_t& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 35; shift += 7)
+    {
+        if (mark >= size)
+        {
+            return false;
+        }
+
+        unsigned char byte = static_cast<unsigned char>(data[mark++]);
+        value |= static_cast<boost::uint32_t>(byte & 0x7F) << shift;
+
+        if ((byte & 0x80) == 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Predicate for partitioning grid coordinates along an axis.
+class CoordsBelow
+{
+public:
+    CoordsBelow(int _axis, int _value)
+     : axis(_axis)
+     , value(_value)
+    {
+
+    }
+
+    bool operator()(const Eigen::Vector3i& coords) const
+    {
+        return coords(axis) < value;
+    }
+
+    int axis;
+    int value;
+};
+
+// Squared distance between the segment from p0 to p1 and an axis-aligned box.
+double
+segmentBoxSquaredDistance(const Eigen::Vector3d& p0, const Eigen::Vector3d& p1,
+                          const Eigen::Vector3d& boxMin, const Eigen::Vector3d& boxMax)
+{
+    Eigen::Vector3d d = p1 - p0;
+
+    // between the points at which the segment crosses the planes of the
+    // box, the squared distance is a quadratic function of the segment
+    // parameter
+    std::vector<double> ts;
+    ts.push_back(0.0);
+    ts.push_back(1.0);
+    for (int i = 0; i < 3; ++i)
+    {
+        if (d(i) == 0.0)
+        {
+            continue;
+        }
+
+        double t = (boxMin(i) - p0(i)) / d(i);
+        if (t > 0.0 && t < 1.0)
+        {
+            ts.push_back(t);
+        }
+
+        t = (boxMax(i) - p0(i)) / d(i);
+        if (t > 0.0 && t < 1.0)
+        {
+            ts.push_back(t);
+        }
+    }
+    std::sort(ts.begin(), ts.end());
+
+    double minDistance2 = std::numeric_limits<double>::max();
+    for (size_t k = 0; k + 1 < ts.size(); ++k)
+    {
+        double tm = 0.5 * (ts.at(k) + ts.at(k + 1));
+
+        // f(t) = a t^2 + b t + c
+        double a = 0.0;
+        double b = 0.0;
+        double c = 0.0;
+        for (int i = 0; i < 3; ++i)
+        {
+            double p = p0(i) + tm * d(i);
+
+            double bound;
+            if (p < boxMin(i))
+            {
+                bound = boxMin(i);
+            }
+            else if (p > boxMax(i))
+            {
+                bound = boxMax(i);
+            }
+            else
+            {
+                continue;
+            }
+
+            double e = p0(i) - bound;
+            a += d(i) * d(i);
+            b += 2.0 * e * d(i);
+            c += e * e;
+        }
+
+        double t = ts.at(k);
+        if (a > 0.0)
+        {
+            t = std::min(std::max(-b / (2.0 * a), ts.at(k)), ts.at(k + 1));
+        }
+
+        minDistance2 = std::min(minDistance2, (a * t + b) * t + c);
+    }
+
+    return std::max(minDistance2, 0.0);
+}
+
+class BoxRegion
+{
+public:
+    BoxRegion(const Eigen::Vector3d& _boxMin, const Eigen::Vector3d& _boxMax)
+     : boxMin(_boxMin)
+     , boxMax(_boxMax)
+    {
+
+    }
+
+    bool intersects(const Eigen::Vector3d& cornerMin, const Eigen::Vector3d& cornerMax) const
+    {
+        return (boxMin.array() < cornerMax.array()).all() &&
+               (boxMax.array() > cornerMin.array()).all();
+    }
+
+    bool isWithin(const Eigen::Vector3d& cornerMin, const Eigen::Vector3d& cornerMax) const
+    {
+        return (boxMin.array() >= cornerMin.array()).all() &&
+               (boxMax.array() <= cornerMax.array()).all();
+    }
+
+    Eigen::Vector3d boxMin;
+    Eigen::Vector3d boxMax;
+};
+
+class CapsuleRegion
+{
+public:
+    CapsuleRegion(const Eigen::Vector3d& _start, const Eigen::Vector3d& _end,
+                  double _radius)
+     : start(_start)
+     , end(_end)
+     , radius(_radius)
+    {
+
+    }
+
+    bool intersects(const Eigen::Vector3d& cornerMin, const Eigen::Vector3d& cornerMax) const
+    {
+        return segmentBoxSquaredDistance(start, end, cornerMin, cornerMax) < radius * radius;
+    }
+
+    bool isWithin(const Eigen::Vector3d& cornerMin, const Eigen::Vector3d& cornerMax) const
+    {
+        Eigen::Vector3d r = Eigen::Vector3d::Constant(radius);
+
+        return (start.cwiseMin(end) - r).cwiseMax(cornerMin) == start.cwiseMin(end) - r &&
+               (start.cwiseMax(end) + r).cwiseMin(cornerMax) == start.cwiseMax(end) + r;
+    }
+
+    Eigen::Vector3d start;
+    Eigen::Vector3d end;
+    double radius;
+};
+
+}
+
 const double LOGODDS_MAX = 3.5;
 const double LOGODDS_MIN = -2.0;
 const double LOGODDS_OCC_THRESH = 1.5;
@@ -20,11 +249,14 @@ namespace px
 OcTree::OcTree()
  : m_resolution(0.0)
  , m_treeHeight(1)
- , m_root(boost::make_shared<OcNode>())
+ , m_pool(boost::make_shared<OcNodePool>())
  , m_logOddsMax(LOGODDS_MAX)
  , m_logOddsMin(LOGODDS_MIN)
  , m_logOddsOccThresh(LOGODDS_OCC_THRESH)
  , m_batchUpdate(false)
+ , m_tTraversal(0.0)
+ , m_tMerge(0.0)
+ , m_tUpdate(0.0)
 {
     m_center.setZero();
 }
@@ -33,11 +265,14 @@ OcTree::OcTree(double resolution, int treeHeight,
                const Eigen::Vector3d& center)
  : m_resolution(resolution)
  , m_treeHeight(treeHeight)
- , m_root(boost::make_shared<OcNode>())
+ , m_pool(boost::make_shared<OcNodePool>())
  , m_logOddsMax(LOGODDS_MAX)
  , m_logOddsMin(LOGODDS_MIN)
  , m_logOddsOccThresh(LOGODDS_OCC_THRESH)
  , m_batchUpdate(false)
+ , m_tTraversal(0.0)
+ , m_tMerge(0.0)
+ , m_tUpdate(0.0)
 {
     m_center = pointToGridCoords(center, m_resolution);
 }
@@ -46,11 +281,14 @@ OcTree::OcTree(double resolution, int treeHeight,
                const Eigen::Vector3i& center)
  : m_resolution(resolution)
  , m_treeHeight(treeHeight)
- , m_root(boost::make_shared<OcNode>())
+ , m_pool(boost::make_shared<OcNodePool>())
  , m_logOddsMax(LOGODDS_MAX)
  , m_logOddsMin(LOGODDS_MIN)
  , m_logOddsOccThresh(LOGODDS_OCC_THRESH)
  , m_batchUpdate(false)
+ , m_tTraversal(0.0)
+ , m_tMerge(0.0)
+ , m_tUpdate(0.0)
 {
     m_center = center;
 }
@@ -62,6 +300,9 @@ OcTree::OcTree(const Eigen::Vector3i& center,
  , m_logOddsMin(LOGODDS_MIN)
  , m_logOddsOccThresh(LOGODDS_OCC_THRESH)
  , m_batchUpdate(false)
+ , m_tTraversal(0.0)
+ , m_tMerge(0.0)
+ , m_tUpdate(0.0)
 {
     int parentTreeHeight = static_cast<int>(log2(subTrees.size())) / 3 + 1;
 
@@ -71,25 +312,29 @@ OcTree::OcTree(const Eigen::Vector3i& center,
 
     if (subTrees.size() == 1)
     {
-        m_root = subTrees.at(0)->m_root;
+        m_pool = subTrees.at(0)->m_pool;
     }
     else
     {
-        m_root = boost::make_shared<OcNode>();
+        m_pool = boost::make_shared<OcNodePool>();
 
-        std::vector<OcNodePtr> tileTrees;
-        tileTrees.push_back(m_root);
+        std::vector<OcNode*> tileTrees;
+        tileTrees.push_back(m_pool->root());
         for (int i = 0; i < parentTreeHeight - 1; ++i)
         {
-            std::vector<OcNodePtr> nodesToSplit = tileTrees;
+            std::vector<OcNode*> nodesToSplit = tileTrees;
             tileTrees.clear();
 
             for (size_t j = 0; j < nodesToSplit.size(); ++j)
             {
-                nodesToSplit.at(j)->split();
+                OcNode* node = nodesToSplit.at(j);
+
+                split(node, m_pool.get());
 
-                std::vector<OcNodePtr>& children = nodesToSplit.at(j)->children();
-                tileTrees.insert(tileTrees.end(), children.begin(), children.end());
+                for (int k = 0; k < 8; ++k)
+                {
+                    tileTrees.push_back(node->m_children + k);
+                }
             }
         }
 
@@ -97,12 +342,16 @@ OcTree::OcTree(const Eigen::Vector3i& center,
         {
             const OcTreePtr& tile = subTrees.at(i);
 
+            // the placeholder node links to the root of the tile
             OcNodePtr node = findNode(tile->m_center, parentTreeHeight - 1);
-            OcNodePtr parent = node->parent().lock();
-
-            parent->setChild(node->index(), tile->m_root);
+            node->m_link = tile.get();
+            node->m_flags |= OcNode::LINK;
         }
+
+        updateSubtreeSummaries(m_pool->root());
     }
+
+    m_subTrees = subTrees;
 }
 
 OcNodePtr
@@ -121,6 +370,42 @@ OcTree::insertNode(const Eigen::Vector3d& pos)
 
 OcNodePtr
 OcTree::insertNode(const Eigen::Vector3i& pos)
+{
+    OcNodePool* pool = 0;
+    OcNode* node = insertLeaf(pos, pool);
+    if (node == 0)
+    {
+        return OcNodePtr();
+    }
+
+    // the node is handed out to be updated
+    pool->markModified();
+
+    return nodePtr(node, pool);
+}
+
+boost::uint64_t
+OcTree::leafKey(const Eigen::Vector3i& pos) const
+{
+    Eigen::Vector3i coords = pos - m_center + Eigen::Vector3i::Constant(gridWidth() / 2);
+
+    return (static_cast<boost::uint64_t>(coords(0)) << 42) |
+           (static_cast<boost::uint64_t>(coords(1)) << 21) |
+           static_cast<boost::uint64_t>(coords(2));
+}
+
+Eigen::Vector3i
+OcTree::leafCoords(boost::uint64_t key) const
+{
+    Eigen::Vector3i coords(static_cast<int>((key >> 42) & 0x1fffff),
+                           static_cast<int>((key >> 21) & 0x1fffff),
+                           static_cast<int>(key & 0x1fffff));
+
+    return coords + m_center - Eigen::Vector3i::Constant(gridWidth() / 2);
+}
+
+OcNode*
+OcTree::insertLeaf(const Eigen::Vector3i& pos, OcNodePool*& pool)
 {
     Eigen::Vector3i coords = pos - m_center;
 
@@ -130,23 +415,25 @@ OcTree::insertNode(const Eigen::Vector3i& pos)
         coords(1) < -halfWidth || coords(1) >= halfWidth ||
         coords(2) < -halfWidth || coords(2) >= halfWidth)
     {
-        return OcNodePtr();
+        return 0;
     }
 
     int depth = 0;
     Eigen::Vector3i nodeCoords = Eigen::Vector3i::Constant(-halfWidth);
 
-    OcNodePtr node = m_root;
+    pool = m_pool.get();
+    OcNode* node = pool->root();
     int halfOctantWidth = halfWidth;
     while (depth < m_treeHeight - 1)
     {
         if (node->isLeaf())
         {
-            node->split();
+            split(node, pool);
         }
 
-        node = node->child(childIndex(coords,
-                                      nodeCoords + Eigen::Vector3i::Constant(halfOctantWidth)));
+        node = node->m_children + childIndex(coords,
+                                             nodeCoords + Eigen::Vector3i::Constant(halfOctantWidth));
+        resolveLink(node, pool);
 
         if (coords(0) >= nodeCoords(0) + halfOctantWidth)
         {
@@ -184,6 +471,277 @@ OcTree::findNode(const Eigen::Vector3d& pos, int maxDepth)
 
 OcNodePtr
 OcTree::findNode(const Eigen::Vector3i& pos, int maxDepth)
+{
+    OcNodePool* pool = 0;
+    OcNode* node = lookupNode(pos, maxDepth, pool);
+    if (node == 0)
+    {
+        return OcNodePtr();
+    }
+
+    return nodePtr(node, pool);
+}
+
+bool
+OcTree::leafLogOdds(const Eigen::Vector3i& pos, double& logOdds) const
+{
+    OcNodePool* pool = 0;
+    const OcNode* node = lookupNode(pos, -1, pool);
+    if (node == 0)
+    {
+        return false;
+    }
+
+    logOdds = node->getLogOdds();
+
+    return true;
+}
+
+OcTreePtr
+OcTree::clone(void) const
+{
+    OcTreePtr tree;
+
+    if (m_subTrees.size() > 1)
+    {
+        std::vector<OcTreePtr> subTrees;
+        subTrees.reserve(m_subTrees.size());
+
+        for (size_t i = 0; i < m_subTrees.size(); ++i)
+        {
+            subTrees.push_back(m_subTrees.at(i)->clone());
+        }
+
+        tree = boost::make_shared<OcTree>(m_center, subTrees);
+    }
+    else
+    {
+        tree = boost::make_shared<OcTree>(m_resolution, m_treeHeight, m_center);
+
+        std::vector<std::pair<const OcNode*, OcNode*> > queue;
+        queue.push_back(std::make_pair(m_pool->root(), tree->m_pool->root()));
+
+        while (!queue.empty())
+        {
+            const OcNode* src = queue.back().first;
+            OcNode* dst = queue.back().second;
+            queue.pop_back();
+
+            dst->setLogOdds(src->getLogOdds());
+            dst->setInterimLogOdds(src->getInterimLogOdds());
+
+            if (!src->isLeaf())
+            {
+                split(dst, tree->m_pool.get());
+
+                for (int i = 0; i < 8; ++i)
+                {
+                    queue.push_back(std::make_pair(src->m_children + i, dst->m_children + i));
+                }
+            }
+        }
+    }
+
+    tree->m_logOddsMax = m_logOddsMax;
+    tree->m_logOddsMin = m_logOddsMin;
+    tree->m_logOddsOccThresh = m_logOddsOccThresh;
+
+    return tree;
+}
+
+bool
+OcTree::isBoxOccupied(const Eigen::Vector3d& boxMin, const Eigen::Vector3d& boxMax,
+                      bool unknownIsOccupied) const
+{
+    return isRegionOccupied(BoxRegion(boxMin, boxMax), unknownIsOccupied);
+}
+
+bool
+OcTree::isSweptSphereOccupied(const Eigen::Vector3d& start, const Eigen::Vector3d& end,
+                              double radius, bool unknownIsOccupied) const
+{
+    return isRegionOccupied(CapsuleRegion(start, end, radius), unknownIsOccupied);
+}
+
+void
+OcTree::updateSummaries(void)
+{
+    if (m_subTrees.size() > 1)
+    {
+        for (size_t i = 0; i < m_subTrees.size(); ++i)
+        {
+            m_subTrees.at(i)->updateSummaries();
+        }
+    }
+
+    updateSubtreeSummaries(m_pool->root());
+}
+
+void
+OcTree::updateSummaries(const Eigen::Vector3i& pos)
+{
+    std::vector<Eigen::Vector3i> leafCoords(1, pos);
+
+    updatePathSummaries(leafCoords);
+}
+
+template<typename Region>
+bool
+OcTree::isRegionOccupied(const Region& region, bool unknownIsOccupied) const
+{
+    Eigen::Vector3i rootCoords = m_center - Eigen::Vector3i::Constant(gridWidth() / 2);
+
+    // space outside the tree has not been observed
+    if (unknownIsOccupied &&
+        !region.isWithin(gridCoordsToPoint(rootCoords, m_resolution),
+                         gridCoordsToPoint(rootCoords, m_resolution) + Eigen::Vector3d::Constant(width())))
+    {
+        return true;
+    }
+
+    std::vector<std::pair<LabeledNode, int> > stack;
+    stack.push_back(std::make_pair(LabeledNode(m_pool->root(), rootCoords), gridWidth()));
+
+    while (!stack.empty())
+    {
+        LabeledNode node = stack.back().first;
+        int nodeWidth = stack.back().second;
+        stack.pop_back();
+
+        Eigen::Vector3d cornerMin = gridCoordsToPoint(node.coords, m_resolution);
+        Eigen::Vector3d cornerMax = cornerMin + Eigen::Vector3d::Constant(nodeWidth * m_resolution);
+
+        if (!region.intersects(cornerMin, cornerMax))
+        {
+            continue;
+        }
+
+        // a node is skipped if none of its leafs is occupied, and is in
+        // collision if all of its leafs are occupied
+        if (!isOccupied(node.node->getMaxLogOdds(), unknownIsOccupied))
+        {
+            continue;
+        }
+
+        if (isOccupied(node.node->getMinLogOdds(), unknownIsOccupied))
+        {
+            return true;
+        }
+
+        for (int i = 0; i < 8; ++i)
+        {
+            stack.push_back(std::make_pair(LabeledNode(child(node.node, i),
+                                                       childCoords(node.coords, i, nodeWidth)),
+                                           nodeWidth / 2));
+        }
+    }
+
+    return false;
+}
+
+bool
+OcTree::isOccupied(double logOdds, bool unknownIsOccupied) const
+{
+    if (unknownIsOccupied)
+    {
+        return logOdds >= 0.0;
+    }
+
+    return logOdds > m_logOddsOccThresh;
+}
+
+void
+OcTree::updateNodeSummary(OcNode* node) const
+{
+    double maxLogOdds = -std::numeric_limits<double>::max();
+    double minLogOdds = std::numeric_limits<double>::max();
+
+    for (int i = 0; i < 8; ++i)
+    {
+        const OcNode* c = child(node, i);
+
+        maxLogOdds = std::max(maxLogOdds, c->getMaxLogOdds());
+        minLogOdds = std::min(minLogOdds, c->getMinLogOdds());
+    }
+
+    node->setLogOdds(maxLogOdds);
+    node->setInterimLogOdds(minLogOdds);
+}
+
+void
+OcTree::updateSubtreeSummaries(OcNode* node) const
+{
+    if (node->isLeaf())
+    {
+        return;
+    }
+
+    for (int i = 0; i < 8; ++i)
+    {
+        // sub-trees keep their own summaries
+        OcNode* c = node->m_children + i;
+        if (!(c->m_flags & OcNode::LINK))
+        {
+            updateSubtreeSummaries(c);
+        }
+    }
+
+    updateNodeSummary(node);
+}
+
+void
+OcTree::updatePathSummaries(std::vector<Eigen::Vector3i>& leafCoords)
+{
+    if (leafCoords.empty())
+    {
+        return;
+    }
+
+    updatePathSummaries(m_pool->root(), m_center - Eigen::Vector3i::Constant(gridWidth() / 2),
+                        gridWidth(), leafCoords.begin(), leafCoords.end());
+}
+
+void
+OcTree::updatePathSummaries(OcNode* node, const Eigen::Vector3i& nodeCoords, int nodeWidth,
+                            std::vector<Eigen::Vector3i>::iterator first,
+                            std::vector<Eigen::Vector3i>::iterator last) const
+{
+    if (node->isLeaf())
+    {
+        return;
+    }
+
+    int halfWidth = nodeWidth / 2;
+
+    // split the leafs between the children, in the order of the child
+    // indices
+    std::vector<Eigen::Vector3i>::iterator bounds[9];
+    bounds[0] = first;
+    bounds[8] = last;
+    bounds[4] = std::partition(first, last, CoordsBelow(0, nodeCoords(0) + halfWidth));
+    for (int i = 0; i < 8; i += 4)
+    {
+        bounds[i + 2] = std::partition(bounds[i], bounds[i + 4], CoordsBelow(1, nodeCoords(1) + halfWidth));
+    }
+    for (int i = 0; i < 8; i += 2)
+    {
+        bounds[i + 1] = std::partition(bounds[i], bounds[i + 2], CoordsBelow(2, nodeCoords(2) + halfWidth));
+    }
+
+    for (int i = 0; i < 8; ++i)
+    {
+        if (bounds[i] != bounds[i + 1])
+        {
+            updatePathSummaries(child(node, i), childCoords(nodeCoords, i, nodeWidth), halfWidth,
+                                bounds[i], bounds[i + 1]);
+        }
+    }
+
+    updateNodeSummary(node);
+}
+
+OcNode*
+OcTree::lookupNode(const Eigen::Vector3i& pos, int maxDepth, OcNodePool*& pool) const
 {
     Eigen::Vector3i coords = pos - m_center;
 
@@ -193,7 +751,7 @@ OcTree::findNode(const Eigen::Vector3i& pos, int maxDepth)
         coords(1) < -halfWidth || coords(1) >= halfWidth ||
         coords(2) < -halfWidth || coords(2) >= halfWidth)
     {
-        return OcNodePtr();
+        return 0;
     }
 
     int depth = 0;
@@ -205,17 +763,19 @@ OcTree::findNode(const Eigen::Vector3i& pos, int maxDepth)
     int halfOctantWidth = gridWidth() / 2;
     Eigen::Vector3i nodeCoords = Eigen::Vector3i::Constant(-halfOctantWidth);
 
-    OcNodePtr node = m_root;
+    pool = m_pool.get();
+    OcNode* node = pool->root();
     while (depth < maxDepth)
     {
         if (node->isLeaf())
         {
-            return OcNodePtr();
+            return 0;
         }
         else
         {
-            node = node->child(childIndex(coords,
-                                          nodeCoords + Eigen::Vector3i::Constant(halfOctantWidth)));
+            node = node->m_children + childIndex(coords,
+                                                 nodeCoords + Eigen::Vector3i::Constant(halfOctantWidth));
+            resolveLink(node, pool);
 
             if (coords(0) >= nodeCoords(0) + halfOctantWidth)
             {
@@ -247,6 +807,51 @@ OcTree::maximumLeafCount(void) const
     return count;
 }
 
+size_t
+OcTree::nodeCount(void) const
+{
+    size_t count = m_pool->nodeCount();
+    if (m_subTrees.size() > 1)
+    {
+        for (size_t i = 0; i < m_subTrees.size(); ++i)
+        {
+            count += m_subTrees.at(i)->nodeCount();
+        }
+    }
+
+    return count;
+}
+
+size_t
+OcTree::modificationCount(void) const
+{
+    size_t count = m_pool->modificationCount();
+    if (m_subTrees.size() > 1)
+    {
+        for (size_t i = 0; i < m_subTrees.size(); ++i)
+        {
+            count += m_subTrees.at(i)->modificationCount();
+        }
+    }
+
+    return count;
+}
+
+size_t
+OcTree::memoryUsage(void) const
+{
+    size_t bytes = m_pool->memoryUsage();
+    if (m_subTrees.size() > 1)
+    {
+        for (size_t i = 0; i < m_subTrees.size(); ++i)
+        {
+            bytes += m_subTrees.at(i)->memoryUsage();
+        }
+    }
+
+    return bytes;
+}
+
 std::vector<OccupancyCell, Eigen::aligned_allocator<OccupancyCell> >
 OcTree::leafs(void) const
 {
@@ -256,7 +861,7 @@ OcTree::leafs(void) const
     std::vector<LabeledNode> queue;
     queue.reserve(maximumLeafCount());
 
-    LabeledNode rootNode(m_root, Eigen::Vector3i::Constant(-halfOctantWidth) + m_center);
+    LabeledNode rootNode(m_pool->root(), Eigen::Vector3i::Constant(-halfOctantWidth) + m_center);
     queue.push_back(rootNode);
 
     while (depth < m_treeHeight - 1 && !queue.empty())
@@ -272,7 +877,7 @@ OcTree::leafs(void) const
             {
                 for (int i = 0; i < 8; ++i)
                 {
-                    LabeledNode newNode(node.node->child(i), node.coords);
+                    LabeledNode newNode(child(node.node, i), node.coords);
 
                     if ((i & 0x4) == 0x4)
                     {
@@ -327,7 +932,7 @@ OcTree::obstacles(void) const
     std::vector<LabeledNode> queue;
     queue.reserve(maximumLeafCount());
 
-    LabeledNode rootNode(m_root, Eigen::Vector3i::Constant(-halfOctantWidth) + m_center);
+    LabeledNode rootNode(m_pool->root(), Eigen::Vector3i::Constant(-halfOctantWidth) + m_center);
 
     queue.push_back(rootNode);
 
@@ -344,7 +949,7 @@ OcTree::obstacles(void) const
             {
                 for (int i = 0; i < 8; ++i)
                 {
-                    LabeledNode newNode(node.node->child(i), node.coords);
+                    LabeledNode newNode(child(node.node, i), node.coords);
 
                     if ((i & 0x4) == 0x4)
                     {
@@ -517,23 +1122,50 @@ OcTree::castRay(const Eigen::Matrix4d& sensorPose, const Eigen::Vector3d& endpoi
                 Frame frame, SensorModelPtr& sensorModel)
 {
     Eigen::Vector3d endpointLocal;
-    Eigen::Vector3d endpointGlobal;
 
     if (frame == GLOBAL_FRAME)
     {
         endpointLocal = sensorPose.block<3,3>(0,0).transpose() * (endpoint - sensorPose.block<3,1>(0,3));
-        endpointGlobal = endpoint;
     }
     else
     {
         endpointLocal = endpoint;
-        endpointGlobal = sensorPose.block<3,3>(0,0) * endpoint + sensorPose.block<3,1>(0,3);
     }
 
+    std::vector<TraversalNode> leafs;
+    std::vector<double> logOdds;
+    traceRay(sensorPose, endpointLocal, *sensorModel, true, leafs, logOdds);
+
+    std::vector<Eigen::Vector3i> leafCoords;
+    leafCoords.reserve(leafs.size());
+
+    for (size_t i = 0; i < leafs.size(); ++i)
+    {
+        updateLeaf(leafs.at(i).node, leafs.at(i).pool, leafs.at(i).gridCoords, logOdds.at(i));
+
+        leafCoords.push_back(leafs.at(i).gridCoords);
+    }
+
+    if (!m_batchUpdate)
+    {
+        updatePathSummaries(leafCoords);
+    }
+}
+
+void
+OcTree::traceRay(const Eigen::Matrix4d& sensorPose, const Eigen::Vector3d& endpointLocal,
+                 SensorModel& sensorModel, bool createNodes,
+                 std::vector<TraversalNode>& leafs, std::vector<double>& logOdds)
+{
+    leafs.clear();
+    logOdds.clear();
+
+    Eigen::Vector3d endpointGlobal = sensorPose.block<3,3>(0,0) * endpointLocal + sensorPose.block<3,1>(0,3);
+
     bool isEndpointObstacle = false;
-    if (endpointLocal.norm() <= sensorModel->maxRange())
+    if (endpointLocal.norm() <= sensorModel.maxRange())
     {
-        sensorModel->setObstacle(endpointLocal);
+        sensorModel.setObstacle(endpointLocal);
         isEndpointObstacle = true;
     }
 
@@ -546,11 +1178,11 @@ OcTree::castRay(const Eigen::Matrix4d& sensorPose, const Eigen::Vector3d& endpoi
     double maxLength = 0.0;
     if (isEndpointObstacle)
     {
-        maxLength = sensorModel->validRange();
+        maxLength = sensorModel.validRange();
     }
     else
     {
-        maxLength = sensorModel->maxRange();
+        maxLength = sensorModel.maxRange();
     }
 
     Eigen::Vector3d cornerMin = center() - Eigen::Vector3d::Constant(width() / 2.0);
@@ -586,12 +1218,21 @@ OcTree::castRay(const Eigen::Matrix4d& sensorPose, const Eigen::Vector3d& endpoi
 
     std::vector<TraversalNode> queue;
     queue.reserve(1000);
-    queue.push_back(TraversalNode(t0, t1, m_root, rootGridCoords));
+    if (createNodes)
+    {
+        queue.push_back(TraversalNode(t0, t1, m_pool->root(), m_pool.get(), rootGridCoords));
+    }
+    else
+    {
+        queue.push_back(TraversalNode(t0, t1, 0, 0, rootGridCoords));
+    }
+
+    std::vector<TraversalNode> nodes;
 
     int depth = 0;
     while (depth < m_treeHeight - 1)
     {
-        std::vector<TraversalNode> nodes = queue;
+        nodes.swap(queue);
         queue.clear();
 
         for (std::vector<TraversalNode>::iterator it = nodes.begin();
@@ -599,7 +1240,8 @@ OcTree::castRay(const Eigen::Matrix4d& sensorPose, const Eigen::Vector3d& endpoi
         {
             Eigen::Vector3d& t0 = it->t0;
             Eigen::Vector3d& t1 = it->t1;
-            OcNodePtr& node = it->node;
+            OcNode* node = it->node;
+            OcNodePool* pool = it->pool;
             const Eigen::Vector3i& nodeGridCoords = it->gridCoords;
 
             if (t1.minCoeff() < 0.0 || t0.maxCoeff() > maxLength)
@@ -607,9 +1249,17 @@ OcTree::castRay(const Eigen::Matrix4d& sensorPose, const Eigen::Vector3d& endpoi
                 continue;
             }
 
-            if (node->isLeaf())
+            OcNode* children = 0;
+            if (createNodes)
             {
-                node->split();
+                resolveLink(node, pool);
+
+                if (node->isLeaf())
+                {
+                    split(node, pool);
+                }
+
+                children = node->m_children;
             }
 
             Eigen::Vector3d tm = 0.5 * (t0 + t1);
@@ -621,7 +1271,7 @@ OcTree::castRay(const Eigen::Matrix4d& sensorPose, const Eigen::Vector3d& endpoi
                 {
                 case 0:
                     queue.push_back(TraversalNode(t0, tm,
-                                                  node->child(a),
+                                                  children ? children + a : 0, pool,
                                                   childCoords(nodeGridCoords, a, octantWidth)));
                     currNode = getNextIntersectedNode(tm, 4, 2, 1);
                     break;
@@ -631,7 +1281,7 @@ OcTree::castRay(const Eigen::Matrix4d& sensorPose, const Eigen::Vector3d& endpoi
 
                     queue.push_back(TraversalNode(Eigen::Vector3d(t0(0), t0(1), tm(2)),
                                                   t1_next,
-                                                  node->child(1^a),
+                                                  children ? children + (1^a) : 0, pool,
                                                   childCoords(nodeGridCoords, 1^a, octantWidth)));
                     currNode = getNextIntersectedNode(t1_next, 5, 3, 8);
                     break;
@@ -642,7 +1292,7 @@ OcTree::castRay(const Eigen::Matrix4d& sensorPose, const Eigen::Vector3d& endpoi
 
                     queue.push_back(TraversalNode(Eigen::Vector3d(t0(0), tm(1), t0(2)),
                                                   t1_next,
-                                                  node->child(2^a),
+                                                  children ? children + (2^a) : 0, pool,
                                                   childCoords(nodeGridCoords, 2^a, octantWidth)));
                     currNode = getNextIntersectedNode(t1_next, 6, 8, 3);
                     break;
@@ -653,7 +1303,7 @@ OcTree::castRay(const Eigen::Matrix4d& sensorPose, const Eigen::Vector3d& endpoi
 
                     queue.push_back(TraversalNode(Eigen::Vector3d(t0(0), tm(1), tm(2)),
                                                   t1_next,
-                                                  node->child(3^a),
+                                                  children ? children + (3^a) : 0, pool,
                                                   childCoords(nodeGridCoords, 3^a, octantWidth)));
                     currNode = getNextIntersectedNode(t1_next, 7, 8, 8);
                     break;
@@ -664,7 +1314,7 @@ OcTree::castRay(const Eigen::Matrix4d& sensorPose, const Eigen::Vector3d& endpoi
 
                     queue.push_back(TraversalNode(Eigen::Vector3d(tm(0), t0(1), t0(2)),
                                                   t1_next,
-                                                  node->child(4^a),
+                                                  children ? children + (4^a) : 0, pool,
                                                   childCoords(nodeGridCoords, 4^a, octantWidth)));
                     currNode = getNextIntersectedNode(t1_next, 8, 6, 5);
                     break;
@@ -675,7 +1325,7 @@ OcTree::castRay(const Eigen::Matrix4d& sensorPose, const Eigen::Vector3d& endpoi
 
                     queue.push_back(TraversalNode(Eigen::Vector3d(tm(0), t0(1), tm(2)),
                                                   t1_next,
-                                                  node->child(5^a),
+                                                  children ? children + (5^a) : 0, pool,
                                                   childCoords(nodeGridCoords, 5^a, octantWidth)));
                     currNode = getNextIntersectedNode(t1_next, 8, 7, 8);
                     break;
@@ -686,14 +1336,14 @@ OcTree::castRay(const Eigen::Matrix4d& sensorPose, const Eigen::Vector3d& endpoi
 
                     queue.push_back(TraversalNode(Eigen::Vector3d(tm(0), tm(1), t0(2)),
                                                   t1_next,
-                                                  node->child(6^a),
+                                                  children ? children + (6^a) : 0, pool,
                                                   childCoords(nodeGridCoords, 6^a, octantWidth)));
                     currNode = getNextIntersectedNode(t1_next, 8, 8, 7);
                     break;
                 }
                 case 7:
                     queue.push_back(TraversalNode(tm, t1,
-                                                  node->child(7^a),
+                                                  children ? children + (7^a) : 0, pool,
                                                   childCoords(nodeGridCoords, 7^a, octantWidth)));
                     currNode = 8;
                     break;
@@ -707,47 +1357,104 @@ OcTree::castRay(const Eigen::Matrix4d& sensorPose, const Eigen::Vector3d& endpoi
         ++depth;
     }
 
-    for (std::vector<TraversalNode>::iterator it = queue.begin();
-         it != queue.end(); ++it)
+    // keep only the leafs within range of the sensor
+    size_t nLeafs = 0;
+    for (size_t i = 0; i < queue.size(); ++i)
     {
-        double r1 = it->t0.maxCoeff();
-        double r2 = it->t1.minCoeff();
+        TraversalNode& leaf = queue.at(i);
+
+        double r1 = leaf.t0.maxCoeff();
+        double r2 = leaf.t1.minCoeff();
 
         if (r2 < 0.0 || r1 > maxLength)
         {
             continue;
         }
 
-        double logodds = 0.0;
         if (isEndpointObstacle)
         {
-            logodds = sensorModel->getLogOddsLikelihood(r1, r2);
+            logOdds.push_back(sensorModel.getLogOddsLikelihood(r1, r2));
         }
         else
         {
-            logodds = sensorModel->freeSpaceLogOdds();
+            logOdds.push_back(sensorModel.freeSpaceLogOdds());
+        }
+
+        if (createNodes)
+        {
+            resolveLink(leaf.node, leaf.pool);
         }
 
-        OcNodePtr& node = it->node;
+        queue.at(nLeafs) = leaf;
+        ++nLeafs;
+    }
+
+    queue.erase(queue.begin() + nLeafs, queue.end());
+
+    leafs.swap(queue);
+}
+
+void
+OcTree::updateLeaf(OcNode* node, OcNodePool* pool, const Eigen::Vector3i& coords,
+                   double logodds)
+{
+    pool->markModified();
 
-        if (m_batchUpdate)
+    if (m_batchUpdate)
+    {
+        if (node->isUpdated())
         {
-            if (node->isUpdated())
-            {
-                if (node->getInterimLogOdds() < logodds)
-                {
-                    node->setInterimLogOdds(logodds);
-                }
-            }
-            else
+            if (node->getInterimLogOdds() < logodds)
             {
                 node->setInterimLogOdds(logodds);
-                node->setUpdated(true);
             }
         }
         else
         {
-            updateLogOdds(it->node, logodds);
+            node->setInterimLogOdds(logodds);
+            node->setUpdated(true);
+
+            m_dirtyLeafs.push_back(node);
+            m_dirtyLeafCoords.push_back(coords);
+        }
+    }
+    else
+    {
+        updateLogOdds(node, logodds);
+    }
+}
+
+void
+OcTree::castRaysThread(const Eigen::Matrix4d& sensorPose,
+                       const std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> >& endpoints,
+                       const std::vector<int>& hitCounts,
+                       SensorModelPtr sensorModel, int threadIdx, int nThreads,
+                       std::vector<LeafUpdateMap>& updates)
+{
+    std::vector<TraversalNode> leafs;
+    std::vector<double> logOdds;
+
+    // rays are interleaved between threads to balance the load
+    for (size_t i = threadIdx; i < endpoints.size(); i += nThreads)
+    {
+        traceRay(sensorPose, endpoints.at(i), *sensorModel, false, leafs, logOdds);
+
+        if (!hitCounts.empty())
+        {
+            scaleHitLogOdds(logOdds, hitCounts.at(i));
+        }
+
+        for (size_t j = 0; j < leafs.size(); ++j)
+        {
+            boost::uint64_t key = leafKey(leafs.at(j).gridCoords);
+
+            LeafUpdateMap& partition = updates.at(key % updates.size());
+
+            std::pair<LeafUpdateMap::iterator, bool> ret = partition.insert(std::make_pair(key, logOdds.at(j)));
+            if (!ret.second && ret.first->second < logOdds.at(j))
+            {
+                ret.first->second = logOdds.at(j);
+            }
         }
     }
 }
@@ -755,7 +1462,7 @@ OcTree::castRay(const Eigen::Matrix4d& sensorPose, const Eigen::Vector3d& endpoi
 void
 OcTree::castRays(const Eigen::Matrix4d& sensorPose, const cv::Mat& depthImage,
                  const Eigen::Matrix3d& cameraMatrix, SensorModelPtr& sensorModel,
-                 bool usePyramid)
+                 bool usePyramid, int nThreads)
 {
     double fx = cameraMatrix(0,0);
     double fy = cameraMatrix(1,1);
@@ -764,6 +1471,9 @@ OcTree::castRays(const Eigen::Matrix4d& sensorPose, const cv::Mat& depthImage,
 
     initBatchUpdate();
 
+    std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > endpoints;
+    endpoints.reserve(depthImage.rows * depthImage.cols);
+
     if (usePyramid)
     {
         std::vector<cv::Mat> pyramid = buildDepthImagePyramid(depthImage);
@@ -822,7 +1532,7 @@ OcTree::castRays(const Eigen::Matrix4d& sensorPose, const cv::Mat& depthImage,
                          1.0;
                     p *= z;
 
-                    castRay(sensorPose, p, SENSOR_FRAME, sensorModel);
+                    endpoints.push_back(p);
                 }
                 else
                 {
@@ -847,50 +1557,242 @@ OcTree::castRays(const Eigen::Matrix4d& sensorPose, const cv::Mat& depthImage,
             {
                 float z = depth[c];
 
-                if (z < 1e-10)
-                {
-                    continue;
-                }
+                if (z < 1e-10)
+                {
+                    continue;
+                }
+
+                Eigen::Vector3d p;
+                p(0) = (c - cx) * z / fx;
+                p(1) = (r - cy) * z / fy;
+                p(2) = z;
+
+                endpoints.push_back(p);
+            }
+        }
+    }
+
+    castRaysBatch(sensorPose, endpoints, std::vector<int>(), sensorModel, nThreads);
+
+    finalizeBatchUpdate();
+}
+
+void
+OcTree::insertScan(const geometry_msgs::Pose& sensorPose,
+                   const std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> >& scanEndpoints,
+                   Frame frame, SensorModelPtr& sensorModel, int nThreads)
+{
+    Eigen::Quaterniond q;
+    tf::quaternionMsgToEigen(sensorPose.orientation, q);
+
+    Eigen::Vector3d t;
+    tf::pointMsgToEigen(sensorPose.position, t);
+
+    Eigen::Matrix4d H = Eigen::Matrix4d::Identity();
+    H.block<3,3>(0,0) = q.toRotationMatrix();
+    H.block<3,1>(0,3) = t;
+
+    insertScan(H, scanEndpoints, frame, sensorModel, nThreads);
+}
+
+void
+OcTree::insertScan(const Eigen::Matrix4d& sensorPose,
+                   const std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> >& scanEndpoints,
+                   Frame frame, SensorModelPtr& sensorModel, int nThreads)
+{
+    initBatchUpdate();
+
+    Eigen::Matrix3d R = sensorPose.block<3,3>(0,0);
+    Eigen::Vector3d t = sensorPose.block<3,1>(0,3);
+
+    int halfWidth = gridWidth() / 2;
+
+    // bin endpoints into voxels, keeping the sum of the endpoints
+    // in the sensor frame and the number of hits per voxel
+    typedef std::pair<Eigen::Vector3d, int> VoxelHits;
+    boost::unordered_map<boost::uint64_t, VoxelHits> voxels;
+
+    std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > endpoints;
+    endpoints.reserve(scanEndpoints.size());
+
+    std::vector<int> hitCounts;
+    hitCounts.reserve(scanEndpoints.size());
+
+    for (size_t i = 0; i < scanEndpoints.size(); ++i)
+    {
+        Eigen::Vector3d endpointLocal;
+        Eigen::Vector3d endpointGlobal;
+
+        if (frame == GLOBAL_FRAME)
+        {
+            endpointLocal = R.transpose() * (scanEndpoints.at(i) - t);
+            endpointGlobal = scanEndpoints.at(i);
+        }
+        else
+        {
+            endpointLocal = scanEndpoints.at(i);
+            endpointGlobal = R * scanEndpoints.at(i) + t;
+        }
+
+        Eigen::Vector3i coords = pointToGridCoords(endpointGlobal, m_resolution);
+        if ((coords - m_center).minCoeff() < -halfWidth ||
+            (coords - m_center).maxCoeff() >= halfWidth)
+        {
+            // endpoints outside the tree are not binned
+            endpoints.push_back(endpointLocal);
+            hitCounts.push_back(1);
+            continue;
+        }
+
+        boost::uint64_t key = leafKey(coords);
+
+        std::pair<boost::unordered_map<boost::uint64_t, VoxelHits>::iterator, bool> ret =
+            voxels.insert(std::make_pair(key, VoxelHits(endpointLocal, 1)));
+        if (!ret.second)
+        {
+            ret.first->second.first += endpointLocal;
+            ++ret.first->second.second;
+        }
+    }
+
+    // cast one ray per voxel to the mean of its endpoints
+    for (boost::unordered_map<boost::uint64_t, VoxelHits>::const_iterator it = voxels.begin();
+         it != voxels.end(); ++it)
+    {
+        endpoints.push_back(it->second.first / it->second.second);
+        hitCounts.push_back(it->second.second);
+    }
+
+    castRaysBatch(sensorPose, endpoints, hitCounts, sensorModel, nThreads);
+
+    finalizeBatchUpdate();
+}
+
+void
+OcTree::castRaysBatch(const Eigen::Matrix4d& sensorPose,
+                      const std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> >& endpoints,
+                      const std::vector<int>& hitCounts,
+                      SensorModelPtr& sensorModel, int nThreads)
+{
+    boost::posix_time::ptime tsStart = boost::posix_time::microsec_clock::universal_time();
+
+    if (nThreads <= 0)
+    {
+        nThreads = ThreadPool::instance().threadCount();
+    }
+
+    if (nThreads <= 1)
+    {
+        std::vector<TraversalNode> leafs;
+        std::vector<double> logOdds;
+
+        for (size_t i = 0; i < endpoints.size(); ++i)
+        {
+            traceRay(sensorPose, endpoints.at(i), *sensorModel, true, leafs, logOdds);
+
+            if (!hitCounts.empty())
+            {
+                scaleHitLogOdds(logOdds, hitCounts.at(i));
+            }
+
+            for (size_t j = 0; j < leafs.size(); ++j)
+            {
+                updateLeaf(leafs.at(j).node, leafs.at(j).pool, leafs.at(j).gridCoords,
+                           logOdds.at(j));
+            }
+        }
+    }
+    else
+    {
+        // each task traverses its rays without modifying the tree, and
+        // the updates are merged into the tree in finalizeBatchUpdate
+        m_threadUpdates.assign(nThreads, std::vector<LeafUpdateMap>(nThreads));
+
+        TaskGroup group;
+        for (int i = 0; i < nThreads; ++i)
+        {
+            group.run(boost::bind(&OcTree::castRaysThread, this,
+                                  boost::cref(sensorPose),
+                                  boost::cref(endpoints),
+                                  boost::cref(hitCounts),
+                                  sensorModel->clone(), i, nThreads,
+                                  boost::ref(m_threadUpdates.at(i))));
+        }
+        group.wait();
+    }
 
-                Eigen::Vector3d p;
-                p(0) = (c - cx) * z / fx;
-                p(1) = (r - cy) * z / fy;
-                p(2) = z;
+    m_tTraversal = (boost::posix_time::microsec_clock::universal_time() - tsStart).total_microseconds() * 1e-3;
+}
 
-                castRay(sensorPose, p, SENSOR_FRAME, sensorModel);
-            }
+void
+OcTree::scaleHitLogOdds(std::vector<double>& logOdds, int hitCount) const
+{
+    if (hitCount <= 1)
+    {
+        return;
+    }
+
+    // Since repeated occupied updates are clamped at m_logOddsMax, the
+    // scaled update only needs to be clamped to the range of log-odds
+    // for the result to match hitCount individual updates.
+    for (size_t i = 0; i < logOdds.size(); ++i)
+    {
+        if (logOdds.at(i) > 0.0)
+        {
+            logOdds.at(i) = std::min(logOdds.at(i) * hitCount, m_logOddsMax - m_logOddsMin);
         }
     }
+}
 
-    finalizeBatchUpdate();
+void
+OcTree::batchUpdateTimes(double& tTraversal, double& tMerge, double& tUpdate) const
+{
+    tTraversal = m_tTraversal;
+    tMerge = m_tMerge;
+    tUpdate = m_tUpdate;
 }
 
 bool
 OcTree::read(const boost::multi_array<char, 1>& byteArray)
 {
-    m_root = boost::make_shared<OcNode>();
+    return read(byteArray.data(), byteArray.size());
+}
+
+bool
+OcTree::read(const char* data, size_t size)
+{
+    if (size >= sizeof(kCompressedMagic) &&
+        memcmp(data, kCompressedMagic, sizeof(kCompressedMagic)) == 0)
+    {
+        return readCompressed(data, size);
+    }
+
+    m_pool = boost::make_shared<OcNodePool>();
+    m_subTrees.clear();
+    m_dirtyLeafs.clear();
+    m_dirtyLeafCoords.clear();
 
-    if (byteArray.size() <= kHeaderSize)
+    if (size <= kHeaderSize)
     {
         return false;
     }
 
     // read in header data
-    m_resolution = *(reinterpret_cast<const double *>(byteArray.data()));
-    m_treeHeight = *(reinterpret_cast<const int *>(byteArray.data() + sizeof(double)));
+    m_resolution = *(reinterpret_cast<const double *>(data));
+    m_treeHeight = *(reinterpret_cast<const int *>(data + sizeof(double)));
 
-    m_center(0) = *(reinterpret_cast<const int *>(byteArray.data() + sizeof(double) + sizeof(int)));
-    m_center(1) = *(reinterpret_cast<const int *>(byteArray.data() + sizeof(double) + sizeof(int) * 2));
-    m_center(2) = *(reinterpret_cast<const int *>(byteArray.data() + sizeof(double) + sizeof(int) * 3));
+    m_center(0) = *(reinterpret_cast<const int *>(data + sizeof(double) + sizeof(int)));
+    m_center(1) = *(reinterpret_cast<const int *>(data + sizeof(double) + sizeof(int) * 2));
+    m_center(2) = *(reinterpret_cast<const int *>(data + sizeof(double) + sizeof(int) * 3));
 
-    m_logOddsMax = *(reinterpret_cast<const double *>(byteArray.data() + sizeof(double) + sizeof(int) * 4));
-    m_logOddsMin = *(reinterpret_cast<const double *>(byteArray.data() + sizeof(double) * 2 + sizeof(int) * 4));
-    m_logOddsOccThresh = *(reinterpret_cast<const double *>(byteArray.data() + sizeof(double) * 3 + sizeof(int) * 4));
+    m_logOddsMax = *(reinterpret_cast<const double *>(data + sizeof(double) + sizeof(int) * 4));
+    m_logOddsMin = *(reinterpret_cast<const double *>(data + sizeof(double) * 2 + sizeof(int) * 4));
+    m_logOddsOccThresh = *(reinterpret_cast<const double *>(data + sizeof(double) * 3 + sizeof(int) * 4));
 
     std::vector<OcNode*> queue;
     queue.reserve(maximumLeafCount());
 
-    queue.push_back(m_root.get());
+    queue.push_back(m_pool->root());
 
     int depth = 0;
     size_t mark = kHeaderSize;
@@ -903,14 +1805,13 @@ OcTree::read(const boost::multi_array<char, 1>& byteArray)
 
         BOOST_FOREACH(OcNode* node, nodes)
         {
-            if (((byteArray[mark] >> count) & 0x1) == 0x1)
+            if (((data[mark] >> count) & 0x1) == 0x1)
             {
-                node->split();
+                split(node, m_pool.get());
 
-                std::vector<OcNodePtr>& children = node->children();
-                for (std::vector<OcNodePtr>::iterator it = children.begin(); it != children.end(); ++it)
+                for (int i = 0; i < 8; ++i)
                 {
-                    queue.push_back(it->get());
+                    queue.push_back(node->m_children + i);
                 }
             }
 
@@ -934,12 +1835,14 @@ OcTree::read(const boost::multi_array<char, 1>& byteArray)
     BOOST_FOREACH(OcNode* node, queue)
     {
         double logodds;
-        memcpy(&logodds, &byteArray[mark], sizeof(double));
+        memcpy(&logodds, data + mark, sizeof(double));
         node->setLogOdds(logodds);
 
         mark += sizeof(double);
     }
 
+    updateSummaries();
+
     return true;
 }
 
@@ -952,7 +1855,7 @@ OcTree::write(boost::multi_array<char, 1>& byteArray) const
     std::vector<OcNode*> queue;
     queue.reserve(maximumLeafCount());
 
-    queue.push_back(m_root.get());
+    queue.push_back(m_pool->root());
 
     char data = 0;
     int count = 0;
@@ -968,10 +1871,9 @@ OcTree::write(boost::multi_array<char, 1>& byteArray) const
             {
                 data |= 1 << count;
 
-                std::vector<OcNodePtr>& children = node->children();
-                for (std::vector<OcNodePtr>::iterator it = children.begin(); it != children.end(); ++it)
+                for (int i = 0; i < 8; ++i)
                 {
-                    queue.push_back(it->get());
+                    queue.push_back(child(node, i));
                 }
             }
 
@@ -1072,10 +1974,294 @@ OcTree::write(const std::string& filename) const
     return true;
 }
 
+bool
+OcTree::writeCompressed(std::vector<char>& data, int bitsPerLeaf) const
+{
+    if (bitsPerLeaf != 8 && bitsPerLeaf != 16)
+    {
+        return false;
+    }
+
+    std::vector<char> structure;
+    std::vector<const OcNode*> leafs;
+    writeStructure(structure, leafs);
+
+    // zero log-odds, i.e. unknown space, is represented exactly
+    int qMax = (1 << (bitsPerLeaf - 1)) - 1;
+    double scale = std::max(fabs(m_logOddsMin), fabs(m_logOddsMax)) / qMax;
+    if (scale <= 0.0)
+    {
+        scale = 1.0;
+    }
+
+    data.clear();
+    data.insert(data.end(), kCompressedMagic, kCompressedMagic + sizeof(kCompressedMagic));
+    data.push_back(static_cast<char>(kCompressedVersion));
+    data.push_back(static_cast<char>(bitsPerLeaf));
+
+    appendValue(data, m_resolution);
+    appendValue(data, static_cast<boost::int32_t>(m_treeHeight));
+    appendValue(data, static_cast<boost::int32_t>(m_center(0)));
+    appendValue(data, static_cast<boost::int32_t>(m_center(1)));
+    appendValue(data, static_cast<boost::int32_t>(m_center(2)));
+    appendValue(data, m_logOddsMax);
+    appendValue(data, m_logOddsMin);
+    appendValue(data, m_logOddsOccThresh);
+    appendValue(data, scale);
+
+    appendValue(data, static_cast<boost::uint32_t>(structure.size()));
+    data.insert(data.end(), structure.begin(), structure.end());
+
+    // run-length encoded leaf log-odds
+    size_t i = 0;
+    while (i < leafs.size())
+    {
+        double logodds = std::min(std::max(leafs.at(i)->getLogOdds(), m_logOddsMin), m_logOddsMax);
+        int q = static_cast<int>(round(logodds / scale));
+        q = std::min(std::max(q, -qMax), qMax);
+
+        size_t j = i + 1;
+        while (j < leafs.size())
+        {
+            double logoddsNext = std::min(std::max(leafs.at(j)->getLogOdds(), m_logOddsMin), m_logOddsMax);
+            int qNext = static_cast<int>(round(logoddsNext / scale));
+            qNext = std::min(std::max(qNext, -qMax), qMax);
+
+            if (qNext != q)
+            {
+                break;
+            }
+
+            ++j;
+        }
+
+        appendVarint(data, j - i);
+        if (bitsPerLeaf == 8)
+        {
+            appendValue(data, static_cast<boost::int8_t>(q));
+        }
+        else
+        {
+            appendValue(data, static_cast<boost::int16_t>(q));
+        }
+
+        i = j;
+    }
+
+    return true;
+}
+
+bool
+OcTree::readCompressed(const char* data, size_t size)
+{
+    m_pool = boost::make_shared<OcNodePool>();
+    m_subTrees.clear();
+    m_dirtyLeafs.clear();
+    m_dirtyLeafCoords.clear();
+
+    size_t mark = sizeof(kCompressedMagic);
+
+    unsigned char version;
+    unsigned char bitsPerLeaf;
+    if (!extractValue(data, size, mark, version) ||
+        !extractValue(data, size, mark, bitsPerLeaf))
+    {
+        return false;
+    }
+
+    if (version != kCompressedVersion ||
+        (bitsPerLeaf != 8 && bitsPerLeaf != 16))
+    {
+        return false;
+    }
+
+    boost::int32_t treeHeight;
+    boost::int32_t center[3];
+    double scale;
+    boost::uint32_t structureSize;
+    if (!extractValue(data, size, mark, m_resolution) ||
+        !extractValue(data, size, mark, treeHeight) ||
+        !extractValue(data, size, mark, center[0]) ||
+        !extractValue(data, size, mark, center[1]) ||
+        !extractValue(data, size, mark, center[2]) ||
+        !extractValue(data, size, mark, m_logOddsMax) ||
+        !extractValue(data, size, mark, m_logOddsMin) ||
+        !extractValue(data, size, mark, m_logOddsOccThresh) ||
+        !extractValue(data, size, mark, scale) ||
+        !extractValue(data, size, mark, structureSize))
+    {
+        return false;
+    }
+
+    m_treeHeight = treeHeight;
+    m_center << center[0], center[1], center[2];
+
+    if (mark + structureSize > size)
+    {
+        return false;
+    }
+
+    std::vector<OcNode*> leafs;
+    size_t structureMark = 0;
+    if (!readStructure(data + mark, structureSize, structureMark, leafs))
+    {
+        return false;
+    }
+    mark += structureSize;
+
+    size_t i = 0;
+    while (i < leafs.size())
+    {
+        boost::uint32_t runLength;
+        if (!extractVarint(data, size, mark, runLength) ||
+            runLength == 0 || i + runLength > leafs.size())
+        {
+            return false;
+        }
+
+        int q;
+        if (bitsPerLeaf == 8)
+        {
+            boost::int8_t value;
+            if (!extractValue(data, size, mark, value))
+            {
+                return false;
+            }
+            q = value;
+        }
+        else
+        {
+            boost::int16_t value;
+            if (!extractValue(data, size, mark, value))
+            {
+                return false;
+            }
+            q = value;
+        }
+
+        double logodds = q * scale;
+        for (size_t j = i; j < i + runLength; ++j)
+        {
+            leafs.at(j)->setLogOdds(logodds);
+        }
+
+        i += runLength;
+    }
+
+    updateSummaries();
+
+    return true;
+}
+
+void
+OcTree::writeStructure(std::vector<char>& data, std::vector<const OcNode*>& leafs) const
+{
+    int depth = 0;
+
+    std::vector<const OcNode*> queue;
+    queue.push_back(m_pool->root());
+
+    char bits = 0;
+    int count = 0;
+
+    while (depth < m_treeHeight - 1 && !queue.empty())
+    {
+        std::vector<const OcNode*> nodes;
+        nodes.swap(queue);
+
+        BOOST_FOREACH(const OcNode* node, nodes)
+        {
+            if (!node->isLeaf())
+            {
+                bits |= 1 << count;
+
+                for (int i = 0; i < 8; ++i)
+                {
+                    queue.push_back(child(node, i));
+                }
+            }
+
+            ++count;
+            if (count == 8)
+            {
+                data.push_back(bits);
+                bits = 0;
+                count = 0;
+            }
+        }
+
+        ++depth;
+    }
+
+    if (count > 0)
+    {
+        data.push_back(bits);
+    }
+
+    leafs.swap(queue);
+}
+
+bool
+OcTree::readStructure(const char* data, size_t size, size_t& mark,
+                      std::vector<OcNode*>& leafs)
+{
+    int depth = 0;
+
+    std::vector<OcNode*> queue;
+    queue.push_back(m_pool->root());
+
+    int count = 0;
+
+    while (depth < m_treeHeight - 1 && !queue.empty())
+    {
+        std::vector<OcNode*> nodes;
+        nodes.swap(queue);
+
+        BOOST_FOREACH(OcNode* node, nodes)
+        {
+            if (mark >= size)
+            {
+                return false;
+            }
+
+            if (((data[mark] >> count) & 0x1) == 0x1)
+            {
+                split(node, m_pool.get());
+
+                for (int i = 0; i < 8; ++i)
+                {
+                    queue.push_back(node->m_children + i);
+                }
+            }
+
+            ++count;
+            if (count == 8)
+            {
+                ++mark;
+                count = 0;
+            }
+        }
+
+        ++depth;
+    }
+
+    if (count > 0)
+    {
+        ++mark;
+    }
+
+    leafs.swap(queue);
+
+    return true;
+}
+
 bool
 OcTree::read(const dynocmap_msgs::DynocMapTile& msg)
 {
-    m_root = boost::make_shared<OcNode>();
+    m_pool = boost::make_shared<OcNodePool>();
+    m_subTrees.clear();
+    m_dirtyLeafs.clear();
+    m_dirtyLeafCoords.clear();
 
     m_resolution = msg.resolution;
     m_treeHeight = msg.tree_height;
@@ -1091,7 +2277,7 @@ OcTree::read(const dynocmap_msgs::DynocMapTile& msg)
     std::vector<OcNode*> queue;
     queue.reserve(maximumLeafCount());
 
-    queue.push_back(m_root.get());
+    queue.push_back(m_pool->root());
 
     int depth = 0;
     size_t mark = 0;
@@ -1106,12 +2292,11 @@ OcTree::read(const dynocmap_msgs::DynocMapTile& msg)
         {
             if (((msg.data.at(mark) >> count) & 0x1) == 0x1)
             {
-                node->split();
+                split(node, m_pool.get());
 
-                std::vector<OcNodePtr>& children = node->children();
-                for (std::vector<OcNodePtr>::iterator it = children.begin(); it != children.end(); ++it)
+                for (int i = 0; i < 8; ++i)
                 {
-                    queue.push_back(it->get());
+                    queue.push_back(node->m_children + i);
                 }
             }
 
@@ -1141,6 +2326,8 @@ OcTree::read(const dynocmap_msgs::DynocMapTile& msg)
         mark += sizeof(double);
     }
 
+    updateSummaries();
+
     return true;
 }
 
@@ -1163,7 +2350,7 @@ OcTree::write(dynocmap_msgs::DynocMapTile& msg) const
     std::vector<OcNode*> queue;
     queue.reserve(maximumLeafCount());
 
-    queue.push_back(m_root.get());
+    queue.push_back(m_pool->root());
 
     char data = 0;
     int count = 0;
@@ -1179,10 +2366,9 @@ OcTree::write(dynocmap_msgs::DynocMapTile& msg) const
             {
                 data |= 1 << count;
 
-                std::vector<OcNodePtr>& children = node->children();
-                for (std::vector<OcNodePtr>::iterator it = children.begin(); it != children.end(); ++it)
+                for (int i = 0; i < 8; ++i)
                 {
-                    queue.push_back(it->get());
+                    queue.push_back(child(node, i));
                 }
             }
 
@@ -1248,6 +2434,53 @@ OcTree::childCoords(const Eigen::Vector3i& parentCoords, int childIndex,
     return coords;
 }
 
+OcNode*
+OcTree::child(OcNode* node, int index) const
+{
+    OcNode* child = node->m_children + index;
+    if (child->m_flags & OcNode::LINK)
+    {
+        return child->m_link->m_pool->root();
+    }
+
+    return child;
+}
+
+const OcNode*
+OcTree::child(const OcNode* node, int index) const
+{
+    const OcNode* child = node->m_children + index;
+    if (child->m_flags & OcNode::LINK)
+    {
+        return child->m_link->m_pool->root();
+    }
+
+    return child;
+}
+
+void
+OcTree::resolveLink(OcNode*& node, OcNodePool*& pool) const
+{
+    if (node->m_flags & OcNode::LINK)
+    {
+        pool = node->m_link->m_pool.get();
+        node = pool->root();
+    }
+}
+
+void
+OcTree::split(OcNode* node, OcNodePool* pool) const
+{
+    node->m_children = pool->allocateChildren();
+}
+
+OcNodePtr
+OcTree::nodePtr(OcNode* node, OcNodePool* pool) const
+{
+    // the node shares ownership of the pool it was allocated from
+    return OcNodePtr(pool->shared_from_this(), node);
+}
+
 int
 OcTree::getFirstIntersectedNode(const Eigen::Vector3d& t0,
                                 const Eigen::Vector3d& tm) const
@@ -1298,7 +2531,7 @@ OcTree::getFirstIntersectedNode(const Eigen::Vector3d& t0,
 }
 
 int
-OcTree::getNextIntersectedNode(const Eigen::Vector3d& tm, int x, int y, int z)
+OcTree::getNextIntersectedNode(const Eigen::Vector3d& tm, int x, int y, int z) const
 {
     int dim;
     tm.minCoeff(&dim);
@@ -1403,42 +2636,76 @@ OcTree::initBatchUpdate(void)
 void
 OcTree::finalizeBatchUpdate(void)
 {
-    std::vector<OcNode*> queue;
-    queue.reserve(maximumLeafCount());
-
-    queue.push_back(m_root.get());
+    boost::posix_time::ptime tsStart = boost::posix_time::microsec_clock::universal_time();
 
-    for (int depth = 0; depth < m_treeHeight - 1; ++depth)
+    // merge updates from castRays tasks, one partition of leafs per task
+    if (m_threadUpdates.size() > 1)
     {
-        std::vector<OcNode*> nodes;
-        nodes.swap(queue);
+        TaskGroup group;
+        for (size_t i = 0; i < m_threadUpdates.front().size(); ++i)
+        {
+            group.run(boost::bind(&OcTree::mergeUpdatesPartition, this, i));
+        }
+        group.wait();
+    }
 
-        BOOST_FOREACH(OcNode* node, nodes)
+    boost::posix_time::ptime tsMerged = boost::posix_time::microsec_clock::universal_time();
+    m_tMerge = (tsMerged - tsStart).total_microseconds() * 1e-3;
+
+    // node allocation is not thread-safe, so the merged updates are
+    // inserted into the tree serially
+    if (!m_threadUpdates.empty())
+    {
+        BOOST_FOREACH(const LeafUpdateMap& updates, m_threadUpdates.front())
         {
-            if (node->isLeaf())
+            for (LeafUpdateMap::const_iterator it = updates.begin(); it != updates.end(); ++it)
             {
-                continue;
-            }
+                Eigen::Vector3i coords = leafCoords(it->first);
 
-            std::vector<OcNodePtr>& children = node->children();
-            for (std::vector<OcNodePtr>::iterator it = children.begin(); it != children.end(); ++it)
-            {
-                queue.push_back(it->get());
+                OcNodePool* pool = 0;
+                OcNode* node = insertLeaf(coords, pool);
+
+                updateLeaf(node, pool, coords, it->second);
             }
         }
     }
+    m_threadUpdates.clear();
 
-    BOOST_FOREACH(OcNode* node, queue)
+    // only leafs which were hit during the batch update are visited
+    BOOST_FOREACH(OcNode* node, m_dirtyLeafs)
     {
-        if (node->isUpdated())
-        {
-            updateLogOdds(node, node->getInterimLogOdds());
+        updateLogOdds(node, node->getInterimLogOdds());
 
-            node->setUpdated(false);
-        }
+        node->setUpdated(false);
     }
 
+    updatePathSummaries(m_dirtyLeafCoords);
+
+    m_dirtyLeafs.clear();
+    m_dirtyLeafCoords.clear();
+
     m_batchUpdate = false;
+
+    m_tUpdate = (boost::posix_time::microsec_clock::universal_time() - tsMerged).total_microseconds() * 1e-3;
+}
+
+void
+OcTree::mergeUpdatesPartition(size_t partitionIdx)
+{
+    LeafUpdateMap& merged = m_threadUpdates.front().at(partitionIdx);
+
+    for (size_t i = 1; i < m_threadUpdates.size(); ++i)
+    {
+        const LeafUpdateMap& updates = m_threadUpdates.at(i).at(partitionIdx);
+        for (LeafUpdateMap::const_iterator it = updates.begin(); it != updates.end(); ++it)
+        {
+            std::pair<LeafUpdateMap::iterator, bool> ret = merged.insert(*it);
+            if (!ret.second && ret.first->second < it->second)
+            {
+                ret.first->second = it->second;
+            }
+        }
+    }
 }
 
 }
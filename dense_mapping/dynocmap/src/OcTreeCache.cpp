@@ -1,285 +1,325 @@
 #include "OcTreeCache.h"
 
-#include <boost/filesystem.hpp>
 #include <boost/make_shared.hpp>
-#include <iostream>
 
 namespace px
 {
 
-OcTreeCache::OcTreeCache(int cacheSize)
- : m_currentReference(0)
+OcTreeCache::OcTreeCache(const boost::shared_ptr<TileArchive>& archive,
+                         int cacheSize, int maxQueueSize)
+ : k_cacheSize(cacheSize > 0 ? cacheSize : 1)
+ , k_maxQueueSize(maxQueueSize > 0 ? maxQueueSize : 1)
+ , m_archive(archive)
+ , m_nWritesCompleted(0)
  , m_requestDestroy(false)
 {
-    m_cache.reserve(cacheSize);
-    for (int i = 0; i < cacheSize; ++i)
-    {
-        m_cache.push_back(CacheItem());
-    }
-
-    m_cache.resize(cacheSize);
-
-    m_cacheThread = boost::make_shared<boost::thread>(&OcTreeCache::cacheThread, this);
+    m_ioThread = boost::make_shared<boost::thread>(&OcTreeCache::ioThread, this);
 }
 
 OcTreeCache::~OcTreeCache()
 {
-    m_requestDestroy = true;
+    {
+        boost::lock_guard<boost::mutex> lock(m_cacheMutex);
 
-    m_cacheThread->join();
+        m_requestDestroy = true;
+    }
+    m_ioCond.notify_all();
+
+    m_ioThread->join();
 }
 
 void
-OcTreeCache::cache(const std::string& filename, const OcTreePtr& data)
+OcTreeCache::cache(const std::string& name, const OcTreePtr& data)
 {
     boost::lock_guard<boost::mutex> lock(m_cacheMutex);
 
-    for (size_t i = 0; i < m_cache.size(); ++i)
-    {
-        CacheItem& item = m_cache.at(i);
-
-        if (item.status != UNINITIALIZED &&
-            item.filename == filename)
-        {
-            if (item.data != data)
-            {
-                item.data = data;
-            }
-            item.exists = true;
-
-            return;
-        }
-    }
-
-    int mark = -1;
+    CacheList::iterator it;
 
-    for (size_t i = 0; i < m_cache.size(); ++i)
+    boost::unordered_map<std::string, CacheList::iterator>::iterator itIndex = m_cacheIndex.find(name);
+    if (itIndex != m_cacheIndex.end())
     {
-        CacheItem& item = m_cache.at(i);
-
-        // get uninitialized octree
-        if (item.status == UNINITIALIZED)
-        {
-            mark = i;
-            break;
-        }
-        // get oldest octree
-        else if (item.status == READY &&
-                 (mark == -1 ||
-                  item.lastReference < m_cache.at(mark).lastReference))
-        {
-            mark = i;
-        }
-    }
-
-    if (mark == -1)
-    {
-       return;
+        it = itIndex->second;
+        touch(it);
     }
     else
     {
-        CacheItem& item = m_cache.at(mark);
+        evict();
 
-        if (item.status == READY)
-        {
-            item.newData = data;
-            item.newFilename = filename;
-            item.status = REPLACE_REQUESTED;
-        }
-        else
-        {
-            item.data = data;
-            item.filename = filename;
-            item.status = READY;
-        }
+        m_cache.push_front(CacheItem(name));
+        it = m_cache.begin();
+        m_cacheIndex[name] = it;
+    }
 
-        item.exists = true;
+    // a pending read of the tile is superseded
+    it->data = data;
+    it->exists = true;
+    it->status = READY;
+    it->inUse = false;
 
-        item.lastReference = m_currentReference;
-        ++m_currentReference;
-    }
+    m_readyCond.notify_all();
 }
 
 OcTreePtr
-OcTreeCache::get(const std::string& filename)
+OcTreeCache::get(const std::string& name)
 {
+    boost::unique_lock<boost::mutex> lock(m_cacheMutex);
+
     while (true)
     {
-        int mark = lookup(filename);
+        CacheList::iterator it;
 
-        if (mark == -1)
+        boost::unordered_map<std::string, CacheList::iterator>::iterator itIndex = m_cacheIndex.find(name);
+        if (itIndex != m_cacheIndex.end())
+        {
+            it = itIndex->second;
+            touch(it);
+        }
+        else if (!insert(name, true, lock, it))
         {
-            usleep(100);
             continue;
         }
 
+        if (it->status == READY)
         {
-            boost::lock_guard<boost::mutex> lock(m_cacheMutex);
-
-            CacheItem& item = m_cache.at(mark);
-            if (!item.exists)
+            if (!it->exists)
             {
                 return OcTreePtr();
             }
-            else if (item.status == READY)
+
+            // The tile cannot be modified until an evicted version of it
+            // has been written.
+            boost::unordered_map<std::string, OcTreePtr>::iterator itWrite = m_pendingWrites.find(name);
+            if (itWrite == m_pendingWrites.end() || itWrite->second != it->data)
             {
-                return item.data;
+                it->inUse = true;
+
+                return it->data;
             }
         }
 
-        usleep(100);
+        m_readyCond.wait(lock);
     }
 }
 
-int
-OcTreeCache::lookup(const std::string& filename)
+bool
+OcTreeCache::prefetch(const std::string& name)
 {
-    boost::lock_guard<boost::mutex> lock(m_cacheMutex);
-
-    int mark = -1;
+    boost::unique_lock<boost::mutex> lock(m_cacheMutex);
 
-    for (size_t i = 0; i < m_cache.size(); ++i)
+    while (true)
     {
-        CacheItem& item = m_cache.at(i);
+        CacheList::iterator it;
 
-        if (item.status != UNINITIALIZED &&
-            item.filename == filename)
+        boost::unordered_map<std::string, CacheList::iterator>::iterator itIndex = m_cacheIndex.find(name);
+        if (itIndex != m_cacheIndex.end())
         {
-            mark = i;
-            break;
+            it = itIndex->second;
+            touch(it);
         }
-    }
-
-    if (mark == -1)
-    {
-        for (size_t i = 0; i < m_cache.size(); ++i)
+        else
         {
-            CacheItem& item = m_cache.at(i);
-
-            // get uninitialized octree
-            if (item.status == UNINITIALIZED)
+            // prefetching is skipped if the I/O queue is full
+            if (!insert(name, false, lock, it))
             {
-                mark = i;
-                break;
+                continue;
             }
-            // get oldest octree
-            else if (item.status == READY &&
-                     (mark == -1 ||
-                      item.lastReference < m_cache.at(mark).lastReference))
+            if (it == m_cache.end())
             {
-                mark = i;
+                return false;
             }
         }
 
-        if (mark == -1)
+        return it->status == READY;
+    }
+}
+
+bool
+OcTreeCache::insert(const std::string& name, bool forceRead,
+                    boost::unique_lock<boost::mutex>& lock,
+                    CacheList::iterator& it)
+{
+    CacheItem item(name);
+
+    boost::unordered_map<std::string, OcTreePtr>::iterator itWrite = m_pendingWrites.find(name);
+    if (itWrite != m_pendingWrites.end())
+    {
+        // the tile has not been written yet
+        item.data = itWrite->second;
+        item.exists = true;
+        item.status = READY;
+    }
+    else
+    {
+        if (!forceRead && m_ioQueue.size() >= k_maxQueueSize)
         {
-           return -1;
+            it = m_cache.end();
+            return true;
         }
-        else
-        {
-            CacheItem& item = m_cache.at(mark);
 
-            item.exists = boost::filesystem::exists(filename.c_str());
+        // The archive is queried without holding the cache mutex, since
+        // it may be busy with I/O.
+        size_t nWritesCompleted = m_nWritesCompleted;
 
-            if (item.status == READY)
-            {
-                item.newFilename = filename;
-                item.status = REPLACE_REQUESTED;
-            }
-            else
-            {
-                item.filename = filename;
+        lock.unlock();
+        bool archived = m_archive->contains(name);
+        lock.lock();
 
-                if (!item.exists)
-                {
-                    item.status = READY;
-                }
-                else
-                {
-                    item.status = READ_REQUESTED;
-                }
-            }
+        // The tile may have been cached, evicted or written in the
+        // meantime. Tiles are never removed from the archive, so only a
+        // negative answer can be outdated.
+        if (m_cacheIndex.find(name) != m_cacheIndex.end() ||
+            m_pendingWrites.find(name) != m_pendingWrites.end() ||
+            (!archived && m_nWritesCompleted != nWritesCompleted))
+        {
+            return false;
+        }
 
-            item.lastReference = m_currentReference;
-            ++m_currentReference;
+        if (!archived)
+        {
+            item.exists = false;
+            item.status = READY;
+        }
+        else
+        {
+            if (!enqueue(IOJob(name, OcTreePtr()), forceRead))
+            {
+                it = m_cache.end();
+                return true;
+            }
 
-            return mark;
+            item.exists = true;
+            item.status = READ_REQUESTED;
         }
     }
-    else
+
+    evict();
+
+    m_cache.push_front(item);
+    m_cacheIndex[name] = m_cache.begin();
+
+    it = m_cache.begin();
+
+    return true;
+}
+
+void
+OcTreeCache::touch(CacheList::iterator it)
+{
+    m_cache.splice(m_cache.begin(), m_cache, it);
+}
+
+void
+OcTreeCache::evict(void)
+{
+    CacheList::iterator it = m_cache.end();
+    while (m_cache.size() >= k_cacheSize && it != m_cache.begin())
     {
-        CacheItem& item = m_cache.at(mark);
+        --it;
 
-        if (item.status == READY)
+        // tiles which are being read or are in use are not evicted
+        if (it->status != READY || it->inUse)
         {
-            item.lastReference = m_currentReference;
-            ++m_currentReference;
-
-            return mark;
+            continue;
         }
-        else
+
+        if (it->data)
         {
-            return -1;
+            m_pendingWrites[it->name] = it->data;
+
+            enqueue(IOJob(it->name, it->data), true);
         }
+
+        m_cacheIndex.erase(it->name);
+        it = m_cache.erase(it);
     }
 }
 
+bool
+OcTreeCache::enqueue(const IOJob& job, bool force)
+{
+    if (!force && m_ioQueue.size() >= k_maxQueueSize)
+    {
+        return false;
+    }
+
+    m_ioQueue.push_back(job);
+
+    m_ioCond.notify_one();
+
+    return true;
+}
+
 void
-OcTreeCache::cacheThread(void)
+OcTreeCache::ioThread(void)
 {
-    while (!m_requestDestroy)
+    while (true)
     {
-        m_cacheMutex.lock();
+        IOJob job("", OcTreePtr());
 
-        for (size_t i = 0; i < m_cache.size(); ++i)
         {
-            CacheItem& item = m_cache.at(i);
-            switch (item.status)
-            {
-            case READ_REQUESTED:
-            {
-                item.data = boost::make_shared<OcTree>();
-                item.data->read(item.filename);
-                item.status = READY;
+            boost::unique_lock<boost::mutex> lock(m_cacheMutex);
 
-                break;
-            }
-            case REPLACE_REQUESTED:
+            while (m_ioQueue.empty() && !m_requestDestroy)
             {
-                item.data->write(item.filename);
+                m_ioCond.wait(lock);
+            }
 
-                if (item.newData)
+            if (m_requestDestroy)
+            {
+                // finish pending writes, but not reads
+                while (!m_ioQueue.empty() && !m_ioQueue.front().data)
                 {
-                    item.data = item.newData;
+                    m_ioQueue.pop_front();
                 }
-                else
+
+                if (m_ioQueue.empty())
                 {
-                    if (item.exists)
-                    {
-                        item.data = boost::make_shared<OcTree>();
-                        item.data->read(item.newFilename);
-                    }
-                    else
-                    {
-                        item.data.reset();
-                    }
+                    return;
                 }
+            }
 
-                item.filename = item.newFilename;
+            job = m_ioQueue.front();
+            m_ioQueue.pop_front();
+        }
 
-                item.newData.reset();
-                item.newFilename.clear();
+        if (job.data)
+        {
+            m_archive->write(job.name, *job.data);
 
-                item.status = READY;
+            boost::lock_guard<boost::mutex> lock(m_cacheMutex);
 
-                break;
-            }
+            ++m_nWritesCompleted;
+
+            // the tile may have been evicted again in the meantime
+            boost::unordered_map<std::string, OcTreePtr>::iterator itWrite = m_pendingWrites.find(job.name);
+            if (itWrite != m_pendingWrites.end() && itWrite->second == job.data)
+            {
+                m_pendingWrites.erase(itWrite);
             }
+
+            m_readyCond.notify_all();
         }
+        else
+        {
+            OcTreePtr data = boost::make_shared<OcTree>();
+            bool exists = m_archive->read(job.name, *data);
+
+            boost::lock_guard<boost::mutex> lock(m_cacheMutex);
 
-        m_cacheMutex.unlock();
+            boost::unordered_map<std::string, CacheList::iterator>::iterator itIndex = m_cacheIndex.find(job.name);
+            if (itIndex != m_cacheIndex.end() &&
+                itIndex->second->status == READ_REQUESTED)
+            {
+                if (exists)
+                {
+                    itIndex->second->data = data;
+                }
+                itIndex->second->exists = exists;
+                itIndex->second->status = READY;
+            }
 
-        usleep(100);
+            m_readyCond.notify_all();
+        }
     }
 }
 
@@ -1,56 +1,122 @@
 #ifndef OCTREECACHE_H
 #define OCTREECACHE_H
 
+#include <boost/thread/condition_variable.hpp>
 #include <boost/thread/thread.hpp>
+#include <boost/unordered_map.hpp>
+#include <deque>
+#include <list>
 
 #include "dynocmap/OcTree.h"
+#include "TileArchive.h"
 
 namespace px
 {
 
+/**
+ * \brief LRU cache of octree tiles backed by a tile archive on disk
+ *
+ * Tiles are read and evicted tiles are written by a background I/O thread.
+ * The cache mutex is never held while the archive is accessed, and callers
+ * waiting for a tile are woken up as soon as it has been read. Tiles which
+ * have been handed out by get are in use until they are handed back with
+ * cache, and are not evicted in the meantime.
+ */
 class OcTreeCache
 {
 public:
-    OcTreeCache(int cacheSize);
+    OcTreeCache(const boost::shared_ptr<TileArchive>& archive,
+                int cacheSize, int maxQueueSize = 64);
     ~OcTreeCache();
 
-    void cache(const std::string& filename, const OcTreePtr& data);
+    // Hand a tile over to the cache, or back to it after get. If the tile
+    // is evicted, it is written to disk.
+    void cache(const std::string& name, const OcTreePtr& data);
 
-    OcTreePtr get(const std::string& filename);
-    int lookup(const std::string& filename);
+    // Return the tile with the given name, waiting for it to be read, or
+    // for an earlier version of it to be written, if necessary. The tile
+    // stays in use until it is handed back with cache. Return a null
+    // pointer if the tile is not archived.
+    OcTreePtr get(const std::string& name);
 
-private:
-    void cacheThread(void);
+    // Request the tile with the given name to be read in the
+    // background. Return true if the tile is already in the cache.
+    bool prefetch(const std::string& name);
 
+private:
     enum Status
     {
-        UNINITIALIZED,
         READ_REQUESTED,
-        READY,
-        REPLACE_REQUESTED
+        READY
     };
 
     class CacheItem
     {
     public:
-        CacheItem(): exists(false), status(UNINITIALIZED) {};
+        CacheItem(const std::string& _name)
+         : name(_name), exists(false), status(READ_REQUESTED), inUse(false) {};
 
+        std::string name;
         OcTreePtr data;
-        std::string filename;
-        OcTreePtr newData;
-        std::string newFilename;
         bool exists;
         Status status;
-        unsigned int lastReference;
+        // the tile has been handed out by get
+        bool inUse;
     };
 
-    boost::shared_ptr<boost::thread> m_cacheThread;
-    std::vector<CacheItem> m_cache;
-    boost::mutex m_cacheMutex;
+    typedef std::list<CacheItem> CacheList;
+
+    class IOJob
+    {
+    public:
+        IOJob(const std::string& _name, const OcTreePtr& _data)
+         : name(_name), data(_data) {};
+
+        std::string name;
+        // data to write, or null to read
+        OcTreePtr data;
+    };
+
+    void ioThread(void);
 
-    unsigned int m_currentReference;
+    // The following methods must be called with m_cacheMutex locked.
+
+    // Insert an item for a tile which is not in the cache, and request
+    // it to be read if it is archived. The mutex is released while the
+    // archive is queried. Return false if the tile has to be looked up
+    // again since the cache changed in the meantime. it is set to the
+    // end of the cache if the read request was not queued.
+    bool insert(const std::string& name, bool forceRead,
+                boost::unique_lock<boost::mutex>& lock,
+                CacheList::iterator& it);
+    void touch(CacheList::iterator it);
+    void evict(void);
+    bool enqueue(const IOJob& job, bool force);
+
+    const size_t k_cacheSize;
+    const size_t k_maxQueueSize;
+
+    boost::shared_ptr<TileArchive> m_archive;
+
+    // items in order of last reference, most recent first
+    CacheList m_cache;
+    boost::unordered_map<std::string, CacheList::iterator> m_cacheIndex;
+
+    // evicted tiles which are yet to be written to disk
+    boost::unordered_map<std::string, OcTreePtr> m_pendingWrites;
+
+    std::deque<IOJob> m_ioQueue;
+
+    // number of writes to the archive which have completed
+    size_t m_nWritesCompleted;
+
+    boost::mutex m_cacheMutex;
+    boost::condition_variable m_ioCond;
+    boost::condition_variable m_readyCond;
 
     bool m_requestDestroy;
+
+    boost::shared_ptr<boost::thread> m_ioThread;
 };
 
 }
@@ -0,0 +1,652 @@
+#include "TileArchive.h"
+
+#include <algorithm>
+#include <boost/make_shared.hpp>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <vector>
+
+namespace px
+{
+
+// header: magic, version, reserved, offset of the index (0 if not stored)
+const char kArchiveMagic[8] = {'D', 'Y', 'N', 'O', 'C', 'A', 'R', 'C'};
+const boost::uint32_t kArchiveVersion = 1;
+const size_t kArchiveIndexOffsetPos = sizeof(kArchiveMagic) + sizeof(boost::uint32_t) * 2;
+const size_t kArchiveHeaderSize = kArchiveIndexOffsetPos + sizeof(boost::uint64_t);
+
+// Extents whose free space would exceed this fraction of the data are
+// split when they are reused, and files with more free space than this
+// fraction are compacted by flush().
+const double kArchiveSlack = 0.25;
+
+namespace
+{
+
+bool
+readAll(int fd, char* data, size_t size, boost::uint64_t offset)
+{
+    while (size > 0)
+    {
+        ssize_t n = pread(fd, data, size, offset);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+
+        data += n;
+        size -= n;
+        offset += n;
+    }
+
+    return true;
+}
+
+bool
+writeAll(int fd, const char* data, size_t size, boost::uint64_t offset)
+{
+    while (size > 0)
+    {
+        ssize_t n = pwrite(fd, data, size, offset);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+
+        data += n;
+        size -= n;
+        offset += n;
+    }
+
+    return true;
+}
+
+}
+
+TileArchive::TileArchive(int bitsPerLeaf)
+ : k_bitsPerLeaf(bitsPerLeaf)
+ , m_fd(-1)
+ , m_dataEnd(kArchiveHeaderSize)
+ , m_indexStored(false)
+ , m_freeBytes(0)
+ , m_nPendingWrites(0)
+ , m_mappedSize(0)
+{
+
+}
+
+TileArchive::~TileArchive()
+{
+    close();
+}
+
+bool
+TileArchive::open(const std::string& filename)
+{
+    close();
+
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    m_filename = filename;
+    m_index.clear();
+    m_dataEnd = kArchiveHeaderSize;
+    m_indexStored = false;
+    m_freeExtents.clear();
+    m_freeBytes = 0;
+
+    m_fd = ::open(filename.c_str(), O_RDWR);
+    if (m_fd < 0)
+    {
+        m_fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (m_fd < 0)
+        {
+            return false;
+        }
+
+        char header[kArchiveHeaderSize];
+        memset(header, 0, kArchiveHeaderSize);
+        memcpy(header, kArchiveMagic, sizeof(kArchiveMagic));
+        memcpy(header + sizeof(kArchiveMagic), &kArchiveVersion, sizeof(boost::uint32_t));
+
+        return writeAll(m_fd, header, kArchiveHeaderSize, 0);
+    }
+
+    if (!readIndex())
+    {
+        // an archive without a stored index is treated as empty
+        m_index.clear();
+        m_dataEnd = kArchiveHeaderSize;
+        m_freeExtents.clear();
+        m_freeBytes = 0;
+    }
+
+    mapFile();
+
+    return true;
+}
+
+void
+TileArchive::close(void)
+{
+    flush();
+
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    m_region.reset();
+    m_mapping.reset();
+    m_mappedSize = 0;
+
+    if (m_fd >= 0)
+    {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+bool
+TileArchive::clear(void)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    if (m_fd < 0)
+    {
+        return false;
+    }
+
+    m_region.reset();
+    m_mapping.reset();
+    m_mappedSize = 0;
+
+    m_index.clear();
+    m_dataEnd = kArchiveHeaderSize;
+    m_indexStored = false;
+    m_freeExtents.clear();
+    m_freeBytes = 0;
+
+    if (!writeIndexOffset(0))
+    {
+        return false;
+    }
+
+    return ftruncate(m_fd, kArchiveHeaderSize) == 0;
+}
+
+bool
+TileArchive::flush(void)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    if (m_fd < 0)
+    {
+        return false;
+    }
+
+    // tiles cannot be moved while data is written to reserved extents
+    if (m_nPendingWrites == 0 &&
+        m_freeBytes > kArchiveSlack * (m_dataEnd - kArchiveHeaderSize))
+    {
+        if (!compact())
+        {
+            return false;
+        }
+    }
+
+    if (m_indexStored)
+    {
+        return true;
+    }
+
+    std::vector<char> buffer;
+
+    boost::uint32_t nEntries = m_index.size();
+    buffer.insert(buffer.end(), reinterpret_cast<const char*>(&nEntries),
+                  reinterpret_cast<const char*>(&nEntries) + sizeof(boost::uint32_t));
+
+    for (boost::unordered_map<std::string, Entry>::const_iterator it = m_index.begin();
+         it != m_index.end(); ++it)
+    {
+        boost::uint16_t nameLength = it->first.size();
+        buffer.insert(buffer.end(), reinterpret_cast<const char*>(&nameLength),
+                      reinterpret_cast<const char*>(&nameLength) + sizeof(boost::uint16_t));
+        buffer.insert(buffer.end(), it->first.begin(), it->first.end());
+
+        const Entry& entry = it->second;
+        buffer.insert(buffer.end(), reinterpret_cast<const char*>(&entry.offset),
+                      reinterpret_cast<const char*>(&entry.offset) + sizeof(boost::uint64_t));
+        buffer.insert(buffer.end(), reinterpret_cast<const char*>(&entry.size),
+                      reinterpret_cast<const char*>(&entry.size) + sizeof(boost::uint32_t));
+        buffer.insert(buffer.end(), reinterpret_cast<const char*>(&entry.capacity),
+                      reinterpret_cast<const char*>(&entry.capacity) + sizeof(boost::uint32_t));
+    }
+
+    if (!writeAll(m_fd, buffer.data(), buffer.size(), m_dataEnd))
+    {
+        return false;
+    }
+
+    // drop data which was freed at the end of the file
+    if (ftruncate(m_fd, m_dataEnd + buffer.size()) != 0)
+    {
+        return false;
+    }
+
+    if (!writeIndexOffset(m_dataEnd))
+    {
+        return false;
+    }
+
+    m_indexStored = true;
+
+    return true;
+}
+
+bool
+TileArchive::contains(const std::string& name) const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    return m_index.find(name) != m_index.end();
+}
+
+size_t
+TileArchive::tileCount(void) const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    return m_index.size();
+}
+
+size_t
+TileArchive::dataSize(void) const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    return m_dataEnd - kArchiveHeaderSize;
+}
+
+bool
+TileArchive::read(const std::string& name, OcTree& tile) const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    boost::unordered_map<std::string, Entry>::const_iterator it = m_index.find(name);
+    if (it == m_index.end())
+    {
+        return false;
+    }
+
+    const Entry& entry = it->second;
+
+    if (entry.offset + entry.size <= m_mappedSize)
+    {
+        return tile.read(static_cast<const char*>(m_region->get_address()) + entry.offset,
+                         entry.size);
+    }
+
+    std::vector<char> buffer(entry.size);
+
+    if (!readAll(m_fd, buffer.data(), entry.size, entry.offset))
+    {
+        return false;
+    }
+
+    return tile.read(buffer.data(), buffer.size());
+}
+
+bool
+TileArchive::write(const std::string& name, const OcTree& tile)
+{
+    std::vector<char> buffer;
+    if (!tile.writeCompressed(buffer, k_bitsPerLeaf))
+    {
+        return false;
+    }
+
+    Entry extent;
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+
+        if (m_fd < 0)
+        {
+            return false;
+        }
+
+        // the stored index is about to be overwritten by tile data
+        if (!invalidateIndex())
+        {
+            return false;
+        }
+
+        extent = allocateExtent(buffer.size());
+
+        ++m_nPendingWrites;
+    }
+
+    // The extent is neither free nor referenced by the index, so that
+    // it is not accessed by anyone else while the data is written.
+    bool written = writeAll(m_fd, buffer.data(), buffer.size(), extent.offset);
+
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    --m_nPendingWrites;
+
+    if (!written)
+    {
+        freeExtent(extent.offset, extent.capacity);
+        return false;
+    }
+
+    // a stored index may have been written in the meantime, and refer
+    // to the extent of the previous version
+    if (!invalidateIndex())
+    {
+        freeExtent(extent.offset, extent.capacity);
+        return false;
+    }
+
+    Entry& entry = m_index[name];
+    if (entry.capacity > 0)
+    {
+        freeExtent(entry.offset, entry.capacity);
+    }
+    entry = extent;
+
+    return true;
+}
+
+bool
+TileArchive::readIndex(void)
+{
+    char header[kArchiveHeaderSize];
+
+    if (!readAll(m_fd, header, kArchiveHeaderSize, 0))
+    {
+        return false;
+    }
+
+    boost::uint32_t version;
+    memcpy(&version, header + sizeof(kArchiveMagic), sizeof(boost::uint32_t));
+
+    if (memcmp(header, kArchiveMagic, sizeof(kArchiveMagic)) != 0 ||
+        version != kArchiveVersion)
+    {
+        return false;
+    }
+
+    boost::uint64_t indexOffset;
+    memcpy(&indexOffset, header + kArchiveIndexOffsetPos, sizeof(boost::uint64_t));
+
+    if (indexOffset < kArchiveHeaderSize)
+    {
+        return false;
+    }
+
+    boost::uint64_t mark = indexOffset;
+
+    boost::uint32_t nEntries;
+    if (!readAll(m_fd, reinterpret_cast<char*>(&nEntries), sizeof(boost::uint32_t), mark))
+    {
+        return false;
+    }
+    mark += sizeof(boost::uint32_t);
+
+    // extents of the tiles, from which the free extents are recovered
+    std::vector<std::pair<boost::uint64_t, boost::uint64_t> > extents;
+
+    for (boost::uint32_t i = 0; i < nEntries; ++i)
+    {
+        boost::uint16_t nameLength;
+        if (!readAll(m_fd, reinterpret_cast<char*>(&nameLength), sizeof(boost::uint16_t), mark))
+        {
+            return false;
+        }
+        mark += sizeof(boost::uint16_t);
+
+        std::string name(nameLength, '\0');
+        if (nameLength > 0 &&
+            !readAll(m_fd, &name[0], nameLength, mark))
+        {
+            return false;
+        }
+        mark += nameLength;
+
+        Entry entry;
+        if (!readAll(m_fd, reinterpret_cast<char*>(&entry.offset), sizeof(boost::uint64_t), mark) ||
+            !readAll(m_fd, reinterpret_cast<char*>(&entry.size), sizeof(boost::uint32_t), mark + sizeof(boost::uint64_t)) ||
+            !readAll(m_fd, reinterpret_cast<char*>(&entry.capacity), sizeof(boost::uint32_t), mark + sizeof(boost::uint64_t) + sizeof(boost::uint32_t)))
+        {
+            return false;
+        }
+        mark += sizeof(boost::uint64_t) + sizeof(boost::uint32_t) * 2;
+
+        if (entry.offset < kArchiveHeaderSize ||
+            entry.size > entry.capacity ||
+            entry.offset + entry.capacity > indexOffset)
+        {
+            return false;
+        }
+
+        m_index[name] = entry;
+        extents.push_back(std::make_pair(entry.offset, entry.capacity));
+    }
+
+    m_dataEnd = indexOffset;
+    m_indexStored = true;
+
+    std::sort(extents.begin(), extents.end());
+
+    boost::uint64_t end = kArchiveHeaderSize;
+    for (size_t i = 0; i < extents.size(); ++i)
+    {
+        if (extents.at(i).first < end)
+        {
+            // overlapping tiles
+            return false;
+        }
+        if (extents.at(i).first > end)
+        {
+            m_freeExtents[end] = extents.at(i).first - end;
+            m_freeBytes += extents.at(i).first - end;
+        }
+
+        end = extents.at(i).first + extents.at(i).second;
+    }
+    if (m_dataEnd > end)
+    {
+        m_freeExtents[end] = m_dataEnd - end;
+        m_freeBytes += m_dataEnd - end;
+    }
+
+    return true;
+}
+
+bool
+TileArchive::writeIndexOffset(boost::uint64_t indexOffset)
+{
+    return writeAll(m_fd, reinterpret_cast<const char*>(&indexOffset),
+                    sizeof(boost::uint64_t), kArchiveIndexOffsetPos);
+}
+
+bool
+TileArchive::invalidateIndex(void)
+{
+    if (!m_indexStored)
+    {
+        return true;
+    }
+
+    if (!writeIndexOffset(0))
+    {
+        return false;
+    }
+
+    m_indexStored = false;
+
+    return true;
+}
+
+TileArchive::Entry
+TileArchive::allocateExtent(size_t size)
+{
+    boost::uint64_t slack = static_cast<boost::uint64_t>(kArchiveSlack * size);
+
+    Entry extent;
+    extent.size = size;
+
+    // best fit among the free extents
+    std::map<boost::uint64_t, boost::uint64_t>::iterator itBest = m_freeExtents.end();
+    for (std::map<boost::uint64_t, boost::uint64_t>::iterator it = m_freeExtents.begin();
+         it != m_freeExtents.end(); ++it)
+    {
+        if (it->second >= size &&
+            (itBest == m_freeExtents.end() || it->second < itBest->second))
+        {
+            itBest = it;
+        }
+    }
+
+    if (itBest != m_freeExtents.end())
+    {
+        extent.offset = itBest->first;
+        extent.capacity = itBest->second;
+
+        // split off the rest of an extent which is much larger
+        if (itBest->second > size + slack)
+        {
+            extent.capacity = size + slack;
+            m_freeExtents[itBest->first + extent.capacity] = itBest->second - extent.capacity;
+        }
+
+        m_freeBytes -= extent.capacity;
+        m_freeExtents.erase(itBest);
+
+        return extent;
+    }
+
+    extent.offset = m_dataEnd;
+    extent.capacity = size + slack;
+
+    m_dataEnd += extent.capacity;
+
+    return extent;
+}
+
+void
+TileArchive::freeExtent(boost::uint64_t offset, boost::uint64_t length)
+{
+    // merge with adjacent free extents
+    std::map<boost::uint64_t, boost::uint64_t>::iterator itNext = m_freeExtents.lower_bound(offset);
+    if (itNext != m_freeExtents.end() && offset + length == itNext->first)
+    {
+        length += itNext->second;
+        m_freeBytes -= itNext->second;
+        m_freeExtents.erase(itNext++);
+    }
+
+    if (itNext != m_freeExtents.begin())
+    {
+        std::map<boost::uint64_t, boost::uint64_t>::iterator itPrev = itNext;
+        --itPrev;
+
+        if (itPrev->first + itPrev->second == offset)
+        {
+            offset = itPrev->first;
+            length += itPrev->second;
+            m_freeBytes -= itPrev->second;
+            m_freeExtents.erase(itPrev);
+        }
+    }
+
+    // free space at the end of the data is given back
+    if (offset + length == m_dataEnd)
+    {
+        m_dataEnd = offset;
+        return;
+    }
+
+    m_freeExtents[offset] = length;
+    m_freeBytes += length;
+}
+
+bool
+TileArchive::compact(void)
+{
+    // tiles are about to be moved
+    if (!invalidateIndex())
+    {
+        return false;
+    }
+
+    std::vector<std::pair<boost::uint64_t, Entry*> > entries;
+    for (boost::unordered_map<std::string, Entry>::iterator it = m_index.begin();
+         it != m_index.end(); ++it)
+    {
+        entries.push_back(std::make_pair(it->second.offset, &it->second));
+    }
+
+    std::sort(entries.begin(), entries.end());
+
+    // Tiles are moved towards the start of the file in the order of their
+    // offsets, so that no tile is overwritten before it has been moved.
+    boost::uint64_t end = kArchiveHeaderSize;
+    std::vector<char> buffer;
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        Entry& entry = *(entries.at(i).second);
+
+        if (entry.offset != end)
+        {
+            buffer.resize(entry.size);
+            if (!readAll(m_fd, buffer.data(), entry.size, entry.offset) ||
+                !writeAll(m_fd, buffer.data(), entry.size, end))
+            {
+                return false;
+            }
+
+            entry.offset = end;
+        }
+
+        entry.capacity = entry.size;
+        end += entry.capacity;
+    }
+
+    m_dataEnd = end;
+    m_freeExtents.clear();
+    m_freeBytes = 0;
+
+    m_region.reset();
+    m_mapping.reset();
+    m_mappedSize = 0;
+
+    mapFile();
+
+    return true;
+}
+
+void
+TileArchive::mapFile(void)
+{
+    if (m_dataEnd <= kArchiveHeaderSize)
+    {
+        return;
+    }
+
+    m_mapping = boost::make_shared<boost::interprocess::file_mapping>(m_filename.c_str(),
+                                                                      boost::interprocess::read_only);
+    m_region = boost::make_shared<boost::interprocess::mapped_region>(*m_mapping,
+                                                                      boost::interprocess::read_only,
+                                                                      0, m_dataEnd);
+    m_mappedSize = m_dataEnd;
+}
+
+}
@@ -0,0 +1,110 @@
+#ifndef TILEARCHIVE_H
+#define TILEARCHIVE_H
+
+#include <boost/cstdint.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "dynocmap/OcTree.h"
+
+namespace px
+{
+
+/**
+ * \brief Single-file archive of compressed octree tiles
+ *
+ * Tiles are located by name through an index which flush() stores at the
+ * end of the file. A rewritten tile is written to a free extent of the
+ * file, or appended, while the archive is unlocked, and then replaces the
+ * previous version of the tile, whose extent is freed. New extents have
+ * some slack, so that freed extents can hold slightly larger tiles.
+ * flush() compacts the file if a large part of it is free. Tiles which are
+ * present when the archive is opened are decoded directly from a memory
+ * mapping of the file.
+ */
+class TileArchive
+{
+public:
+    explicit TileArchive(int bitsPerLeaf = 16);
+    virtual ~TileArchive();
+
+    // Open the archive, creating it if it does not exist.
+    bool open(const std::string& filename);
+    void close(void);
+
+    // Remove all tiles.
+    bool clear(void);
+
+    // Store the index, so that the archive can be opened again.
+    bool flush(void);
+
+    virtual bool contains(const std::string& name) const;
+    size_t tileCount(void) const;
+
+    // Bytes of the file taken up by tile data, including free extents.
+    size_t dataSize(void) const;
+
+    virtual bool read(const std::string& name, OcTree& tile) const;
+    // Concurrent writes of the same tile take effect in the order in
+    // which they complete.
+    virtual bool write(const std::string& name, const OcTree& tile);
+
+private:
+    class Entry
+    {
+    public:
+        Entry()
+         : offset(0), size(0), capacity(0) {};
+
+        boost::uint64_t offset;
+        boost::uint32_t size;
+        boost::uint32_t capacity;
+    };
+
+    // The following methods must be called with m_mutex locked.
+    bool readIndex(void);
+    bool writeIndexOffset(boost::uint64_t indexOffset);
+    // Mark the index stored in the file as outdated, before any data it
+    // refers to is overwritten.
+    bool invalidateIndex(void);
+    Entry allocateExtent(size_t size);
+    void freeExtent(boost::uint64_t offset, boost::uint64_t length);
+    bool compact(void);
+    void mapFile(void);
+
+    const int k_bitsPerLeaf;
+
+    std::string m_filename;
+    int m_fd;
+
+    boost::unordered_map<std::string, Entry> m_index;
+
+    // offset of the end of the tile data, where the index is stored
+    boost::uint64_t m_dataEnd;
+    // true if the index stored in the file is up to date
+    bool m_indexStored;
+
+    // extents between tiles which can be reused, keyed by offset
+    std::map<boost::uint64_t, boost::uint64_t> m_freeExtents;
+    boost::uint64_t m_freeBytes;
+
+    // writes whose data is being written to a reserved extent
+    size_t m_nPendingWrites;
+
+    boost::shared_ptr<boost::interprocess::file_mapping> m_mapping;
+    boost::shared_ptr<boost::interprocess::mapped_region> m_region;
+    boost::uint64_t m_mappedSize;
+
+    mutable boost::mutex m_mutex;
+};
+
+}
+
+#endif
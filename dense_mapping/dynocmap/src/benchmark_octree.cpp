@@ -0,0 +1,331 @@
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/program_options.hpp>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+
+#include "dynocmap/OcTree.h"
+#include "sensor_models/LaserSensorModel.h"
+
+// Synthetic depth image of a wavy surface in front of the camera.
+void
+syntheticDepthImage(int rows, int cols, cv::Mat& depthImage)
+{
+    depthImage.create(rows, cols, CV_32F);
+    for (int r = 0; r < rows; ++r)
+    {
+        float* depth = depthImage.ptr<float>(r);
+        for (int c = 0; c < cols; ++c)
+        {
+            depth[c] = 1.0f + 4.0f * (0.5f + 0.5f * sin(r * 0.013f + c * 0.011f));
+        }
+    }
+}
+
+// Reports castRays throughput in rays and leaf updates per second, and
+// node storage of px::OcTree.
+void
+benchmark(const cv::Mat& depthImage, double resolution, int treeHeight,
+          bool usePyramid, int nThreads, int nIterations)
+{
+    px::SensorModelPtr sensorModel(new px::LaserSensorModel(0.4, 0.9, 8.0, 0.05));
+
+    Eigen::Matrix3d cameraMatrix;
+    cameraMatrix << depthImage.cols * 0.75, 0.0, depthImage.cols / 2.0,
+                    0.0, depthImage.cols * 0.75, depthImage.rows / 2.0,
+                    0.0, 0.0, 1.0;
+
+    Eigen::Matrix4d sensorPose = Eigen::Matrix4d::Identity();
+
+    Eigen::Vector3d center = Eigen::Vector3d::Zero();
+    px::OcTree octree(resolution, treeHeight, center);
+
+    size_t nUpdatesStart = octree.modificationCount();
+
+    double tTraversal = 0.0;
+    double tMerge = 0.0;
+    double tUpdate = 0.0;
+
+    boost::posix_time::ptime tsStart = boost::posix_time::microsec_clock::universal_time();
+    for (int i = 0; i < nIterations; ++i)
+    {
+        octree.castRays(sensorPose, depthImage, cameraMatrix, sensorModel, usePyramid, nThreads);
+
+        double t[3];
+        octree.batchUpdateTimes(t[0], t[1], t[2]);
+        tTraversal += t[0] / nIterations;
+        tMerge += t[1] / nIterations;
+        tUpdate += t[2] / nIterations;
+    }
+    double tCastRays = (boost::posix_time::microsec_clock::universal_time() - tsStart).total_microseconds() * 1e-3 / nIterations;
+
+    // leaf updates per castRays call
+    double nUpdates = static_cast<double>(octree.modificationCount() - nUpdatesStart) / nIterations;
+
+    size_t nLeafs = octree.leafs().size();
+    size_t nNodes = octree.nodeCount();
+    size_t nBytes = octree.memoryUsage();
+
+    printf("castRays%-10s  %8.2f ms  %10.0f rays/s  %10.0f nodes/s\n",
+           usePyramid ? " (pyramid)" : "",
+           tCastRays,
+           depthImage.rows * depthImage.cols / (tCastRays * 1e-3),
+           nUpdates / (tCastRays * 1e-3));
+    if (nThreads != 1)
+    {
+        // rays are traversed and their updates merged in parallel, and the
+        // tree update and the endpoint computation are serial
+        printf("  parallel          %8.2f ms  traversal %.2f ms  merge %.2f ms\n",
+               tTraversal + tMerge, tTraversal, tMerge);
+        printf("  serial            %8.2f ms  tree update %.2f ms  endpoints %.2f ms\n",
+               tCastRays - tTraversal - tMerge, tUpdate,
+               tCastRays - tTraversal - tMerge - tUpdate);
+    }
+    printf("tree                %zu nodes  %zu leafs  %zu bytes  %.2f bytes/leaf\n",
+           nNodes, nLeafs, nBytes,
+           static_cast<double>(nBytes) / nLeafs);
+}
+
+int
+occupancyClass(const px::OcTree& octree, double logOdds)
+{
+    if (logOdds >= octree.logOddsOccThresh())
+    {
+        return 1;
+    }
+    else if (logOdds < 0.0)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+// Compares integration of a dense scan with one ray per point against
+// voxel-deduplicated integration with px::OcTree::insertScan.
+void
+benchmarkInsertScan(const cv::Mat& depthImage, double resolution, int treeHeight,
+                    int nThreads, int nIterations)
+{
+    px::SensorModelPtr sensorModel(new px::LaserSensorModel(0.4, 0.9, 8.0, 0.05));
+
+    double f = depthImage.cols * 0.75;
+
+    std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > scan;
+    for (int r = 0; r < depthImage.rows; ++r)
+    {
+        const float* depth = depthImage.ptr<float>(r);
+        for (int c = 0; c < depthImage.cols; ++c)
+        {
+            scan.push_back(Eigen::Vector3d((c - depthImage.cols / 2.0) * depth[c] / f,
+                                           (r - depthImage.rows / 2.0) * depth[c] / f,
+                                           depth[c]));
+        }
+    }
+
+    Eigen::Matrix4d sensorPose = Eigen::Matrix4d::Identity();
+
+    Eigen::Vector3d center = Eigen::Vector3d::Zero();
+    px::OcTree octreeRays(resolution, treeHeight, center);
+    px::OcTree octreeScan(resolution, treeHeight, center);
+
+    boost::posix_time::ptime tsStart = boost::posix_time::microsec_clock::universal_time();
+    for (int i = 0; i < nIterations; ++i)
+    {
+        for (size_t j = 0; j < scan.size(); ++j)
+        {
+            octreeRays.castRay(sensorPose, scan.at(j), px::OcTree::SENSOR_FRAME, sensorModel);
+        }
+    }
+    double tRays = (boost::posix_time::microsec_clock::universal_time() - tsStart).total_microseconds() * 1e-3 / nIterations;
+
+    tsStart = boost::posix_time::microsec_clock::universal_time();
+    for (int i = 0; i < nIterations; ++i)
+    {
+        octreeScan.insertScan(sensorPose, scan, px::OcTree::SENSOR_FRAME, sensorModel, nThreads);
+    }
+    double tScan = (boost::posix_time::microsec_clock::universal_time() - tsStart).total_microseconds() * 1e-3 / nIterations;
+
+    printf("castRay per point   %8.2f ms  %10.0f points/s\n",
+           tRays, scan.size() / (tRays * 1e-3));
+    printf("insertScan          %8.2f ms  %10.0f points/s  speedup: %5.2fx\n",
+           tScan, scan.size() / (tScan * 1e-3), tRays / tScan);
+
+    // compare occupied / free / unknown classification of cells
+    std::vector<px::OccupancyCell, Eigen::aligned_allocator<px::OccupancyCell> > cells = octreeRays.leafs();
+
+    size_t nCells = 0;
+    size_t nAgree = 0;
+    size_t nOccupied = 0;
+    size_t nOccupiedAgree = 0;
+    for (size_t i = 0; i < cells.size(); ++i)
+    {
+        px::OcNodePtr node = octreeScan.findNode(cells.at(i).coords);
+
+        int classRays = occupancyClass(octreeRays, cells.at(i).occupancyLogOdds);
+        int classScan = node ? occupancyClass(octreeScan, node->getLogOdds()) : 0;
+
+        if (classRays == 0 && classScan == 0)
+        {
+            continue;
+        }
+
+        ++nCells;
+        if (classRays == classScan)
+        {
+            ++nAgree;
+        }
+
+        if (classRays == 1)
+        {
+            ++nOccupied;
+            if (classScan == 1)
+            {
+                ++nOccupiedAgree;
+            }
+        }
+    }
+
+    printf("map equivalence     %.2f%% of %zu observed cells, %.2f%% of %zu occupied cells\n",
+           100.0 * nAgree / nCells, nCells,
+           100.0 * nOccupiedAgree / nOccupied, nOccupied);
+}
+
+// Compares box collision checks which use the occupancy summaries of
+// px::OcTree against checking every leaf in the box.
+void
+benchmarkCollisionChecks(const cv::Mat& depthImage, double resolution, int treeHeight,
+                         int nIterations)
+{
+    px::SensorModelPtr sensorModel(new px::LaserSensorModel(0.4, 0.9, 8.0, 0.05));
+
+    Eigen::Matrix3d cameraMatrix;
+    cameraMatrix << depthImage.cols * 0.75, 0.0, depthImage.cols / 2.0,
+                    0.0, depthImage.cols * 0.75, depthImage.rows / 2.0,
+                    0.0, 0.0, 1.0;
+
+    Eigen::Matrix4d sensorPose = Eigen::Matrix4d::Identity();
+
+    Eigen::Vector3d center = Eigen::Vector3d::Zero();
+    px::OcTree octree(resolution, treeHeight, center);
+    octree.castRays(sensorPose, depthImage, cameraMatrix, sensorModel, false);
+
+    // boxes of 1 m in front of the camera
+    const int nBoxes = 1000;
+    std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > boxMin;
+    srand(0);
+    for (int i = 0; i < nBoxes; ++i)
+    {
+        Eigen::Vector3d p = Eigen::Vector3d::Random();
+        boxMin.push_back(Eigen::Vector3d(2.0 * p(0), 2.0 * p(1), 3.0 + 2.5 * p(2)));
+    }
+    Eigen::Vector3d boxSize = Eigen::Vector3d::Constant(1.0);
+
+    std::vector<bool> occupied(nBoxes);
+    boost::posix_time::ptime tsStart = boost::posix_time::microsec_clock::universal_time();
+    for (int i = 0; i < nIterations; ++i)
+    {
+        for (int j = 0; j < nBoxes; ++j)
+        {
+            occupied.at(j) = octree.isBoxOccupied(boxMin.at(j), boxMin.at(j) + boxSize);
+        }
+    }
+    double tSummaries = (boost::posix_time::microsec_clock::universal_time() - tsStart).total_microseconds() * 1e-3 / nIterations;
+
+    std::vector<bool> occupiedLeafs(nBoxes);
+    tsStart = boost::posix_time::microsec_clock::universal_time();
+    for (int i = 0; i < nIterations; ++i)
+    {
+        for (int j = 0; j < nBoxes; ++j)
+        {
+            Eigen::Vector3i lo, hi;
+            for (int k = 0; k < 3; ++k)
+            {
+                lo(k) = static_cast<int>(floor(boxMin.at(j)(k) / resolution));
+                hi(k) = static_cast<int>(floor((boxMin.at(j)(k) + boxSize(k)) / resolution));
+            }
+
+            bool collision = false;
+            for (int x = lo(0); x <= hi(0) && !collision; ++x)
+            {
+                for (int y = lo(1); y <= hi(1) && !collision; ++y)
+                {
+                    for (int z = lo(2); z <= hi(2) && !collision; ++z)
+                    {
+                        double logOdds;
+                        collision = octree.leafLogOdds(Eigen::Vector3i(x, y, z), logOdds) &&
+                                    logOdds > octree.logOddsOccThresh();
+                    }
+                }
+            }
+
+            occupiedLeafs.at(j) = collision;
+        }
+    }
+    double tLeafs = (boost::posix_time::microsec_clock::universal_time() - tsStart).total_microseconds() * 1e-3 / nIterations;
+
+    int nOccupied = 0;
+    int nAgree = 0;
+    for (int j = 0; j < nBoxes; ++j)
+    {
+        if (occupied.at(j))
+        {
+            ++nOccupied;
+        }
+        if (occupied.at(j) == occupiedLeafs.at(j))
+        {
+            ++nAgree;
+        }
+    }
+
+    printf("box checks (leafs)  %8.2f ms\n", tLeafs);
+    printf("box checks          %8.2f ms  speedup: %5.2fx  %d of %d boxes occupied, %d agree\n",
+           tSummaries, tLeafs / tSummaries, nOccupied, nBoxes, nAgree);
+}
+
+int
+main(int argc, char** argv)
+{
+    int rows;
+    int cols;
+    double resolution;
+    int treeHeight;
+    int nThreads;
+    int nIterations;
+
+    //========= Handling Program options =========
+    boost::program_options::options_description desc("Allowed options");
+    desc.add_options()
+        ("help", "produce help message")
+        ("rows,r", boost::program_options::value<int>(&rows)->default_value(480), "Depth image rows")
+        ("cols,c", boost::program_options::value<int>(&cols)->default_value(640), "Depth image columns")
+        ("resolution", boost::program_options::value<double>(&resolution)->default_value(0.05), "Octree resolution")
+        ("height", boost::program_options::value<int>(&treeHeight)->default_value(10), "Octree height")
+        ("threads,t", boost::program_options::value<int>(&nThreads)->default_value(1), "Number of castRays threads (0: one per core)")
+        ("iterations,i", boost::program_options::value<int>(&nIterations)->default_value(3), "Number of iterations")
+        ;
+
+    boost::program_options::variables_map vm;
+    boost::program_options::store(boost::program_options::parse_command_line(argc, argv, desc), vm);
+    boost::program_options::notify(vm);
+
+    if (vm.count("help"))
+    {
+        std::cout << desc << std::endl;
+        return 1;
+    }
+
+    std::cout << "# " << rows << " x " << cols << " depth image, resolution "
+              << resolution << ", height " << treeHeight
+              << ", " << nThreads << " threads" << std::endl;
+
+    cv::Mat depthImage;
+    syntheticDepthImage(rows, cols, depthImage);
+
+    benchmark(depthImage, resolution, treeHeight, true, nThreads, nIterations);
+    benchmark(depthImage, resolution, treeHeight, false, nThreads, nIterations);
+    benchmarkInsertScan(depthImage, resolution, treeHeight, nThreads, nIterations);
+    benchmarkCollisionChecks(depthImage, resolution, treeHeight, nIterations);
+
+    return 0;
+}
@@ -1,3 +1,5 @@
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
 #include <eigen_conversions/eigen_msg.h>
 #include <gtest/gtest.h>
 #include <iostream>
@@ -111,6 +113,73 @@ TEST(DynocMap, CastRay2)
     EXPECT_TRUE(expectObstacle(pObstacleGlobal, center, width));
 }
 
+// Insert the same scan with bundled rays into one map and ray by ray into
+// another, and check that the maps are equivalent. The endpoints of the
+// scan lie in different directions, and some are repeated so that their
+// occupied updates are scaled by the hit count, and clamped.
+TEST(DynocMap, InsertScanBundled)
+{
+    px::SensorModelPtr sensorModel(new px::LaserSensorModel(0.1, 0.7,
+                                                            maxSensorRange,
+                                                            sensorSigma));
+
+    px::DynocMap map1(resolution, sensorModel, "mapcache");
+    px::DynocMap map2(resolution, sensorModel, "mapcache");
+
+    geometry_msgs::Pose sensorPose;
+    tf::quaternionEigenToMsg(Eigen::Quaterniond::Identity(), sensorPose.orientation);
+    tf::pointEigenToMsg(Eigen::Vector3d::Zero(), sensorPose.position);
+
+    std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > endpoints;
+    endpoints.push_back(Eigen::Vector3d(2.37, 0.41, -0.18));
+    endpoints.push_back(Eigen::Vector3d(-0.52, 3.11, 0.27));
+    endpoints.push_back(Eigen::Vector3d(-2.83, -0.94, 0.63));
+    endpoints.push_back(Eigen::Vector3d(0.36, -1.77, 2.46));
+
+    int hitCounts[4] = {1, 2, 3, 5};
+
+    std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > scan;
+    for (int i = 0; i < 5; ++i)
+    {
+        for (size_t j = 0; j < endpoints.size(); ++j)
+        {
+            if (i < hitCounts[j])
+            {
+                scan.push_back(endpoints.at(j));
+            }
+        }
+    }
+
+    map1.insertScan(sensorPose, scan, px::DynocMap::SENSOR_FRAME, true);
+    map2.insertScan(sensorPose, scan, px::DynocMap::SENSOR_FRAME, false);
+
+    std::vector<px::OccupancyTile, Eigen::aligned_allocator<px::OccupancyTile> > tiles1 = map1.tiles();
+    std::vector<px::OccupancyTile, Eigen::aligned_allocator<px::OccupancyTile> > tiles2 = map2.tiles();
+    ASSERT_EQ(tiles1.size(), tiles2.size());
+
+    size_t obstacleCount = 0;
+    for (size_t i = 0; i < tiles1.size(); ++i)
+    {
+        const std::vector<px::OccupancyCell, Eigen::aligned_allocator<px::OccupancyCell> >& cells1 = tiles1.at(i).cells();
+        const std::vector<px::OccupancyCell, Eigen::aligned_allocator<px::OccupancyCell> >& cells2 = tiles2.at(i).cells();
+        ASSERT_EQ(cells1.size(), cells2.size());
+
+        for (size_t j = 0; j < cells1.size(); ++j)
+        {
+            EXPECT_EQ(cells1.at(j).coords, cells2.at(j).coords);
+            EXPECT_EQ(cells1.at(j).width, cells2.at(j).width);
+            EXPECT_NEAR(cells1.at(j).occupancyLogOdds, cells2.at(j).occupancyLogOdds, 1e-5);
+        }
+
+        EXPECT_EQ(tiles1.at(i).obstacles().size(), tiles2.at(i).obstacles().size());
+        obstacleCount += tiles1.at(i).obstacles().size();
+    }
+
+    // a single occupied update is below the occupancy threshold, so only
+    // the repeated endpoints are obstacles
+    EXPECT_GE(obstacleCount, endpoints.size() - 1);
+}
+
 // Create a map centered at the origin, and insert an obstacle within
 // the map boundary. Recenter the map such that the obstacle lies outside
 // the map boundary, and check for a zero obstacle count. Recenter the map
@@ -251,6 +320,379 @@ TEST(DynocMap, Recenter2)
     }
 }
 
+// Same as Recenter1, but with the map recentered in the background, with
+// and without a memory cache. Check that the map stays at its previous
+// position until the new window has been switched to.
+TEST(DynocMap, RecenterAsync)
+{
+    // tiles which leave the window are handed to the memory cache, or
+    // written to the tile archive in the background
+    for (int k = 0; k < 2; ++k)
+    {
+        bool enableCaching = (k == 0);
+
+        px::SensorModelPtr sensorModel(new px::LaserSensorModel(freeSpaceProbability,
+                                                                occSpaceProbability,
+                                                                maxSensorRange,
+                                                                sensorSigma));
+
+        px::DynocMap map(resolution, sensorModel, "mapcache", enableCaching);
+
+        Eigen::Quaterniond q = Eigen::Quaterniond::Identity();
+        Eigen::Vector3d t = Eigen::Vector3d::Zero();
+
+        geometry_msgs::Pose cameraPose;
+        tf::quaternionEigenToMsg(q, cameraPose.orientation);
+        tf::pointEigenToMsg(t, cameraPose.position);
+
+        Eigen::Vector3d pObstacleLocal(Eigen::Vector3d(obstacleRange, 0.0, 0.0));
+
+        map.castRay(cameraPose, pObstacleLocal, px::DynocMap::SENSOR_FRAME);
+
+        Eigen::Vector3d center = map.center();
+
+        map.recenterAsync(Eigen::Vector3d::Constant(1000.0), Eigen::Vector3d::Constant(1.0));
+
+        ASSERT_TRUE((map.center() - center).norm() < 1e-10);
+
+        ASSERT_TRUE(map.waitForRecenterLoaded(10.0));
+
+        ASSERT_TRUE((map.center() - center).norm() < 1e-10);
+
+        map.waitForRecenter();
+
+        ASSERT_TRUE((map.center() - center).norm() > 1.0);
+
+        std::vector<px::OccupancyTile> tiles = map.tiles();
+
+        int nObstacles = 0;
+        for (size_t i = 0; i < tiles.size(); ++i)
+        {
+            nObstacles += tiles.at(i).obstacles().size();
+        }
+
+        ASSERT_EQ(0, nObstacles);
+
+        map.recenterAsync(Eigen::Vector3d::Zero());
+        map.waitForRecenter();
+
+        tiles = map.tiles();
+
+        std::vector<px::OccupancyCell> obstacles;
+        for (size_t i = 0; i < tiles.size(); ++i)
+        {
+            std::vector<px::OccupancyCell> tileObstacles = tiles.at(i).obstacles();
+
+            obstacles.insert(obstacles.end(), tileObstacles.begin(), tileObstacles.end());
+        }
+
+        ASSERT_EQ(1, obstacles.size());
+
+        Eigen::Vector3i obstacleCenter = obstacles.front().coords;
+        int width = obstacles.front().width;
+
+        Eigen::Vector3d pObstacleGlobal = q.toRotationMatrix() * pObstacleLocal + t;
+
+        EXPECT_TRUE(expectObstacle(pObstacleGlobal, obstacleCenter, width));
+    }
+}
+
+// Start recentering the map by one tile in the background, and insert an
+// obstacle into a tile which stays in the window while the new window is
+// being loaded. Check that collision checks find the obstacle before and
+// after the new window has been switched to.
+TEST(DynocMap, RecenterAsyncCollision)
+{
+    px::SensorModelPtr sensorModel(new px::LaserSensorModel(freeSpaceProbability,
+                                                            occSpaceProbability,
+                                                            maxSensorRange,
+                                                            sensorSigma));
+
+    px::DynocMap map(resolution, sensorModel, "mapcache");
+
+    geometry_msgs::Pose cameraPose;
+    tf::quaternionEigenToMsg(Eigen::Quaterniond::Identity(), cameraPose.orientation);
+    tf::pointEigenToMsg(Eigen::Vector3d::Zero(), cameraPose.position);
+
+    Eigen::Vector3d pObstacle(obstacleRange, 0.0, 0.0);
+    Eigen::Vector3d boxSize = Eigen::Vector3d::Constant(resolution);
+
+    Eigen::Vector3d center = map.center();
+
+    map.recenterAsync(Eigen::Vector3d(map.tileWidth(), 0.0, 0.0));
+
+    // the new window is loaded before the obstacle is inserted
+    ASSERT_TRUE(map.waitForRecenterLoaded(10.0));
+
+    map.castRay(cameraPose, pObstacle, px::DynocMap::SENSOR_FRAME);
+
+    EXPECT_TRUE(map.isBoxOccupied(pObstacle - boxSize, pObstacle + boxSize));
+
+    map.waitForRecenter();
+
+    ASSERT_TRUE((map.center() - center).norm() > 1.0);
+
+    EXPECT_TRUE(map.isBoxOccupied(pObstacle - boxSize, pObstacle + boxSize));
+    EXPECT_TRUE(map.isSweptSphereOccupied(Eigen::Vector3d(obstacleRange, -1.0, 0.0),
+                                          Eigen::Vector3d(obstacleRange, 1.0, 0.0),
+                                          resolution));
+    EXPECT_FALSE(map.isSweptSphereOccupied(Eigen::Vector3d(obstacleRange / 2.0, -1.0, 0.0),
+                                           Eigen::Vector3d(obstacleRange / 2.0, 1.0, 0.0),
+                                           resolution));
+}
+
+// Insert an obstacle with castRay, and check that it only appears in
+// snapshots published afterwards. Query the published snapshot for free,
+// occupied and unknown cells, and cast rays towards and away from the
+// obstacle.
+TEST(DynocMap, Snapshot)
+{
+    px::SensorModelPtr sensorModel(new px::LaserSensorModel(freeSpaceProbability,
+                                                            occSpaceProbability,
+                                                            maxSensorRange,
+                                                            sensorSigma));
+
+    px::DynocMap map(resolution, sensorModel, "mapcache");
+
+    geometry_msgs::Pose cameraPose;
+    tf::quaternionEigenToMsg(Eigen::Quaterniond::Identity(), cameraPose.orientation);
+    tf::pointEigenToMsg(Eigen::Vector3d::Zero(), cameraPose.position);
+
+    Eigen::Vector3d pObstacle(obstacleRange, 0.0, 0.0);
+
+    map.castRay(cameraPose, pObstacle, px::DynocMap::SENSOR_FRAME);
+
+    px::DynocMapSnapshotConstPtr snapshot1 = map.snapshot();
+    EXPECT_FALSE(snapshot1->isOccupied(pObstacle));
+
+    map.publishSnapshot();
+
+    px::DynocMapSnapshotConstPtr snapshot2 = map.snapshot();
+    EXPECT_GT(snapshot2->epoch(), snapshot1->epoch());
+    EXPECT_FALSE(snapshot1->isOccupied(pObstacle));
+    EXPECT_TRUE(snapshot2->isOccupied(pObstacle));
+
+    std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > points;
+    points.push_back(Eigen::Vector3d(obstacleRange / 2.0, 0.0, 0.0));
+    points.push_back(pObstacle);
+    points.push_back(Eigen::Vector3d(0.0, obstacleRange, 0.0));
+
+    std::vector<px::DynocMapSnapshot::CellState> states;
+    snapshot2->queryOccupancy(points, states);
+
+    ASSERT_EQ(3, states.size());
+    EXPECT_EQ(px::DynocMapSnapshot::FREE, states.at(0));
+    EXPECT_EQ(px::DynocMapSnapshot::OCCUPIED, states.at(1));
+    EXPECT_EQ(px::DynocMapSnapshot::UNKNOWN, states.at(2));
+
+    Eigen::Vector3d hit;
+    ASSERT_TRUE(snapshot2->raycastFirstHit(Eigen::Vector3d(0.01, 0.01, 0.01),
+                                           Eigen::Vector3d(1.0, 0.0, 0.0),
+                                           maxSensorRange, hit));
+    EXPECT_LT((hit - pObstacle).norm(), resolution);
+
+    EXPECT_FALSE(snapshot2->raycastFirstHit(Eigen::Vector3d(0.01, 0.01, 0.01),
+                                            Eigen::Vector3d(-1.0, 0.0, 0.0),
+                                            maxSensorRange, hit));
+    EXPECT_FALSE(snapshot2->raycastFirstHit(Eigen::Vector3d(0.01, 0.01, 0.01),
+                                            Eigen::Vector3d(1.0, 0.0, 0.0),
+                                            obstacleRange / 2.0, hit));
+
+    Eigen::Vector3d boxSize = Eigen::Vector3d::Constant(resolution);
+    EXPECT_TRUE(map.isBoxOccupied(pObstacle - boxSize, pObstacle + boxSize));
+    EXPECT_TRUE(snapshot2->isBoxOccupied(pObstacle - boxSize, pObstacle + boxSize));
+    EXPECT_FALSE(snapshot1->isBoxOccupied(pObstacle - boxSize, pObstacle + boxSize));
+
+    EXPECT_TRUE(snapshot2->isSweptSphereOccupied(Eigen::Vector3d(obstacleRange, -1.0, 0.0),
+                                                 Eigen::Vector3d(obstacleRange, 1.0, 0.0),
+                                                 resolution));
+    EXPECT_FALSE(snapshot2->isSweptSphereOccupied(Eigen::Vector3d(obstacleRange / 2.0, -1.0, 0.0),
+                                                  Eigen::Vector3d(obstacleRange / 2.0, 1.0, 0.0),
+                                                  resolution));
+
+    std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > endpoints;
+    endpoints.push_back(Eigen::Vector3d(0.0, -obstacleRange, 0.0));
+
+    // scans are only published once automatic publishing is enabled, and
+    // then at most once per interval
+    map.insertScan(cameraPose, endpoints, px::DynocMap::SENSOR_FRAME);
+    EXPECT_EQ(snapshot2->epoch(), map.snapshot()->epoch());
+
+    map.setSnapshotInterval(3600.0);
+    map.insertScan(cameraPose, endpoints, px::DynocMap::SENSOR_FRAME);
+    EXPECT_EQ(snapshot2->epoch() + 1, map.snapshot()->epoch());
+    EXPECT_TRUE(map.snapshot()->isOccupied(endpoints.front()));
+
+    map.insertScan(cameraPose, endpoints, px::DynocMap::SENSOR_FRAME);
+    EXPECT_EQ(snapshot2->epoch() + 1, map.snapshot()->epoch());
+}
+
+void
+insertScans(px::DynocMap& map,
+            const std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> >& endpoints,
+            int nScans)
+{
+    geometry_msgs::Pose cameraPose;
+    tf::quaternionEigenToMsg(Eigen::Quaterniond::Identity(), cameraPose.orientation);
+    tf::pointEigenToMsg(Eigen::Vector3d::Zero(), cameraPose.position);
+
+    for (int i = 0; i < nScans; ++i)
+    {
+        map.insertScan(cameraPose, endpoints, px::DynocMap::SENSOR_FRAME, i % 2 == 0);
+    }
+}
+
+void
+queryMap(const px::DynocMap& map,
+         const std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> >& endpoints,
+         int nQueries)
+{
+    unsigned int epoch = 0;
+
+    for (int i = 0; i < nQueries; ++i)
+    {
+        px::DynocMapSnapshotConstPtr snapshot = map.snapshot();
+
+        EXPECT_GE(snapshot->epoch(), epoch);
+        epoch = snapshot->epoch();
+
+        // a snapshot does not change while it is being read
+        std::vector<px::DynocMapSnapshot::CellState> states[2];
+        snapshot->queryOccupancy(endpoints, states[0]);
+        for (size_t j = 0; j < endpoints.size(); ++j)
+        {
+            Eigen::Vector3d hit;
+            if (snapshot->raycastFirstHit(Eigen::Vector3d(0.01, 0.01, 0.01), endpoints.at(j),
+                                          maxSensorRange, hit))
+            {
+                EXPECT_TRUE(snapshot->isOccupied(hit));
+            }
+        }
+        snapshot->queryOccupancy(endpoints, states[1]);
+
+        EXPECT_TRUE(states[0] == states[1]);
+    }
+}
+
+// Insert scans in one thread while other threads query snapshots of the
+// map, and check that each snapshot stays consistent. Once all scans have
+// been inserted, check that all endpoints are occupied.
+TEST(DynocMap, ConcurrentQueries)
+{
+    px::SensorModelPtr sensorModel(new px::LaserSensorModel(freeSpaceProbability,
+                                                            occSpaceProbability,
+                                                            maxSensorRange,
+                                                            sensorSigma));
+
+    px::DynocMap map(resolution, sensorModel, "mapcache");
+    map.setSnapshotInterval(0.0);
+
+    std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > endpoints;
+    for (int i = 0; i < 32; ++i)
+    {
+        double angle = 2.0 * M_PI * i / 32.0;
+
+        endpoints.push_back(Eigen::Vector3d(obstacleRange * cos(angle),
+                                            obstacleRange * sin(angle),
+                                            0.3));
+    }
+
+    boost::thread_group threads;
+    for (int i = 0; i < 4; ++i)
+    {
+        threads.create_thread(boost::bind(&queryMap, boost::cref(map), boost::cref(endpoints),
+                                          500));
+    }
+
+    threads.create_thread(boost::bind(&insertScans, boost::ref(map), boost::cref(endpoints),
+                                      200));
+
+    threads.join_all();
+
+    px::DynocMapSnapshotConstPtr snapshot = map.snapshot();
+    for (size_t i = 0; i < endpoints.size(); ++i)
+    {
+        EXPECT_TRUE(snapshot->isOccupied(endpoints.at(i)));
+    }
+}
+
+void
+expectTilesEqual(const px::DynocMap& map1, const px::DynocMap& map2)
+{
+    std::vector<px::OccupancyTile, Eigen::aligned_allocator<px::OccupancyTile> > tiles1 = map1.tiles();
+    std::vector<px::OccupancyTile, Eigen::aligned_allocator<px::OccupancyTile> > tiles2 = map2.tiles();
+    ASSERT_EQ(tiles1.size(), tiles2.size());
+
+    for (size_t i = 0; i < tiles1.size(); ++i)
+    {
+        ASSERT_EQ(tiles1.at(i).tileGridCenter(), tiles2.at(i).tileGridCenter());
+
+        const std::vector<px::OccupancyCell, Eigen::aligned_allocator<px::OccupancyCell> >& cells1 = tiles1.at(i).cells();
+        const std::vector<px::OccupancyCell, Eigen::aligned_allocator<px::OccupancyCell> >& cells2 = tiles2.at(i).cells();
+        ASSERT_EQ(cells1.size(), cells2.size());
+
+        for (size_t j = 0; j < cells1.size(); ++j)
+        {
+            EXPECT_EQ(cells1.at(j).coords, cells2.at(j).coords);
+            EXPECT_EQ(cells1.at(j).width, cells2.at(j).width);
+            EXPECT_EQ(cells1.at(j).occupancyLogOdds, cells2.at(j).occupancyLogOdds);
+        }
+    }
+}
+
+// Write a keyframe and incremental updates of a map as obstacles are
+// added, apply them to a second map, and check that it matches the first.
+// An update whose base_seq is not the update last applied is rejected.
+TEST(DynocMap, WriteDelta)
+{
+    px::SensorModelPtr sensorModel(new px::LaserSensorModel(freeSpaceProbability,
+                                                            occSpaceProbability,
+                                                            maxSensorRange,
+                                                            sensorSigma));
+
+    px::DynocMap map(resolution, sensorModel, "mapcache");
+    px::DynocMap mapCopy(resolution, sensorModel, "mapcache");
+
+    geometry_msgs::Pose cameraPose;
+    tf::quaternionEigenToMsg(Eigen::Quaterniond::Identity(), cameraPose.orientation);
+    tf::pointEigenToMsg(Eigen::Vector3d::Zero(), cameraPose.position);
+
+    map.castRay(cameraPose, Eigen::Vector3d(obstacleRange, 0.0, 0.0), px::DynocMap::SENSOR_FRAME);
+
+    dynocmap_msgs::DynocMap keyframeMsg;
+    ASSERT_TRUE(map.writeDelta(keyframeMsg));
+    EXPECT_TRUE(keyframeMsg.keyframe);
+    EXPECT_EQ(map.tiles().size(), keyframeMsg.tiles.size());
+
+    ASSERT_TRUE(mapCopy.readDelta(keyframeMsg));
+    expectTilesEqual(map, mapCopy);
+
+    map.castRay(cameraPose, Eigen::Vector3d(0.0, -obstacleRange, 0.0), px::DynocMap::SENSOR_FRAME);
+
+    dynocmap_msgs::DynocMap deltaMsg1;
+    ASSERT_TRUE(map.writeDelta(deltaMsg1));
+    EXPECT_FALSE(deltaMsg1.keyframe);
+    EXPECT_EQ(keyframeMsg.seq, deltaMsg1.base_seq);
+    EXPECT_LT(deltaMsg1.tiles.size(), keyframeMsg.tiles.size());
+
+    map.castRay(cameraPose, Eigen::Vector3d(-obstacleRange, 0.0, 0.3), px::DynocMap::SENSOR_FRAME);
+
+    dynocmap_msgs::DynocMap deltaMsg2;
+    ASSERT_TRUE(map.writeDelta(deltaMsg2));
+    EXPECT_FALSE(deltaMsg2.keyframe);
+    EXPECT_EQ(deltaMsg1.seq, deltaMsg2.base_seq);
+
+    // the second update does not apply without the first
+    EXPECT_FALSE(mapCopy.readDelta(deltaMsg2));
+
+    ASSERT_TRUE(mapCopy.readDelta(deltaMsg1));
+    ASSERT_TRUE(mapCopy.readDelta(deltaMsg2));
+    expectTilesEqual(map, mapCopy);
+
+    // an update cannot be applied twice
+    EXPECT_FALSE(mapCopy.readDelta(deltaMsg2));
+}
+
 int main(int argc, char **argv)
 {
     ::testing::InitGoogleTest(&argc, argv);
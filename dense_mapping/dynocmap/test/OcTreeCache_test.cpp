@@ -0,0 +1,292 @@
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/thread/thread.hpp>
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "../src/OcTreeCache.h"
+
+namespace px
+{
+
+namespace
+{
+
+// Archive whose I/O takes long enough for reads, writes and evictions
+// of other threads to be interleaved with it.
+class SlowTileArchive : public TileArchive
+{
+public:
+    bool contains(const std::string& name) const
+    {
+        boost::this_thread::sleep(boost::posix_time::microseconds(100));
+
+        return TileArchive::contains(name);
+    }
+
+    bool read(const std::string& name, OcTree& tile) const
+    {
+        boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+
+        return TileArchive::read(name, tile);
+    }
+
+    bool write(const std::string& name, const OcTree& tile)
+    {
+        boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+
+        return TileArchive::write(name, tile);
+    }
+};
+
+std::string
+tileName(int idx)
+{
+    return "tile" + boost::lexical_cast<std::string>(idx);
+}
+
+// The version of a tile is stored in the log-odds of a single leaf.
+double
+versionLogOdds(int version)
+{
+    return -1.5 + 0.05 * (version % 100);
+}
+
+OcTreePtr
+makeTile(int version)
+{
+    OcTreePtr tile = boost::make_shared<OcTree>(0.1, 4, Eigen::Vector3i::Zero());
+    tile->insertNode(Eigen::Vector3i::Zero())->setLogOdds(versionLogOdds(version));
+
+    return tile;
+}
+
+void
+checkTile(const OcTreePtr& tile, int version)
+{
+    if (version == 0)
+    {
+        EXPECT_FALSE(tile);
+        return;
+    }
+
+    ASSERT_TRUE(tile);
+
+    double logOdds;
+    ASSERT_TRUE(tile->leafLogOdds(Eigen::Vector3i::Zero(), logOdds));
+    EXPECT_NEAR(versionLogOdds(version), logOdds, 1e-3);
+}
+
+// Get a tile and hand it back to the cache right away.
+OcTreePtr
+getTile(OcTreeCache* cache, const std::string& name)
+{
+    OcTreePtr tile = cache->get(name);
+    if (tile)
+    {
+        cache->cache(name, tile);
+    }
+
+    return tile;
+}
+
+// Archive which counts the writes of a tile while it is marked as in use.
+class CheckedTileArchive : public SlowTileArchive
+{
+public:
+    CheckedTileArchive()
+     : m_inUse(false), m_nConflicts(0) {}
+
+    bool write(const std::string& name, const OcTree& tile)
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(m_mutex);
+
+            if (name == m_name && m_inUse)
+            {
+                ++m_nConflicts;
+            }
+        }
+
+        return SlowTileArchive::write(name, tile);
+    }
+
+    void setInUse(const std::string& name, bool inUse)
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+
+        m_name = name;
+        m_inUse = inUse;
+    }
+
+    int conflictCount(void) const
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+
+        return m_nConflicts;
+    }
+
+private:
+    std::string m_name;
+    bool m_inUse;
+    int m_nConflicts;
+    mutable boost::mutex m_mutex;
+};
+
+// Each thread owns a disjoint set of tiles, so that it knows the latest
+// version of each of its tiles, while the tiles of all threads compete
+// for the cache.
+void
+accessTiles(OcTreeCache* cache, int threadIdx, int nTilesPerThread,
+            int nIterations, std::vector<int>* versions)
+{
+    unsigned int seed = threadIdx;
+
+    for (int i = 0; i < nIterations; ++i)
+    {
+        int tileIdx = rand_r(&seed) % nTilesPerThread;
+        std::string name = tileName(threadIdx * nTilesPerThread + tileIdx);
+        int& version = versions->at(tileIdx);
+
+        switch (rand_r(&seed) % 3)
+        {
+        case 0:
+            ++version;
+            cache->cache(name, makeTile(version));
+            break;
+        case 1:
+            checkTile(getTile(cache, name), version);
+            break;
+        case 2:
+            if (cache->prefetch(name))
+            {
+                checkTile(getTile(cache, name), version);
+            }
+            break;
+        }
+    }
+}
+
+}
+
+TEST(OcTreeCache, ConcurrentAccess)
+{
+    boost::filesystem::path filename = boost::filesystem::temp_directory_path() /
+                                       boost::filesystem::unique_path("octreecache-%%%%-%%%%.bin");
+
+    boost::shared_ptr<SlowTileArchive> archive = boost::make_shared<SlowTileArchive>();
+    ASSERT_TRUE(archive->open(filename.string()));
+
+    const int nThreads = 4;
+    const int nTilesPerThread = 6;
+
+    std::vector<std::vector<int> > versions(nThreads, std::vector<int>(nTilesPerThread, 0));
+
+    {
+        // far fewer cache slots than tiles, and a short I/O queue,
+        // so that tiles are evicted and read back all the time
+        OcTreeCache cache(archive, 4, 2);
+
+        boost::thread_group threads;
+        for (int i = 0; i < nThreads; ++i)
+        {
+            threads.create_thread(boost::bind(&accessTiles, &cache, i, nTilesPerThread,
+                                              300, &versions.at(i)));
+        }
+        threads.join_all();
+
+        // the cache returns the latest version of every tile
+        for (int i = 0; i < nThreads; ++i)
+        {
+            for (int j = 0; j < nTilesPerThread; ++j)
+            {
+                checkTile(getTile(&cache, tileName(i * nTilesPerThread + j)), versions.at(i).at(j));
+            }
+        }
+    }
+
+    // destroying the cache writes the tiles which are still pending,
+    // but tiles which are only in the cache are not written
+    for (int i = 0; i < nThreads; ++i)
+    {
+        for (int j = 0; j < nTilesPerThread; ++j)
+        {
+            OcTree tile;
+            if (archive->read(tileName(i * nTilesPerThread + j), tile))
+            {
+                EXPECT_GT(versions.at(i).at(j), 0);
+            }
+        }
+    }
+
+    archive->close();
+    boost::filesystem::remove(filename);
+}
+
+// Modify a tile obtained from the cache while the cache is flooded with
+// other tiles, and check that it is neither evicted nor written while it
+// is in use, and that its evicted version is written before it is handed
+// out again.
+TEST(OcTreeCache, ModifyWhileEvicting)
+{
+    boost::filesystem::path filename = boost::filesystem::temp_directory_path() /
+                                       boost::filesystem::unique_path("octreecache-%%%%-%%%%.bin");
+
+    boost::shared_ptr<CheckedTileArchive> archive = boost::make_shared<CheckedTileArchive>();
+    ASSERT_TRUE(archive->open(filename.string()));
+
+    const std::string name = tileName(0);
+    ASSERT_TRUE(archive->TileArchive::write(name, *makeTile(1)));
+
+    int version = 1;
+
+    {
+        OcTreeCache cache(archive, 2, 2);
+
+        for (int k = 0; k < 3; ++k)
+        {
+            OcTreePtr tile = cache.get(name);
+            checkTile(tile, version);
+
+            archive->setInUse(name, true);
+
+            for (int i = 1; i <= 20; ++i)
+            {
+                ++version;
+                tile->insertNode(Eigen::Vector3i::Zero())->setLogOdds(versionLogOdds(version));
+
+                cache.cache(tileName(k * 100 + i), makeTile(i));
+            }
+
+            archive->setInUse(name, false);
+
+            // hand the tile back and evict it
+            cache.cache(name, tile);
+            for (int i = 1; i <= 2; ++i)
+            {
+                cache.cache(tileName(k * 100 + 50 + i), makeTile(i));
+            }
+        }
+
+        checkTile(cache.get(name), version);
+    }
+
+    EXPECT_EQ(0, archive->conflictCount());
+
+    OcTreePtr tile = boost::make_shared<OcTree>();
+    ASSERT_TRUE(archive->read(name, *tile));
+    checkTile(tile, version);
+
+    archive->close();
+    boost::filesystem::remove(filename);
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -1,3 +1,4 @@
+#include <boost/make_shared.hpp>
 #include <gtest/gtest.h>
 #include <iostream>
 
@@ -39,7 +40,7 @@ TEST(OcTree, ObstacleCount)
     px::OcNodePtr node1 = octree.insertNode(nodePos[0], nodePos[1], nodePos[2]);
     node1->setLogOdds(4.0);
 
-    std::vector<px::OccupancyCell> obstacles = octree.obstacles();
+    std::vector<px::OccupancyCell, Eigen::aligned_allocator<px::OccupancyCell> > obstacles = octree.obstacles();
     EXPECT_EQ(1, obstacles.size());
 }
 
@@ -66,7 +67,7 @@ TEST(OcTree, CastRay)
 
     Eigen::Vector3d obstaclePos_w = sensorPose.block<3,3>(0,0) * obstaclePos + sensorPose.block<3,1>(0,3);
 
-    std::vector<px::OccupancyCell> obstacles = octree.obstacles();
+    std::vector<px::OccupancyCell, Eigen::aligned_allocator<px::OccupancyCell> > obstacles = octree.obstacles();
     for (size_t i = 0; i < obstacles.size(); ++i)
     {
         const px::OccupancyCell& obstacle = obstacles.at(i);
@@ -92,7 +93,7 @@ TEST(OcTree, TreeIntegrity)
     octree.write(treeData);
     octree.read(treeData);
 
-    std::vector<px::OccupancyCell> obstacles = octree.obstacles();
+    std::vector<px::OccupancyCell, Eigen::aligned_allocator<px::OccupancyCell> > obstacles = octree.obstacles();
     ASSERT_EQ(1, obstacles.size());
 
     Eigen::Vector3d p = (obstacles[0].coords.cast<double>() + Eigen::Vector3d::Constant(obstacles[0].width / 2.0)) * octree.resolution();
@@ -117,7 +118,7 @@ TEST(OcTree, IO)
     octree.write(filename);
     octree.read(filename);
 
-    std::vector<px::OccupancyCell> obstacles = octree.obstacles();
+    std::vector<px::OccupancyCell, Eigen::aligned_allocator<px::OccupancyCell> > obstacles = octree.obstacles();
     ASSERT_EQ(1, obstacles.size());
 
     Eigen::Vector3d p = (obstacles[0].coords.cast<double>() + Eigen::Vector3d::Constant(obstacles[0].width / 2.0)) * octree.resolution();
@@ -127,6 +128,519 @@ TEST(OcTree, IO)
     EXPECT_LE(fabsf(p(2) - nodePos[2]), octree.resolution() / 2.0);
 }
 
+// Test #7: assemble tree from sub-trees, ensuring that the tree and its
+// sub-trees share nodes
+TEST(OcTree, SubTrees)
+{
+    std::vector<px::OcTreePtr> tiles;
+    for (int i = 0; i < 8; ++i)
+    {
+        Eigen::Vector3i tileCenter((i & 0x4) ? 4 : -4,
+                                   (i & 0x2) ? 4 : -4,
+                                   (i & 0x1) ? 4 : -4);
+
+        tiles.push_back(boost::make_shared<px::OcTree>(0.25, 4, tileCenter));
+    }
+
+    px::OcTree octree(Eigen::Vector3i::Zero(), tiles);
+    ASSERT_EQ(5, octree.treeHeight());
+
+    px::OcNodePtr node1 = octree.insertNode(1.0, -1.0, 1.5);
+    ASSERT_TRUE(node1);
+    node1->setLogOdds(4.0);
+
+    px::OcNodePtr node2 = tiles.at(5)->findNode(1.0, -1.0, 1.5);
+    EXPECT_EQ(node1.get(), node2.get());
+
+    px::OcNodePtr node3 = tiles.at(2)->insertNode(-1.0, 1.0, -1.5);
+    ASSERT_TRUE(node3);
+
+    px::OcNodePtr node4 = octree.findNode(-1.0, 1.0, -1.5);
+    EXPECT_EQ(node3.get(), node4.get());
+
+    EXPECT_EQ(1, octree.obstacles().size());
+    EXPECT_EQ(1, tiles.at(5)->obstacles().size());
+
+    boost::multi_array<char, 1> treeData;
+    octree.write(treeData);
+
+    px::OcTree octree2;
+    octree2.read(treeData);
+
+    std::vector<px::OccupancyCell, Eigen::aligned_allocator<px::OccupancyCell> > obstacles = octree2.obstacles();
+    ASSERT_EQ(1, obstacles.size());
+    EXPECT_EQ(octree.obstacles().at(0).coords, obstacles.at(0).coords);
+    EXPECT_EQ(octree.leafs().size(), octree2.leafs().size());
+}
+
+// Test #8: integrate depth image with multiple threads, ensuring that the
+// resulting tree is the same as with a single thread
+TEST(OcTree, CastRaysThreads)
+{
+    px::SensorModelPtr sensorModel(new px::LaserSensorModel(0.4, 0.9, 8.0, 0.05));
+
+    cv::Mat depthImage(60, 80, CV_32F);
+    for (int r = 0; r < depthImage.rows; ++r)
+    {
+        for (int c = 0; c < depthImage.cols; ++c)
+        {
+            depthImage.at<float>(r,c) = 2.0f + sin(r * 0.1f) + 0.5f * cos(c * 0.1f);
+        }
+    }
+
+    Eigen::Matrix3d cameraMatrix;
+    cameraMatrix << 60.0, 0.0, 40.0,
+                    0.0, 60.0, 30.0,
+                    0.0, 0.0, 1.0;
+
+    Eigen::Matrix4d sensorPose = Eigen::Matrix4d::Identity();
+    sensorPose(0,3) = 0.3;
+
+    Eigen::Vector3d center = Eigen::Vector3d::Zero();
+    px::OcTree octree1(0.1, 8, center);
+    px::OcTree octree2(0.1, 8, center);
+
+    for (int i = 0; i < 2; ++i)
+    {
+        octree1.castRays(sensorPose, depthImage, cameraMatrix, sensorModel, false, 1);
+        octree2.castRays(sensorPose, depthImage, cameraMatrix, sensorModel, false, 3);
+    }
+
+    std::vector<px::OccupancyCell, Eigen::aligned_allocator<px::OccupancyCell> > leafs1 = octree1.leafs();
+    std::vector<px::OccupancyCell, Eigen::aligned_allocator<px::OccupancyCell> > leafs2 = octree2.leafs();
+    ASSERT_EQ(leafs1.size(), leafs2.size());
+
+    for (size_t i = 0; i < leafs1.size(); ++i)
+    {
+        EXPECT_EQ(leafs1.at(i).coords, leafs2.at(i).coords);
+        EXPECT_EQ(leafs1.at(i).occupancyLogOdds, leafs2.at(i).occupancyLogOdds);
+    }
+}
+
+// Test #9: insert scan with repeated endpoints, ensuring that free cells
+// are updated once as if a single ray was cast, and occupied cells once
+// per endpoint
+TEST(OcTree, InsertScan)
+{
+    px::SensorModelPtr sensorModel(new px::LaserSensorModel(0.4, 0.9, 8.0, 0.05));
+
+    Eigen::Matrix4d sensorPose = Eigen::Matrix4d::Identity();
+    Eigen::Vector3d endpoint(1.02109, -0.765036, 2.0790663);
+
+    std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > scan(10, endpoint);
+
+    Eigen::Vector3d center = Eigen::Vector3d::Zero();
+    px::OcTree octree1(0.1, 8, center);
+    px::OcTree octree2(0.1, 8, center);
+
+    octree1.castRay(sensorPose, endpoint, px::OcTree::SENSOR_FRAME, sensorModel);
+    octree2.insertScan(sensorPose, scan, px::OcTree::SENSOR_FRAME, sensorModel);
+
+    std::vector<px::OccupancyCell, Eigen::aligned_allocator<px::OccupancyCell> > leafs1 = octree1.leafs();
+    std::vector<px::OccupancyCell, Eigen::aligned_allocator<px::OccupancyCell> > leafs2 = octree2.leafs();
+    ASSERT_EQ(leafs1.size(), leafs2.size());
+
+    for (size_t i = 0; i < leafs1.size(); ++i)
+    {
+        double logOdds = leafs1.at(i).occupancyLogOdds;
+        if (logOdds > 0.0)
+        {
+            logOdds = std::min(logOdds * scan.size(), octree1.logOddsMax());
+        }
+
+        EXPECT_EQ(leafs1.at(i).coords, leafs2.at(i).coords);
+        EXPECT_NEAR(logOdds, leafs2.at(i).occupancyLogOdds, 1e-9);
+    }
+
+    EXPECT_EQ(octree1.obstacles().size(), octree2.obstacles().size());
+}
+
+// Test #10: write tree in compressed encoding and read it back, ensuring
+// that the structure is identical and log-odds are within quantization error
+TEST(OcTree, CompressedIO)
+{
+    px::SensorModelPtr sensorModel(new px::LaserSensorModel(0.4, 0.9, 8.0, 0.05));
+
+    Eigen::Matrix4d sensorPose = Eigen::Matrix4d::Identity();
+
+    Eigen::Vector3d center = Eigen::Vector3d::Zero();
+    px::OcTree octree1(0.1, 8, center);
+
+    octree1.castRay(sensorPose, Eigen::Vector3d(1.02109, -0.765036, 2.0790663),
+                    px::OcTree::SENSOR_FRAME, sensorModel);
+    octree1.castRay(sensorPose, Eigen::Vector3d(-0.5, 0.25, 3.0),
+                    px::OcTree::SENSOR_FRAME, sensorModel);
+
+    int bitsPerLeaf[2] = {8, 16};
+    for (int i = 0; i < 2; ++i)
+    {
+        std::vector<char> data;
+        ASSERT_TRUE(octree1.writeCompressed(data, bitsPerLeaf[i]));
+
+        px::OcTree octree2;
+        ASSERT_TRUE(octree2.read(data.data(), data.size()));
+
+        double maxError = std::max(fabs(octree1.logOddsMin()), fabs(octree1.logOddsMax())) /
+                          ((1 << (bitsPerLeaf[i] - 1)) - 1);
+
+        std::vector<px::OccupancyCell, Eigen::aligned_allocator<px::OccupancyCell> > leafs1 = octree1.leafs();
+        std::vector<px::OccupancyCell, Eigen::aligned_allocator<px::OccupancyCell> > leafs2 = octree2.leafs();
+        ASSERT_EQ(leafs1.size(), leafs2.size());
+
+        for (size_t j = 0; j < leafs1.size(); ++j)
+        {
+            EXPECT_EQ(leafs1.at(j).coords, leafs2.at(j).coords);
+            EXPECT_NEAR(leafs1.at(j).occupancyLogOdds, leafs2.at(j).occupancyLogOdds, maxError);
+        }
+
+        EXPECT_EQ(octree1.obstacles().size(), octree2.obstacles().size());
+    }
+}
+
+// Test #11: check that updates of sub-trees through the tree they are
+// linked into are counted by the sub-trees
+TEST(OcTree, ModificationCount)
+{
+    px::SensorModelPtr sensorModel(new px::LaserSensorModel(0.4, 0.9, 8.0, 0.05));
+
+    std::vector<px::OcTreePtr> tiles;
+    for (int i = 0; i < 8; ++i)
+    {
+        Eigen::Vector3i tileCenter((i & 0x4) ? 8 : -8,
+                                   (i & 0x2) ? 8 : -8,
+                                   (i & 0x1) ? 8 : -8);
+
+        tiles.push_back(boost::make_shared<px::OcTree>(0.1, 5, tileCenter));
+    }
+
+    px::OcTree octree(Eigen::Vector3i::Zero(), tiles);
+
+    Eigen::Matrix4d sensorPose = Eigen::Matrix4d::Identity();
+    sensorPose.block<3,1>(0,3) << 0.05, 0.05, 0.05;
+
+    octree.castRay(sensorPose, Eigen::Vector3d(0.0, 0.0, 1.0),
+                   px::OcTree::SENSOR_FRAME, sensorModel);
+
+    size_t count = 0;
+    for (int i = 0; i < 8; ++i)
+    {
+        // the ray only traverses the tile in the positive octant
+        if (i == 7)
+        {
+            EXPECT_GT(tiles.at(i)->modificationCount(), 0);
+        }
+        else
+        {
+            EXPECT_EQ(0, tiles.at(i)->modificationCount());
+        }
+
+        count += tiles.at(i)->modificationCount();
+    }
+
+    EXPECT_EQ(count, octree.modificationCount());
+}
+
+// Test #12: clone tree assembled from sub-trees, ensuring that the clone
+// holds the same leafs and is not affected by updates of the original tree
+TEST(OcTree, Clone)
+{
+    px::SensorModelPtr sensorModel(new px::LaserSensorModel(0.4, 0.9, 8.0, 0.05));
+
+    std::vector<px::OcTreePtr> tiles;
+    for (int i = 0; i < 8; ++i)
+    {
+        Eigen::Vector3i tileCenter((i & 0x4) ? 8 : -8,
+                                   (i & 0x2) ? 8 : -8,
+                                   (i & 0x1) ? 8 : -8);
+
+        tiles.push_back(boost::make_shared<px::OcTree>(0.1, 5, tileCenter));
+    }
+
+    px::OcTree octree(Eigen::Vector3i::Zero(), tiles);
+
+    Eigen::Matrix4d sensorPose = Eigen::Matrix4d::Identity();
+    sensorPose.block<3,1>(0,3) << 0.05, 0.05, 0.05;
+
+    octree.castRay(sensorPose, Eigen::Vector3d(1.0, 0.5, 0.2),
+                   px::OcTree::SENSOR_FRAME, sensorModel);
+
+    px::OcTreePtr copy = octree.clone();
+
+    std::vector<px::OccupancyCell, Eigen::aligned_allocator<px::OccupancyCell> > leafs = octree.leafs();
+    std::vector<px::OccupancyCell, Eigen::aligned_allocator<px::OccupancyCell> > copyLeafs = copy->leafs();
+
+    ASSERT_EQ(leafs.size(), copyLeafs.size());
+    ASSERT_FALSE(octree.obstacles().empty());
+    EXPECT_EQ(octree.obstacles().size(), copy->obstacles().size());
+
+    for (size_t i = 0; i < leafs.size(); ++i)
+    {
+        EXPECT_EQ(leafs.at(i).coords, copyLeafs.at(i).coords);
+        EXPECT_FLOAT_EQ(leafs.at(i).occupancyLogOdds, copyLeafs.at(i).occupancyLogOdds);
+
+        double logOdds;
+        ASSERT_TRUE(copy->leafLogOdds(copyLeafs.at(i).coords, logOdds));
+        EXPECT_FLOAT_EQ(copyLeafs.at(i).occupancyLogOdds, logOdds);
+    }
+
+    px::OcNodePtr node = octree.findNode(leafs.front().coords);
+    ASSERT_TRUE(node);
+    octree.updateLogOdds(node, 1.0);
+
+    double logOdds;
+    ASSERT_TRUE(copy->leafLogOdds(leafs.front().coords, logOdds));
+    EXPECT_FLOAT_EQ(leafs.front().occupancyLogOdds, logOdds);
+
+    // leafs which have not been allocated are not found
+    EXPECT_FALSE(copy->leafLogOdds(Eigen::Vector3i(-15, -15, -15), logOdds));
+}
+
+// Leaf-by-leaf reference for the collision checks: return true if a leaf
+// within distance of point p is occupied.
+bool
+isNearOccupiedLeaf(const px::OcTree& octree, const Eigen::Vector3d& p,
+                   double distance, bool unknownIsOccupied)
+{
+    double resolution = octree.resolution();
+
+    Eigen::Vector3i lo, hi;
+    for (int i = 0; i < 3; ++i)
+    {
+        lo(i) = static_cast<int>(floor((p(i) - distance) / resolution));
+        hi(i) = static_cast<int>(floor((p(i) + distance) / resolution));
+    }
+
+    for (int x = lo(0); x <= hi(0); ++x)
+    {
+        for (int y = lo(1); y <= hi(1); ++y)
+        {
+            for (int z = lo(2); z <= hi(2); ++z)
+            {
+                Eigen::Vector3d cornerMin = Eigen::Vector3d(x, y, z) * resolution;
+                Eigen::Vector3d cornerMax = cornerMin + Eigen::Vector3d::Constant(resolution);
+
+                Eigen::Vector3d q = p.cwiseMax(cornerMin).cwiseMin(cornerMax);
+                if ((q - p).norm() >= distance)
+                {
+                    continue;
+                }
+
+                double logOdds = 0.0;
+                octree.leafLogOdds(Eigen::Vector3i(x, y, z), logOdds);
+
+                if (unknownIsOccupied ? logOdds >= 0.0 : logOdds > octree.logOddsOccThresh())
+                {
+                    return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+px::OcTreePtr
+scannedTree(void)
+{
+    px::SensorModelPtr sensorModel(new px::LaserSensorModel(0.4, 0.9, 8.0, 0.05));
+
+    Eigen::Vector3d center = Eigen::Vector3d::Zero();
+    px::OcTreePtr octree = boost::make_shared<px::OcTree>(0.1, 8, center);
+
+    std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > scan;
+    for (int i = -20; i <= 20; ++i)
+    {
+        for (int j = -20; j <= 20; ++j)
+        {
+            scan.push_back(Eigen::Vector3d(2.0 + 0.3 * sin(i * 0.2), i * 0.07, j * 0.07));
+        }
+    }
+
+    Eigen::Matrix4d sensorPose = Eigen::Matrix4d::Identity();
+    sensorPose.block<3,1>(0,3) << 0.05, 0.05, 0.05;
+
+    octree->insertScan(sensorPose, scan, px::OcTree::SENSOR_FRAME, sensorModel);
+
+    // single rays are summarized as well
+    octree->castRay(sensorPose, Eigen::Vector3d(-1.5, -1.0, 0.5),
+                    px::OcTree::SENSOR_FRAME, sensorModel);
+
+    return octree;
+}
+
+// Test #13: check box collision checks against the leafs of the tree, with
+// unknown leafs counted as free and as occupied
+TEST(OcTree, BoxOccupied)
+{
+    px::OcTreePtr octree = scannedTree();
+
+    ASSERT_FALSE(octree->obstacles().empty());
+
+    srand(0);
+    int nOccupied[2] = {0, 0};
+    for (int i = 0; i < 500; ++i)
+    {
+        Eigen::Vector3d center = Eigen::Vector3d::Random() * 3.0;
+        Eigen::Vector3d halfSize = (Eigen::Vector3d::Random() + Eigen::Vector3d::Constant(1.2)) * 0.3;
+
+        for (int j = 0; j < 2; ++j)
+        {
+            bool unknownIsOccupied = (j == 1);
+
+            bool occupied = octree->isBoxOccupied(center - halfSize, center + halfSize,
+                                                  unknownIsOccupied);
+
+            bool expected = false;
+            Eigen::Vector3i lo, hi;
+            for (int k = 0; k < 3; ++k)
+            {
+                lo(k) = static_cast<int>(floor((center(k) - halfSize(k)) / 0.1));
+                hi(k) = static_cast<int>(floor((center(k) + halfSize(k)) / 0.1));
+            }
+            for (int x = lo(0); x <= hi(0) && !expected; ++x)
+            {
+                for (int y = lo(1); y <= hi(1) && !expected; ++y)
+                {
+                    for (int z = lo(2); z <= hi(2) && !expected; ++z)
+                    {
+                        double logOdds = 0.0;
+                        octree->leafLogOdds(Eigen::Vector3i(x, y, z), logOdds);
+
+                        expected = unknownIsOccupied ? logOdds >= 0.0 :
+                                                       logOdds > octree->logOddsOccThresh();
+                    }
+                }
+            }
+
+            EXPECT_EQ(expected, occupied);
+
+            if (occupied)
+            {
+                ++nOccupied[j];
+            }
+        }
+    }
+
+    // both outcomes are covered
+    EXPECT_GT(nOccupied[0], 0);
+    EXPECT_LT(nOccupied[0], 500);
+    EXPECT_GT(nOccupied[1], nOccupied[0]);
+    EXPECT_LT(nOccupied[1], 500);
+}
+
+// Test #14: check swept-sphere collision checks against spheres placed
+// along the segment
+TEST(OcTree, SweptSphereOccupied)
+{
+    px::OcTreePtr octree = scannedTree();
+
+    srand(1);
+    int nOccupied = 0;
+    for (int i = 0; i < 200; ++i)
+    {
+        Eigen::Vector3d start = Eigen::Vector3d::Random() * 2.5;
+        Eigen::Vector3d end = Eigen::Vector3d::Random() * 2.5;
+        double radius = 0.05 + 0.2 * (Eigen::Vector3d::Random()(0) + 1.0);
+
+        bool occupied = octree->isSweptSphereOccupied(start, end, radius);
+
+        // the spheres cover the swept sphere if their radius is increased
+        // by half the spacing between them
+        int nSpheres = static_cast<int>(ceil((end - start).norm() / 0.02)) + 1;
+        double spacing = (end - start).norm() / std::max(nSpheres - 1, 1);
+
+        bool inner = false;
+        bool outer = false;
+        for (int j = 0; j < nSpheres; ++j)
+        {
+            Eigen::Vector3d p = start + (end - start) * j / std::max(nSpheres - 1, 1);
+
+            inner = inner || isNearOccupiedLeaf(*octree, p, radius, false);
+            outer = outer || isNearOccupiedLeaf(*octree, p, radius + spacing / 2.0, false);
+        }
+
+        if (inner)
+        {
+            EXPECT_TRUE(occupied);
+        }
+        if (!outer)
+        {
+            EXPECT_FALSE(occupied);
+        }
+
+        if (occupied)
+        {
+            ++nOccupied;
+        }
+    }
+
+    EXPECT_GT(nOccupied, 0);
+    EXPECT_LT(nOccupied, 200);
+
+    // a stationary sphere is a sphere
+    for (int i = 0; i < 200; ++i)
+    {
+        Eigen::Vector3d p = Eigen::Vector3d::Random() * 2.5;
+
+        EXPECT_EQ(isNearOccupiedLeaf(*octree, p, 0.3, true),
+                  octree->isSweptSphereOccupied(p, p, 0.3, true));
+    }
+}
+
+// Test #15: insert scan whose voxels contain different numbers of
+// endpoints, ensuring that the occupancy of each endpoint voxel matches
+// one occupied update per endpoint, clamped at the maximum log-odds
+TEST(OcTree, InsertScanHitCounts)
+{
+    px::SensorModelPtr sensorModel(new px::LaserSensorModel(0.4, 0.9, 8.0, 0.05));
+
+    Eigen::Matrix4d sensorPose = Eigen::Matrix4d::Identity();
+
+    std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > endpoints;
+    endpoints.push_back(Eigen::Vector3d(1.02109, -0.765036, 2.0790663));
+    endpoints.push_back(Eigen::Vector3d(-1.51, 0.83, 2.47));
+    endpoints.push_back(Eigen::Vector3d(0.13, 1.37, 1.93));
+    endpoints.push_back(Eigen::Vector3d(-0.87, -1.21, 3.11));
+
+    int hitCounts[4] = {1, 2, 3, 7};
+
+    std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > scan;
+    for (size_t i = 0; i < endpoints.size(); ++i)
+    {
+        scan.insert(scan.end(), hitCounts[i], endpoints.at(i));
+    }
+
+    Eigen::Vector3d center = Eigen::Vector3d::Zero();
+    px::OcTree octree(0.1, 8, center);
+    octree.insertScan(sensorPose, scan, px::OcTree::SENSOR_FRAME, sensorModel);
+
+    bool clamped = false;
+    for (size_t i = 0; i < endpoints.size(); ++i)
+    {
+        // update of the endpoint voxel by a single ray
+        px::OcTree octreeRef(0.1, 8, center);
+        octreeRef.castRay(sensorPose, endpoints.at(i), px::OcTree::SENSOR_FRAME, sensorModel);
+
+        px::OcNodePtr nodeRef = octreeRef.findNode(endpoints.at(i));
+        ASSERT_TRUE(nodeRef);
+        ASSERT_GT(nodeRef->getLogOdds(), 0.0);
+
+        double logOdds = std::min(nodeRef->getLogOdds() * hitCounts[i], octree.logOddsMax());
+        if (logOdds == octree.logOddsMax())
+        {
+            clamped = true;
+        }
+
+        px::OcNodePtr node = octree.findNode(endpoints.at(i));
+        ASSERT_TRUE(node);
+        EXPECT_NEAR(logOdds, node->getLogOdds(), 1e-9);
+    }
+
+    // the scan covers both scaled and clamped updates
+    EXPECT_TRUE(clamped);
+    EXPECT_LT(octree.findNode(endpoints.at(0))->getLogOdds(), octree.logOddsMax());
+}
+
 int main(int argc, char **argv)
 {
     ::testing::InitGoogleTest(&argc, argv);
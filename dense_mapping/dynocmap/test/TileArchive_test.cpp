@@ -0,0 +1,190 @@
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "../src/TileArchive.h"
+
+namespace px
+{
+
+namespace
+{
+
+std::string
+tileName(int idx)
+{
+    return "tile" + boost::lexical_cast<std::string>(idx);
+}
+
+Eigen::Vector3i
+leafCoords(int idx)
+{
+    return Eigen::Vector3i(idx % 16, (idx / 16) % 16, idx / 256) - Eigen::Vector3i::Constant(8);
+}
+
+double
+leafLogOdds(int version, int idx)
+{
+    return -2.0 + 0.25 * ((version + idx) % 23);
+}
+
+// Tile with nLeafs leafs whose log-odds depend on the version.
+OcTree
+makeTile(int version, int nLeafs)
+{
+    OcTree tile(0.1, 6, Eigen::Vector3i::Zero());
+    for (int i = 0; i < nLeafs; ++i)
+    {
+        tile.insertNode(leafCoords(i))->setLogOdds(leafLogOdds(version, i));
+    }
+
+    return tile;
+}
+
+void
+checkTile(const TileArchive& archive, const std::string& name,
+          int version, int nLeafs)
+{
+    OcTree tile;
+    ASSERT_TRUE(archive.read(name, tile));
+
+    for (int i = 0; i < nLeafs; ++i)
+    {
+        double logOdds;
+        ASSERT_TRUE(tile.leafLogOdds(leafCoords(i), logOdds));
+        EXPECT_NEAR(leafLogOdds(version, i), logOdds, 1e-3);
+    }
+}
+
+}
+
+TEST(TileArchive, RewriteGrowReopen)
+{
+    boost::filesystem::path filename = boost::filesystem::temp_directory_path() /
+                                       boost::filesystem::unique_path("tilearchive-%%%%-%%%%.bin");
+
+    const int nTiles = 10;
+    std::vector<int> versions(nTiles, 0);
+    std::vector<int> nLeafs(nTiles, 400);
+
+    {
+        TileArchive archive;
+        ASSERT_TRUE(archive.open(filename.string()));
+
+        for (int i = 0; i < nTiles; ++i)
+        {
+            ASSERT_TRUE(archive.write(tileName(i), makeTile(versions.at(i), nLeafs.at(i))));
+        }
+        ASSERT_TRUE(archive.flush());
+
+        size_t dataSize = archive.dataSize();
+        boost::uintmax_t fileSize = boost::filesystem::file_size(filename);
+
+        // rewritten tiles of the same size reuse the freed extents
+        for (int k = 0; k < 20; ++k)
+        {
+            for (int i = 0; i < nTiles; ++i)
+            {
+                ++versions.at(i);
+                ASSERT_TRUE(archive.write(tileName(i), makeTile(versions.at(i), nLeafs.at(i))));
+            }
+
+            EXPECT_LE(archive.dataSize(), 2 * dataSize);
+        }
+        ASSERT_TRUE(archive.flush());
+
+        EXPECT_LE(boost::filesystem::file_size(filename), 2 * fileSize);
+
+        // the space freed by tiles which shrink is reclaimed on flush
+        for (int i = 0; i < nTiles; ++i)
+        {
+            ++versions.at(i);
+            nLeafs.at(i) = 50;
+            ASSERT_TRUE(archive.write(tileName(i), makeTile(versions.at(i), nLeafs.at(i))));
+        }
+
+        size_t dataSizeShrunk = archive.dataSize();
+        ASSERT_TRUE(archive.flush());
+
+        EXPECT_LT(archive.dataSize(), dataSizeShrunk);
+        EXPECT_LT(boost::filesystem::file_size(filename), fileSize);
+
+        for (int i = 0; i < nTiles; ++i)
+        {
+            checkTile(archive, tileName(i), versions.at(i), nLeafs.at(i));
+        }
+
+        // tiles which grow are moved
+        for (int i = 0; i < nTiles; i += 2)
+        {
+            ++versions.at(i);
+            nLeafs.at(i) = 400;
+            ASSERT_TRUE(archive.write(tileName(i), makeTile(versions.at(i), nLeafs.at(i))));
+        }
+
+        for (int i = 0; i < nTiles; ++i)
+        {
+            checkTile(archive, tileName(i), versions.at(i), nLeafs.at(i));
+        }
+
+        EXPECT_EQ(nTiles, archive.tileCount());
+        EXPECT_FALSE(archive.contains(tileName(nTiles)));
+
+        archive.close();
+    }
+
+    {
+        // tiles are read from the memory mapping, and rewritten tiles
+        // from the file
+        TileArchive archive;
+        ASSERT_TRUE(archive.open(filename.string()));
+
+        EXPECT_EQ(nTiles, archive.tileCount());
+        for (int i = 0; i < nTiles; ++i)
+        {
+            checkTile(archive, tileName(i), versions.at(i), nLeafs.at(i));
+        }
+
+        for (int i = 1; i < nTiles; i += 2)
+        {
+            ++versions.at(i);
+            nLeafs.at(i) = 200;
+            ASSERT_TRUE(archive.write(tileName(i), makeTile(versions.at(i), nLeafs.at(i))));
+        }
+
+        for (int i = 0; i < nTiles; ++i)
+        {
+            checkTile(archive, tileName(i), versions.at(i), nLeafs.at(i));
+        }
+
+        archive.close();
+    }
+
+    {
+        TileArchive archive;
+        ASSERT_TRUE(archive.open(filename.string()));
+
+        for (int i = 0; i < nTiles; ++i)
+        {
+            checkTile(archive, tileName(i), versions.at(i), nLeafs.at(i));
+        }
+
+        ASSERT_TRUE(archive.clear());
+        EXPECT_EQ(0, archive.tileCount());
+        EXPECT_EQ(0, archive.dataSize());
+        EXPECT_FALSE(archive.contains(tileName(0)));
+
+        archive.close();
+    }
+
+    boost::filesystem::remove(filename);
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
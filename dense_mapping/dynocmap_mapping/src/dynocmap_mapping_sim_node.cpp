@@ -14,6 +14,43 @@
 
 double k_maxRange = 5.0;
 
+// Velocity from consecutive poses, used to preload tiles ahead of the map.
+class VelocityEstimator
+{
+public:
+    VelocityEstimator()
+     : m_initialized(false)
+     , m_tPrev(Eigen::Vector3d::Zero())
+    {
+
+    }
+
+    Eigen::Vector3d update(const Eigen::Vector3d& t, const ros::Time& stamp)
+    {
+        Eigen::Vector3d velocity = Eigen::Vector3d::Zero();
+
+        if (m_initialized)
+        {
+            double dt = (stamp - m_stampPrev).toSec();
+            if (dt > 0.0)
+            {
+                velocity = (t - m_tPrev) / dt;
+            }
+        }
+
+        m_initialized = true;
+        m_tPrev = t;
+        m_stampPrev = stamp;
+
+        return velocity;
+    }
+
+private:
+    bool m_initialized;
+    Eigen::Vector3d m_tPrev;
+    ros::Time m_stampPrev;
+};
+
 void cameraInfoCallback(const sensor_msgs::CameraInfo::ConstPtr& msg,
                         sensor_msgs::CameraInfoPtr& cameraInfo)
 {
@@ -30,6 +67,7 @@ void callback(const geometry_msgs::PoseStamped::ConstPtr& poseMsg,
               px::DynocMapPtr& map,
               const Eigen::Matrix3d& cameraMatrix,
               const Eigen::Matrix4d& H_sensor_body,
+              VelocityEstimator& velocityEstimator,
               ros::Publisher& mapPub)
 {
     float rangeThresh = k_maxRange - 1e-2;
@@ -40,7 +78,9 @@ void callback(const geometry_msgs::PoseStamped::ConstPtr& poseMsg,
     Eigen::Vector3d t;
     tf::pointMsgToEigen(poseMsg->pose.position, t);
 
-    map->recenter(t);
+    Eigen::Vector3d velocity = velocityEstimator.update(t, poseMsg->header.stamp);
+
+    map->recenterAsync(t, velocity);
 
     Eigen::Matrix4d H_body_world = Eigen::Matrix4d::Identity();
     H_body_world.block<3,3>(0,0) = q.toRotationMatrix();
@@ -66,7 +106,7 @@ void callback(const geometry_msgs::PoseStamped::ConstPtr& poseMsg,
     map->castRays(H_sensor_world, depthImage, cameraMatrix, true);
 
     dynocmap_msgs::DynocMap msg;
-    map->write(msg, "world");
+    map->writeDelta(msg, "world");
 
     mapPub.publish(msg);
 }
@@ -146,8 +186,10 @@ int main(int argc, char** argv)
     message_filters::Subscriber<sensor_msgs::PointCloud2> cloudSub(nh, "/vrep/rgbd/cloud", 1);
     message_filters::Subscriber<geometry_msgs::PoseStamped> poseSub(nh, "/vrep/pose", 1);
 
+    VelocityEstimator velocityEstimator;
+
     message_filters::TimeSynchronizer<geometry_msgs::PoseStamped, sensor_msgs::PointCloud2> sync(poseSub, cloudSub, 10);
-    sync.registerCallback(boost::bind(&callback, _1, _2, boost::ref(map), boost::cref(cameraMatrix), boost::cref(H_sensor_body), boost::ref(mapPub)));
+    sync.registerCallback(boost::bind(&callback, _1, _2, boost::ref(map), boost::cref(cameraMatrix), boost::cref(H_sensor_body), boost::ref(velocityEstimator), boost::ref(mapPub)));
 
     ROS_INFO("Initialized!");
 
@@ -53,6 +53,8 @@ private:
                                              bool dynamic) const;
     Ogre::ManualObject* createTileObject(const std::string& name, bool dynamic) const;
     void destroyObject(Ogre::ManualObject* object);
+    bool isInMapWindow(const dynocmap_msgs::DynocMap& msg,
+                       const Eigen::Vector3i& tileGridCenter) const;
     std::string toString(const Eigen::Vector3i& center) const;
 
     class TileItem
@@ -91,6 +93,10 @@ private:
     bool m_enabled;
     bool m_showBoundary;
 
+    // sequence number of the last map update which was applied
+    bool m_hasKeyframe;
+    uint32_t m_lastSeq;
+
     Ogre::SceneNode* m_map_node;
     Ogre::SceneManager* m_scene_manager;
 };
@@ -13,6 +13,8 @@ DynocMapVisual::DynocMapVisual(Ogre::SceneManager* scene_manager,
  , m_coloring_mode(DYNOCMAP_FLAT_COLOR)
  , m_enabled(false)
  , m_showBoundary(false)
+ , m_hasKeyframe(false)
+ , m_lastSeq(0)
 {
     m_scene_manager = scene_manager;
 
@@ -50,6 +52,8 @@ DynocMapVisual::reset(void)
     }
 
     m_tileMap.clear();
+
+    m_hasKeyframe = false;
 }
 
 void
@@ -60,20 +64,27 @@ DynocMapVisual::setMessage(const dynocmap_msgs::DynocMap::ConstPtr& msg)
         return;
     }
 
-    px::DynocMap map;
-    if (!map.read(*msg))
+    // An incremental update only holds the tiles changed since update
+    // base_seq. If that update was missed, the tiles are out of sync until
+    // the next keyframe.
+    if (!msg->keyframe && (!m_hasKeyframe || msg->base_seq != m_lastSeq))
     {
+        m_hasKeyframe = false;
         return;
     }
+    m_hasKeyframe = true;
+    m_lastSeq = msg->seq;
 
+    // Tiles which are not part of an incremental update are unchanged,
+    // and remain dynamic as long as they are in the map window.
     for (TileMap::iterator it = m_tileMap.begin(); it != m_tileMap.end(); ++it)
     {
-        it->second.dynamic = false;
+        it->second.dynamic = !msg->keyframe && isInMapWindow(*msg, it->first);
     }
 
-    double resolution = map.resolution();
+    double resolution = msg->resolution;
 
-    std::vector<px::OccupancyTile, Eigen::aligned_allocator<px::OccupancyTile> > tiles = map.tiles();
+    std::vector<px::OccupancyTile, Eigen::aligned_allocator<px::OccupancyTile> > tiles = px::DynocMap::readTiles(*msg);
 
     for (size_t i = 0; i < tiles.size(); ++i)
     {
@@ -275,6 +286,34 @@ DynocMapVisual::destroyObject(Ogre::ManualObject* object)
     m_scene_manager->destroyManualObject(object);
 }
 
+bool
+DynocMapVisual::isInMapWindow(const dynocmap_msgs::DynocMap& msg,
+                              const Eigen::Vector3i& tileGridCenter) const
+{
+    int mapGridWidth = 1 << (msg.map_tree_height - 1);
+    int tileGridWidth = 1 << (msg.tile_tree_height - 1);
+
+    Eigen::Vector3i mapGridCenter(msg.center_grid_x, msg.center_grid_y, msg.center_grid_z);
+
+    if (mapGridWidth == 1)
+    {
+        return tileGridCenter == mapGridCenter;
+    }
+
+    for (int i = 0; i < 3; ++i)
+    {
+        int d = tileGridCenter(i) - mapGridCenter(i) - tileGridWidth / 2;
+
+        if (d < -(mapGridWidth / 2) * tileGridWidth ||
+            d > (mapGridWidth / 2 - 1) * tileGridWidth)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 std::string
 DynocMapVisual::toString(const Eigen::Vector3i& center) const
 {
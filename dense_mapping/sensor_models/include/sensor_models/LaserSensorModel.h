@@ -19,6 +19,8 @@ public:
 
     void setObstacle(const Eigen::Vector3d& pObstacle);
 
+    boost::shared_ptr<SensorModel> clone(void) const;
+
     double freeSpaceLogOdds(void) const;
     double getLikelihood(double r) const;
     double getLikelihood(double r1, double r2) const;
@@ -64,6 +64,10 @@ public:
         m_pObstacle = pObstacle;
     }
 
+    // Return a copy of the model with its own obstacle state, so that
+    // rays can be evaluated in parallel with one copy per thread.
+    virtual boost::shared_ptr<SensorModel> clone(void) const = 0;
+
     virtual double freeSpaceLogOdds(void) const = 0;
     virtual double getLikelihood(double r) const = 0;
     virtual double getLikelihood(double r1, double r2) const = 0;
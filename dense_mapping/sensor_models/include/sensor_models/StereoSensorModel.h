@@ -21,6 +21,8 @@ public:
 
     void setObstacle(const Eigen::Vector3d& pObstacle);
 
+    boost::shared_ptr<SensorModel> clone(void) const;
+
     double freeSpaceLogOdds(void) const;
     double getLikelihood(double r) const;
     double getLikelihood(double r1, double r2) const;
@@ -44,7 +46,8 @@ private:
     int m_z;
     int m_r_p;
 
-    boost::multi_array<double, 3> m_lut;
+    // shared between clones of the model
+    boost::shared_ptr<boost::multi_array<double, 3> > m_lut;
     std::vector<double> m_maxLogOddsLikelihood;
     int m_lutRange[3];
     double m_lutResolution;
@@ -1,5 +1,7 @@
 #include "sensor_models/LaserSensorModel.h"
 
+#include <boost/make_shared.hpp>
+
 namespace px
 {
 
@@ -29,6 +31,12 @@ LaserSensorModel::setObstacle(const Eigen::Vector3d& pObstacle)
     m_validRange = m_pObstacle.norm() + 2.0 * m_sigma;
 }
 
+boost::shared_ptr<SensorModel>
+LaserSensorModel::clone(void) const
+{
+    return boost::make_shared<LaserSensorModel>(*this);
+}
+
 double
 LaserSensorModel::freeSpaceLogOdds(void) const
 {
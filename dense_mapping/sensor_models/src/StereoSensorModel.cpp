@@ -1,5 +1,7 @@
 #include "sensor_models/StereoSensorModel.h"
 
+#include <boost/make_shared.hpp>
+
 namespace px
 {
 
@@ -60,6 +62,12 @@ StereoSensorModel::setObstacle(const Eigen::Vector3d& pObstacle)
     m_validRange = m_pObstacle.norm() + sqrt(-2.0 * square(c) * log(0.01 / a));
 }
 
+boost::shared_ptr<SensorModel>
+StereoSensorModel::clone(void) const
+{
+    return boost::make_shared<StereoSensorModel>(*this);
+}
+
 double
 StereoSensorModel::freeSpaceLogOdds(void) const
 {
@@ -186,7 +194,7 @@ StereoSensorModel::getLogOddsLikelihood(double r) const
             return m_unknownSpaceLogOdds;
         }
 
-        return m_lut[m_z][m_r_p][r_i];
+        return (*m_lut)[m_z][m_r_p][r_i];
     }
     else
     {
@@ -248,7 +256,9 @@ StereoSensorModel::buildLUT(void)
     m_lutRange[0] = m_lutRange[1] = ceil(m_maxSensorRange / m_lutResolution);
     m_lutRange[2] = ceil(m_maxRange / m_lutResolution);
 
-    m_lut.resize(boost::extents[m_lutRange[0] + 1][m_lutRange[1] + 1][m_lutRange[2] + 1]);
+    m_lut = boost::make_shared<boost::multi_array<double, 3> >(boost::extents[m_lutRange[0] + 1][m_lutRange[1] + 1][m_lutRange[2] + 1]);
+    boost::multi_array<double, 3>& lut = *m_lut;
+
     m_maxLogOddsLikelihood.resize(m_lutRange[0] + 1);
 
     for (int z = 0; z <= m_lutRange[0]; ++z)
@@ -257,7 +267,7 @@ StereoSensorModel::buildLUT(void)
         {
             for (int r = 0; r <= m_lutRange[2]; ++r)
             {
-                m_lut[z][r_p][r] = m_unknownSpaceLogOdds;
+                lut[z][r_p][r] = m_unknownSpaceLogOdds;
             }
         }
     }
@@ -307,7 +317,7 @@ StereoSensorModel::buildLUT(void)
                     }
                 }
 
-                m_lut[z][r_p][r] = probToLogOdds(p);
+                lut[z][r_p][r] = probToLogOdds(p);
             }
         }
     }
@@ -1,16 +1,30 @@
 #ifndef GCAMDWBA_H
 #define GCAMDWBA_H
 
+#include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
 #include <Eigen/Dense>
 #include <list>
 #include <ros/ros.h>
 
 #include "camera_systems/CameraSystem.h"
+#include "sparse_graph/BAProblem.h"
 #include "sparse_graph/SparseGraph.h"
 
 namespace px
 {
 
+/**
+ * \brief Double window bundle adjustment
+ *
+ * A covisibility graph over the frame sets is maintained as frame sets and
+ * loop closure edges are added, and the inner and outer windows are
+ * selected by a breadth-first search on this graph. The residuals of
+ * point-pose constraints are kept in the optimization problem across
+ * calls; only those of observations which have entered or left the
+ * windows are added or removed.
+ */
 class GCamDWBA
 {
 public:
@@ -18,9 +32,33 @@ public:
              const CameraSystemConstPtr& cameraSystem,
              int M1 = 15, int M2 = 50);
 
+    // Add the weight of a loop closure edge between two frame sets to the
+    // covisibility graph.
+    void addLoopClosureEdge(FrameSet* frameSet1, FrameSet* frameSet2,
+                            size_t weight);
+
+    // Keep the frame set last passed to optimize() in the covisibility
+    // graph. Otherwise, it is replaced by the next frame set.
+    void keyCurrentFrameSet(void);
+
     void optimize(FrameSetPtr& refFrameSet);
 
 private:
+    typedef boost::unordered_map<FrameSet*, size_t> NeighborMap;
+
+    void addFrameSet(const FrameSetPtr& frameSet);
+    void removeFrameSet(const FrameSetPtr& frameSet);
+
+    void selectWindows(FrameSet* refFrameSet,
+                       boost::unordered_set<FrameSet*>& W1,
+                       boost::unordered_set<FrameSet*>& W2) const;
+
+    void addPoseResidual(ceres::CostFunction* costFunction,
+                         ceres::LossFunction* lossFunction,
+                         FrameSet* frameSet1, FrameSet* frameSet2);
+    void addVerticalResidual(FrameSet* frameSet);
+    void clearPoseResiduals(void);
+
     const int k_M1;
     const int k_M2;
 
@@ -28,7 +66,28 @@ private:
     ros::Publisher m_poseVizPub;
 
     std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d> > m_H_cam_sys;
-    std::vector<Transform, Eigen::aligned_allocator<Transform> > m_T_sys_cam;
+
+    boost::unordered_map<FrameSet*, NeighborMap> m_covisibilityGraph;
+    FrameSetPtr m_frameSetCurr;
+
+    // pose-pose and vertical direction residuals, which are rebuilt for
+    // each call since their measurements change
+    class PoseResidual
+    {
+    public:
+        ceres::ResidualBlockId residualId;
+        boost::shared_ptr<ceres::CostFunction> costFunction;
+        FrameSet* frameSet1;
+        FrameSet* frameSet2;
+    };
+
+    // the problem does not own the loss functions
+    boost::shared_ptr<ceres::LossFunction> m_posePoseLossFunction;
+    boost::shared_ptr<ceres::LossFunction> m_loopClosureLossFunction;
+
+    BAProblem m_problem;
+
+    std::vector<PoseResidual> m_poseResiduals;
 };
 
 }
@@ -1,10 +1,12 @@
 #ifndef GCAMSLAM_H
 #define GCAMSLAM_H
 
+#include <boost/thread.hpp>
 #include <ros/ros.h>
 #include <sensor_msgs/Imu.h>
 
 #include "camera_systems/CameraSystem.h"
+#include "cauldron/BoundedQueue.h"
 #include "sparse_graph/SparseGraph.h"
 
 namespace px
@@ -19,7 +21,9 @@ class GCamSLAM
 {
 public:
     GCamSLAM(ros::NodeHandle& nh,
-             const CameraSystemConstPtr& cameraSystem);
+             const CameraSystemConstPtr& cameraSystem,
+             size_t pipelineDepth = 1);
+    ~GCamSLAM();
 
     bool init(const std::string& detectorType,
               const std::string& descriptorExtractorType,
@@ -27,14 +31,33 @@ public:
               const std::string& poseTopicName,
               const std::string& vocFilename);
 
+    // Queue a set of images for processing. Feature extraction for a
+    // frame set runs concurrently with motion estimation, loop closure
+    // detection and bundle adjustment for the previous frame set.
+    // Blocks while the pipeline is full.
     bool processFrames(const ros::Time& stamp,
                        const std::vector<cv::Mat>& imageVec,
                        const sensor_msgs::ImuConstPtr& imu);
 
+    // Process all queued frame sets and stop the pipeline.
+    void shutdown(void);
+
     bool writePosesToTextFile(const std::string& filename, bool wrtWorld = false) const;
     bool writeScenePointsToTextFile(const std::string& filename) const;
 
 private:
+    struct FrameData
+    {
+        ros::Time stamp;
+        std::vector<cv::Mat> imageVec;
+        sensor_msgs::ImuConstPtr imu;
+    };
+
+    void extractFeaturesThread(void);
+    void estimateMotionThread(void);
+
+    bool processFrameSet(const FrameSetPtr& frameSet);
+
     void findLoopClosures(std::vector<std::pair<LoopClosureEdge,LoopClosureEdge> >& edges);
     void findLoopClosuresHelper(const FrameConstPtr& frameQuery,
                                 std::pair<LoopClosureEdge,LoopClosureEdge>& edge);
@@ -59,6 +82,12 @@ private:
 
     FrameSetPtr m_frameSetKey;
 
+    // pipeline stages
+    BoundedQueue<FrameData> m_frameDataQueue;
+    BoundedQueue<FrameSetPtr> m_frameSetQueue;
+    boost::shared_ptr<boost::thread> m_extractFeaturesThread;
+    boost::shared_ptr<boost::thread> m_estimateMotionThread;
+
     size_t k_minVOCorrespondenceCount;
     size_t k_minLoopCorrespondenceCount;
     int k_nLocationMatches;
@@ -3,11 +3,10 @@
 #include <boost/unordered_set.hpp>
 #include <visualization_msgs/Marker.h>
 
-#include "camera_models/CostFunctionFactory.h"
-#include "cauldron/EigenQuaternionParameterization.h"
 #include "cauldron/EigenUtils.h"
 #include "ceres/ceres.h"
 #include "PoseGraphError.h"
+#include "sparse_graph/BAProblem.h"
 
 namespace px
 {
@@ -49,20 +48,31 @@ GCamDWBA::GCamDWBA(ros::NodeHandle& nh,
                    int M1, int M2)
  : k_M1(M1)
  , k_M2(M2)
+ , m_posePoseLossFunction(new ceres::ScaledLoss(0, 0.001, ceres::TAKE_OWNERSHIP))
+ , m_loopClosureLossFunction(new ceres::ScaledLoss(new ceres::CauchyLoss(0.01), 0.001, ceres::TAKE_OWNERSHIP))
+ , m_problem(cameraSystem)
 {
     m_mapVizPub = nh.advertise<visualization_msgs::Marker>("map_marker", 1);
     m_poseVizPub = nh.advertise<visualization_msgs::Marker>("pose_marker", 1);
 
     for (int i = 0; i < cameraSystem->cameraCount(); ++i)
     {
-        Eigen::Matrix4d H_cam_sys = cameraSystem->getGlobalCameraPose(i);
-
-        m_H_cam_sys.push_back(H_cam_sys);
+        m_H_cam_sys.push_back(cameraSystem->getGlobalCameraPose(i));
+    }
+}
 
-        Eigen::Matrix4d H_sys_cam = invertHomogeneousTransform(H_cam_sys);
+void
+GCamDWBA::addLoopClosureEdge(FrameSet* frameSet1, FrameSet* frameSet2,
+                             size_t weight)
+{
+    m_covisibilityGraph[frameSet1][frameSet2] += weight;
+    m_covisibilityGraph[frameSet2][frameSet1] += weight;
+}
 
-        m_T_sys_cam.push_back(Transform(H_sys_cam));
-    }
+void
+GCamDWBA::keyCurrentFrameSet(void)
+{
+    m_frameSetCurr.reset();
 }
 
 bool
@@ -74,130 +84,28 @@ sortFunction(std::pair<size_t, FrameSet*> x, std::pair<size_t, FrameSet*> y)
 void
 GCamDWBA::optimize(FrameSetPtr& refFrameSet)
 {
-    // construct double windows
-    int N = k_M1 + k_M2;
-
-    boost::unordered_set<FrameSet*> W1;
-    boost::unordered_set<FrameSet*> W2;
-
-    std::vector<std::pair<size_t, FrameSet*> > queue;
-    queue.push_back(std::make_pair(0, refFrameSet.get()));
+    clearPoseResiduals();
 
-    while (!queue.empty())
+    if (m_frameSetCurr && m_frameSetCurr != refFrameSet)
     {
-        std::sort(queue.begin(), queue.end(), sortFunction);
-
-        boost::unordered_map<FrameSet*,int> neighborMap;
-
-        for (std::vector<std::pair<size_t, FrameSet*> >::iterator it = queue.begin();
-                it != queue.end(); ++it)
-        {
-            FrameSet* frameSet = it->second;
-
-            if (frameSet->prevFrameSet() &&
-                W1.find(frameSet->prevFrameSet()) == W1.end() &&
-                W2.find(frameSet->prevFrameSet()) == W2.end())
-            {
-                size_t weight = 0;
-                for (size_t i = 0; i < frameSet->frames().size(); i += 2)
-                {
-                    const std::vector<Point2DFeaturePtr>& features = frameSet->frame(i)->features2D();
-                    for (size_t j = 0; j < features.size(); ++j)
-                    {
-                        if (!features.at(j)->prevMatches().empty())
-                        {
-                            ++weight;
-                        }
-                    }
-                }
-
-                neighborMap.insert(std::make_pair(frameSet->prevFrameSet(), weight));
-            }
-
-            if (frameSet->nextFrameSet() &&
-                W1.find(frameSet->nextFrameSet()) == W1.end() &&
-                W2.find(frameSet->nextFrameSet()) == W2.end())
-            {
-                size_t weight = 0;
-                for (size_t i = 0; i < frameSet->frames().size(); i += 2)
-                {
-                    const std::vector<Point2DFeaturePtr>& features = frameSet->frame(i)->features2D();
-                    for (size_t j = 0; j < features.size(); ++j)
-                    {
-                        if (!features.at(j)->nextMatches().empty())
-                        {
-                            ++weight;
-                        }
-                    }
-                }
-
-                neighborMap.insert(std::make_pair(frameSet->nextFrameSet(), weight));
-            }
-
-            for (size_t i = 0; i < frameSet->frames().size(); i += 2)
-            {
-                const std::vector<LoopClosureEdge>& edges = frameSet->frame(i)->loopClosureEdges();
-
-                for (size_t j = 0; j < edges.size(); ++j)
-                {
-                    const LoopClosureEdge& edge = edges.at(j);
-
-                    if (W1.find(edge.inFrame()->frameSet()) != W1.end() ||
-                        W2.find(edge.inFrame()->frameSet()) != W2.end())
-                    {
-                        continue;
-                    }
-
-                    size_t weight = edge.inMatchIds().size();
-
-                    boost::unordered_map<FrameSet*,int>::iterator itNeighbor = neighborMap.find(edge.inFrame()->frameSet());
-                    if (itNeighbor == neighborMap.end())
-                    {
-                        neighborMap.insert(std::make_pair(edge.inFrame()->frameSet(), weight));
-                    }
-                    else
-                    {
-                        itNeighbor->second += weight;
-                    }
-                }
-            }
-
-            if (W1.size() < k_M1)
-            {
-                W1.insert(frameSet);
-            }
-            else if (W2.size() < k_M2)
-            {
-                W2.insert(frameSet);
-            }
-            else
-            {
-                break;
-            }
-        }
-
-        if (W2.size() < k_M2)
-        {
-            queue.clear();
+        // the previous frame set was not keyed and has been replaced
+        removeFrameSet(m_frameSetCurr);
+    }
 
-            for (boost::unordered_map<FrameSet*,int>::iterator it = neighborMap.begin();
-                 it != neighborMap.end(); ++it)
-            {
-                queue.push_back(std::make_pair(it->second, it->first));
-            }
-        }
-        else
-        {
-            break;
-        }
+    if (m_covisibilityGraph.find(refFrameSet.get()) == m_covisibilityGraph.end())
+    {
+        addFrameSet(refFrameSet);
     }
+    m_frameSetCurr = refFrameSet;
 
-    // build optimization problem
+    // construct double windows
+    boost::unordered_set<FrameSet*> W1;
+    boost::unordered_set<FrameSet*> W2;
 
-    ceres::Problem problem;
+    selectWindows(refFrameSet.get(), W1, W2);
 
     // find all scene points visible from inner window
-    boost::unordered_set<Point3DFeature*> scenePoints;
+    boost::unordered_map<Point3DFeature*, Point3DFeaturePtr> scenePoints;
     for (boost::unordered_set<FrameSet*>::iterator it = W1.begin();
             it != W1.end(); ++it)
     {
@@ -210,17 +118,14 @@ GCamDWBA::optimize(FrameSetPtr& refFrameSet)
             for (size_t j = 0; j < features.size(); ++j)
             {
                 const Point2DFeaturePtr& feature = features.at(j);
-                Point3DFeature* scenePoint = feature->feature3D().get();
+                const Point3DFeaturePtr& scenePoint = feature->feature3D();
 
                 if (scenePoint->features2D().size() <= 2)
                 {
                     continue;
                 }
 
-                if (scenePoints.find(scenePoint) == scenePoints.end())
-                {
-                    scenePoints.insert(scenePoint);
-                }
+                scenePoints.insert(std::make_pair(scenePoint.get(), scenePoint));
             }
         }
     }
@@ -234,11 +139,14 @@ GCamDWBA::optimize(FrameSetPtr& refFrameSet)
     W.insert(W1.begin(), W1.end());
     W.insert(W2.begin(), W2.end());
 
-    // create residuals corresponding to point-pose constraints
-    for (boost::unordered_set<Point3DFeature*>::iterator it = scenePoints.begin();
+    m_problem.beginUpdate();
+
+    // create residuals corresponding to point-pose constraints, keeping
+    // the residuals of observations which have not changed
+    for (boost::unordered_map<Point3DFeature*, Point3DFeaturePtr>::iterator it = scenePoints.begin();
             it != scenePoints.end(); ++it)
     {
-        Point3DFeature* scenePoint = *it;
+        Point3DFeature* scenePoint = it->first;
 
         for (size_t i = 0; i < scenePoint->features2D().size(); ++i)
         {
@@ -251,35 +159,17 @@ GCamDWBA::optimize(FrameSetPtr& refFrameSet)
                 continue;
             }
 
-            FrameSet* frameSet = frame1->frameSet();
-
-            if (W.find(frameSet) == W.end())
+            if (W.find(frame1->frameSet()) == W.end())
             {
                 continue;
             }
 
-            Point2DFeature* feature2 = feature1->match();
-            int cameraId2 = feature2->frame()->cameraId();
-
-            ceres::LossFunction* lossFunction = new ceres::HuberLoss(0.0000055555);
-
-            ceres::CostFunction* costFunction =
-                CostFunctionFactory::instance()->generateCostFunction(feature1->ray(),
-                                                                      feature2->ray(),
-                                                                      m_T_sys_cam.at(cameraId1).rotation(),
-                                                                      m_T_sys_cam.at(cameraId1).translation(),
-                                                                      m_T_sys_cam.at(cameraId2).rotation(),
-                                                                      m_T_sys_cam.at(cameraId2).translation());
-
-            problem.AddResidualBlock(costFunction, lossFunction,
-                                     frameSet->systemPose()->rotationData(),
-                                     frameSet->systemPose()->translationData(),
-                                     scenePoint->pointData());
+            m_problem.addStereoObservation(feature1, it->second);
         }
     }
 
-    double wPosePose = 0.001;
-    boost::unordered_map<FrameSet*, FrameSet*> posePoseMap;
+    // remove the residuals of observations which have left the windows
+    m_problem.removeStaleObservations();
 
     // create residuals corresponding to pose-pose constraints
     for (boost::unordered_set<FrameSet*>::iterator it = W2.begin();
@@ -294,13 +184,8 @@ GCamDWBA::optimize(FrameSetPtr& refFrameSet)
                 new ceres::AutoDiffCostFunction<PoseGraphError, 6, 4, 3, 4, 3>(
                     new PoseGraphError(frameSet->prevTransformMeasurement()));
 
-            ceres::LossFunction* lossFunction = new ceres::ScaledLoss(0, wPosePose, ceres::TAKE_OWNERSHIP);
-
-            problem.AddResidualBlock(costFunction, lossFunction,
-                                     frameSet->systemPose()->rotationData(),
-                                     frameSet->systemPose()->translationData(),
-                                     frameSet->prevFrameSet()->systemPose()->rotationData(),
-                                     frameSet->prevFrameSet()->systemPose()->translationData());
+            addPoseResidual(costFunction, m_posePoseLossFunction.get(),
+                            frameSet, frameSet->prevFrameSet());
         }
 
         if (frameSet->nextFrameSet() &&
@@ -310,13 +195,8 @@ GCamDWBA::optimize(FrameSetPtr& refFrameSet)
                 new ceres::AutoDiffCostFunction<PoseGraphError, 6, 4, 3, 4, 3>(
                     new PoseGraphError(frameSet->nextTransformMeasurement()));
 
-            ceres::LossFunction* lossFunction = new ceres::ScaledLoss(0, wPosePose, ceres::TAKE_OWNERSHIP);
-
-            problem.AddResidualBlock(costFunction, lossFunction,
-                                     frameSet->systemPose()->rotationData(),
-                                     frameSet->systemPose()->translationData(),
-                                     frameSet->nextFrameSet()->systemPose()->rotationData(),
-                                     frameSet->nextFrameSet()->systemPose()->translationData());
+            addPoseResidual(costFunction, m_posePoseLossFunction.get(),
+                            frameSet, frameSet->nextFrameSet());
         }
 
         for (size_t i = 0; i < frameSet->frames().size(); i += 2)
@@ -336,67 +216,39 @@ GCamDWBA::optimize(FrameSetPtr& refFrameSet)
                    new ceres::AutoDiffCostFunction<PoseGraphError, 6, 4, 3, 4, 3>(
                        new PoseGraphError(edge.measurement()));
 
-               ceres::LossFunction* lossFunction = new ceres::ScaledLoss(new ceres::CauchyLoss(0.01), wPosePose, ceres::TAKE_OWNERSHIP);
-
-               problem.AddResidualBlock(costFunction, lossFunction,
-                                        frameSet->systemPose()->rotationData(),
-                                        frameSet->systemPose()->translationData(),
-                                        edge.inFrame()->frameSet()->systemPose()->rotationData(),
-                                        edge.inFrame()->frameSet()->systemPose()->translationData());
+               addPoseResidual(costFunction, m_loopClosureLossFunction.get(),
+                               frameSet, edge.inFrame()->frameSet());
            }
         }
     }
 
-    if (refFrameSet->prevFrameSet() &&
-        W.find(refFrameSet->prevFrameSet()) != W.end())
-    {
-        problem.SetParameterBlockConstant(refFrameSet->prevFrameSet()->systemPose()->rotationData());
-        problem.SetParameterBlockConstant(refFrameSet->prevFrameSet()->systemPose()->translationData());
-    }
-
     // add residuals corresponding to vertical direction
     for (boost::unordered_set<FrameSet*>::iterator it = W.begin();
              it != W.end(); ++it)
     {
-        FrameSet* frameSet = *it;
-
-        const sensor_msgs::ImuConstPtr& imu = frameSet->imuMeasurement();
-
-        Eigen::Matrix3d R_imu = Eigen::Quaterniond(imu->orientation.w,
-                                                   imu->orientation.x,
-                                                   imu->orientation.y,
-                                                   imu->orientation.z).toRotationMatrix();
-
-        double r_imu, p_imu, y_imu;
-        mat2RPY(R_imu, r_imu, p_imu, y_imu);
-
-        Eigen::Matrix3d R_sys = invertHomogeneousTransform(frameSet->systemPose()->toMatrix()).block<3,3>(0,0);
-
-        double r_sys, p_sys, y_sys;
-        mat2RPY(R_sys, r_sys, p_sys, y_sys);
-
-        ceres::CostFunction* costFunction =
-            new ceres::AutoDiffCostFunction<VerticalError, 2, 4>(
-                new VerticalError(r_imu, p_imu));
+        addVerticalResidual(*it);
+    }
 
-        problem.AddResidualBlock(costFunction, 0,
-                                 frameSet->systemPose()->rotationData());
+    // The parameter blocks are the poses and scene points themselves, so
+    // that each solve starts from the solution of the previous one.
+    FrameSet* frameSetFixed = refFrameSet->prevFrameSet();
 
-        ceres::LocalParameterization* quaternionParameterization =
-            new EigenQuaternionParameterization;
+    std::vector<FrameSet*> poses;
+    m_problem.getPoses(poses);
 
-        problem.SetParameterization(frameSet->systemPose()->rotationData(),
-                                    quaternionParameterization);
+    for (size_t i = 0; i < poses.size(); ++i)
+    {
+        m_problem.setPoseConstant(poses.at(i), poses.at(i) == frameSetFixed);
     }
 
     ceres::Solver::Options options;
-    options.linear_solver_type = ceres::SPARSE_NORMAL_CHOLESKY;
+    m_problem.setLinearSolver(ceres::SPARSE_SCHUR, options);
     options.max_num_iterations = 3;
     options.num_threads = 8;
     options.num_linear_solver_threads = 8;
 
     ceres::Solver::Summary summary;
-    ceres::Solve(options, &problem, &summary);
+    ceres::Solve(options, &m_problem.problem(), &summary);
 
     // Update 3D coordinates of scene points that are only observed in a single frame set
     // since these points are not optimized in bundle adjustment.
@@ -539,10 +391,10 @@ GCamDWBA::optimize(FrameSetPtr& refFrameSet)
 
     poseW2Marker.lifetime = ros::Duration();
 
-    for (boost::unordered_set<Point3DFeature*>::iterator it = scenePoints.begin();
+    for (boost::unordered_map<Point3DFeature*, Point3DFeaturePtr>::iterator it = scenePoints.begin();
                 it != scenePoints.end(); ++it)
     {
-        const Eigen::Vector3d& P = (*it)->point();
+        const Eigen::Vector3d& P = it->first->point();
 
         geometry_msgs::Point p;
         p.x = P(0);
@@ -587,4 +439,199 @@ GCamDWBA::optimize(FrameSetPtr& refFrameSet)
     m_poseVizPub.publish(poseW2Marker);
 }
 
+
+void
+GCamDWBA::addFrameSet(const FrameSetPtr& frameSet)
+{
+    NeighborMap& neighbors = m_covisibilityGraph[frameSet.get()];
+
+    FrameSet* frameSetPrev = frameSet->prevFrameSet();
+    if (!frameSetPrev)
+    {
+        return;
+    }
+
+    // weight the edge to the previous frame set by the number of
+    // temporal correspondences
+    size_t weight = 0;
+    for (size_t i = 0; i < frameSet->frames().size(); i += 2)
+    {
+        const std::vector<Point2DFeaturePtr>& features = frameSet->frame(i)->features2D();
+        for (size_t j = 0; j < features.size(); ++j)
+        {
+            if (!features.at(j)->prevMatches().empty())
+            {
+                ++weight;
+            }
+        }
+    }
+
+    neighbors[frameSetPrev] += weight;
+    m_covisibilityGraph[frameSetPrev][frameSet.get()] += weight;
+}
+
+void
+GCamDWBA::removeFrameSet(const FrameSetPtr& frameSet)
+{
+    boost::unordered_map<FrameSet*, NeighborMap>::iterator it = m_covisibilityGraph.find(frameSet.get());
+    if (it != m_covisibilityGraph.end())
+    {
+        for (NeighborMap::iterator itNeighbor = it->second.begin();
+                 itNeighbor != it->second.end(); ++itNeighbor)
+        {
+            m_covisibilityGraph[itNeighbor->first].erase(frameSet.get());
+        }
+
+        m_covisibilityGraph.erase(it);
+    }
+
+    for (size_t i = 0; i < frameSet->frames().size(); i += 2)
+    {
+        const std::vector<Point2DFeaturePtr>& features = frameSet->frame(i)->features2D();
+        for (size_t j = 0; j < features.size(); ++j)
+        {
+            m_problem.removeObservation(features.at(j).get());
+        }
+    }
+}
+
+void
+GCamDWBA::selectWindows(FrameSet* refFrameSet,
+                        boost::unordered_set<FrameSet*>& W1,
+                        boost::unordered_set<FrameSet*>& W2) const
+{
+    // Expand the windows one level of the covisibility graph at a time,
+    // adding the frame sets of each level in order of decreasing weight.
+    boost::unordered_set<FrameSet*> visited;
+    visited.insert(refFrameSet);
+
+    std::vector<std::pair<size_t, FrameSet*> > queue;
+    queue.push_back(std::make_pair(0, refFrameSet));
+
+    while (!queue.empty())
+    {
+        std::sort(queue.begin(), queue.end(), sortFunction);
+
+        NeighborMap neighborMap;
+
+        for (std::vector<std::pair<size_t, FrameSet*> >::iterator it = queue.begin();
+                it != queue.end(); ++it)
+        {
+            FrameSet* frameSet = it->second;
+
+            if (W1.size() < k_M1)
+            {
+                W1.insert(frameSet);
+            }
+            else if (W2.size() < k_M2)
+            {
+                W2.insert(frameSet);
+            }
+            else
+            {
+                return;
+            }
+
+            boost::unordered_map<FrameSet*, NeighborMap>::const_iterator itNode =
+                m_covisibilityGraph.find(frameSet);
+            if (itNode == m_covisibilityGraph.end())
+            {
+                continue;
+            }
+
+            for (NeighborMap::const_iterator itNeighbor = itNode->second.begin();
+                     itNeighbor != itNode->second.end(); ++itNeighbor)
+            {
+                if (visited.find(itNeighbor->first) == visited.end())
+                {
+                    neighborMap[itNeighbor->first] += itNeighbor->second;
+                }
+            }
+        }
+
+        queue.clear();
+
+        for (NeighborMap::iterator it = neighborMap.begin();
+                 it != neighborMap.end(); ++it)
+        {
+            visited.insert(it->first);
+            queue.push_back(std::make_pair(it->second, it->first));
+        }
+    }
+}
+
+void
+GCamDWBA::addPoseResidual(ceres::CostFunction* costFunction,
+                          ceres::LossFunction* lossFunction,
+                          FrameSet* frameSet1, FrameSet* frameSet2)
+{
+    PoseResidual residual;
+    residual.costFunction.reset(costFunction);
+    residual.residualId =
+        m_problem.problem().AddResidualBlock(costFunction, lossFunction,
+                                             frameSet1->systemPose()->rotationData(),
+                                             frameSet1->systemPose()->translationData(),
+                                             frameSet2->systemPose()->rotationData(),
+                                             frameSet2->systemPose()->translationData());
+    residual.frameSet1 = frameSet1;
+    residual.frameSet2 = frameSet2;
+
+    m_problem.retainPose(frameSet1, true);
+    m_problem.retainPose(frameSet2, true);
+
+    m_poseResiduals.push_back(residual);
+}
+
+void
+GCamDWBA::addVerticalResidual(FrameSet* frameSet)
+{
+    const sensor_msgs::ImuConstPtr& imu = frameSet->imuMeasurement();
+
+    Eigen::Matrix3d R_imu = Eigen::Quaterniond(imu->orientation.w,
+                                               imu->orientation.x,
+                                               imu->orientation.y,
+                                               imu->orientation.z).toRotationMatrix();
+
+    double r_imu, p_imu, y_imu;
+    mat2RPY(R_imu, r_imu, p_imu, y_imu);
+
+    PoseResidual residual;
+    residual.costFunction.reset(
+        new ceres::AutoDiffCostFunction<VerticalError, 2, 4>(
+            new VerticalError(r_imu, p_imu)));
+    residual.residualId =
+        m_problem.problem().AddResidualBlock(residual.costFunction.get(), 0,
+                                             frameSet->systemPose()->rotationData());
+    residual.frameSet1 = frameSet;
+    residual.frameSet2 = 0;
+
+    m_problem.retainPose(frameSet, false);
+
+    m_poseResiduals.push_back(residual);
+}
+
+void
+GCamDWBA::clearPoseResiduals(void)
+{
+    for (size_t i = 0; i < m_poseResiduals.size(); ++i)
+    {
+        PoseResidual& residual = m_poseResiduals.at(i);
+
+        m_problem.problem().RemoveResidualBlock(residual.residualId);
+
+        if (residual.frameSet2)
+        {
+            m_problem.releasePose(residual.frameSet1, true);
+            m_problem.releasePose(residual.frameSet2, true);
+        }
+        else
+        {
+            // vertical direction residuals only depend on the rotation
+            m_problem.releasePose(residual.frameSet1, false);
+        }
+    }
+
+    m_poseResiduals.clear();
+}
+
 }
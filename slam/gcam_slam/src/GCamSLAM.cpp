@@ -5,6 +5,8 @@
 #include <geometry_msgs/PoseWithCovarianceStamped.h>
 
 #include "cauldron/EigenUtils.h"
+#include "cauldron/HammingMatcher.h"
+#include "cauldron/ThreadPool.h"
 #include "gcam_slam/GCamDWBA.h"
 #include "gcam_vo/GCamVO.h"
 #include "location_recognition/OrbLocationRecognition.h"
@@ -15,7 +17,8 @@ namespace px
 {
 
 GCamSLAM::GCamSLAM(ros::NodeHandle& nh,
-                   const CameraSystemConstPtr& cameraSystem)
+                   const CameraSystemConstPtr& cameraSystem,
+                   size_t pipelineDepth)
  : m_nh(nh)
  , m_cameraSystem(cameraSystem)
  , m_vo(boost::make_shared<GCamVO>(boost::ref(cameraSystem), false, false))
@@ -24,8 +27,17 @@ GCamSLAM::GCamSLAM(ros::NodeHandle& nh,
  , k_minLoopCorrespondenceCount(15)
  , k_nLocationMatches(5)
  , k_sphericalErrorThresh(0.999976)
+ , m_frameDataQueue(pipelineDepth)
+ , m_frameSetQueue(pipelineDepth)
 {
     m_sgv = boost::make_shared<SparseGraphViz>(boost::ref(nh), m_sparseGraph);
+
+    m_vo->setScenePointArena(m_sparseGraph->scenePointArena(0));
+}
+
+GCamSLAM::~GCamSLAM()
+{
+    shutdown();
 }
 
 bool
@@ -53,6 +65,9 @@ GCamSLAM::init(const std::string& detectorType,
 
     m_dwba = boost::make_shared<GCamDWBA>(boost::ref(m_nh), boost::ref(m_cameraSystem), 15, 50);
 
+    m_extractFeaturesThread = boost::make_shared<boost::thread>(&GCamSLAM::extractFeaturesThread, this);
+    m_estimateMotionThread = boost::make_shared<boost::thread>(&GCamSLAM::estimateMotionThread, this);
+
     return true;
 }
 
@@ -61,39 +76,94 @@ GCamSLAM::processFrames(const ros::Time& stamp,
                         const std::vector<cv::Mat>& imageVec,
                         const sensor_msgs::ImuConstPtr& imu)
 {
-    if (m_vo->isRunning())
+    if (!m_extractFeaturesThread)
     {
+        ROS_WARN("GCamSLAM is not initialized.");
         return false;
     }
 
-    // find loop closure edges
-    boost::shared_ptr<boost::thread> loopClosureThread;
-    std::vector<std::pair<LoopClosureEdge,LoopClosureEdge> > edges;
-    if (m_frameSetKey)
+    // The caller may reuse the image buffers, so copy the image data.
+    FrameData frameData;
+    frameData.stamp = stamp;
+    frameData.imageVec.resize(imageVec.size());
+    for (size_t i = 0; i < imageVec.size(); ++i)
     {
-        loopClosureThread = boost::make_shared<boost::thread>(boost::bind(&GCamSLAM::findLoopClosures,
-                                                                          this,
-                                                                          boost::ref(edges)));
+        imageVec.at(i).copyTo(frameData.imageVec.at(i));
     }
+    frameData.imu = imu;
 
-    boost::shared_ptr<boost::thread> vizThread;
-    if (!m_sparseGraph->frameSetSegment(0).empty())
+    return m_frameDataQueue.push(frameData);
+}
+
+void
+GCamSLAM::shutdown(void)
+{
+    m_frameDataQueue.close();
+    if (m_extractFeaturesThread)
     {
-        vizThread = boost::make_shared<boost::thread>(&SparseGraphViz::visualize, m_sgv.get(), 0);
+        m_extractFeaturesThread->join();
+        m_extractFeaturesThread.reset();
     }
 
-    px::FrameSetPtr frameSet;
-    bool success = m_vo->processFrames(stamp, imageVec, imu, frameSet);
+    m_frameSetQueue.close();
+    if (m_estimateMotionThread)
+    {
+        m_estimateMotionThread->join();
+        m_estimateMotionThread.reset();
+    }
+}
+
+void
+GCamSLAM::extractFeaturesThread(void)
+{
+    FrameData frameData;
+    while (m_frameDataQueue.pop(frameData))
+    {
+        FrameSetPtr frameSet;
+        if (!m_vo->extractFeatures(frameData.stamp, frameData.imageVec,
+                                   frameData.imu, frameSet))
+        {
+            continue;
+        }
+
+        if (!m_frameSetQueue.push(frameSet))
+        {
+            break;
+        }
+    }
+}
+
+void
+GCamSLAM::estimateMotionThread(void)
+{
+    FrameSetPtr frameSet;
+    while (m_frameSetQueue.pop(frameSet))
+    {
+        processFrameSet(frameSet);
+    }
+}
 
-    if (loopClosureThread)
+bool
+GCamSLAM::processFrameSet(const FrameSetPtr& frameSet)
+{
+    // find loop closure edges and visualize the map on the thread pool
+    // while the motion is estimated
+    TaskGroup tasks;
+    std::vector<std::pair<LoopClosureEdge,LoopClosureEdge> > edges;
+    if (m_frameSetKey)
     {
-        loopClosureThread->join();
+        tasks.run(boost::bind(&GCamSLAM::findLoopClosures, this, boost::ref(edges)));
     }
-    if (vizThread)
+
+    if (!m_sparseGraph->frameSetSegment(0).empty())
     {
-        vizThread->join();
+        tasks.run(boost::bind(&SparseGraphViz::visualize, m_sgv.get(), 0));
     }
 
+    bool success = m_vo->estimateMotion(frameSet);
+
+    tasks.wait();
+
     if (!success)
     {
         return false;
@@ -120,6 +190,9 @@ GCamSLAM::processFrames(const ros::Time& stamp,
 
             frameMatch->loopClosureEdges().push_back(edges.at(i).second);
 
+            m_dwba->addLoopClosureEdge(m_frameSetKey.get(), frameMatch->frameSet(),
+                                       edges.at(i).first.inMatchIds().size());
+
             // merge pairs of scene points
             const std::vector<size_t>& inMatchIds = edges.at(i).first.inMatchIds();
             const std::vector<size_t>& outMatchIds = edges.at(i).first.outMatchIds();
@@ -173,7 +246,7 @@ GCamSLAM::processFrames(const ros::Time& stamp,
     Eigen::Vector3d t = q * (- frameSet->systemPose()->translation());
 
     geometry_msgs::PoseWithCovarianceStamped pose;
-    pose.header.stamp = stamp;
+    pose.header.stamp = frameSet->systemPose()->timeStamp();
     pose.header.frame_id = "vmav";
     pose.pose.pose.orientation.w = q.w();
     pose.pose.pose.orientation.x = q.x();
@@ -188,11 +261,14 @@ GCamSLAM::processFrames(const ros::Time& stamp,
     if (m_vo->getCurrentCorrespondenceCount() < k_minVOCorrespondenceCount)
     {
         m_vo->keyCurrentFrameSet();
+        m_dwba->keyCurrentFrameSet();
 
         m_sparseGraph->frameSetSegment(0).push_back(frameSet);
 
         m_frameSetKey = frameSet;
     }
+
+    return true;
 }
 
 bool
@@ -301,28 +377,24 @@ GCamSLAM::findLoopClosures(std::vector<std::pair<LoopClosureEdge,LoopClosureEdge
     edges.clear();
     edges.resize(nStereoCams);
 
-    std::vector<boost::shared_ptr<boost::thread> > threads(nStereoCams);
+    TaskGroup tasks;
     for (int i = 0; i < nStereoCams; ++i)
     {
         FramePtr& frameQuery = m_frameSetKey->frames().at(i * 2);
 
-        threads.at(i) = boost::make_shared<boost::thread>(boost::bind(&GCamSLAM::findLoopClosuresHelper,
-                                                                      this,
-                                                                      frameQuery,
-                                                                      boost::ref(edges.at(i))));
-    }
-
-    for (int i = 0; i < nStereoCams; ++i)
-    {
-        threads.at(i)->join();
+        tasks.run(boost::bind(&GCamSLAM::findLoopClosuresHelper,
+                              this,
+                              frameQuery,
+                              boost::ref(edges.at(i))));
     }
+    tasks.wait();
 }
 
 void
 GCamSLAM::findLoopClosuresHelper(const FrameConstPtr& frameQuery,
                                  std::pair<LoopClosureEdge,LoopClosureEdge>& edge)
 {
-    cv::BFMatcher descriptorMatcher(cv::NORM_HAMMING, true);
+    HammingMatcher descriptorMatcher(true);
 
     std::vector<FrameConstPtr> frameMatches;
     if (!m_locRec->detectSimilarLocations(frameQuery, k_nLocationMatches,
@@ -415,24 +487,7 @@ GCamSLAM::findLoopClosuresHelper(const FrameConstPtr& frameQuery,
 void
 GCamSLAM::getDescriptorMat(const FrameConstPtr& frame, cv::Mat& dmat) const
 {
-    const std::vector<Point2DFeaturePtr>& features2D = frame->features2D();
-
-    if (features2D.empty())
-    {
-        dmat = cv::Mat();
-
-        return;
-    }
-
-    dmat = cv::Mat(features2D.size(), features2D.front()->descriptor().cols,
-                   features2D.front()->descriptor().type());
-
-    for (size_t i = 0; i < features2D.size(); ++i)
-    {
-        const Point2DFeatureConstPtr& feature2D = features2D.at(i);
-
-        feature2D->descriptor().copyTo(dmat.row(i));
-    }
+    dmat = frame->descriptorMat();
 }
 
 void
@@ -227,6 +227,8 @@ int main(int argc, char** argv)
 
     ROS_INFO("Shutting down...");
 
+    slam->shutdown();
+
     slam->writeScenePointsToTextFile("vmav_slam_points.txt");
     slam->writePosesToTextFile("vmav_slam_poses.txt", true);
 
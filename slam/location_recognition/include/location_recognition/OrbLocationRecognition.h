@@ -34,6 +34,13 @@ public:
                   std::vector<FrameTag>& matches) const;
     void knnMatch(const FrameConstPtr& frame, int k, std::vector<FrameConstPtr>& matches) const;
 
+    // Find the best matches to the frame with the given tag in the graph
+    // passed to setup(). Matches are restricted to frames of cameras which
+    // the matching mask pairs with the query camera, and to frame sets at
+    // least minFrameSetSeparation apart from the query in its segment.
+    void knnMatch(const FrameTag& queryTag, const FrameConstPtr& frame, int k,
+                  int minFrameSetSeparation, std::vector<FrameTag>& matches) const;
+
 private:
     DVision::ORB::bitset dtorToFeature(const cv::Mat& dtor) const;
     std::vector<DVision::ORB::bitset> dtorsToFeatures(const cv::Mat& dtors) const;
@@ -45,6 +52,12 @@ private:
     boost::unordered_map<FrameTag, size_t> m_frameTagMap;
     std::vector<FrameTag> m_frameTags;
     std::vector<FrameConstPtr> m_frames;
+
+    // database entries which may be matched to frames of each camera
+    std::vector<std::vector<bool> > m_cameraEntryMasks;
+    // id of the first database entry of each frame set in each segment,
+    // followed by the number of entries up to the end of the segment
+    std::vector<std::vector<size_t> > m_frameSetEntryIds;
 };
 
 }
@@ -79,8 +79,11 @@ OrbLocationRecognition::createVocabulary(const std::vector<std::vector<DVision::
 void
 OrbLocationRecognition::setup(const std::string& vocFilename)
 {
+    m_frameTagMap.clear();
     m_frameTags.clear();
     m_frames.clear();
+    m_cameraEntryMasks.clear();
+    m_frameSetEntryIds.clear();
 
     OrbVocabulary voc(vocFilename);
     m_db.setVocabulary(voc);
@@ -91,8 +94,11 @@ OrbLocationRecognition::setup(const std::string& vocFilename,
                               const SparseGraphConstPtr& graph,
                               const cv::Mat& matchingMask)
 {
+    m_frameTagMap.clear();
     m_frameTags.clear();
     m_frames.clear();
+    m_cameraEntryMasks.clear();
+    m_frameSetEntryIds.clear();
 
     std::vector<bool> cameraFlags(matchingMask.rows);
     for (int i = 0; i < matchingMask.rows; ++i)
@@ -110,10 +116,14 @@ OrbLocationRecognition::setup(const std::string& vocFilename,
     {
         const FrameSetSegment& segment = graph->frameSetSegment(segmentId);
 
+        m_frameSetEntryIds.push_back(std::vector<size_t>());
+
         for (size_t frameSetId = 0; frameSetId < segment.size(); ++frameSetId)
         {
             const FrameSetPtr& frameSet = segment.at(frameSetId);
 
+            m_frameSetEntryIds.back().push_back(m_frameTags.size());
+
             for (size_t frameId = 0; frameId < frameSet->frames().size(); ++frameId)
             {
                 const FramePtr& frame = frameSet->frames().at(frameId);
@@ -140,12 +150,26 @@ OrbLocationRecognition::setup(const std::string& vocFilename,
                 features.push_back(frameToFeatures(frame));
             }
         }
+
+        m_frameSetEntryIds.back().push_back(m_frameTags.size());
     }
 
     for (size_t i = 0; i < features.size(); ++i)
     {
         m_db.add(features.at(i));
     }
+
+    m_cameraEntryMasks.resize(matchingMask.rows);
+    for (int i = 0; i < matchingMask.rows; ++i)
+    {
+        std::vector<bool>& mask = m_cameraEntryMasks.at(i);
+
+        mask.resize(m_frameTags.size());
+        for (size_t j = 0; j < m_frameTags.size(); ++j)
+        {
+            mask.at(j) = (matchingMask.at<unsigned char>(i, m_frameTags.at(j).frameId) != 0);
+        }
+    }
 }
 
 bool
@@ -226,26 +250,14 @@ OrbLocationRecognition::knnMatch(const FrameConstPtr& frame, int k,
     }
 
     DBoW2::QueryResults ret;
-    m_db.query(frameToFeatures(frame), ret, 0);
+    m_db.query(frameToFeatures(frame), ret, k, mask);
 
     matches.clear();
     for (size_t i = 0; i < ret.size(); ++i)
     {
-        int id = ret.at(i).Id;
-
-        if (!mask.at(id))
-        {
-            continue;
-        }
-
-        FrameTag tag = m_frameTags.at(id);
+        FrameTag tag = m_frameTags.at(ret.at(i).Id);
 
         matches.push_back(tag);
-
-        if (matches.size() == k)
-        {
-            return;
-        }
     }
 }
 
@@ -265,6 +277,37 @@ OrbLocationRecognition::knnMatch(const FrameConstPtr& frame, int k,
     }
 }
 
+void
+OrbLocationRecognition::knnMatch(const FrameTag& queryTag, const FrameConstPtr& frame, int k,
+                                 int minFrameSetSeparation, std::vector<FrameTag>& matches) const
+{
+    std::vector<bool> mask = m_cameraEntryMasks.at(queryTag.frameId);
+
+    // The entries of a segment are ordered by frame set, so the frame sets
+    // close to the query form a single range of entries.
+    const std::vector<size_t>& entryIds = m_frameSetEntryIds.at(queryTag.frameSetSegmentId);
+    int frameSetCount = entryIds.size() - 1;
+
+    int frameSetIdStart = std::max(queryTag.frameSetId - minFrameSetSeparation + 1, 0);
+    int frameSetIdEnd = std::min(queryTag.frameSetId + minFrameSetSeparation, frameSetCount);
+    if (frameSetIdStart < frameSetIdEnd)
+    {
+        std::fill(mask.begin() + entryIds.at(frameSetIdStart),
+                  mask.begin() + entryIds.at(frameSetIdEnd), false);
+    }
+
+    DBoW2::QueryResults ret;
+    m_db.query(frameToFeatures(frame), ret, k, mask);
+
+    matches.clear();
+    for (size_t i = 0; i < ret.size(); ++i)
+    {
+        FrameTag tag = m_frameTags.at(ret.at(i).Id);
+
+        matches.push_back(tag);
+    }
+}
+
 DVision::ORB::bitset
 OrbLocationRecognition::dtorToFeature(const cv::Mat& dtor) const
 {
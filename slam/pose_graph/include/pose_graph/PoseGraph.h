@@ -1,6 +1,7 @@
 #ifndef POSEGRAPH_H
 #define POSEGRAPH_H
 
+#include <boost/thread/mutex.hpp>
 #include <vector>
 
 #include "camera_systems/CameraSystem.h"
@@ -11,6 +12,7 @@ namespace px
 {
 
 // forward declaration
+class HammingMatcher;
 class OrbLocationRecognition;
 
 class PoseGraph
@@ -42,6 +44,15 @@ private:
 
     typedef DirectedEdge<Transform, Pose> Edge;
 
+    class LoopClosureProgress
+    {
+    public:
+        size_t nCandidates;
+        size_t nCandidatesDone;
+        double tsStart;
+        boost::mutex mutex;
+    };
+
     void getDescriptorMat(const FrameConstPtr& frame, cv::Mat& dmat) const;
 
     std::vector<Edge, Eigen::aligned_allocator<Edge> > findVOEdges(void) const;
@@ -49,13 +60,25 @@ private:
                           std::vector<Edge, Eigen::aligned_allocator<Edge> >& loopClosureEdges,
                           std::vector<std::vector<std::pair<Point2DFeaturePtr, Point3DFeaturePtr> > >& correspondences2D3D) const;
 
-    void findLoopClosuresHelper(FrameTag frameTagQuery,
-                                const boost::shared_ptr<const OrbLocationRecognition>& locRec,
-                                const std::vector<FrameTag>& validMatchingFrameTags,
-                                PoseGraph::Edge& edge,
-                                std::vector<std::pair<Point2DFeaturePtr, Point3DFeaturePtr> >& correspondences2D3D) const;
-
-    std::vector<FrameTag> computeValidMatchingFrameTags(FrameTag queryTag) const;
+    void findLoopClosureCandidates(FrameTag frameTagQuery,
+                                   const FramePtr& frameQuery,
+                                   const boost::shared_ptr<const OrbLocationRecognition>& locRec,
+                                   std::vector<FrameTag>& frameTags) const;
+    void verifyLoopClosure(const FrameConstPtr& frameQuery,
+                           const FrameConstPtr& frame,
+                           Eigen::Matrix4d& systemPose,
+                           std::vector<cv::DMatch>& inliers,
+                           LoopClosureProgress& progress) const;
+    // Pick the verified candidate with the most inliers, in order of image
+    // similarity. Return false if no candidate has enough inliers.
+    bool selectLoopClosure(FrameTag frameTagQuery,
+                           const FramePtr& frameQuery,
+                           const std::vector<FrameTag>& frameTags,
+                           const std::vector<FramePtr>& frames,
+                           const std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d> >& systemPoses,
+                           const std::vector<std::vector<cv::DMatch> >& inliers,
+                           Edge& edge,
+                           std::vector<std::pair<Point2DFeaturePtr, Point3DFeaturePtr> >& correspondences2D3D) const;
 
     bool iterateEM(bool useRobustOptimization);
     void classifySwitches(void);
@@ -73,13 +96,14 @@ private:
     std::vector<EdgeSwitchState> m_loopClosureEdgeSwitches;
     std::vector<std::vector<std::pair<Point2DFeaturePtr, Point3DFeaturePtr> > > m_correspondences2D3D;
 
-    cv::Ptr<cv::DescriptorMatcher> m_descriptorMatcher;
+    boost::shared_ptr<HammingMatcher> m_descriptorMatcher;
 
     const double k_lossWidth;
     const cv::Mat k_matchingMask;
     const int k_minLoopCorrespondences2D3D;
     const int k_nImageMatches;
     const double k_sphericalErrorThresh;
+    const int k_minLoopFrameSetSeparation;
 
     bool m_verbose;
 };
@@ -7,6 +7,8 @@
 #include <ros/ros.h>
 
 #include "cauldron/EigenQuaternionParameterization.h"
+#include "cauldron/HammingMatcher.h"
+#include "cauldron/ThreadPool.h"
 #include "location_recognition/OrbLocationRecognition.h"
 #include "pose_estimation/P3P.h"
 #include "PoseGraphError.h"
@@ -26,9 +28,10 @@ PoseGraph::PoseGraph(const CameraSystemConstPtr& cameraSystem,
  , k_minLoopCorrespondences2D3D(minLoopCorrespondences2D3D)
  , k_nImageMatches(nImageMatches)
  , k_sphericalErrorThresh(0.999976)
+ , k_minLoopFrameSetSeparation(20)
  , m_verbose(false)
 {
-    m_descriptorMatcher = cv::Ptr<cv::DescriptorMatcher>(new cv::BFMatcher(cv::NORM_HAMMING, true));
+    m_descriptorMatcher = boost::make_shared<HammingMatcher>(true);
 }
 
 void
@@ -153,24 +156,7 @@ PoseGraph::getCorrespondences2D3D(void) const
 void
 PoseGraph::getDescriptorMat(const FrameConstPtr& frame, cv::Mat& dmat) const
 {
-    const std::vector<Point2DFeaturePtr>& features2D = frame->features2D();
-
-    if (features2D.empty())
-    {
-        dmat = cv::Mat();
-
-        return;
-    }
-
-    dmat = cv::Mat(features2D.size(), features2D.front()->descriptor().cols,
-                   features2D.front()->descriptor().type());
-
-    for (size_t i = 0; i < features2D.size(); ++i)
-    {
-        const Point2DFeatureConstPtr& feature2D = features2D.at(i);
-
-        feature2D->descriptor().copyTo(dmat.row(i));
-    }
+    dmat = frame->descriptorMat();
 }
 
 std::vector<PoseGraph::Edge, Eigen::aligned_allocator<PoseGraph::Edge> >
@@ -220,6 +206,7 @@ PoseGraph::findLoopClosures(const std::string& vocFilename,
     boost::shared_ptr<OrbLocationRecognition> locRec = boost::make_shared<OrbLocationRecognition>();
     locRec->setup(vocFilename, m_sparseGraph, k_matchingMask);
 
+    std::vector<FrameTag> frameTags;
     for (int i = 0; i < m_sparseGraph->frameSetSegments().size(); ++i)
     {
         const FrameSetSegment& segment = m_sparseGraph->frameSetSegment(i);
@@ -228,10 +215,6 @@ PoseGraph::findLoopClosures(const std::string& vocFilename,
         {
             const FrameSetPtr& frameSet = segment.at(j);
 
-            std::vector<boost::shared_ptr<boost::thread> > threads(frameSet->frames().size());
-            std::vector<PoseGraph::Edge> edges(frameSet->frames().size());
-            std::vector<std::vector<std::pair<Point2DFeaturePtr, Point3DFeaturePtr> > > corr2D3D(frameSet->frames().size());
-
             for (size_t k = 0; k < frameSet->frames().size(); ++k)
             {
                 const FramePtr& frame = frameSet->frames().at(k);
@@ -251,80 +234,136 @@ PoseGraph::findLoopClosures(const std::string& vocFilename,
                 frameTag.frameSetId = j;
                 frameTag.frameId = k;
 
-                std::vector<FrameTag> validMatchingFrameTags = computeValidMatchingFrameTags(frameTag);
-
-                threads.at(k) = boost::make_shared<boost::thread>(boost::bind(&PoseGraph::findLoopClosuresHelper, this,
-                                                                              frameTag,
-                                                                              boost::cref(locRec),
-                                                                              validMatchingFrameTags,
-                                                                              boost::ref(edges.at(k)),
-                                                                              boost::ref(corr2D3D.at(k))));
+                frameTags.push_back(frameTag);
             }
+        }
+    }
 
-            for (int k = 0; k < frameSet->frames().size(); ++k)
-            {
-                if (!threads.at(k))
-                {
-                    continue;
-                }
-                threads.at(k)->join();
+    // Find the closest matching images of all frames first, and then
+    // verify all (frame, candidate) pairs in a single flat task group, so
+    // that the pool is neither drained at the end of each frame nor blocked
+    // by tasks which wait for nested tasks.
+    std::vector<FramePtr> framesQuery(frameTags.size());
+    std::vector<std::vector<FrameTag> > candidateTags(frameTags.size());
 
-                if (!corr2D3D.at(k).empty())
-                {
-                    loopClosureEdges.push_back(edges.at(k));
-                    correspondences2D3D.push_back(corr2D3D.at(k));
-                }
-            }
+    double tsStart = ros::WallTime::now().toSec();
+
+    TaskGroup matchTasks;
+    for (size_t i = 0; i < frameTags.size(); ++i)
+    {
+        FrameTag frameTag = frameTags.at(i);
+
+        framesQuery.at(i) = m_sparseGraph->frameSetSegment(frameTag.frameSetSegmentId).at(frameTag.frameSetId)->frames().at(frameTag.frameId);
+
+        matchTasks.run(boost::bind(&PoseGraph::findLoopClosureCandidates, this,
+                                   frameTag,
+                                   boost::cref(framesQuery.at(i)),
+                                   boost::cref(locRec),
+                                   boost::ref(candidateTags.at(i))));
+    }
+
+    matchTasks.wait();
+
+    std::vector<std::vector<FramePtr> > candidateFrames(frameTags.size());
+    std::vector<std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d> > > systemPoses(frameTags.size());
+    std::vector<std::vector<std::vector<cv::DMatch> > > inliers(frameTags.size());
+
+    LoopClosureProgress progress;
+    progress.nCandidates = 0;
+    progress.nCandidatesDone = 0;
+    progress.tsStart = ros::WallTime::now().toSec();
+
+    for (size_t i = 0; i < frameTags.size(); ++i)
+    {
+        size_t nCandidates = candidateTags.at(i).size();
+
+        candidateFrames.at(i).resize(nCandidates);
+        systemPoses.at(i).resize(nCandidates);
+        inliers.at(i).resize(nCandidates);
+
+        progress.nCandidates += nCandidates;
+    }
+
+    TaskGroup verifyTasks;
+    for (size_t i = 0; i < frameTags.size(); ++i)
+    {
+        for (size_t j = 0; j < candidateTags.at(i).size(); ++j)
+        {
+            FrameTag frameTag = candidateTags.at(i).at(j);
+
+            candidateFrames.at(i).at(j) = m_sparseGraph->frameSetSegment(frameTag.frameSetSegmentId).at(frameTag.frameSetId)->frames().at(frameTag.frameId);
+
+            verifyTasks.run(boost::bind(&PoseGraph::verifyLoopClosure, this,
+                                        boost::cref(framesQuery.at(i)),
+                                        boost::cref(candidateFrames.at(i).at(j)),
+                                        boost::ref(systemPoses.at(i).at(j)),
+                                        boost::ref(inliers.at(i).at(j)),
+                                        boost::ref(progress)));
         }
     }
-}
 
-void
-PoseGraph::findLoopClosuresHelper(FrameTag frameTagQuery,
-                                  const boost::shared_ptr<const OrbLocationRecognition>& locRec,
-                                  const std::vector<FrameTag>& validMatchingFrameTags,
-                                  PoseGraph::Edge& edge,
-                                  std::vector<std::pair<Point2DFeaturePtr, Point3DFeaturePtr> >& correspondences2D3D) const
-{
-    FramePtr& frameQuery = m_sparseGraph->frameSetSegment(frameTagQuery.frameSetSegmentId).at(frameTagQuery.frameSetId)->frames().at(frameTagQuery.frameId);
+    verifyTasks.wait();
+
+    // collect results in frame order so that the output
+    // does not depend on task scheduling
+    for (size_t i = 0; i < frameTags.size(); ++i)
+    {
+        PoseGraph::Edge edge;
+        std::vector<std::pair<Point2DFeaturePtr, Point3DFeaturePtr> > corr2D3D;
+
+        if (selectLoopClosure(frameTags.at(i), framesQuery.at(i),
+                              candidateTags.at(i), candidateFrames.at(i),
+                              systemPoses.at(i), inliers.at(i),
+                              edge, corr2D3D))
+        {
+            loopClosureEdges.push_back(edge);
+            correspondences2D3D.push_back(corr2D3D);
+        }
+    }
 
-    if (!frameQuery)
+    if (m_verbose)
     {
-        return;
+        double elapsed = ros::WallTime::now().toSec() - tsStart;
+
+        ROS_INFO("Searched %lu frames for loop closures in %.1f s (%.1f frames/s).",
+                 frameTags.size(), elapsed,
+                 (elapsed > 0.0) ? frameTags.size() / elapsed : 0.0);
     }
+}
 
+void
+PoseGraph::findLoopClosureCandidates(FrameTag frameTagQuery,
+                                     const FramePtr& frameQuery,
+                                     const boost::shared_ptr<const OrbLocationRecognition>& locRec,
+                                     std::vector<FrameTag>& frameTags) const
+{
     // find closest matching images
-    std::vector<FrameTag> frameTags;
-    locRec->knnMatch(frameQuery, k_nImageMatches, validMatchingFrameTags, frameTags);
+    locRec->knnMatch(frameTagQuery, frameQuery, k_nImageMatches,
+                     k_minLoopFrameSetSeparation, frameTags);
+}
 
+bool
+PoseGraph::selectLoopClosure(FrameTag frameTagQuery,
+                             const FramePtr& frameQuery,
+                             const std::vector<FrameTag>& frameTags,
+                             const std::vector<FramePtr>& frames,
+                             const std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d> >& systemPoses,
+                             const std::vector<std::vector<cv::DMatch> >& inliers,
+                             PoseGraph::Edge& edge,
+                             std::vector<std::pair<Point2DFeaturePtr, Point3DFeaturePtr> >& correspondences2D3D) const
+{
     std::vector<std::pair<Point2DFeaturePtr, Point3DFeaturePtr> > corr2D3DBest;
     Transform transformBest;
     FramePtr frameBest;
     FrameTag frameTagBest;
 
+    // pick the best candidate in order of image similarity
     for (size_t i = 0; i < frameTags.size(); ++i)
     {
         FrameTag frameTag = frameTags.at(i);
-
-        const FramePtr& frame = m_sparseGraph->frameSetSegment(frameTag.frameSetSegmentId).at(frameTag.frameSetId)->frames().at(frameTag.frameId);
-
-        // find 2D-3D correspondences
-        cv::Mat dtors, dtorsQuery;
-        getDescriptorMat(frame, dtors);
-        getDescriptorMat(frameQuery, dtorsQuery);
-
-        std::vector<cv::DMatch> rawMatches;
-        m_descriptorMatcher->match(dtors, dtorsQuery, rawMatches);
-
-        if (rawMatches.size() < k_minLoopCorrespondences2D3D)
-        {
-            continue;
-        }
-
-        // find camera pose from P3P RANSAC
-        Eigen::Matrix4d systemPose;
-        std::vector<cv::DMatch> matches;
-        solveP3PRansac(frame, frameQuery, rawMatches, systemPose, matches);
+        const FramePtr& frame = frames.at(i);
+        const Eigen::Matrix4d& systemPose = systemPoses.at(i);
+        const std::vector<cv::DMatch>& matches = inliers.at(i);
 
         int nInliers = matches.size();
 
@@ -379,52 +418,47 @@ PoseGraph::findLoopClosuresHelper(FrameTag frameTagQuery,
                      correspondences2D3D.size());
         }
     }
+
+    return !corr2D3DBest.empty();
 }
 
-std::vector<FrameTag>
-PoseGraph::computeValidMatchingFrameTags(FrameTag queryTag) const
+void
+PoseGraph::verifyLoopClosure(const FrameConstPtr& frameQuery,
+                             const FrameConstPtr& frame,
+                             Eigen::Matrix4d& systemPose,
+                             std::vector<cv::DMatch>& inliers,
+                             LoopClosureProgress& progress) const
 {
-    std::vector<FrameTag> matchingTags;
+    // find 2D-3D correspondences
+    cv::Mat dtors, dtorsQuery;
+    getDescriptorMat(frame, dtors);
+    getDescriptorMat(frameQuery, dtorsQuery);
 
-    for (int i = 0; i < m_sparseGraph->frameSetSegments().size(); ++i)
-    {
-        const FrameSetSegment& segment = m_sparseGraph->frameSetSegment(i);
+    std::vector<cv::DMatch> rawMatches;
+    m_descriptorMatcher->match(dtors, dtorsQuery, rawMatches);
 
-        for (int j = 0; j < segment.size(); ++j)
-        {
-            const FrameSetPtr& frameSet = segment.at(j);
-
-            for (size_t k = 0; k < frameSet->frames().size(); ++k)
-            {
-                const FramePtr& frame = frameSet->frames().at(k);
-
-                if (!frame)
-                {
-                    continue;
-                }
+    if (rawMatches.size() >= k_minLoopCorrespondences2D3D)
+    {
+        // find camera pose from P3P RANSAC
+        solveP3PRansac(frame, frameQuery, rawMatches, systemPose, inliers);
+    }
 
-                FrameTag trainTag;
-                trainTag.frameSetSegmentId = i;
-                trainTag.frameSetId = j;
-                trainTag.frameId = k;
+    if (m_verbose)
+    {
+        boost::lock_guard<boost::mutex> lock(progress.mutex);
 
-                if (k_matchingMask.at<unsigned char>(queryTag.frameId, trainTag.frameId) == 0)
-                {
-                    continue;
-                }
+        ++progress.nCandidatesDone;
 
-                if (queryTag.frameSetSegmentId == trainTag.frameSetSegmentId &&
-                    std::abs(queryTag.frameSetId - trainTag.frameSetId) < 20)
-                {
-                    continue;
-                }
+        size_t reportInterval = std::max(progress.nCandidates / 20, static_cast<size_t>(1));
+        if (progress.nCandidatesDone % reportInterval == 0)
+        {
+            double elapsed = ros::WallTime::now().toSec() - progress.tsStart;
 
-                matchingTags.push_back(trainTag);
-            }
+            ROS_INFO("Verified %lu/%lu loop closure candidates (%.1f candidates/s).",
+                     progress.nCandidatesDone, progress.nCandidates,
+                     (elapsed > 0.0) ? progress.nCandidatesDone / elapsed : 0.0);
         }
     }
-
-    return matchingTags;
 }
 
 bool
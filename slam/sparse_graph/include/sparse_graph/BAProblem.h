@@ -0,0 +1,127 @@
+#ifndef BAPROBLEM_H
+#define BAPROBLEM_H
+
+#include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
+#include <Eigen/Dense>
+
+#include "camera_systems/CameraSystem.h"
+#include "ceres/ceres.h"
+#include "sparse_graph/SparseGraph.h"
+#include "sparse_graph/Transform.h"
+
+namespace px
+{
+
+/**
+ * \brief Bundle adjustment problem over poses and scene points
+ *
+ * Scene points are tracked as residuals are added, so that the solver can
+ * be given an elimination ordering in which all scene points are eliminated
+ * before the poses, as the Schur complement linear solvers require.
+ *
+ * A problem constructed with a camera system can
+ * also be kept across solves, with stereo observations added and removed
+ * as they change. The problem then does not own the cost and loss
+ * functions or the parameterizations, so that removed residuals free
+ * their cost functions instead of accumulating them. Poses and scene
+ * points are removed from the problem once their last residual is.
+ */
+class BAProblem
+{
+public:
+    BAProblem();
+    explicit BAProblem(const CameraSystemConstPtr& cameraSystem);
+
+    ceres::Problem& problem(void);
+    const ceres::Problem& problem(void) const;
+
+    // Add a residual on a pose, given by its rotation and translation
+    // blocks, and a scene point. Residuals which do not depend on a scene
+    // point are added to problem() directly.
+    ceres::ResidualBlockId addResidualBlock(ceres::CostFunction* costFunction,
+                                            ceres::LossFunction* lossFunction,
+                                            double* rotation, double* translation,
+                                            double* scenePoint);
+
+    // Remove a scene point together with the residuals which depend on it.
+    void removeScenePoint(double* scenePoint);
+
+    size_t scenePointCount(void) const;
+
+    // Start a new round of stereo observation updates.
+    void beginUpdate(void);
+
+    // Add the residual of the stereo observation of a scene point by a
+    // feature in the left camera of a stereo pair and its match. The
+    // residual of an unchanged observation is kept.
+    void addStereoObservation(Point2DFeature* feature1,
+                              const Point3DFeaturePtr& scenePoint);
+    void removeObservation(Point2DFeature* feature1);
+
+    // Remove the residuals of observations which have not been added
+    // since the last call to beginUpdate().
+    void removeStaleObservations(void);
+
+    // Reference count the rotation, and optionally the translation, of a
+    // pose for residuals which are added to problem() directly.
+    void retainPose(FrameSet* frameSet, bool translation);
+    void releasePose(FrameSet* frameSet, bool translation);
+
+    bool hasPose(FrameSet* frameSet) const;
+    void getPoses(std::vector<FrameSet*>& frameSets) const;
+    void setPoseConstant(FrameSet* frameSet, bool constant);
+
+    // Set the linear solver of options. For SPARSE_SCHUR and ITERATIVE_SCHUR,
+    // the scene points form the first elimination group and all other
+    // parameter blocks the second. ITERATIVE_SCHUR is preconditioned with
+    // the visibility-based CLUSTER_JACOBI preconditioner if Ceres was built
+    // with SuiteSparse, and with SCHUR_JACOBI otherwise.
+    void setLinearSolver(ceres::LinearSolverType linearSolverType,
+                         ceres::Solver::Options& options) const;
+
+private:
+    class Observation
+    {
+    public:
+        ceres::ResidualBlockId residualId;
+        boost::shared_ptr<ceres::CostFunction> costFunction;
+        Point3DFeaturePtr scenePoint;
+        FrameSet* frameSet;
+        // rays of the stereo feature pair which the cost function was
+        // generated from
+        Eigen::Vector3d ray1;
+        Eigen::Vector3d ray2;
+        unsigned int updateSeq;
+    };
+
+    class PoseBlock
+    {
+    public:
+        PoseBlock()
+         : rotationResidualCount(0), translationResidualCount(0) {};
+
+        int rotationResidualCount;
+        int translationResidualCount;
+    };
+
+    ceres::Problem m_problem;
+
+    boost::unordered_set<double*> m_scenePoints;
+
+    std::vector<Transform, Eigen::aligned_allocator<Transform> > m_T_sys_cam;
+
+    boost::shared_ptr<ceres::LossFunction> m_lossFunction;
+    boost::shared_ptr<ceres::LocalParameterization> m_quaternionParameterization;
+
+    // residuals keyed by the feature of the left camera of a stereo pair
+    boost::unordered_map<Point2DFeature*, Observation> m_observations;
+    boost::unordered_map<FrameSet*, PoseBlock> m_poseBlocks;
+    boost::unordered_map<Point3DFeature*, int> m_scenePointResidualCounts;
+    unsigned int m_updateSeq;
+};
+
+}
+
+#endif
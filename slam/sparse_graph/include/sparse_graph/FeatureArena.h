@@ -0,0 +1,362 @@
+#ifndef FEATUREARENA_H
+#define FEATUREARENA_H
+
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <Eigen/Core>
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace px
+{
+
+/**
+ * \brief Allocates features and scene points in fixed-size chunks
+ *
+ * Each object is handed out as a shared pointer whose control block is
+ * stored together with the object in a slot of a chunk, so that there is
+ * one heap allocation per chunk instead of one per object, and object
+ * addresses are stable. An object is destroyed as soon as its last handle
+ * is dropped, and its slot is reused by later allocations. A chunk is
+ * released once all of its objects have been destroyed.
+ *
+ * The chunks outlive the arena as long as any of their objects is
+ * referenced.
+ */
+template <class T>
+class FeatureArena
+{
+public:
+    explicit FeatureArena(size_t chunkSize = 1024);
+
+    boost::shared_ptr<T> allocate(void);
+    void allocate(size_t n, std::vector<boost::shared_ptr<T> >& objects);
+
+    // Bytes held by chunks which still contain live objects.
+    size_t bytesAllocated(void) const;
+
+    // Number of objects which have not been destroyed yet.
+    size_t objectCount(void) const;
+
+private:
+    class Pool
+    {
+    public:
+        explicit Pool(size_t chunkSize);
+
+        void* allocate(size_t bytes);
+        void deallocate(void* p);
+
+        size_t bytesAllocated(void) const;
+        size_t objectCount(void) const;
+
+    private:
+        class Chunk
+        {
+        public:
+            char* data;
+            size_t nSlotsUsed;
+            size_t nLiveSlots;
+            std::vector<char*> freeSlots;
+            bool hasFreeSlots;
+        };
+
+        // Each slot starts with a header holding its chunk, padded to keep
+        // the object aligned for fixed-size Eigen members.
+        static const size_t k_alignment = 16;
+
+        void releaseChunk(Chunk* chunk);
+
+        const size_t k_chunkSize;
+        size_t m_slotSize;
+
+        std::vector<Chunk*> m_chunks;
+        Chunk* m_currentChunk;
+        // chunks with slots of destroyed objects
+        std::vector<Chunk*> m_freeChunks;
+        size_t m_nLargeObjects;
+
+        mutable boost::mutex m_globalMutex;
+    };
+
+    // Allocator which places the object and its control block in a slot
+    // of the pool.
+    template <class U>
+    class Allocator
+    {
+    public:
+        typedef U value_type;
+        typedef U* pointer;
+        typedef const U* const_pointer;
+        typedef U& reference;
+        typedef const U& const_reference;
+        typedef size_t size_type;
+        typedef ptrdiff_t difference_type;
+
+        template <class V>
+        struct rebind
+        {
+            typedef Allocator<V> other;
+        };
+
+        explicit Allocator(const boost::shared_ptr<Pool>& pool)
+         : m_pool(pool) {}
+
+        template <class V>
+        Allocator(const Allocator<V>& other)
+         : m_pool(other.pool()) {}
+
+        pointer allocate(size_type n, const void* hint = 0)
+        {
+            return static_cast<pointer>(m_pool->allocate(n * sizeof(U)));
+        }
+
+        void deallocate(pointer p, size_type n)
+        {
+            m_pool->deallocate(p);
+        }
+
+        void construct(pointer p, const U& value)
+        {
+            new (p) U(value);
+        }
+
+        void destroy(pointer p)
+        {
+            p->~U();
+        }
+
+        pointer address(reference r) const
+        {
+            return &r;
+        }
+
+        const_pointer address(const_reference r) const
+        {
+            return &r;
+        }
+
+        size_type max_size(void) const
+        {
+            return static_cast<size_type>(-1) / sizeof(U);
+        }
+
+        const boost::shared_ptr<Pool>& pool(void) const
+        {
+            return m_pool;
+        }
+
+        template <class V>
+        bool operator==(const Allocator<V>& other) const
+        {
+            return m_pool == other.pool();
+        }
+
+        template <class V>
+        bool operator!=(const Allocator<V>& other) const
+        {
+            return m_pool != other.pool();
+        }
+
+    private:
+        boost::shared_ptr<Pool> m_pool;
+    };
+
+    boost::shared_ptr<Pool> m_pool;
+};
+
+template <class T>
+FeatureArena<T>::FeatureArena(size_t chunkSize)
+ : m_pool(new Pool(chunkSize))
+{
+
+}
+
+template <class T>
+boost::shared_ptr<T>
+FeatureArena<T>::allocate(void)
+{
+    return boost::allocate_shared<T>(Allocator<T>(m_pool));
+}
+
+template <class T>
+void
+FeatureArena<T>::allocate(size_t n, std::vector<boost::shared_ptr<T> >& objects)
+{
+    objects.resize(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        objects.at(i) = allocate();
+    }
+}
+
+template <class T>
+size_t
+FeatureArena<T>::bytesAllocated(void) const
+{
+    return m_pool->bytesAllocated();
+}
+
+template <class T>
+size_t
+FeatureArena<T>::objectCount(void) const
+{
+    return m_pool->objectCount();
+}
+
+template <class T>
+FeatureArena<T>::Pool::Pool(size_t chunkSize)
+ : k_chunkSize(chunkSize > 0 ? chunkSize : 1)
+ , m_slotSize(0)
+ , m_currentChunk(0)
+ , m_nLargeObjects(0)
+{
+
+}
+
+template <class T>
+void*
+FeatureArena<T>::Pool::allocate(size_t bytes)
+{
+    boost::lock_guard<boost::mutex> lock(m_globalMutex);
+
+    // The slot size is fixed by the first allocation, since all objects
+    // are allocated together with control blocks of the same type.
+    if (m_slotSize == 0)
+    {
+        m_slotSize = k_alignment + (bytes + k_alignment - 1) / k_alignment * k_alignment;
+    }
+
+    char* slot = 0;
+    Chunk* chunk = 0;
+
+    if (k_alignment + bytes > m_slotSize)
+    {
+        slot = Eigen::aligned_allocator<char>().allocate(k_alignment + bytes);
+        ++m_nLargeObjects;
+    }
+    else
+    {
+        // reuse the slots of destroyed objects first
+        while (!m_freeChunks.empty() && !slot)
+        {
+            chunk = m_freeChunks.back();
+            if (chunk->freeSlots.empty())
+            {
+                chunk->hasFreeSlots = false;
+                m_freeChunks.pop_back();
+                continue;
+            }
+
+            slot = chunk->freeSlots.back();
+            chunk->freeSlots.pop_back();
+        }
+
+        if (!slot)
+        {
+            if (!m_currentChunk || m_currentChunk->nSlotsUsed == k_chunkSize)
+            {
+                m_currentChunk = new Chunk;
+                m_currentChunk->data = Eigen::aligned_allocator<char>().allocate(k_chunkSize * m_slotSize);
+                m_currentChunk->nSlotsUsed = 0;
+                m_currentChunk->nLiveSlots = 0;
+                m_currentChunk->hasFreeSlots = false;
+
+                m_chunks.push_back(m_currentChunk);
+            }
+
+            chunk = m_currentChunk;
+            slot = chunk->data + chunk->nSlotsUsed * m_slotSize;
+            ++chunk->nSlotsUsed;
+        }
+
+        ++chunk->nLiveSlots;
+    }
+
+    *reinterpret_cast<Chunk**>(slot) = chunk;
+
+    return slot + k_alignment;
+}
+
+template <class T>
+void
+FeatureArena<T>::Pool::deallocate(void* p)
+{
+    boost::lock_guard<boost::mutex> lock(m_globalMutex);
+
+    char* slot = static_cast<char*>(p) - k_alignment;
+    Chunk* chunk = *reinterpret_cast<Chunk**>(slot);
+
+    if (!chunk)
+    {
+        Eigen::aligned_allocator<char>().deallocate(slot, 0);
+        --m_nLargeObjects;
+        return;
+    }
+
+    --chunk->nLiveSlots;
+
+    if (chunk->nLiveSlots == 0)
+    {
+        if (chunk == m_currentChunk)
+        {
+            m_currentChunk = 0;
+        }
+
+        releaseChunk(chunk);
+        return;
+    }
+
+    chunk->freeSlots.push_back(slot);
+    if (!chunk->hasFreeSlots)
+    {
+        chunk->hasFreeSlots = true;
+        m_freeChunks.push_back(chunk);
+    }
+}
+
+template <class T>
+size_t
+FeatureArena<T>::Pool::bytesAllocated(void) const
+{
+    boost::lock_guard<boost::mutex> lock(m_globalMutex);
+
+    return m_chunks.size() * k_chunkSize * m_slotSize;
+}
+
+template <class T>
+size_t
+FeatureArena<T>::Pool::objectCount(void) const
+{
+    boost::lock_guard<boost::mutex> lock(m_globalMutex);
+
+    size_t count = m_nLargeObjects;
+    for (size_t i = 0; i < m_chunks.size(); ++i)
+    {
+        count += m_chunks.at(i)->nLiveSlots;
+    }
+
+    return count;
+}
+
+template <class T>
+void
+FeatureArena<T>::Pool::releaseChunk(Chunk* chunk)
+{
+    m_chunks.erase(std::find(m_chunks.begin(), m_chunks.end(), chunk));
+
+    if (chunk->hasFreeSlots)
+    {
+        m_freeChunks.erase(std::find(m_freeChunks.begin(), m_freeChunks.end(), chunk));
+    }
+
+    Eigen::aligned_allocator<char>().deallocate(chunk->data, k_chunkSize * m_slotSize);
+    delete chunk;
+}
+
+}
+
+#endif
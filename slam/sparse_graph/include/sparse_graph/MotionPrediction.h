@@ -0,0 +1,35 @@
+#ifndef MOTIONPREDICTION_H
+#define MOTIONPREDICTION_H
+
+#include <Eigen/Dense>
+#include <opencv2/core/core.hpp>
+#include <ros/time.h>
+#include <vector>
+
+#include "camera_models/Camera.h"
+#include "sparse_graph/SparseGraph.h"
+
+namespace px
+{
+
+// Predict the system pose at timeStamp from a constant-velocity prior
+// over the motion between the previous frame set and its predecessor.
+// If imu and the IMU measurement of the previous frame set are both
+// available, the relative rotation measured by the IMU is used instead.
+Eigen::Matrix4d predictSystemPose(const FrameSetConstPtr& frameSetPrev,
+                                  const ros::Time& timeStamp,
+                                  const sensor_msgs::ImuConstPtr& imu = sensor_msgs::ImuConstPtr());
+
+// Predict the image locations of the features in a frame given the system
+// pose of the frame set they are matched against. Features without a scene
+// point are predicted from the rotation only. Keypoints behind a pinhole
+// camera are set to NaN.
+void predictKeypoints(const FrameConstPtr& frame,
+                      const CameraConstPtr& camera,
+                      const Eigen::Matrix4d& H_cam_sys,
+                      const Eigen::Matrix4d& systemPose,
+                      std::vector<cv::Point2f>& keypoints);
+
+}
+
+#endif
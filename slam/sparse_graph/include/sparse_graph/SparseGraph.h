@@ -2,10 +2,12 @@
 #define SPARSEGRAPH_H
 
 #include <boost/unordered_map.hpp>
+#include <boost/weak_ptr.hpp>
 #include <opencv2/core/core.hpp>
 #include <opencv2/features2d/features2d.hpp>
 #include <sensor_msgs/Imu.h>
 
+#include "sparse_graph/FeatureArena.h"
 #include "sparse_graph/Pose.h"
 
 namespace px
@@ -81,6 +83,31 @@ public:
     std::vector<Point2DFeaturePtr>& features2D(void);
     const std::vector<Point2DFeaturePtr>& features2D(void) const;
 
+    /**
+     * \brief Append one 2D feature per row of descriptors
+     *
+     * The features are allocated in a single block, and the descriptor of
+     * each feature is a view of its row in descriptors. The keypoints and
+     * rays of the appended features are left to the caller.
+     */
+    void appendFeatures2D(const cv::Mat& descriptors);
+
+    /**
+     * \brief Rebuild the descriptor matrix after features2D() has been
+     *        modified
+     *
+     * The descriptors of the features are copied into a new matrix, and
+     * the descriptors, match lists and scene points of features that have
+     * been erased from features2D() are released. The erased features
+     * themselves are freed with their block.
+     */
+    void compactFeatures2D(void);
+
+    // Descriptors of features2D() as the rows of a single matrix. The
+    // feature descriptors are views of its rows, so the matrix must not
+    // be modified.
+    const cv::Mat& descriptorMat(void) const;
+
     cv::Mat& image(void);
     const cv::Mat& image(void) const;
 
@@ -91,7 +118,11 @@ private:
     FrameSet* m_frameSet;
     std::vector<LoopClosureEdge> m_loopClosureEdges;
 
+    typedef std::vector<Point2DFeature, Eigen::aligned_allocator<Point2DFeature> > Point2DFeatureBlock;
+
     std::vector<Point2DFeaturePtr> m_features2D;
+    std::vector<boost::weak_ptr<Point2DFeatureBlock> > m_featureBlocks;
+    cv::Mat m_descriptors;
 
     cv::Mat m_image;
 };
@@ -284,6 +315,16 @@ public:
 
     size_t scenePointCount(void) const;
 
+    // Approximate memory in bytes used by the frame sets, frames,
+    // features and scene points of a segment. Scene points observed
+    // in several frames are counted once.
+    size_t memoryUsage(int segmentId) const;
+
+    // Arena from which the scene points of a segment are allocated. It
+    // is owned by the graph, and the memory of the scene points is
+    // released with the last frame set that references them.
+    const boost::shared_ptr<FeatureArena<Point3DFeature> >& scenePointArena(int segmentId);
+
     bool readFromBinaryFile(const std::string& filename);
     void writeToBinaryFile(const std::string& filename) const;
 
@@ -295,6 +336,7 @@ private:
     void writeData(std::ofstream& ofs, T data) const;
 
     std::vector<FrameSetSegment> m_frameSetSegments;
+    std::vector<boost::shared_ptr<FeatureArena<Point3DFeature> > > m_scenePointArenas;
 };
 
 typedef boost::shared_ptr<SparseGraph> SparseGraphPtr;
@@ -0,0 +1,338 @@
+#include "sparse_graph/BAProblem.h"
+
+#include "camera_models/CostFunctionFactory.h"
+#include "cauldron/EigenQuaternionParameterization.h"
+#include "cauldron/EigenUtils.h"
+
+namespace px
+{
+
+namespace
+{
+
+ceres::Problem::Options
+problemOptions(void)
+{
+    ceres::Problem::Options options;
+    options.cost_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+    options.loss_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+    options.local_parameterization_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+    options.enable_fast_parameter_block_removal = true;
+
+    return options;
+}
+
+}
+
+BAProblem::BAProblem()
+ : m_updateSeq(0)
+{
+
+}
+
+BAProblem::BAProblem(const CameraSystemConstPtr& cameraSystem)
+ : m_problem(problemOptions())
+ , m_lossFunction(new ceres::HuberLoss(0.0000055555))
+ , m_quaternionParameterization(new EigenQuaternionParameterization)
+ , m_updateSeq(0)
+{
+    for (int i = 0; i < cameraSystem->cameraCount(); ++i)
+    {
+        Eigen::Matrix4d H_sys_cam = invertHomogeneousTransform(cameraSystem->getGlobalCameraPose(i));
+
+        m_T_sys_cam.push_back(Transform(H_sys_cam));
+    }
+}
+
+ceres::Problem&
+BAProblem::problem(void)
+{
+    return m_problem;
+}
+
+const ceres::Problem&
+BAProblem::problem(void) const
+{
+    return m_problem;
+}
+
+ceres::ResidualBlockId
+BAProblem::addResidualBlock(ceres::CostFunction* costFunction,
+                            ceres::LossFunction* lossFunction,
+                            double* rotation, double* translation,
+                            double* scenePoint)
+{
+    m_scenePoints.insert(scenePoint);
+
+    return m_problem.AddResidualBlock(costFunction, lossFunction,
+                                      rotation, translation, scenePoint);
+}
+
+void
+BAProblem::removeScenePoint(double* scenePoint)
+{
+    m_problem.RemoveParameterBlock(scenePoint);
+
+    m_scenePoints.erase(scenePoint);
+}
+
+size_t
+BAProblem::scenePointCount(void) const
+{
+    return m_scenePoints.size();
+}
+
+void
+BAProblem::beginUpdate(void)
+{
+    ++m_updateSeq;
+}
+
+void
+BAProblem::addStereoObservation(Point2DFeature* feature1,
+                                const Point3DFeaturePtr& scenePoint)
+{
+    FrameSet* frameSet = feature1->frame()->frameSet();
+    Point2DFeature* feature2 = feature1->match();
+
+    boost::unordered_map<Point2DFeature*, Observation>::iterator itObs = m_observations.find(feature1);
+    if (itObs != m_observations.end())
+    {
+        Observation& observation = itObs->second;
+
+        if (observation.scenePoint == scenePoint &&
+            observation.frameSet == frameSet &&
+            observation.ray1 == feature1->ray() &&
+            observation.ray2 == feature2->ray())
+        {
+            observation.updateSeq = m_updateSeq;
+            return;
+        }
+
+        removeObservation(feature1);
+    }
+
+    int cameraId1 = feature1->frame()->cameraId();
+    int cameraId2 = feature2->frame()->cameraId();
+
+    Observation observation;
+    observation.costFunction.reset(
+        CostFunctionFactory::instance()->generateCostFunction(feature1->ray(),
+                                                              feature2->ray(),
+                                                              m_T_sys_cam.at(cameraId1).rotation(),
+                                                              m_T_sys_cam.at(cameraId1).translation(),
+                                                              m_T_sys_cam.at(cameraId2).rotation(),
+                                                              m_T_sys_cam.at(cameraId2).translation()));
+
+    observation.residualId =
+        addResidualBlock(observation.costFunction.get(), m_lossFunction.get(),
+                         frameSet->systemPose()->rotationData(),
+                         frameSet->systemPose()->translationData(),
+                         scenePoint->pointData());
+
+    observation.scenePoint = scenePoint;
+    observation.frameSet = frameSet;
+    observation.ray1 = feature1->ray();
+    observation.ray2 = feature2->ray();
+    observation.updateSeq = m_updateSeq;
+
+    retainPose(frameSet, true);
+
+    ++m_scenePointResidualCounts[scenePoint.get()];
+
+    m_observations.insert(std::make_pair(feature1, observation));
+}
+
+void
+BAProblem::removeObservation(Point2DFeature* feature1)
+{
+    boost::unordered_map<Point2DFeature*, Observation>::iterator itObs = m_observations.find(feature1);
+    if (itObs == m_observations.end())
+    {
+        return;
+    }
+
+    Observation& observation = itObs->second;
+
+    m_problem.RemoveResidualBlock(observation.residualId);
+
+    boost::unordered_map<Point3DFeature*, int>::iterator itPoint =
+        m_scenePointResidualCounts.find(observation.scenePoint.get());
+    if (--itPoint->second == 0)
+    {
+        removeScenePoint(observation.scenePoint->pointData());
+        m_scenePointResidualCounts.erase(itPoint);
+    }
+
+    releasePose(observation.frameSet, true);
+
+    m_observations.erase(itObs);
+}
+
+void
+BAProblem::removeStaleObservations(void)
+{
+    std::vector<Point2DFeature*> staleFeatures;
+    for (boost::unordered_map<Point2DFeature*, Observation>::iterator it = m_observations.begin();
+             it != m_observations.end(); ++it)
+    {
+        if (it->second.updateSeq != m_updateSeq)
+        {
+            staleFeatures.push_back(it->first);
+        }
+    }
+
+    for (size_t i = 0; i < staleFeatures.size(); ++i)
+    {
+        removeObservation(staleFeatures.at(i));
+    }
+}
+
+void
+BAProblem::retainPose(FrameSet* frameSet, bool translation)
+{
+    PoseBlock& poseBlock = m_poseBlocks[frameSet];
+
+    if (poseBlock.rotationResidualCount == 0)
+    {
+        // the pose has just been added to the problem
+        m_problem.SetParameterization(frameSet->systemPose()->rotationData(),
+                                      m_quaternionParameterization.get());
+    }
+    ++poseBlock.rotationResidualCount;
+
+    if (translation)
+    {
+        ++poseBlock.translationResidualCount;
+    }
+}
+
+void
+BAProblem::releasePose(FrameSet* frameSet, bool translation)
+{
+    boost::unordered_map<FrameSet*, PoseBlock>::iterator it = m_poseBlocks.find(frameSet);
+    PoseBlock& poseBlock = it->second;
+
+    if (--poseBlock.rotationResidualCount == 0)
+    {
+        m_problem.RemoveParameterBlock(frameSet->systemPose()->rotationData());
+    }
+
+    if (translation && --poseBlock.translationResidualCount == 0)
+    {
+        m_problem.RemoveParameterBlock(frameSet->systemPose()->translationData());
+    }
+
+    if (poseBlock.rotationResidualCount == 0)
+    {
+        m_poseBlocks.erase(it);
+    }
+}
+
+bool
+BAProblem::hasPose(FrameSet* frameSet) const
+{
+    return m_poseBlocks.find(frameSet) != m_poseBlocks.end();
+}
+
+void
+BAProblem::getPoses(std::vector<FrameSet*>& frameSets) const
+{
+    frameSets.clear();
+    frameSets.reserve(m_poseBlocks.size());
+
+    for (boost::unordered_map<FrameSet*, PoseBlock>::const_iterator it = m_poseBlocks.begin();
+             it != m_poseBlocks.end(); ++it)
+    {
+        frameSets.push_back(it->first);
+    }
+}
+
+void
+BAProblem::setPoseConstant(FrameSet* frameSet, bool constant)
+{
+    boost::unordered_map<FrameSet*, PoseBlock>::iterator it = m_poseBlocks.find(frameSet);
+    if (it == m_poseBlocks.end())
+    {
+        return;
+    }
+
+    const PoseBlock& poseBlock = it->second;
+
+    if (poseBlock.rotationResidualCount > 0)
+    {
+        if (constant)
+        {
+            m_problem.SetParameterBlockConstant(frameSet->systemPose()->rotationData());
+        }
+        else
+        {
+            m_problem.SetParameterBlockVariable(frameSet->systemPose()->rotationData());
+        }
+    }
+
+    if (poseBlock.translationResidualCount > 0)
+    {
+        if (constant)
+        {
+            m_problem.SetParameterBlockConstant(frameSet->systemPose()->translationData());
+        }
+        else
+        {
+            m_problem.SetParameterBlockVariable(frameSet->systemPose()->translationData());
+        }
+    }
+}
+
+void
+BAProblem::setLinearSolver(ceres::LinearSolverType linearSolverType,
+                           ceres::Solver::Options& options) const
+{
+    options.linear_solver_type = linearSolverType;
+
+    // options owns the ordering
+    delete options.linear_solver_ordering;
+    options.linear_solver_ordering = 0;
+
+    if (!ceres::IsSchurType(linearSolverType))
+    {
+        return;
+    }
+
+    // Ceres requires every parameter block of the problem to be ordered,
+    // including constant blocks.
+    std::vector<double*> parameterBlocks;
+    m_problem.GetParameterBlocks(&parameterBlocks);
+
+    ceres::ParameterBlockOrdering* ordering = new ceres::ParameterBlockOrdering;
+    for (size_t i = 0; i < parameterBlocks.size(); ++i)
+    {
+        double* parameterBlock = parameterBlocks.at(i);
+
+        if (m_scenePoints.find(parameterBlock) != m_scenePoints.end())
+        {
+            ordering->AddElementToGroup(parameterBlock, 0);
+        }
+        else
+        {
+            ordering->AddElementToGroup(parameterBlock, 1);
+        }
+    }
+
+    options.linear_solver_ordering = ordering;
+
+    if (linearSolverType == ceres::ITERATIVE_SCHUR)
+    {
+        // the visibility-based preconditioners require SuiteSparse
+        if (ceres::IsSparseLinearAlgebraLibraryTypeAvailable(ceres::SUITE_SPARSE))
+        {
+            options.preconditioner_type = ceres::CLUSTER_JACOBI;
+        }
+        else
+        {
+            options.preconditioner_type = ceres::SCHUR_JACOBI;
+        }
+    }
+}
+
+}
@@ -0,0 +1,101 @@
+#include "sparse_graph/MotionPrediction.h"
+
+#include <limits>
+
+#include "cauldron/EigenUtils.h"
+
+namespace px
+{
+
+Eigen::Matrix4d
+predictSystemPose(const FrameSetConstPtr& frameSetPrev,
+                  const ros::Time& timeStamp,
+                  const sensor_msgs::ImuConstPtr& imu)
+{
+    Eigen::Matrix4d H_prev = frameSetPrev->systemPose()->toMatrix();
+
+    // transform from the previous to the current system frame
+    Eigen::Matrix4d H_delta = Eigen::Matrix4d::Identity();
+
+    const FrameSet* frameSetPrevPrev = frameSetPrev->prevFrameSet();
+    if (frameSetPrevPrev)
+    {
+        double dt0 = (frameSetPrev->systemPose()->timeStamp() -
+                      frameSetPrevPrev->systemPose()->timeStamp()).toSec();
+        double dt1 = (timeStamp - frameSetPrev->systemPose()->timeStamp()).toSec();
+
+        if (dt0 > 0.0)
+        {
+            Eigen::Matrix4d H_motion = H_prev *
+                                       invertHomogeneousTransform(frameSetPrevPrev->systemPose()->toMatrix());
+
+            Eigen::AngleAxisd aa(Eigen::Matrix3d(H_motion.block<3,3>(0,0)));
+            aa.angle() *= dt1 / dt0;
+
+            H_delta.block<3,3>(0,0) = aa.toRotationMatrix();
+            H_delta.block<3,1>(0,3) = H_motion.block<3,1>(0,3) * dt1 / dt0;
+        }
+    }
+
+    const sensor_msgs::ImuConstPtr& imuPrev = frameSetPrev->imuMeasurement();
+    if (imuPrev && imu)
+    {
+        Eigen::Quaterniond q_prev(imuPrev->orientation.w, imuPrev->orientation.x,
+                                  imuPrev->orientation.y, imuPrev->orientation.z);
+        Eigen::Quaterniond q_curr(imu->orientation.w, imu->orientation.x,
+                                  imu->orientation.y, imu->orientation.z);
+
+        H_delta.block<3,3>(0,0) = (q_curr.conjugate() * q_prev).toRotationMatrix();
+    }
+
+    return H_delta * H_prev;
+}
+
+void
+predictKeypoints(const FrameConstPtr& frame,
+                 const CameraConstPtr& camera,
+                 const Eigen::Matrix4d& H_cam_sys,
+                 const Eigen::Matrix4d& systemPose,
+                 std::vector<cv::Point2f>& keypoints)
+{
+    const std::vector<Point2DFeaturePtr>& features = frame->features2D();
+
+    Eigen::Matrix4d H_sys_cam = invertHomogeneousTransform(H_cam_sys);
+    Eigen::Matrix4d H_prev = H_sys_cam * frame->frameSet()->systemPose()->toMatrix();
+
+    // transforms from the world frame and from the camera frame of the
+    // features to the predicted camera frame
+    Eigen::Matrix4d H_world = H_sys_cam * systemPose;
+    Eigen::Matrix4d H_cam = H_world * invertHomogeneousTransform(H_prev);
+
+    keypoints.resize(features.size());
+    for (size_t i = 0; i < features.size(); ++i)
+    {
+        const Point2DFeatureConstPtr& feature = features.at(i);
+
+        // Use the scene point if available, otherwise only the rotation.
+        Eigen::Vector3d P;
+        if (feature->feature3D())
+        {
+            P = transformPoint(H_world, feature->feature3D()->point());
+        }
+        else
+        {
+            P = H_cam.block<3,3>(0,0) * feature->ray();
+        }
+
+        if (camera->modelType() == Camera::PINHOLE && P(2) <= 0.0)
+        {
+            keypoints.at(i).x = std::numeric_limits<float>::quiet_NaN();
+            keypoints.at(i).y = std::numeric_limits<float>::quiet_NaN();
+            continue;
+        }
+
+        Eigen::Vector2d p;
+        camera->spaceToPlane(P, p);
+
+        keypoints.at(i) = cv::Point2f(p(0), p(1));
+    }
+}
+
+}
@@ -150,6 +150,121 @@ Frame::features2D(void) const
     return m_features2D;
 }
 
+void
+Frame::appendFeatures2D(const cv::Mat& descriptors)
+{
+    if (descriptors.empty())
+    {
+        return;
+    }
+
+    // the features share ownership of the block
+    boost::shared_ptr<Point2DFeatureBlock> block =
+        boost::make_shared<Point2DFeatureBlock>(descriptors.rows);
+    m_featureBlocks.push_back(block);
+
+    bool append = !m_features2D.empty();
+    if (!append)
+    {
+        m_descriptors = descriptors;
+    }
+
+    m_features2D.reserve(m_features2D.size() + descriptors.rows);
+    for (int i = 0; i < descriptors.rows; ++i)
+    {
+        Point2DFeature& feature = block->at(i);
+        feature.frame() = this;
+        feature.descriptor() = descriptors.row(i);
+
+        m_features2D.push_back(Point2DFeaturePtr(block, &feature));
+    }
+
+    if (append)
+    {
+        compactFeatures2D();
+    }
+}
+
+void
+Frame::compactFeatures2D(void)
+{
+    boost::unordered_set<Point2DFeature*> features;
+    for (size_t i = 0; i < m_features2D.size(); ++i)
+    {
+        features.insert(m_features2D.at(i).get());
+    }
+
+    // release the resources held by erased features
+    std::vector<boost::weak_ptr<Point2DFeatureBlock> >::iterator it = m_featureBlocks.begin();
+    while (it != m_featureBlocks.end())
+    {
+        boost::shared_ptr<Point2DFeatureBlock> block = it->lock();
+        if (!block)
+        {
+            it = m_featureBlocks.erase(it);
+            continue;
+        }
+
+        for (size_t i = 0; i < block->size(); ++i)
+        {
+            Point2DFeature& feature = block->at(i);
+            if (features.find(&feature) != features.end())
+            {
+                continue;
+            }
+
+            feature.descriptor().release();
+            std::vector<Point2DFeature*>().swap(feature.prevMatches());
+            std::vector<Point2DFeature*>().swap(feature.matches());
+            std::vector<Point2DFeature*>().swap(feature.nextMatches());
+            feature.feature3D().reset();
+        }
+
+        ++it;
+    }
+
+    m_descriptors = cv::Mat();
+
+    std::vector<Point2DFeaturePtr>::iterator itFeature = m_features2D.begin();
+    while (itFeature != m_features2D.end() &&
+           (!(*itFeature) || (*itFeature)->descriptor().empty()))
+    {
+        ++itFeature;
+    }
+
+    if (itFeature == m_features2D.end())
+    {
+        return;
+    }
+
+    const cv::Mat& dtor = (*itFeature)->descriptor();
+    cv::Mat descriptors = cv::Mat::zeros(m_features2D.size(), dtor.cols, dtor.type());
+
+    for (size_t i = 0; i < m_features2D.size(); ++i)
+    {
+        Point2DFeaturePtr& feature = m_features2D.at(i);
+        if (!feature)
+        {
+            continue;
+        }
+
+        cv::Mat row = descriptors.row(i);
+        if (!feature->descriptor().empty())
+        {
+            feature->descriptor().copyTo(row);
+        }
+        feature->descriptor() = row;
+    }
+
+    m_descriptors = descriptors;
+}
+
+const cv::Mat&
+Frame::descriptorMat(void) const
+{
+    return m_descriptors;
+}
+
 cv::Mat&
 Frame::image(void)
 {
@@ -705,6 +820,77 @@ SparseGraph::scenePointCount(void) const
     return scenePointSet.size();
 }
 
+size_t
+SparseGraph::memoryUsage(int segmentId) const
+{
+    const FrameSetSegment& segment = m_frameSetSegments.at(segmentId);
+
+    size_t bytes = segment.capacity() * sizeof(FrameSetPtr);
+
+    boost::unordered_set<Point3DFeature*> scenePointSet;
+    for (size_t i = 0; i < segment.size(); ++i)
+    {
+        const FrameSetPtr& frameSet = segment.at(i);
+
+        bytes += sizeof(FrameSet);
+        bytes += frameSet->frames().capacity() * sizeof(FramePtr);
+
+        for (size_t j = 0; j < frameSet->frames().size(); ++j)
+        {
+            const FramePtr& frame = frameSet->frames().at(j);
+
+            if (!frame)
+            {
+                continue;
+            }
+
+            bytes += sizeof(Frame);
+            bytes += frame->image().total() * frame->image().elemSize();
+            bytes += frame->loopClosureEdges().capacity() * sizeof(LoopClosureEdge);
+
+            const std::vector<Point2DFeaturePtr>& features2D = frame->features2D();
+            bytes += features2D.capacity() * sizeof(Point2DFeaturePtr);
+
+            for (size_t k = 0; k < features2D.size(); ++k)
+            {
+                const Point2DFeaturePtr& feature2D = features2D.at(k);
+
+                bytes += sizeof(Point2DFeature);
+                bytes += feature2D->descriptor().cols * feature2D->descriptor().elemSize();
+                bytes += (feature2D->prevMatches().capacity() +
+                          feature2D->matches().capacity() +
+                          feature2D->nextMatches().capacity()) * sizeof(Point2DFeature*);
+
+                Point3DFeature* scenePoint = feature2D->feature3D().get();
+                if (scenePoint && scenePointSet.insert(scenePoint).second)
+                {
+                    bytes += sizeof(Point3DFeature);
+                    bytes += scenePoint->features2D().capacity() * sizeof(Point2DFeature*);
+                }
+            }
+        }
+    }
+
+    return bytes;
+}
+
+const boost::shared_ptr<FeatureArena<Point3DFeature> >&
+SparseGraph::scenePointArena(int segmentId)
+{
+    if (segmentId >= static_cast<int>(m_scenePointArenas.size()))
+    {
+        m_scenePointArenas.resize(segmentId + 1);
+    }
+
+    boost::shared_ptr<FeatureArena<Point3DFeature> >& arena = m_scenePointArenas.at(segmentId);
+    if (!arena)
+    {
+        arena = boost::make_shared<FeatureArena<Point3DFeature> >();
+    }
+
+    return arena;
+}
+
 bool
 SparseGraph::readFromBinaryFile(const std::string& filename)
 {
@@ -762,17 +948,13 @@ SparseGraph::readFromBinaryFile(const std::string& filename)
         imuMap.at(i) = boost::make_shared<sensor_msgs::Imu>();
     }
 
-    std::vector<Point2DFeaturePtr> feature2DMap(nFeatures2D);
-    for (size_t i = 0; i < nFeatures2D; ++i)
-    {
-        feature2DMap.at(i) = boost::make_shared<Point2DFeature>();
-    }
+    std::vector<Point2DFeaturePtr> feature2DMap;
+    FeatureArena<Point2DFeature> feature2DArena;
+    feature2DArena.allocate(nFeatures2D, feature2DMap);
 
-    std::vector<Point3DFeaturePtr> feature3DMap(nFeatures3D);
-    for (size_t i = 0; i < nFeatures3D; ++i)
-    {
-        feature3DMap.at(i) = boost::make_shared<Point3DFeature>();
-    }
+    std::vector<Point3DFeaturePtr> feature3DMap;
+    FeatureArena<Point3DFeature> feature3DArena;
+    feature3DArena.allocate(nFeatures3D, feature3DMap);
 
     for (size_t i = 0; i < nFrames; ++i)
     {
@@ -1063,6 +1245,12 @@ SparseGraph::readFromBinaryFile(const std::string& filename)
         }
     }
 
+    // pack the descriptors of each frame into a single matrix
+    for (size_t i = 0; i < frameMap.size(); ++i)
+    {
+        frameMap.at(i)->compactFeatures2D();
+    }
+
     size_t nSegments;
     readData(ifs, nSegments);
 
@@ -0,0 +1,125 @@
+#include <gtest/gtest.h>
+
+#include "sparse_graph/FeatureArena.h"
+
+namespace px
+{
+
+namespace
+{
+
+class Counted
+{
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    Counted()
+     : observations(16)
+    {
+        ++nLive;
+    }
+
+    ~Counted()
+    {
+        --nLive;
+    }
+
+    static int nLive;
+
+    Eigen::Vector4d point;
+    std::vector<int> observations;
+};
+
+int Counted::nLive = 0;
+
+}
+
+TEST(FeatureArena, destroyObjects)
+{
+    FeatureArena<Counted> arena(8);
+
+    std::vector<boost::shared_ptr<Counted> > objects;
+    arena.allocate(20, objects);
+
+    EXPECT_EQ(20, Counted::nLive);
+    EXPECT_EQ(20, arena.objectCount());
+
+    for (size_t i = 0; i < objects.size(); ++i)
+    {
+        // fixed-size Eigen members stay aligned
+        EXPECT_EQ(0, reinterpret_cast<size_t>(objects.at(i)->point.data()) % 16);
+    }
+
+    // objects are destroyed when their last handle is dropped, even though
+    // other objects in the same chunk are still referenced
+    objects.at(3).reset();
+    objects.at(17).reset();
+
+    EXPECT_EQ(18, Counted::nLive);
+    EXPECT_EQ(18, arena.objectCount());
+
+    objects.clear();
+
+    EXPECT_EQ(0, Counted::nLive);
+    EXPECT_EQ(0, arena.objectCount());
+}
+
+TEST(FeatureArena, reclaimMemory)
+{
+    FeatureArena<Counted> arena(8);
+
+    std::vector<boost::shared_ptr<Counted> > objects;
+    arena.allocate(24, objects);
+
+    size_t chunkBytes = arena.bytesAllocated() / 3;
+    EXPECT_GT(chunkBytes, 8 * sizeof(Counted));
+
+    // releasing all objects of a chunk releases the chunk
+    for (size_t i = 0; i < 8; ++i)
+    {
+        objects.at(i).reset();
+    }
+    EXPECT_EQ(2 * chunkBytes, arena.bytesAllocated());
+
+    // a surviving object pins its chunk, but the slots of the destroyed
+    // objects are reused
+    for (size_t i = 9; i < 16; ++i)
+    {
+        objects.at(i).reset();
+    }
+    EXPECT_EQ(2 * chunkBytes, arena.bytesAllocated());
+
+    std::vector<boost::shared_ptr<Counted> > newObjects;
+    arena.allocate(7, newObjects);
+    EXPECT_EQ(2 * chunkBytes, arena.bytesAllocated());
+
+    objects.clear();
+    newObjects.clear();
+
+    EXPECT_EQ(0, arena.bytesAllocated());
+    EXPECT_EQ(0, arena.objectCount());
+}
+
+TEST(FeatureArena, outliveArena)
+{
+    boost::shared_ptr<Counted> object;
+    {
+        FeatureArena<Counted> arena(8);
+        object = arena.allocate();
+    }
+
+    EXPECT_EQ(1, Counted::nLive);
+    EXPECT_EQ(16, object->observations.size());
+
+    object.reset();
+
+    EXPECT_EQ(0, Counted::nLive);
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,144 @@
+#include <boost/make_shared.hpp>
+#include <gtest/gtest.h>
+#include <opencv2/core/core.hpp>
+
+#include "sparse_graph/SparseGraph.h"
+
+namespace px
+{
+
+TEST(Frame, appendFeatures2D)
+{
+    cv::Mat dtors(100, 32, CV_8U);
+    cv::randu(dtors, cv::Scalar(0), cv::Scalar(256));
+
+    Frame frame;
+    frame.appendFeatures2D(dtors);
+
+    ASSERT_EQ(100, frame.features2D().size());
+
+    // the descriptor matrix is shared with the features without copying
+    const cv::Mat& dmat = frame.descriptorMat();
+    EXPECT_EQ(dtors.data, dmat.data);
+
+    for (size_t i = 0; i < frame.features2D().size(); ++i)
+    {
+        const Point2DFeaturePtr& feature = frame.features2D().at(i);
+
+        EXPECT_EQ(&frame, feature->frame());
+        EXPECT_EQ(dmat.ptr(i), feature->descriptor().data);
+    }
+}
+
+TEST(Frame, compactFeatures2D)
+{
+    cv::Mat dtors(100, 32, CV_8U);
+    cv::randu(dtors, cv::Scalar(0), cv::Scalar(256));
+
+    Frame frame;
+    frame.appendFeatures2D(dtors);
+
+    Point3DFeaturePtr scenePoint(new Point3DFeature);
+    frame.features2D().at(1)->feature3D() = scenePoint;
+    frame.features2D().at(1)->nextMatches().resize(3);
+
+    // erase every other feature
+    std::vector<Point2DFeature*> erased;
+    std::vector<Point2DFeaturePtr>& features = frame.features2D();
+    std::vector<Point2DFeaturePtr>::iterator it = features.begin();
+    while (it != features.end())
+    {
+        if ((it - features.begin() + erased.size()) % 2 == 1)
+        {
+            erased.push_back(it->get());
+            it = features.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    ASSERT_EQ(50, features.size());
+
+    frame.compactFeatures2D();
+
+    const cv::Mat& dmat = frame.descriptorMat();
+    ASSERT_EQ(50, dmat.rows);
+    EXPECT_NE(dtors.data, dmat.data);
+
+    for (size_t i = 0; i < features.size(); ++i)
+    {
+        EXPECT_EQ(dmat.ptr(i), features.at(i)->descriptor().data);
+        EXPECT_EQ(0, cv::norm(dtors.row(i * 2), dmat.row(i), cv::NORM_HAMMING));
+    }
+
+    // the erased features no longer hold their descriptors, match lists
+    // and scene points
+    for (size_t i = 0; i < erased.size(); ++i)
+    {
+        EXPECT_TRUE(erased.at(i)->descriptor().empty());
+        EXPECT_EQ(0, erased.at(i)->nextMatches().capacity());
+        EXPECT_FALSE(erased.at(i)->feature3D());
+    }
+    EXPECT_TRUE(scenePoint.unique());
+}
+
+TEST(SparseGraph, memoryUsage)
+{
+    SparseGraph graph;
+    graph.frameSetSegments().resize(1);
+
+    const boost::shared_ptr<FeatureArena<Point3DFeature> >& arena = graph.scenePointArena(0);
+
+    size_t nFeatures = 200;
+    for (int i = 0; i < 5; ++i)
+    {
+        FrameSetPtr frameSet = boost::make_shared<FrameSet>();
+
+        FramePtr frame = boost::make_shared<Frame>();
+        frame->frameSet() = frameSet.get();
+        frameSet->frames().push_back(frame);
+
+        cv::Mat dtors(nFeatures, 32, CV_8U, cv::Scalar(0));
+        frame->appendFeatures2D(dtors);
+
+        std::vector<Point3DFeaturePtr> scenePoints;
+        arena->allocate(nFeatures, scenePoints);
+
+        for (size_t j = 0; j < nFeatures; ++j)
+        {
+            const Point2DFeaturePtr& feature = frame->features2D().at(j);
+
+            feature->feature3D() = scenePoints.at(j);
+            scenePoints.at(j)->features2D().push_back(feature.get());
+        }
+
+        graph.frameSetSegment(0).push_back(frameSet);
+    }
+
+    size_t bytes = graph.memoryUsage(0);
+    EXPECT_GT(bytes, 5 * nFeatures * (sizeof(Point2DFeature) + sizeof(Point3DFeature)));
+    EXPECT_EQ(5 * nFeatures, arena->objectCount());
+    EXPECT_GT(arena->bytesAllocated(), 0);
+
+    // scene points are destroyed with the frame sets which reference them
+    FrameSetSegment& segment = graph.frameSetSegment(0);
+    segment.erase(segment.begin(), segment.begin() + 3);
+
+    EXPECT_LT(graph.memoryUsage(0), bytes);
+    EXPECT_EQ(2 * nFeatures, arena->objectCount());
+
+    segment.clear();
+
+    EXPECT_EQ(0, arena->objectCount());
+    EXPECT_EQ(0, arena->bytesAllocated());
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
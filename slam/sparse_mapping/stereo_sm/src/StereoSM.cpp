@@ -8,6 +8,7 @@
 #include "ceres/ceres.h"
 #include "pose_graph/PoseGraph.h"
 #include "pose_graph/PoseGraphViz.h"
+#include "sparse_graph/BAProblem.h"
 
 namespace px
 {
@@ -21,7 +22,7 @@ StereoSM::StereoSM(ros::NodeHandle& nh,
  , m_svo(cameraSystem, 0, 1, true)
  , m_sgv(nh, sparseGraph)
 {
-
+    m_svo.setScenePointArena(m_sparseGraph->scenePointArena(0));
 }
 
 bool
@@ -204,13 +205,7 @@ void
 StereoSM::runBA(void)
 {
     // run bundle adjustment
-    ceres::Problem problem;
-
-    ceres::Solver::Options options;
-    options.linear_solver_type = ceres::SPARSE_NORMAL_CHOLESKY;
-    options.max_num_iterations = 1000;
-    options.num_threads = 8;
-    options.num_linear_solver_threads = 8;
+    BAProblem problem;
 
     std::vector<Eigen::Quaterniond, Eigen::aligned_allocator<Eigen::Quaterniond> > q_veh_cam;
     std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > t_veh_cam;
@@ -250,7 +245,7 @@ StereoSM::runBA(void)
                                                                               feature->ray(),
                                                                               SYSTEM_POSE | SCENE_POINT);
 
-                    problem.AddResidualBlock(costFunction, lossFunction,
+                    problem.addResidualBlock(costFunction, lossFunction,
                                              frameSet->systemPose()->rotationData(),
                                              frameSet->systemPose()->translationData(),
                                              scenePoint->pointData());
@@ -260,13 +255,19 @@ StereoSM::runBA(void)
             ceres::LocalParameterization* quaternionParameterization =
                 new EigenQuaternionParameterization;
 
-            problem.SetParameterization(frameSet->systemPose()->rotationData(),
-                                        quaternionParameterization);
+            problem.problem().SetParameterization(frameSet->systemPose()->rotationData(),
+                                                  quaternionParameterization);
         }
     }
 
+    ceres::Solver::Options options;
+    problem.setLinearSolver(ceres::SPARSE_SCHUR, options);
+    options.max_num_iterations = 1000;
+    options.num_threads = 8;
+    options.num_linear_solver_threads = 8;
+
     ceres::Solver::Summary summary;
-    ceres::Solve(options, &problem, &summary);
+    ceres::Solve(options, &problem.problem(), &summary);
 
     std::cout << summary.BriefReport() << std::endl;
 
@@ -5,11 +5,22 @@
 #include <list>
 
 #include "camera_systems/CameraSystem.h"
+#include "sparse_graph/BAProblem.h"
 #include "sparse_graph/SparseGraph.h"
 
 namespace px
 {
 
+/**
+ * \brief Local bundle adjustment over a sliding window of frame sets
+ *
+ * The optimization problem is kept across frame sets. Each time the window
+ * moves, only the residuals of observations which have appeared or changed
+ * are added, and those of observations which are no longer in the window's
+ * scope are removed. Poses of frame sets outside the window stay in the
+ * problem as constant blocks for as long as they observe scene points seen
+ * in the window.
+ */
 class GCamLocalBA
 {
 public:
@@ -21,12 +32,23 @@ public:
 private:
     void optimize(void);
 
+    void removeFrameSet(const FrameSetPtr& frameSet);
+
+    // Bring the residuals of the problem in line with the observations of
+    // the scene points which are seen in the window.
+    void updateProblem(void);
+
     const int k_N;
 
     std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d> > m_H_cam_sys;
-    std::vector<Transform, Eigen::aligned_allocator<Transform> > m_T_sys_cam;
 
     std::list<FrameSetPtr> m_window;
+
+    // frame sets which have left the window, but whose poses are still
+    // in the problem
+    std::list<FrameSetPtr> m_retiredFrameSets;
+
+    BAProblem m_problem;
 };
 
 }
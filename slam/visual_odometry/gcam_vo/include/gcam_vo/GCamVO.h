@@ -5,6 +5,7 @@
 #include <opencv2/features2d/features2d.hpp>
 
 #include "camera_systems/CameraSystem.h"
+#include "sparse_graph/FeatureArena.h"
 #include "sparse_graph/SparseGraph.h"
 
 namespace px
@@ -12,12 +13,14 @@ namespace px
 
 class GCamIMU;
 class GCamLocalBA;
+class HammingMatcher;
 
 class GCamVO
 {
 public:
     GCamVO(const CameraSystemConstPtr& cameraSystem,
-           bool preUndistort, bool useLocalBA);
+           bool preUndistort, bool useLocalBA,
+           bool epipolarGuidedMatching = true);
 
     bool init(const std::string& detectorType,
               const std::string& descriptorExtractorType,
@@ -28,10 +31,25 @@ public:
                        const sensor_msgs::ImuConstPtr& imu,
                        FrameSetPtr& frameSet);
 
+    // processFrames() is split into two stages which can be pipelined:
+    // extractFeatures() does not modify the state of the VO and may run
+    // for frame set N while estimateMotion() runs for frame set N-1.
+    // Frame sets must be passed to estimateMotion() in the order of
+    // their time stamps.
+    bool extractFeatures(const ros::Time& stamp,
+                         const std::vector<cv::Mat>& imageVec,
+                         const sensor_msgs::ImuConstPtr& imu,
+                         FrameSetPtr& frameSet) const;
+    bool estimateMotion(const FrameSetPtr& frameSet);
+
     size_t getCurrentCorrespondenceCount(void) const;
 
     void keyCurrentFrameSet(void);
 
+    // Allocate scene points from the arena of the sparse graph segment
+    // which the frame sets are added to, instead of a private arena.
+    void setScenePointArena(const boost::shared_ptr<FeatureArena<Point3DFeature> >& arena);
+
     bool isRunning(void);
 
 private:
@@ -68,20 +86,41 @@ private:
     void matchCorrespondences(const FrameSetConstPtr& frameSet1,
                               const FrameSetConstPtr& frameSet2,
                               std::vector<std::vector<cv::DMatch> >& matches) const;
-    void matchStereoCorrespondences(const cv::Mat& dtors11,
-                                    const cv::Mat& dtors12,
-                                    const cv::Mat& dtors21,
-                                    const cv::Mat& dtors22,
+    // Keep the matches that are consistent between both cameras of a
+    // stereo pair and unique.
+    void matchStereoCorrespondences(const std::vector<cv::DMatch>& rawMatches1,
+                                    const std::vector<cv::DMatch>& rawMatches2,
+                                    int nQueryFeatures, int nTrainFeatures,
                                     std::vector<cv::DMatch>& matches) const;
 
+    // Match the features of a camera between consecutive frame sets,
+    // comparing only features close to their predicted image locations.
+    // Falls back to matching against all features if fewer than
+    // k_minTemporalMatches matches are found.
+    void matchTemporalDescriptors(const FrameConstPtr& frame1,
+                                  const FrameConstPtr& frame2,
+                                  const cv::Mat& dtors1,
+                                  const cv::Mat& dtors2,
+                                  const Eigen::Matrix4d& systemPose,
+                                  std::vector<cv::DMatch>& matches) const;
+
     void processFrame(CameraMetadata& metadata) const;
 
     void processStereoFrame(CameraMetadata& metadata1,
                             CameraMetadata& metadata2) const;
 
-    bool reconstructScenePoint(Point2DFeaturePtr& f1,
-                               Point2DFeaturePtr& f2,
-                               const Eigen::Matrix4d& H) const;
+    // Match descriptors between stereo images by only comparing features
+    // whose rays lie close to the same epipolar plane.
+    void matchStereoDescriptorsEpipolar(const CameraMetadata& metadata1,
+                                        const CameraMetadata& metadata2,
+                                        std::vector<cv::DMatch>& matches) const;
+
+    // Triangulate the scene point P in the frame of the first camera
+    // from the rays of a stereo match.
+    bool reconstructScenePoint(const Eigen::Vector3d& ray1,
+                               const Eigen::Vector3d& ray2,
+                               const Eigen::Matrix4d& H,
+                               Eigen::Vector3d& P) const;
 
     void reprojErrorStats(const FrameSetConstPtr& frameSet,
                           double& avgError, double& maxError,
@@ -101,11 +140,15 @@ private:
     void visualizeCorrespondences(const FrameSetConstPtr& frameSetPrev,
                                   const FrameSetConstPtr& frameSetCurr) const;
 
+    const double k_epipolarBandWidth;
+    const bool k_epipolarGuidedMatching;
     const double k_epipolarThresh;
     const float k_maxDistanceRatio;
     const double k_maxStereoRange;
+    const int k_minTemporalMatches;
     const bool k_preUndistort;
     const double k_sphericalErrorThresh;
+    const float k_temporalMatchingWindow;
 
     // input
     CameraSystemConstPtr m_cameraSystem;
@@ -126,10 +169,13 @@ private:
     cv::Ptr<cv::FeatureDetector> m_featureDetector;
     cv::Ptr<cv::DescriptorExtractor> m_descriptorExtractor;
     cv::Ptr<cv::DescriptorMatcher> m_descriptorMatcher;
+    boost::shared_ptr<HammingMatcher> m_hammingMatcher;
 
     boost::shared_ptr<GCamIMU> m_gcam;
     boost::shared_ptr<GCamLocalBA> m_lba;
 
+    boost::shared_ptr<FeatureArena<Point3DFeature> > m_scenePointArena;
+
     boost::mutex m_globalMutex;
     size_t m_nCorrespondences;
     bool m_debug;
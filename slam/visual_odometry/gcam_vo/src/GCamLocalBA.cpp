@@ -1,9 +1,8 @@
 #include "gcam_vo/GCamLocalBA.h"
 
+#include <boost/unordered_map.hpp>
 #include <boost/unordered_set.hpp>
 
-#include "camera_models/CostFunctionFactory.h"
-#include "cauldron/EigenQuaternionParameterization.h"
 #include "cauldron/EigenUtils.h"
 #include "ceres/ceres.h"
 
@@ -13,16 +12,11 @@ namespace px
 GCamLocalBA::GCamLocalBA(const CameraSystemConstPtr& cameraSystem,
                          int N)
  : k_N(N)
+ , m_problem(cameraSystem)
 {
     for (int i = 0; i < cameraSystem->cameraCount(); ++i)
     {
-        Eigen::Matrix4d H_cam_sys = cameraSystem->getGlobalCameraPose(i);
-
-        m_H_cam_sys.push_back(H_cam_sys);
-
-        Eigen::Matrix4d H_sys_cam = invertHomogeneousTransform(H_cam_sys);
-
-        m_T_sys_cam.push_back(Transform(H_sys_cam));
+        m_H_cam_sys.push_back(cameraSystem->getGlobalCameraPose(i));
     }
 }
 
@@ -31,12 +25,15 @@ GCamLocalBA::addFrameSet(FrameSetPtr& frameSet, bool replaceCurrentFrameSet)
 {
     if (replaceCurrentFrameSet)
     {
+        removeFrameSet(m_window.back());
         m_window.pop_back();
     }
 
     m_window.push_back(frameSet);
+
     while (m_window.size() > k_N)
     {
+        removeFrameSet(m_window.front());
         m_window.pop_front();
     }
 
@@ -51,110 +48,40 @@ GCamLocalBA::addFrameSet(FrameSetPtr& frameSet, bool replaceCurrentFrameSet)
 void
 GCamLocalBA::optimize(void)
 {
-    ceres::Problem problem;
-
-    boost::unordered_set<FrameSet*> frameSetsActive;
-    boost::unordered_set<FrameSet*> frameSetsInactive;
-    boost::unordered_set<Point3DFeature*> scenePoints;
+    updateProblem();
 
+    // Poses of frame sets which have left the window are held constant.
+    // Until the window is full, the pose of the first frame set is also
+    // held constant.
+    boost::unordered_set<FrameSet*> window;
     for (std::list<FrameSetPtr>::iterator it = m_window.begin(); it != m_window.end(); ++it)
     {
-        FrameSet* frameSet = it->get();
-
-        frameSetsActive.insert(frameSet);
-
-        for (size_t i = 0; i < frameSet->frames().size(); i += 2)
-        {
-            std::vector<Point2DFeaturePtr>& features = frameSet->frames().at(i)->features2D();
-
-            for (size_t i = 0; i < features.size(); ++i)
-            {
-                Point2DFeaturePtr& feature = features.at(i);
-
-                if (feature->prevMatches().empty() && feature->nextMatches().empty())
-                {
-                    continue;
-                }
-
-                scenePoints.insert(feature->feature3D().get());
-            }
-        }
+        window.insert(it->get());
     }
 
-    for (boost::unordered_set<Point3DFeature*>::iterator it = scenePoints.begin(); it != scenePoints.end(); ++it)
-    {
-        Point3DFeature* scenePoint = *it;
+    std::vector<FrameSet*> poses;
+    m_problem.getPoses(poses);
 
-        for (size_t i = 0; i < scenePoint->features2D().size(); ++i)
-        {
-            Point2DFeature* feature1 = scenePoint->features2D().at(i);
-            Frame* frame1 = feature1->frame();
-            int cameraId1 = frame1->cameraId();
-
-            if (cameraId1 % 2 == 1)
-            {
-                continue;
-            }
-
-            FrameSet* frameSet = frame1->frameSet();
-            Point2DFeature* feature2 = feature1->match();
-            Frame* frame2 = feature2->frame();
-            int cameraId2 = frame2->cameraId();
-
-            ceres::LossFunction* lossFunction = new ceres::HuberLoss(0.0000055555);
-
-            ceres::CostFunction* costFunction =
-                CostFunctionFactory::instance()->generateCostFunction(feature1->ray(),
-                                                                      feature2->ray(),
-                                                                      m_T_sys_cam.at(cameraId1).rotation(),
-                                                                      m_T_sys_cam.at(cameraId1).translation(),
-                                                                      m_T_sys_cam.at(cameraId2).rotation(),
-                                                                      m_T_sys_cam.at(cameraId2).translation());
-
-            problem.AddResidualBlock(costFunction, lossFunction,
-                                     frameSet->systemPose()->rotationData(),
-                                     frameSet->systemPose()->translationData(),
-                                     scenePoint->pointData());
-
-            if (frameSetsActive.find(frameSet) == frameSetsActive.end())
-            {
-                frameSetsInactive.insert(frameSet);
-            }
-        }
-    }
-
-    for (boost::unordered_set<FrameSet*>::iterator it = frameSetsActive.begin();
-             it != frameSetsActive.end(); ++it)
-    {
-        ceres::LocalParameterization* quaternionParameterization =
-            new EigenQuaternionParameterization;
-
-        problem.SetParameterization((*it)->systemPose()->rotationData(),
-                                    quaternionParameterization);
-    }
-
-    for (boost::unordered_set<FrameSet*>::iterator it = frameSetsInactive.begin();
-             it != frameSetsInactive.end(); ++it)
+    for (size_t i = 0; i < poses.size(); ++i)
     {
-        problem.SetParameterBlockConstant((*it)->systemPose()->rotationData());
-        problem.SetParameterBlockConstant((*it)->systemPose()->translationData());
-    }
+        FrameSet* frameSet = poses.at(i);
 
-    if (m_window.size() < k_N)
-    {
-        problem.SetParameterBlockConstant(m_window.front()->systemPose()->rotationData());
-        problem.SetParameterBlockConstant(m_window.front()->systemPose()->translationData());
+        m_problem.setPoseConstant(frameSet,
+                                  window.find(frameSet) == window.end() ||
+                                  (m_window.size() < k_N && frameSet == m_window.front().get()));
     }
 
+    // The parameter blocks are the poses and scene points themselves,
+    // so that each solve starts from the solution of the previous one.
     ceres::Solver::Options options;
-    options.linear_solver_type = ceres::SPARSE_NORMAL_CHOLESKY;
+    m_problem.setLinearSolver(ceres::SPARSE_SCHUR, options);
     options.max_num_iterations = 20;
     options.num_threads = 4;
     options.num_linear_solver_threads = 4;
     options.max_num_consecutive_invalid_steps = 2;
-    
+
     ceres::Solver::Summary summary;
-    ceres::Solve(options, &problem, &summary);
+    ceres::Solve(options, &m_problem.problem(), &summary);
 
     // Update 3D coordinates of scene points that are only observed in a single frame set
     // since these points are not optimized in local bundle adjustment.
@@ -184,4 +111,81 @@ GCamLocalBA::optimize(void)
     }
 }
 
+void
+GCamLocalBA::removeFrameSet(const FrameSetPtr& frameSet)
+{
+    // keep the pose as long as it has residuals
+    if (m_problem.hasPose(frameSet.get()))
+    {
+        m_retiredFrameSets.push_back(frameSet);
+    }
+}
+
+void
+GCamLocalBA::updateProblem(void)
+{
+    m_problem.beginUpdate();
+
+    // find all scene points seen in the window which are tracked
+    boost::unordered_map<Point3DFeature*, Point3DFeaturePtr> scenePoints;
+
+    for (std::list<FrameSetPtr>::iterator it = m_window.begin(); it != m_window.end(); ++it)
+    {
+        FrameSet* frameSet = it->get();
+
+        for (size_t i = 0; i < frameSet->frames().size(); i += 2)
+        {
+            std::vector<Point2DFeaturePtr>& features = frameSet->frames().at(i)->features2D();
+
+            for (size_t i = 0; i < features.size(); ++i)
+            {
+                Point2DFeaturePtr& feature = features.at(i);
+
+                if (feature->prevMatches().empty() && feature->nextMatches().empty())
+                {
+                    continue;
+                }
+
+                scenePoints.insert(std::make_pair(feature->feature3D().get(), feature->feature3D()));
+            }
+        }
+    }
+
+    // keep the residuals of observations which have not changed, and
+    // generate cost functions only for new observations
+    for (boost::unordered_map<Point3DFeature*, Point3DFeaturePtr>::iterator it = scenePoints.begin();
+             it != scenePoints.end(); ++it)
+    {
+        Point3DFeature* scenePoint = it->first;
+
+        for (size_t i = 0; i < scenePoint->features2D().size(); ++i)
+        {
+            Point2DFeature* feature1 = scenePoint->features2D().at(i);
+
+            if (feature1->frame()->cameraId() % 2 == 1)
+            {
+                continue;
+            }
+
+            m_problem.addStereoObservation(feature1, it->second);
+        }
+    }
+
+    // remove the residuals of observations which are no longer seen
+    m_problem.removeStaleObservations();
+
+    std::list<FrameSetPtr>::iterator it = m_retiredFrameSets.begin();
+    while (it != m_retiredFrameSets.end())
+    {
+        if (m_problem.hasPose(it->get()))
+        {
+            ++it;
+        }
+        else
+        {
+            it = m_retiredFrameSets.erase(it);
+        }
+    }
+}
+
 }
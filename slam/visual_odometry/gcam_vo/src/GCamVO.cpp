@@ -1,5 +1,8 @@
 #include "gcam_vo/GCamVO.h"
 
+#include <algorithm>
+#include <cassert>
+#include <limits>
 #include <opencv2/core/eigen.hpp>
 #include <opencv2/calib3d/calib3d.hpp>
 #include <opencv2/highgui/highgui.hpp>
@@ -7,20 +10,29 @@
 #include <ros/ros.h>
 
 #include "cauldron/EigenUtils.h"
+#include "cauldron/FeatureGrid.h"
+#include "cauldron/HammingMatcher.h"
+#include "cauldron/ThreadPool.h"
 #include "gcam/GCamIMU.h"
 #include "gcam_vo/GCamLocalBA.h"
 #include "pose_estimation/gP3P.h"
+#include "sparse_graph/MotionPrediction.h"
 
 namespace px
 {
 
 GCamVO::GCamVO(const CameraSystemConstPtr& cameraSystem,
-               bool preUndistort, bool useLocalBA)
- : k_epipolarThresh(0.00005)
+               bool preUndistort, bool useLocalBA,
+               bool epipolarGuidedMatching)
+ : k_epipolarBandWidth(0.02)
+ , k_epipolarGuidedMatching(epipolarGuidedMatching)
+ , k_epipolarThresh(0.00005)
  , k_maxDistanceRatio(0.7f)
  , k_maxStereoRange(20.0)
+ , k_minTemporalMatches(30)
  , k_preUndistort(preUndistort)
  , k_sphericalErrorThresh(0.999976)
+ , k_temporalMatchingWindow(48.0f)
  , m_cameraSystem(cameraSystem)
  , m_nCorrespondences(0)
  , m_debug(false)
@@ -60,6 +72,7 @@ GCamVO::GCamVO(const CameraSystemConstPtr& cameraSystem,
     }
 
     m_gcam = boost::make_shared<GCamIMU>(cameraSystem);
+    m_scenePointArena = boost::make_shared<FeatureArena<Point3DFeature> >();
 
     if (useLocalBA)
     {
@@ -99,6 +112,13 @@ GCamVO::init(const std::string& detectorType,
         return false;
     }
 
+    // binary descriptors are matched with SIMD popcounts instead of
+    // the generic OpenCV matcher
+    if (descriptorMatcherType == "BruteForce-Hamming")
+    {
+        m_hammingMatcher = boost::make_shared<HammingMatcher>();
+    }
+
     return true;
 }
 
@@ -108,10 +128,20 @@ GCamVO::processFrames(const ros::Time& stamp,
                       const sensor_msgs::ImuConstPtr& imu,
                       FrameSetPtr& frameSet)
 {
-    boost::lock_guard<boost::mutex> lock(m_globalMutex);
+    if (!extractFeatures(stamp, imageVec, imu, frameSet))
+    {
+        return false;
+    }
 
-    ros::Time tsStart = ros::Time::now();
+    return estimateMotion(frameSet);
+}
 
+bool
+GCamVO::extractFeatures(const ros::Time& stamp,
+                        const std::vector<cv::Mat>& imageVec,
+                        const sensor_msgs::ImuConstPtr& imu,
+                        FrameSetPtr& frameSet) const
+{
     int nCameras = m_cameraSystem->cameraCount();
     int nStereoCameras = nCameras / 2;
 
@@ -121,24 +151,30 @@ GCamVO::processFrames(const ros::Time& stamp,
         return false;
     }
 
-    for (int i = 0; i < m_cameraSystem->cameraCount(); ++i)
+    // Each call works on its own copy of the per-frame metadata so that
+    // feature extraction for consecutive frame sets can overlap.
+    std::vector<CameraMetadata> metadataVec(nCameras);
+    for (int i = 0; i < nCameras; ++i)
     {
-        imageVec.at(i).copyTo(m_metadataVec.at(i).rawImage);
+        CameraMetadata& metadata = metadataVec.at(i);
+
+        metadata.camera = m_metadataVec.at(i).camera;
+        metadata.undistortMapX = m_metadataVec.at(i).undistortMapX;
+        metadata.undistortMapY = m_metadataVec.at(i).undistortMapY;
+
+        imageVec.at(i).copyTo(metadata.rawImage);
     }
 
     ros::Time tsStartProcMono = ros::Time::now();
 
-    std::vector<boost::shared_ptr<boost::thread> > threadVec(nCameras);
-    for (int i = 0; i < nCameras; ++i)
-    {
-        threadVec.at(i) = boost::make_shared<boost::thread>(boost::bind(&GCamVO::processFrame,
-                                                                        this,
-                                                                        boost::ref(m_metadataVec.at(i))));
-    }
+    TaskGroup tasks;
     for (int i = 0; i < nCameras; ++i)
     {
-        threadVec.at(i)->join();
+        tasks.run(boost::bind(&GCamVO::processFrame,
+                              this,
+                              boost::ref(metadataVec.at(i))));
     }
+    tasks.wait();
 
     if (m_debug)
     {
@@ -146,14 +182,11 @@ GCamVO::processFrames(const ros::Time& stamp,
     }
 
     frameSet = boost::make_shared<FrameSet>();
-    if (m_frameSetPrev)
-    {
-        frameSet->seq() = m_frameSetPrev->seq() + 1;
-    }
-    else
-    {
-        frameSet->seq() = 0;
-    }
+
+    // The sequence number and the system pose are assigned in
+    // estimateMotion. Until then, the pose only carries the time stamp.
+    frameSet->systemPose() = boost::make_shared<Pose>();
+    frameSet->systemPose()->timeStamp() = stamp;
 
     frameSet->imuMeasurement() = imu;
     for (int i = 0; i < nCameras; ++i)
@@ -163,25 +196,21 @@ GCamVO::processFrames(const ros::Time& stamp,
         frame->frameSet() = frameSet.get();
         frameSet->frames().push_back(frame);
 
-        m_metadataVec.at(i).frame = frame;
+        metadataVec.at(i).frame = frame;
     }
 
     // --- Find feature correspondences between the stereo images. ---
 
     ros::Time tsStartProcStereo = ros::Time::now();
 
-    std::vector<std::vector<cv::DMatch> > stereoMatches(nStereoCameras);
-    for (int i = 0; i < nStereoCameras; ++i)
-    {
-        threadVec.at(i) = boost::make_shared<boost::thread>(boost::bind(&GCamVO::processStereoFrame,
-                                                                        this,
-                                                                        boost::ref(m_metadataVec.at(i * 2)),
-                                                                        boost::ref(m_metadataVec.at(i * 2 + 1))));
-    }
     for (int i = 0; i < nStereoCameras; ++i)
     {
-        threadVec.at(i)->join();
+        tasks.run(boost::bind(&GCamVO::processStereoFrame,
+                              this,
+                              boost::ref(metadataVec.at(i * 2)),
+                              boost::ref(metadataVec.at(i * 2 + 1))));
     }
+    tasks.wait();
 
     if (m_debug)
     {
@@ -193,10 +222,34 @@ GCamVO::processFrames(const ros::Time& stamp,
     {
         for (int i = 0; i < nCameras; ++i)
         {
-            m_metadataVec.at(i).procImage.copyTo(frameSet->frame(i)->image());
+            metadataVec.at(i).procImage.copyTo(frameSet->frame(i)->image());
         }
     }
 
+    return true;
+}
+
+bool
+GCamVO::estimateMotion(const FrameSetPtr& frameSet)
+{
+    boost::lock_guard<boost::mutex> lock(m_globalMutex);
+
+    ros::Time tsStart = ros::Time::now();
+
+    int nStereoCameras = m_cameraSystem->cameraCount() / 2;
+
+    ros::Time stamp = frameSet->systemPose()->timeStamp();
+    const sensor_msgs::ImuConstPtr& imu = frameSet->imuMeasurement();
+
+    if (m_frameSetPrev)
+    {
+        frameSet->seq() = m_frameSetPrev->seq() + 1;
+    }
+    else
+    {
+        frameSet->seq() = 0;
+    }
+
     bool replaceCurrentFrameSet = false;
     if (m_frameSetCurr)
     {
@@ -530,6 +583,9 @@ GCamVO::processFrames(const ros::Time& stamp,
                 ++it2;
             }
         }
+
+        frame1->compactFeatures2D();
+        frame2->compactFeatures2D();
     }
 
     if (m_debug)
@@ -592,6 +648,12 @@ GCamVO::keyCurrentFrameSet(void)
     }
 }
 
+void
+GCamVO::setScenePointArena(const boost::shared_ptr<FeatureArena<Point3DFeature> >& arena)
+{
+    m_scenePointArena = arena;
+}
+
 bool
 GCamVO::isRunning(void)
 {
@@ -608,24 +670,7 @@ GCamVO::isRunning(void)
 void
 GCamVO::getDescriptorMat(const FrameConstPtr& frame, cv::Mat& dmat) const
 {
-    const std::vector<Point2DFeaturePtr>& features2D = frame->features2D();
-
-    if (features2D.empty())
-    {
-        dmat = cv::Mat();
-
-        return;
-    }
-
-    dmat = cv::Mat(features2D.size(), features2D.front()->descriptor().cols,
-                   features2D.front()->descriptor().type());
-
-    for (size_t i = 0; i < features2D.size(); ++i)
-    {
-        const Point2DFeatureConstPtr& feature2D = features2D.at(i);
-
-        feature2D->descriptor().copyTo(dmat.row(i));
-    }
+    dmat = frame->descriptorMat();
 }
 
 void
@@ -656,8 +701,16 @@ GCamVO::matchDescriptors(const cv::Mat& queryDescriptors,
     case RATIO_MATCH:
     {
         std::vector<std::vector<cv::DMatch> > rawMatches;
-        m_descriptorMatcher->knnMatch(queryDescriptors, trainDescriptors,
-                                      rawMatches, 2, mask, true);
+        if (m_hammingMatcher)
+        {
+            m_hammingMatcher->knnMatch(queryDescriptors, trainDescriptors,
+                                       rawMatches, 2, mask, true);
+        }
+        else
+        {
+            m_descriptorMatcher->knnMatch(queryDescriptors, trainDescriptors,
+                                          rawMatches, 2, mask, true);
+        }
 
         matches.reserve(rawMatches.size());
         for (size_t i = 0; i < rawMatches.size(); ++i)
@@ -683,8 +736,16 @@ GCamVO::matchDescriptors(const cv::Mat& queryDescriptors,
     case BEST_MATCH:
     default:
     {
-        m_descriptorMatcher->match(queryDescriptors, trainDescriptors,
-                                   matches, mask);
+        if (m_hammingMatcher)
+        {
+            m_hammingMatcher->match(queryDescriptors, trainDescriptors,
+                                    matches, mask);
+        }
+        else
+        {
+            m_descriptorMatcher->match(queryDescriptors, trainDescriptors,
+                                       matches, mask);
+        }
     }
     }
 }
@@ -700,54 +761,93 @@ GCamVO::matchCorrespondences(const FrameSetConstPtr& frameSet1,
     std::vector<cv::Mat> dtors2;
     getDescriptorMatVec(frameSet2, dtors2);
 
-    int nStereoCameras = m_cameraSystem->cameraCount() / 2;
-    std::vector<boost::shared_ptr<boost::thread> > threads(nStereoCameras);
+    int nCameras = m_cameraSystem->cameraCount();
+    int nStereoCameras = nCameras / 2;
 
-    matches.resize(nStereoCameras);
+    Eigen::Matrix4d systemPose = predictSystemPose(frameSet1,
+                                                   frameSet2->systemPose()->timeStamp(),
+                                                   frameSet2->imuMeasurement());
+
+    std::vector<std::vector<cv::DMatch> > rawMatches(nCameras);
+
+    TaskGroup tasks;
+    for (int i = 0; i < nCameras; ++i)
+    {
+        tasks.run(boost::bind(&GCamVO::matchTemporalDescriptors,
+                              this,
+                              frameSet1->frame(i),
+                              frameSet2->frame(i),
+                              boost::cref(dtors1.at(i)),
+                              boost::cref(dtors2.at(i)),
+                              boost::cref(systemPose),
+                              boost::ref(rawMatches.at(i))));
+    }
+    tasks.wait();
 
+    matches.resize(nStereoCameras);
     for (int i = 0; i < nStereoCameras; ++i)
     {
         int cameraId1 = i * 2;
         int cameraId2 = i * 2 + 1;
 
-        threads.at(i) = boost::make_shared<boost::thread>(boost::bind(&GCamVO::matchStereoCorrespondences,
-                                                                      this,
-                                                                      boost::cref(dtors1.at(cameraId1)),
-                                                                      boost::cref(dtors1.at(cameraId2)),
-                                                                      boost::cref(dtors2.at(cameraId1)),
-                                                                      boost::cref(dtors2.at(cameraId2)),
-                                                                      boost::ref(matches.at(i))));
-    }
-    for (int i = 0; i < nStereoCameras; ++i)
-    {
-        threads.at(i)->join();
+        matchStereoCorrespondences(rawMatches.at(cameraId1),
+                                   rawMatches.at(cameraId2),
+                                   dtors1.at(cameraId1).rows,
+                                   dtors2.at(cameraId1).rows,
+                                   matches.at(i));
     }
 }
 
 void
-GCamVO::matchStereoCorrespondences(const cv::Mat& dtors11,
-                                   const cv::Mat& dtors12,
-                                   const cv::Mat& dtors21,
-                                   const cv::Mat& dtors22,
-                                   std::vector<cv::DMatch>& matches) const
+GCamVO::matchTemporalDescriptors(const FrameConstPtr& frame1,
+                                 const FrameConstPtr& frame2,
+                                 const cv::Mat& dtors1,
+                                 const cv::Mat& dtors2,
+                                 const Eigen::Matrix4d& systemPose,
+                                 std::vector<cv::DMatch>& matches) const
 {
-    matches.clear();
+    if (k_temporalMatchingWindow <= 0.0f)
+    {
+        matchDescriptors(dtors1, dtors2, matches, cv::Mat(), BEST_MATCH);
+        return;
+    }
 
-    std::vector<cv::DMatch> rawMatches1, rawMatches2;
-    boost::shared_ptr<boost::thread> threads[2];
+    std::vector<cv::Point2f> predictedKeypoints;
+    predictKeypoints(frame1, m_metadataVec.at(frame1->cameraId()).camera,
+                     m_cameraSystem->getGlobalCameraPose(frame1->cameraId()),
+                     systemPose, predictedKeypoints);
 
-    threads[0] = boost::make_shared<boost::thread>(boost::bind(&GCamVO::matchDescriptors, this,
-                                                               boost::cref(dtors11), boost::cref(dtors21), boost::ref(rawMatches1),
-                                                               cv::Mat(), BEST_MATCH, k_maxDistanceRatio));
+    const std::vector<Point2DFeaturePtr>& features2 = frame2->features2D();
+
+    std::vector<cv::Point2f> keypoints2(features2.size());
+    for (size_t i = 0; i < features2.size(); ++i)
+    {
+        keypoints2.at(i) = features2.at(i)->keypoint().pt;
+    }
 
-    threads[1] = boost::make_shared<boost::thread>(boost::bind(&GCamVO::matchDescriptors, this,
-                                                               boost::cref(dtors12), boost::cref(dtors22), boost::ref(rawMatches2),
-                                                               cv::Mat(), BEST_MATCH, k_maxDistanceRatio));
+    FeatureGrid grid(k_temporalMatchingWindow);
+    grid.build(keypoints2);
 
-    threads[0]->join();
-    threads[1]->join();
+    grid.matchDescriptors(dtors1, predictedKeypoints, dtors2,
+                          k_temporalMatchingWindow, 0.0f, matches);
 
-    std::vector<int> matchLUT(dtors11.rows, -1);
+    // The prediction is likely wrong, e.g. after a sudden change in motion,
+    // so fall back to matching against all features.
+    if (static_cast<int>(matches.size()) < k_minTemporalMatches)
+    {
+        matchDescriptors(dtors1, dtors2, matches, cv::Mat(), BEST_MATCH);
+    }
+}
+
+void
+GCamVO::matchStereoCorrespondences(const std::vector<cv::DMatch>& rawMatches1,
+                                   const std::vector<cv::DMatch>& rawMatches2,
+                                   int nQueryFeatures, int nTrainFeatures,
+                                   std::vector<cv::DMatch>& matches) const
+{
+    matches.clear();
+
+    std::vector<int> matchLUT(nQueryFeatures, -1);
     for (size_t i = 0; i < rawMatches1.size(); ++i)
     {
         const cv::DMatch& rawMatch = rawMatches1.at(i);
@@ -768,7 +868,7 @@ GCamVO::matchStereoCorrespondences(const cv::Mat& dtors11,
     }
 
     // Remove matches which have the same training descriptor index.
-    std::vector<std::vector<cv::DMatch> > revMatches(dtors21.rows);
+    std::vector<std::vector<cv::DMatch> > revMatches(nTrainFeatures);
     for (size_t i = 0; i < candidateMatches.size(); ++i)
     {
         const cv::DMatch& match = candidateMatches.at(i);
@@ -807,18 +907,32 @@ GCamVO::processFrame(CameraMetadata& metadata) const
     // Detect features.
     m_featureDetector->detect(metadata.procImage, metadata.kpts);
 
+    // The extractor drops keypoints for which no descriptor can be
+    // computed, so the rays are lifted from the remaining keypoints.
+    m_descriptorExtractor->compute(metadata.procImage, metadata.kpts,
+                                   metadata.dtors);
+
     // Backproject feature coordinates to rays with spherical coordinates.
-    metadata.spts.resize(metadata.kpts.size());
-    for (size_t i = 0; i < metadata.kpts.size(); ++i)
+    size_t nKpts = metadata.kpts.size();
+
+    std::vector<double> u(nKpts), v(nKpts);
+    for (size_t i = 0; i < nKpts; ++i)
     {
         const cv::KeyPoint& kpt = metadata.kpts.at(i);
 
-        metadata.camera->liftSphere(Eigen::Vector2d(kpt.pt.x, kpt.pt.y),
-                                    metadata.spts.at(i));
+        u.at(i) = kpt.pt.x;
+        v.at(i) = kpt.pt.y;
     }
 
-    m_descriptorExtractor->compute(metadata.procImage, metadata.kpts,
-                                   metadata.dtors);
+    std::vector<double> X(nKpts), Y(nKpts), Z(nKpts);
+    metadata.camera->liftSphere(nKpts, u.data(), v.data(),
+                                X.data(), Y.data(), Z.data());
+
+    metadata.spts.resize(nKpts);
+    for (size_t i = 0; i < nKpts; ++i)
+    {
+        metadata.spts.at(i) << X.at(i), Y.at(i), Z.at(i);
+    }
 }
 
 void
@@ -827,8 +941,15 @@ GCamVO::processStereoFrame(CameraMetadata& metadata1,
 {
     // Match descriptors between stereo images.
     std::vector<cv::DMatch> rawMatches;
-    matchDescriptors(metadata1.dtors, metadata2.dtors, rawMatches,
-                     cv::Mat(), BEST_MATCH);
+    if (k_epipolarGuidedMatching)
+    {
+        matchStereoDescriptorsEpipolar(metadata1, metadata2, rawMatches);
+    }
+    else
+    {
+        matchDescriptors(metadata1.dtors, metadata2.dtors, rawMatches,
+                         cv::Mat(), BEST_MATCH);
+    }
 
     // Use the epipolar constraint to filter out outlier matches.
     Eigen::Matrix3d E = m_E.at(metadata1.frame->cameraId() / 2);
@@ -855,34 +976,70 @@ GCamVO::processStereoFrame(CameraMetadata& metadata1,
     Eigen::Matrix4d H_stereo = m_H_stereo.at(metadata1.frame->cameraId() / 2);
     Eigen::Matrix4d H_cam1_sys = m_cameraSystem->getGlobalCameraPose(metadata1.frame->cameraId());
 
-    metadata1.frame->features2D().reserve(matches.size());
-    metadata2.frame->features2D().reserve(matches.size());
+    std::vector<cv::DMatch> inliers;
+    std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > scenePoints;
+    inliers.reserve(matches.size());
+    scenePoints.reserve(matches.size());
     for (size_t i = 0; i < matches.size(); ++i)
     {
         const cv::DMatch& match = matches.at(i);
 
-        Point2DFeaturePtr feature1 = boost::make_shared<Point2DFeature>();
-        feature1->frame() = metadata1.frame.get();
+        Eigen::Vector3d P;
+        if (!reconstructScenePoint(metadata1.spts.at(match.queryIdx),
+                                   metadata2.spts.at(match.trainIdx),
+                                   H_stereo, P))
+        {
+            continue;
+        }
+
+        inliers.push_back(match);
+        scenePoints.push_back(P);
+    }
+
+    if (inliers.empty())
+    {
+        return;
+    }
+
+    // Gather the descriptors of the inliers so that the features of each
+    // frame share a single descriptor matrix.
+    cv::Mat dtors1(inliers.size(), metadata1.dtors.cols, metadata1.dtors.type());
+    cv::Mat dtors2(inliers.size(), metadata2.dtors.cols, metadata2.dtors.type());
+    for (size_t i = 0; i < inliers.size(); ++i)
+    {
+        metadata1.dtors.row(inliers.at(i).queryIdx).copyTo(dtors1.row(i));
+        metadata2.dtors.row(inliers.at(i).trainIdx).copyTo(dtors2.row(i));
+    }
+
+    size_t offset1 = metadata1.frame->features2D().size();
+    size_t offset2 = metadata2.frame->features2D().size();
+
+    metadata1.frame->appendFeatures2D(dtors1);
+    metadata2.frame->appendFeatures2D(dtors2);
+
+    std::vector<Point3DFeaturePtr> features3D;
+    m_scenePointArena->allocate(inliers.size(), features3D);
+
+    for (size_t i = 0; i < inliers.size(); ++i)
+    {
+        const cv::DMatch& match = inliers.at(i);
+
+        Point2DFeaturePtr& feature1 = metadata1.frame->features2D().at(offset1 + i);
         feature1->keypoint() = metadata1.kpts.at(match.queryIdx);
-        metadata1.dtors.row(match.queryIdx).copyTo(feature1->descriptor());
         feature1->ray() = metadata1.spts.at(match.queryIdx);
 
-        Point2DFeaturePtr feature2 = boost::make_shared<Point2DFeature>();
-        feature2->frame() = metadata2.frame.get();
+        Point2DFeaturePtr& feature2 = metadata2.frame->features2D().at(offset2 + i);
         feature2->keypoint() = metadata2.kpts.at(match.trainIdx);
-        metadata2.dtors.row(match.trainIdx).copyTo(feature2->descriptor());
         feature2->ray() = metadata2.spts.at(match.trainIdx);
 
-        if (!reconstructScenePoint(feature1, feature2, H_stereo))
-        {
-            continue;
-        }
-
-        Eigen::Vector3d& P = feature1->feature3D()->point();
-        P = transformPoint(H_cam1_sys, P);
+        Point3DFeaturePtr& p3D = features3D.at(i);
+        p3D->point() = transformPoint(H_cam1_sys, scenePoints.at(i));
+        p3D->pointFromStereo() = scenePoints.at(i);
+        p3D->features2D().push_back(feature1.get());
+        p3D->features2D().push_back(feature2.get());
 
-        metadata1.frame->features2D().push_back(feature1);
-        metadata2.frame->features2D().push_back(feature2);
+        feature1->feature3D() = p3D;
+        feature2->feature3D() = p3D;
 
         feature1->bestMatchId() = 0;
         feature1->matches().push_back(feature2.get());
@@ -892,14 +1049,131 @@ GCamVO::processStereoFrame(CameraMetadata& metadata1,
     }
 }
 
+void
+GCamVO::matchStereoDescriptorsEpipolar(const CameraMetadata& metadata1,
+                                       const CameraMetadata& metadata2,
+                                       std::vector<cv::DMatch>& matches) const
+{
+    matches.clear();
+
+    if (metadata1.dtors.empty() || metadata2.dtors.empty())
+    {
+        return;
+    }
+
+    // All epipolar planes contain the baseline. Expressed in the frame of
+    // the second camera, a scene point seen by both cameras lies in the
+    // half-plane whose angle phi around the baseline is the same for
+    // the ray from either camera.
+    const Eigen::Matrix4d& H_stereo = m_H_stereo.at(metadata1.frame->cameraId() / 2);
+    Eigen::Matrix3d R = H_stereo.block<3,3>(0,0);
+    Eigen::Vector3d baseline = H_stereo.block<3,1>(0,3).normalized();
+
+    Eigen::Vector3d e1 = baseline.unitOrthogonal();
+    Eigen::Vector3d e2 = baseline.cross(e1);
+
+    // the rays are indexed like the descriptors
+    assert(metadata1.spts.size() == static_cast<size_t>(metadata1.dtors.rows));
+    assert(metadata2.spts.size() == static_cast<size_t>(metadata2.dtors.rows));
+
+    // Sort the rays of the second camera by the angle of their epipolar plane.
+    std::vector<std::pair<double,int> > angles2(metadata2.dtors.rows);
+    for (int i = 0; i < metadata2.dtors.rows; ++i)
+    {
+        const Eigen::Vector3d& spt2 = metadata2.spts.at(i);
+
+        angles2.at(i) = std::make_pair(atan2(spt2.dot(e2), spt2.dot(e1)), i);
+    }
+    std::sort(angles2.begin(), angles2.end());
+
+    bool binary = (metadata1.dtors.depth() == CV_8U);
+
+    matches.reserve(metadata1.dtors.rows);
+    for (int i = 0; i < metadata1.dtors.rows; ++i)
+    {
+        Eigen::Vector3d spt1 = R * metadata1.spts.at(i);
+
+        double u = spt1.dot(e1);
+        double v = spt1.dot(e2);
+        double phi = atan2(v, u);
+
+        // A ray at a distance k_epipolarBandWidth from the epipolar plane
+        // deviates in angle by asin(k_epipolarBandWidth / r) where r is the
+        // distance of the ray direction from the baseline. Close to the
+        // epipoles, the band covers all angles.
+        double r = sqrt(u * u + v * v);
+
+        std::vector<std::pair<double,double> > intervals;
+        if (r <= k_epipolarBandWidth)
+        {
+            intervals.push_back(std::make_pair(-M_PI, M_PI));
+        }
+        else
+        {
+            double dphi = asin(k_epipolarBandWidth / r);
+
+            intervals.push_back(std::make_pair(std::max(phi - dphi, -M_PI),
+                                               std::min(phi + dphi, M_PI)));
+            if (phi - dphi < -M_PI)
+            {
+                intervals.push_back(std::make_pair(phi - dphi + 2.0 * M_PI, M_PI));
+            }
+            if (phi + dphi > M_PI)
+            {
+                intervals.push_back(std::make_pair(-M_PI, phi + dphi - 2.0 * M_PI));
+            }
+        }
+
+        cv::DMatch bestMatch(i, -1, std::numeric_limits<float>::max());
+        for (size_t j = 0; j < intervals.size(); ++j)
+        {
+            std::vector<std::pair<double,int> >::const_iterator itBegin =
+                std::lower_bound(angles2.begin(), angles2.end(),
+                                 std::make_pair(intervals.at(j).first, -1));
+            std::vector<std::pair<double,int> >::const_iterator itEnd =
+                std::lower_bound(angles2.begin(), angles2.end(),
+                                 std::make_pair(intervals.at(j).second, std::numeric_limits<int>::max()));
+
+            for (std::vector<std::pair<double,int> >::const_iterator it = itBegin; it != itEnd; ++it)
+            {
+                float distance;
+                if (binary)
+                {
+                    distance = HammingMatcher::distance(metadata1.dtors.ptr<unsigned char>(i),
+                                                        metadata2.dtors.ptr<unsigned char>(it->second),
+                                                        metadata1.dtors.cols);
+                }
+                else
+                {
+                    distance = cv::norm(metadata1.dtors.row(i),
+                                        metadata2.dtors.row(it->second),
+                                        cv::NORM_L2);
+                }
+
+                if (distance < bestMatch.distance)
+                {
+                    bestMatch.trainIdx = it->second;
+                    bestMatch.distance = distance;
+                }
+            }
+        }
+
+        if (bestMatch.trainIdx != -1)
+        {
+            matches.push_back(bestMatch);
+        }
+    }
+}
+
 bool
-GCamVO::reconstructScenePoint(Point2DFeaturePtr& f1,
-                              Point2DFeaturePtr& f2,
-                              const Eigen::Matrix4d& H) const
+GCamVO::reconstructScenePoint(const Eigen::Vector3d& ray1,
+                              const Eigen::Vector3d& ray2,
+                              const Eigen::Matrix4d& H,
+                              Eigen::Vector3d& P) const
 {
     Eigen::MatrixXd A(3,2);
-    A.col(0) = H.block<3,3>(0,0) * f1->ray();
-    A.col(1) = - f2->ray();
+    A.col(0) = H.block<3,3>(0,0) * ray1;
+    A.col(1) = - ray2;
 
     Eigen::Vector3d b = - H.block<3,1>(0,3);
 
@@ -917,7 +1191,7 @@ GCamVO::reconstructScenePoint(Point2DFeaturePtr& f1,
         return false;
     }
 
-    Eigen::Vector3d P1 = gamma(0) * f1->ray();
+    Eigen::Vector3d P1 = gamma(0) * ray1;
     Eigen::Vector3d P2 = transformPoint(H, P1);
 
     if (P2(2) < 0.0)
@@ -927,20 +1201,13 @@ GCamVO::reconstructScenePoint(Point2DFeaturePtr& f1,
 
     Eigen::Vector3d ray2_est = P2.normalized();
 
-    double err = fabs(ray2_est.dot(f2->ray()));
+    double err = fabs(ray2_est.dot(ray2));
     if (err < k_sphericalErrorThresh)
     {
         return false;
     }
 
-    Point3DFeaturePtr p3D = boost::make_shared<Point3DFeature>();
-    p3D->point() = P1;
-    p3D->pointFromStereo() = P1;
-    p3D->features2D().push_back(f1.get());
-    p3D->features2D().push_back(f2.get());
-
-    f1->feature3D() = p3D;
-    f2->feature3D() = p3D;
+    P = P1;
 
     return true;
 }
@@ -1250,19 +1517,19 @@ GCamVO::visualizeCorrespondences(const FrameSetConstPtr& frameSetPrev,
         int cameraId1 = i * 2;
         int cameraId2 = i * 2 + 1;
 
-        const CameraMetadata& metadata1 = m_metadataVec.at(cameraId1);
-        const CameraMetadata& metadata2 = m_metadataVec.at(cameraId2);
+        const cv::Mat& procImage1 = frameSetCurr->frame(cameraId1)->image();
+        const cv::Mat& procImage2 = frameSetCurr->frame(cameraId2)->image();
 
-        cv::Mat sketch(metadata1.procImage.rows,
-                       metadata1.procImage.cols + metadata2.procImage.cols,
+        cv::Mat sketch(procImage1.rows,
+                       procImage1.cols + procImage2.cols,
                        CV_8UC3);
 
-        cv::Mat image1(sketch, cv::Rect(0, 0, metadata1.procImage.cols, metadata1.procImage.rows));
-        cv::cvtColor(metadata1.procImage, image1, CV_GRAY2BGR);
+        cv::Mat image1(sketch, cv::Rect(0, 0, procImage1.cols, procImage1.rows));
+        cv::cvtColor(procImage1, image1, CV_GRAY2BGR);
 
-        cv::Mat image2(sketch, cv::Rect(metadata1.procImage.cols, 0,
-                                        metadata2.procImage.cols, metadata2.procImage.rows));
-        cv::cvtColor(metadata2.procImage, image2, CV_GRAY2BGR);
+        cv::Mat image2(sketch, cv::Rect(procImage1.cols, 0,
+                                        procImage2.cols, procImage2.rows));
+        cv::cvtColor(procImage2, image2, CV_GRAY2BGR);
 
         const std::vector<Point2DFeaturePtr>& features1Curr = frameSetCurr->frame(cameraId1)->features2D();
         const std::vector<Point2DFeaturePtr>& features2Curr = frameSetCurr->frame(cameraId2)->features2D();
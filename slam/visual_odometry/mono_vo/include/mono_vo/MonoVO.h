@@ -6,12 +6,15 @@
 #include <opencv2/features2d/features2d.hpp>
 
 #include "camera_systems/CameraSystem.h"
+#include "sparse_graph/FeatureArena.h"
 #include "sparse_graph/SparseGraph.h"
 #include "mono_vo/LocalMonoBA.h"
 
 namespace px
 {
 
+class HammingMatcher;
+
 class MonoVO
 {
 public:
@@ -38,6 +41,10 @@ public:
 
     void keyCurrentFrameSet(void);
 
+    // Allocate scene points from the arena of the sparse graph segment
+    // which the frame sets are added to, instead of a private arena.
+    void setScenePointArena(const boost::shared_ptr<FeatureArena<Point3DFeature> >& arena);
+
 private:
     enum DescriptorMatchMethod
     {
@@ -148,8 +155,10 @@ private:
     cv::Ptr<cv::FeatureDetector> m_featureDetector;
     cv::Ptr<cv::DescriptorExtractor> m_descriptorExtractor;
     cv::Ptr<cv::DescriptorMatcher> m_descriptorMatcher;
+    boost::shared_ptr<HammingMatcher> m_hammingMatcher;
 
     boost::shared_ptr<LocalMonoBA> m_lba;
+    boost::shared_ptr<FeatureArena<Point3DFeature> > m_scenePointArena;
 
     boost::mutex m_globalMutex;
     bool m_init;
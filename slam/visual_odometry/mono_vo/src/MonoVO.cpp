@@ -7,6 +7,7 @@
 #include <ros/ros.h>
 
 #include "cauldron/EigenUtils.h"
+#include "cauldron/HammingMatcher.h"
 #include "fivepoint/fivepoint.hpp"
 #include "pose_estimation/P3P.h"
 
@@ -37,6 +38,7 @@ MonoVO::MonoVO(const CameraSystemConstPtr& cameraSystem,
     }
 
     m_lba = boost::make_shared<LocalMonoBA>(cameraSystem, m_cameraId);
+    m_scenePointArena = boost::make_shared<FeatureArena<Point3DFeature> >();
 }
 
 bool
@@ -71,6 +73,11 @@ MonoVO::init(const std::string& detectorType,
         return false;
     }
 
+    if (descriptorMatcherType == "BruteForce-Hamming")
+    {
+        m_hammingMatcher = boost::make_shared<HammingMatcher>();
+    }
+
     return true;
 }
 
@@ -104,15 +111,12 @@ MonoVO::processFrames(FrameSetPtr& frameSet)
     FramePtr frame = boost::make_shared<Frame>();
     frame->cameraId() = m_cameraId;
 
-    for (size_t i = 0; i < kpts.size(); ++i)
+    frame->appendFeatures2D(dtors);
+    for (size_t i = 0; i < frame->features2D().size(); ++i)
     {
-        Point2DFeaturePtr feature = boost::make_shared<Point2DFeature>();
-        feature->frame() = frame.get();
+        Point2DFeaturePtr& feature = frame->features2D().at(i);
         feature->keypoint() = kpts.at(i);
-        dtors.row(i).copyTo(feature->descriptor());
         feature->ray() = spts.at(i);
-
-        frame->features2D().push_back(feature);
     }
 
     frameSet = boost::make_shared<FrameSet>();
@@ -563,12 +567,20 @@ MonoVO::keyCurrentFrameSet(void)
     }
 }
 
+void
+MonoVO::setScenePointArena(const boost::shared_ptr<FeatureArena<Point3DFeature> >& arena)
+{
+    m_scenePointArena = arena;
+}
+
 void
 MonoVO::removeSingletonFeatures(FrameSetPtr& frameSet) const
 {
     for (size_t i = 0; i < frameSet->frames().size(); ++i)
     {
-        std::vector<Point2DFeaturePtr>& features = frameSet->frames().at(i)->features2D();
+        FramePtr& frame = frameSet->frames().at(i);
+
+        std::vector<Point2DFeaturePtr>& features = frame->features2D();
         std::vector<Point2DFeaturePtr>::iterator it = features.begin();
         while (it != features.end())
         {
@@ -584,6 +596,9 @@ MonoVO::removeSingletonFeatures(FrameSetPtr& frameSet) const
                 ++it;
             }
         }
+
+        // keep the descriptor matrix in step with the features
+        frame->compactFeatures2D();
     }
 }
 
@@ -638,24 +653,7 @@ MonoVO::removeCorrespondence(Point2DFeature* featurePrev,
 void
 MonoVO::getDescriptorMat(const FrameConstPtr& frame, cv::Mat& dmat) const
 {
-    const std::vector<Point2DFeaturePtr>& features2D = frame->features2D();
-
-    if (features2D.empty())
-    {
-        dmat = cv::Mat();
-
-        return;
-    }
-
-    dmat = cv::Mat(features2D.size(), features2D.front()->descriptor().cols,
-                   features2D.front()->descriptor().type());
-
-    for (size_t i = 0; i < features2D.size(); ++i)
-    {
-        const Point2DFeatureConstPtr& feature2D = features2D.at(i);
-
-        feature2D->descriptor().copyTo(dmat.row(i));
-    }
+    dmat = frame->descriptorMat();
 }
 
 void
@@ -686,8 +684,16 @@ MonoVO::matchDescriptors(const cv::Mat& queryDescriptors,
     case RATIO_MATCH:
     {
         std::vector<std::vector<cv::DMatch> > rawMatches;
-        m_descriptorMatcher->knnMatch(queryDescriptors, trainDescriptors,
-                                      rawMatches, 2, mask, true);
+        if (m_hammingMatcher)
+        {
+            m_hammingMatcher->knnMatch(queryDescriptors, trainDescriptors,
+                                       rawMatches, 2, mask, true);
+        }
+        else
+        {
+            m_descriptorMatcher->knnMatch(queryDescriptors, trainDescriptors,
+                                          rawMatches, 2, mask, true);
+        }
 
         matches.reserve(rawMatches.size());
         for (size_t i = 0; i < rawMatches.size(); ++i)
@@ -713,8 +719,16 @@ MonoVO::matchDescriptors(const cv::Mat& queryDescriptors,
     case BEST_MATCH:
     default:
     {
-        m_descriptorMatcher->match(queryDescriptors, trainDescriptors,
-                                   matches, mask);
+        if (m_hammingMatcher)
+        {
+            m_hammingMatcher->match(queryDescriptors, trainDescriptors,
+                                    matches, mask);
+        }
+        else
+        {
+            m_descriptorMatcher->match(queryDescriptors, trainDescriptors,
+                                       matches, mask);
+        }
     }
     }
 }
@@ -870,7 +884,7 @@ MonoVO::reconstructScenePoint(Point2DFeaturePtr& f1,
         return false;
     }
 
-    Point3DFeaturePtr p3D = boost::make_shared<Point3DFeature>();
+    Point3DFeaturePtr p3D = m_scenePointArena->allocate();
     p3D->point() = transformPoint(m_cameraSystem->getGlobalCameraPose(frame1->cameraId()), P1);
     p3D->pointFromStereo() = p3D->point();
     p3D->features2D().push_back(f1.get());
@@ -6,12 +6,15 @@
 #include <opencv2/features2d/features2d.hpp>
 
 #include "camera_systems/CameraSystem.h"
+#include "sparse_graph/FeatureArena.h"
 #include "sparse_graph/SparseGraph.h"
 #include "stereo_vo/LocalStereoBA.h"
 
 namespace px
 {
 
+class HammingMatcher;
+
 class StereoVO
 {
 public:
@@ -38,6 +41,10 @@ public:
 
     void keyCurrentFrameSet(void);
 
+    // Allocate scene points from the arena of the sparse graph segment
+    // which the frame sets are added to, instead of a private arena.
+    void setScenePointArena(const boost::shared_ptr<FeatureArena<Point3DFeature> >& arena);
+
 private:
     enum DescriptorMatchMethod
     {
@@ -80,6 +87,17 @@ private:
                                   const FrameSetConstPtr& frameSet2,
                                   std::vector<cv::DMatch>& matches) const;
 
+    // Match the features of a camera between consecutive frame sets,
+    // comparing only features close to their predicted image locations.
+    // Falls back to matching against all features if fewer than
+    // k_minTemporalMatches matches are found.
+    void matchTemporalDescriptors(const FrameConstPtr& frame1,
+                                  const FrameConstPtr& frame2,
+                                  const cv::Mat& dtors1,
+                                  const cv::Mat& dtors2,
+                                  const Eigen::Matrix4d& systemPose,
+                                  std::vector<cv::DMatch>& matches) const;
+
     void processFrame(const ImageMetadata& metadata,
                       cv::Mat& imageProc,
                       std::vector<cv::KeyPoint>& kpts,
@@ -89,6 +107,10 @@ private:
     bool reconstructScenePoint(Point2DFeaturePtr& f1,
                                Point2DFeaturePtr& f2,
                                const Eigen::Matrix4d& H) const;
+    bool reconstructScenePoint(const Eigen::Vector3d& ray1,
+                               const Eigen::Vector3d& ray2,
+                               const Eigen::Matrix4d& H,
+                               Eigen::Vector3d& P) const;
 
     int reconstructScenePoints(FrameSetPtr& frameSet) const;
 
@@ -108,8 +130,10 @@ private:
     const double k_epipolarThresh;
     const float k_maxDistanceRatio;
     const double k_maxStereoRange;
+    const int k_minTemporalMatches;
     const bool k_preUndistort;
     const double k_sphericalErrorThresh;
+    const float k_temporalMatchingWindow;
 
     // input
     CameraSystemConstPtr m_cameraSystem;
@@ -140,8 +164,10 @@ private:
     cv::Ptr<cv::FeatureDetector> m_featureDetector;
     cv::Ptr<cv::DescriptorExtractor> m_descriptorExtractor;
     cv::Ptr<cv::DescriptorMatcher> m_descriptorMatcher;
+    boost::shared_ptr<HammingMatcher> m_hammingMatcher;
 
     boost::shared_ptr<LocalStereoBA> m_lba;
+    boost::shared_ptr<FeatureArena<Point3DFeature> > m_scenePointArena;
 
     boost::mutex m_globalMutex;
     size_t m_n2D3DCorrespondences;
@@ -1,5 +1,6 @@
 #include "stereo_vo/StereoVO.h"
 
+#include <limits>
 #include <opencv2/core/eigen.hpp>
 #include <opencv2/calib3d/calib3d.hpp>
 #include <opencv2/highgui/highgui.hpp>
@@ -7,7 +8,10 @@
 #include <ros/ros.h>
 
 #include "cauldron/EigenUtils.h"
+#include "cauldron/FeatureGrid.h"
+#include "cauldron/HammingMatcher.h"
 #include "pose_estimation/P3P.h"
+#include "sparse_graph/MotionPrediction.h"
 
 namespace px
 {
@@ -17,8 +21,10 @@ StereoVO::StereoVO(const CameraSystemConstPtr& cameraSystem,
  : k_epipolarThresh(0.00005)
  , k_maxDistanceRatio(0.7f)
  , k_maxStereoRange(10.0)
+ , k_minTemporalMatches(30)
  , k_preUndistort(preUndistort)
  , k_sphericalErrorThresh(0.999976)
+ , k_temporalMatchingWindow(48.0f)
  , m_cameraSystem(cameraSystem)
  , m_cameraId1(cameraId1)
  , m_cameraId2(cameraId2)
@@ -42,6 +48,7 @@ StereoVO::StereoVO(const CameraSystemConstPtr& cameraSystem,
     m_E = skew(t) * R;
 
     m_lba = boost::make_shared<LocalStereoBA>(cameraSystem, m_cameraId1, m_cameraId2);
+    m_scenePointArena = boost::make_shared<FeatureArena<Point3DFeature> >();
 }
 
 bool
@@ -76,6 +83,11 @@ StereoVO::init(const std::string& detectorType,
         return false;
     }
 
+    if (descriptorMatcherType == "BruteForce-Hamming")
+    {
+        m_hammingMatcher = boost::make_shared<HammingMatcher>();
+    }
+
     return true;
 }
 
@@ -163,29 +175,63 @@ StereoVO::processFrames(FrameSetPtr& frameSet)
     // For each match, reconstruct the scene point.
     // If the reprojection error of the scene point in either camera exceeds
     // a threshold, mark the match as an outlier.
+    std::vector<cv::DMatch> inliers;
+    std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > scenePoints;
+    inliers.reserve(matches.size());
+    scenePoints.reserve(matches.size());
     for (size_t i = 0; i < matches.size(); ++i)
     {
         const cv::DMatch& match = matches.at(i);
 
-        Point2DFeaturePtr feature1 = boost::make_shared<Point2DFeature>();
-        feature1->frame() = frame1.get();
+        Eigen::Vector3d P;
+        if (!reconstructScenePoint(spts1.at(match.queryIdx),
+                                   spts2.at(match.trainIdx),
+                                   m_H_1_2, P))
+        {
+            continue;
+        }
+
+        inliers.push_back(match);
+        scenePoints.push_back(P);
+    }
+
+    // The features of each frame are allocated in one block and share
+    // a single descriptor matrix.
+    cv::Mat dtorsInlier1(inliers.size(), dtors1.cols, dtors1.type());
+    cv::Mat dtorsInlier2(inliers.size(), dtors2.cols, dtors2.type());
+    for (size_t i = 0; i < inliers.size(); ++i)
+    {
+        dtors1.row(inliers.at(i).queryIdx).copyTo(dtorsInlier1.row(i));
+        dtors2.row(inliers.at(i).trainIdx).copyTo(dtorsInlier2.row(i));
+    }
+
+    frame1->appendFeatures2D(dtorsInlier1);
+    frame2->appendFeatures2D(dtorsInlier2);
+
+    std::vector<Point3DFeaturePtr> features3D;
+    m_scenePointArena->allocate(inliers.size(), features3D);
+
+    Eigen::Matrix4d H_cam1_sys = m_cameraSystem->getGlobalCameraPose(m_cameraId1);
+    for (size_t i = 0; i < inliers.size(); ++i)
+    {
+        const cv::DMatch& match = inliers.at(i);
+
+        Point2DFeaturePtr& feature1 = frame1->features2D().at(i);
         feature1->keypoint() = kpts1.at(match.queryIdx);
-        dtors1.row(match.queryIdx).copyTo(feature1->descriptor());
         feature1->ray() = spts1.at(match.queryIdx);
 
-        Point2DFeaturePtr feature2 = boost::make_shared<Point2DFeature>();
-        feature2->frame() = frame2.get();
+        Point2DFeaturePtr& feature2 = frame2->features2D().at(i);
         feature2->keypoint() = kpts2.at(match.trainIdx);
-        dtors2.row(match.trainIdx).copyTo(feature2->descriptor());
         feature2->ray() = spts2.at(match.trainIdx);
 
-        if (!reconstructScenePoint(feature1, feature2, m_H_1_2))
-        {
-            continue;
-        }
+        Point3DFeaturePtr& p3D = features3D.at(i);
+        p3D->point() = transformPoint(H_cam1_sys, scenePoints.at(i));
+        p3D->pointFromStereo() = scenePoints.at(i);
+        p3D->features2D().push_back(feature1.get());
+        p3D->features2D().push_back(feature2.get());
 
-        frame1->features2D().push_back(feature1);
-        frame2->features2D().push_back(feature2);
+        feature1->feature3D() = p3D;
+        feature2->feature3D() = p3D;
 
         feature1->bestMatchId() = 0;
         feature1->matches().push_back(feature2.get());
@@ -458,6 +504,9 @@ StereoVO::processFrames(FrameSetPtr& frameSet)
         }
     }
 
+    frame1->compactFeatures2D();
+    frame2->compactFeatures2D();
+
     if (m_debug)
     {
         ROS_INFO("Local BA took %.3f s.", (ros::Time::now() - tsStart).toSec());
@@ -596,26 +645,15 @@ StereoVO::keyCurrentFrameSet(void)
 }
 
 void
-StereoVO::getDescriptorMat(const FrameConstPtr& frame, cv::Mat& dmat) const
+StereoVO::setScenePointArena(const boost::shared_ptr<FeatureArena<Point3DFeature> >& arena)
 {
-    const std::vector<Point2DFeaturePtr>& features2D = frame->features2D();
-
-    if (features2D.empty())
-    {
-        dmat = cv::Mat();
-
-        return;
-    }
-
-    dmat = cv::Mat(features2D.size(), features2D.front()->descriptor().cols,
-                   features2D.front()->descriptor().type());
-
-    for (size_t i = 0; i < features2D.size(); ++i)
-    {
-        const Point2DFeatureConstPtr& feature2D = features2D.at(i);
+    m_scenePointArena = arena;
+}
 
-        feature2D->descriptor().copyTo(dmat.row(i));
-    }
+void
+StereoVO::getDescriptorMat(const FrameConstPtr& frame, cv::Mat& dmat) const
+{
+    dmat = frame->descriptorMat();
 }
 
 void
@@ -646,8 +684,16 @@ StereoVO::matchDescriptors(const cv::Mat& queryDescriptors,
     case RATIO_MATCH:
     {
         std::vector<std::vector<cv::DMatch> > rawMatches;
-        m_descriptorMatcher->knnMatch(queryDescriptors, trainDescriptors,
-                                      rawMatches, 2, mask, true);
+        if (m_hammingMatcher)
+        {
+            m_hammingMatcher->knnMatch(queryDescriptors, trainDescriptors,
+                                       rawMatches, 2, mask, true);
+        }
+        else
+        {
+            m_descriptorMatcher->knnMatch(queryDescriptors, trainDescriptors,
+                                          rawMatches, 2, mask, true);
+        }
 
         matches.reserve(rawMatches.size());
         for (size_t i = 0; i < rawMatches.size(); ++i)
@@ -673,8 +719,16 @@ StereoVO::matchDescriptors(const cv::Mat& queryDescriptors,
     case BEST_MATCH:
     default:
     {
-        m_descriptorMatcher->match(queryDescriptors, trainDescriptors,
-                                   matches, mask);
+        if (m_hammingMatcher)
+        {
+            m_hammingMatcher->match(queryDescriptors, trainDescriptors,
+                                    matches, mask);
+        }
+        else
+        {
+            m_descriptorMatcher->match(queryDescriptors, trainDescriptors,
+                                       matches, mask);
+        }
     }
     }
 }
@@ -692,17 +746,21 @@ StereoVO::match2D3DCorrespondences(const FrameSetConstPtr& frameSet1,
     std::vector<cv::Mat> dtors2;
     getDescriptorMatVec(frameSet2, dtors2);
 
+    Eigen::Matrix4d systemPose = predictSystemPose(frameSet1, m_imageStamp);
+
     // match between left image in frame set 1 and left image in frame set 2
     std::vector<cv::DMatch> rawMatches1, rawMatches2;
     boost::shared_ptr<boost::thread> threads[2];
 
-    threads[0] = boost::make_shared<boost::thread>(boost::bind(&StereoVO::matchDescriptors, this,
-                                                               boost::cref(dtors1.at(0)), boost::cref(dtors2.at(0)), boost::ref(rawMatches1),
-                                                               cv::Mat(), RATIO_MATCH, k_maxDistanceRatio));
+    threads[0] = boost::make_shared<boost::thread>(boost::bind(&StereoVO::matchTemporalDescriptors, this,
+                                                               frameSet1->frames().at(0), frameSet2->frames().at(0),
+                                                               boost::cref(dtors1.at(0)), boost::cref(dtors2.at(0)),
+                                                               boost::cref(systemPose), boost::ref(rawMatches1)));
 
-    threads[1] = boost::make_shared<boost::thread>(boost::bind(&StereoVO::matchDescriptors, this,
-                                                               boost::cref(dtors1.at(1)), boost::cref(dtors2.at(1)), boost::ref(rawMatches2),
-                                                               cv::Mat(), RATIO_MATCH, k_maxDistanceRatio));
+    threads[1] = boost::make_shared<boost::thread>(boost::bind(&StereoVO::matchTemporalDescriptors, this,
+                                                               frameSet1->frames().at(1), frameSet2->frames().at(1),
+                                                               boost::cref(dtors1.at(1)), boost::cref(dtors2.at(1)),
+                                                               boost::cref(systemPose), boost::ref(rawMatches2)));
 
     threads[0]->join();
     threads[1]->join();
@@ -745,6 +803,47 @@ StereoVO::match2D3DCorrespondences(const FrameSetConstPtr& frameSet1,
     }
 }
 
+void
+StereoVO::matchTemporalDescriptors(const FrameConstPtr& frame1,
+                                   const FrameConstPtr& frame2,
+                                   const cv::Mat& dtors1,
+                                   const cv::Mat& dtors2,
+                                   const Eigen::Matrix4d& systemPose,
+                                   std::vector<cv::DMatch>& matches) const
+{
+    if (k_temporalMatchingWindow <= 0.0f)
+    {
+        matchDescriptors(dtors1, dtors2, matches, cv::Mat(), RATIO_MATCH, k_maxDistanceRatio);
+        return;
+    }
+
+    std::vector<cv::Point2f> predictedKeypoints;
+    predictKeypoints(frame1, m_cameraSystem->getCamera(frame1->cameraId()),
+                     m_cameraSystem->getGlobalCameraPose(frame1->cameraId()),
+                     systemPose, predictedKeypoints);
+
+    const std::vector<Point2DFeaturePtr>& features2 = frame2->features2D();
+
+    std::vector<cv::Point2f> keypoints2(features2.size());
+    for (size_t i = 0; i < features2.size(); ++i)
+    {
+        keypoints2.at(i) = features2.at(i)->keypoint().pt;
+    }
+
+    FeatureGrid grid(k_temporalMatchingWindow);
+    grid.build(keypoints2);
+
+    grid.matchDescriptors(dtors1, predictedKeypoints, dtors2,
+                          k_temporalMatchingWindow, k_maxDistanceRatio, matches);
+
+    // The prediction is likely wrong, e.g. after a sudden change in motion,
+    // so fall back to matching against all features.
+    if (static_cast<int>(matches.size()) < k_minTemporalMatches)
+    {
+        matchDescriptors(dtors1, dtors2, matches, cv::Mat(), RATIO_MATCH, k_maxDistanceRatio);
+    }
+}
+
 void
 StereoVO::processFrame(const ImageMetadata& metadata,
                        cv::Mat& imageProc,
@@ -788,9 +887,33 @@ StereoVO::reconstructScenePoint(Point2DFeaturePtr& f1,
 {
     Frame* frame1 = f1->frame();
 
+    Eigen::Vector3d P1;
+    if (!reconstructScenePoint(f1->ray(), f2->ray(), H, P1))
+    {
+        return false;
+    }
+
+    Point3DFeaturePtr p3D = m_scenePointArena->allocate();
+    p3D->point() = transformPoint(m_cameraSystem->getGlobalCameraPose(frame1->cameraId()), P1);
+    p3D->pointFromStereo() = P1;
+    p3D->features2D().push_back(f1.get());
+    p3D->features2D().push_back(f2.get());
+
+    f1->feature3D() = p3D;
+    f2->feature3D() = p3D;
+
+    return true;
+}
+
+bool
+StereoVO::reconstructScenePoint(const Eigen::Vector3d& ray1,
+                                const Eigen::Vector3d& ray2,
+                                const Eigen::Matrix4d& H,
+                                Eigen::Vector3d& P) const
+{
     Eigen::MatrixXd A(3,2);
-    A.col(0) = H.block<3,3>(0,0) * f1->ray();
-    A.col(1) = - f2->ray();
+    A.col(0) = H.block<3,3>(0,0) * ray1;
+    A.col(1) = - ray2;
 
     Eigen::Vector3d b = - H.block<3,1>(0,3);
 
@@ -808,7 +931,7 @@ StereoVO::reconstructScenePoint(Point2DFeaturePtr& f1,
         return false;
     }
 
-    Eigen::Vector3d P1 = gamma(0) * f1->ray();
+    Eigen::Vector3d P1 = gamma(0) * ray1;
     Eigen::Vector3d P2 = H.block<3,3>(0,0) * P1 + H.block<3,1>(0,3);
 
     if (P2(2) < 0.0)
@@ -818,20 +941,13 @@ StereoVO::reconstructScenePoint(Point2DFeaturePtr& f1,
 
     Eigen::Vector3d ray2_est = P2.normalized();
 
-    double err = fabs(ray2_est.dot(f2->ray()));
+    double err = fabs(ray2_est.dot(ray2));
     if (err < k_sphericalErrorThresh)
     {
         return false;
     }
 
-    Point3DFeaturePtr p3D = boost::make_shared<Point3DFeature>();
-    p3D->point() = transformPoint(m_cameraSystem->getGlobalCameraPose(frame1->cameraId()), P1);
-    p3D->pointFromStereo() = P1;
-    p3D->features2D().push_back(f1.get());
-    p3D->features2D().push_back(f2.get());
-
-    f1->feature3D() = p3D;
-    f2->feature3D() = p3D;
+    P = P1;
 
     return true;
 }
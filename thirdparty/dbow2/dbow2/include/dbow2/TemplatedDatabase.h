@@ -200,6 +200,30 @@ public:
   void query(const BowVector &vec, QueryResults &ret, 
     int max_results = 1, int min_id = -1, int max_id = -1) const;
 
+  /**
+   * Queries the database with some features, scoring only the entries
+   * which are set in a mask
+   * @param features query features
+   * @param ret (out) query results
+   * @param max_results number of results to return. <= 0 means all
+   * @param entry_mask entries which may be returned, indexed by entry id.
+   *   Entries beyond the size of the mask are not returned
+   */
+  void query(const vector<TDescriptor> &features, QueryResults &ret,
+    int max_results, const std::vector<bool> &entry_mask) const;
+
+  /**
+   * Queries the database with a vector, scoring only the entries which are
+   * set in a mask
+   * @param vec bow vector already normalized
+   * @param ret results
+   * @param max_results number of results to return. <= 0 means all
+   * @param entry_mask entries which may be returned, indexed by entry id.
+   *   Entries beyond the size of the mask are not returned
+   */
+  void query(const BowVector &vec, QueryResults &ret,
+    int max_results, const std::vector<bool> &entry_mask) const;
+
   /**
    * Returns the a feature vector associated with a database entry
    * @param id entry id (must be < size())
@@ -244,29 +268,48 @@ public:
 
 protected:
   
+  /// Query with the scoring type of the vocabulary
+  void queryScoring(const BowVector &vec, QueryResults &ret, 
+    int max_results, int min_id, int max_id,
+    const std::vector<bool> *entry_mask) const;
+  
+  /// Returns whether an entry may be returned by a query with entry_mask
+  static inline bool inEntryMask(EntryId entry_id,
+    const std::vector<bool> *entry_mask)
+  {
+    return entry_mask == NULL ||
+      (entry_id < entry_mask->size() && (*entry_mask)[entry_id]);
+  }
+  
   /// Query with L1 scoring
   void queryL1(const BowVector &vec, QueryResults &ret, 
-    int max_results, int min_id, int max_id) const;
+    int max_results, int min_id, int max_id,
+    const std::vector<bool> *entry_mask) const;
   
   /// Query with L2 scoring
   void queryL2(const BowVector &vec, QueryResults &ret, 
-    int max_results, int min_id, int max_id) const;
+    int max_results, int min_id, int max_id,
+    const std::vector<bool> *entry_mask) const;
   
   /// Query with Chi square scoring
   void queryChiSquare(const BowVector &vec, QueryResults &ret, 
-    int max_results, int min_id, int max_id) const;
+    int max_results, int min_id, int max_id,
+    const std::vector<bool> *entry_mask) const;
   
   /// Query with Bhattacharyya scoring
   void queryBhattacharyya(const BowVector &vec, QueryResults &ret, 
-    int max_results, int min_id, int max_id) const;
+    int max_results, int min_id, int max_id,
+    const std::vector<bool> *entry_mask) const;
   
   /// Query with KL divergence scoring  
   void queryKL(const BowVector &vec, QueryResults &ret, 
-    int max_results, int min_id, int max_id) const;
+    int max_results, int min_id, int max_id,
+    const std::vector<bool> *entry_mask) const;
   
   /// Query with dot product scoring
   void queryDotProduct(const BowVector &vec, QueryResults &ret, 
-    int max_results, int min_id, int max_id) const;
+    int max_results, int min_id, int max_id,
+    const std::vector<bool> *entry_mask) const;
   
   /// TEST Query with normalized square difference scoring
   void __queryNormSqDiff(const BowVector &vec, QueryResults &ret, 
@@ -639,33 +682,68 @@ template<class TDescriptor, class F>
 void TemplatedDatabase<TDescriptor, F>::query(
   const BowVector &vec, 
   QueryResults &ret, int max_results, int min_id, int max_id) const
+{
+  queryScoring(vec, ret, max_results, min_id, max_id, NULL);
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedDatabase<TDescriptor, F>::query(
+  const vector<TDescriptor> &features, 
+  QueryResults &ret, int max_results, 
+  const std::vector<bool> &entry_mask) const
+{
+  BowVector vec;
+  m_voc->transform(features, vec);
+  query(vec, ret, max_results, entry_mask);
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedDatabase<TDescriptor, F>::query(
+  const BowVector &vec, 
+  QueryResults &ret, int max_results, 
+  const std::vector<bool> &entry_mask) const
+{
+  queryScoring(vec, ret, max_results, -1, -1, &entry_mask);
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedDatabase<TDescriptor, F>::queryScoring(
+  const BowVector &vec, 
+  QueryResults &ret, int max_results, int min_id, int max_id,
+  const std::vector<bool> *entry_mask) const
 {
   ret.resize(0);
   
   switch(m_voc->getScoringType())
   {
     case L1_NORM:
-      queryL1(vec, ret, max_results, min_id, max_id);
+      queryL1(vec, ret, max_results, min_id, max_id, entry_mask);
       break;
       
     case L2_NORM:
-      queryL2(vec, ret, max_results, min_id, max_id);
+      queryL2(vec, ret, max_results, min_id, max_id, entry_mask);
       break;
       
     case CHI_SQUARE:
-      queryChiSquare(vec, ret, max_results, min_id, max_id);
+      queryChiSquare(vec, ret, max_results, min_id, max_id, entry_mask);
       break;
       
     case KL:
-      queryKL(vec, ret, max_results, min_id, max_id);
+      queryKL(vec, ret, max_results, min_id, max_id, entry_mask);
       break;
       
     case BHATTACHARYYA:
-      queryBhattacharyya(vec, ret, max_results, min_id, max_id);
+      queryBhattacharyya(vec, ret, max_results, min_id, max_id, entry_mask);
       break;
       
     case DOT_PRODUCT:
-      queryDotProduct(vec, ret, max_results, min_id, max_id);
+      queryDotProduct(vec, ret, max_results, min_id, max_id, entry_mask);
       break;
   }
 }
@@ -674,7 +752,8 @@ void TemplatedDatabase<TDescriptor, F>::query(
 
 template<class TDescriptor, class F>
 void TemplatedDatabase<TDescriptor, F>::queryL1(const BowVector &vec, 
-  QueryResults &ret, int max_results, int min_id, int max_id) const
+  QueryResults &ret, int max_results, int min_id, int max_id,
+  const std::vector<bool> *entry_mask) const
 {
   BowVector::const_iterator vit;
   typename IFRow::const_iterator rit;
@@ -696,10 +775,11 @@ void TemplatedDatabase<TDescriptor, F>::queryL1(const BowVector &vec,
       const EntryId entry_id = rit->entry_id;
       const WordValue& dvalue = rit->word_weight;
       
-      if(((int)entry_id >= min_id && min_id != -1 && max_id == -1) ||
+      if((((int)entry_id >= min_id && min_id != -1 && max_id == -1) ||
          ((int)entry_id <= max_id && min_id == -1 && max_id != -1) ||
          ((int)entry_id >= min_id && (int)entry_id <= max_id && min_id != -1 && max_id != -1) ||
-         (min_id == -1 && max_id == -1))
+         (min_id == -1 && max_id == -1)) &&
+         inEntryMask(entry_id, entry_mask))
       {
         double value = fabs(qvalue - dvalue) - fabs(qvalue) - fabs(dvalue);
         
@@ -749,7 +829,8 @@ void TemplatedDatabase<TDescriptor, F>::queryL1(const BowVector &vec,
 
 template<class TDescriptor, class F>
 void TemplatedDatabase<TDescriptor, F>::queryL2(const BowVector &vec, 
-  QueryResults &ret, int max_results, int min_id, int max_id) const
+  QueryResults &ret, int max_results, int min_id, int max_id,
+  const std::vector<bool> *entry_mask) const
 {
   BowVector::const_iterator vit;
   typename IFRow::const_iterator rit;
@@ -774,10 +855,11 @@ void TemplatedDatabase<TDescriptor, F>::queryL2(const BowVector &vec,
       const EntryId entry_id = rit->entry_id;
       const WordValue& dvalue = rit->word_weight;
       
-      if(((int)entry_id >= min_id && min_id != -1 && max_id == -1) ||
+      if((((int)entry_id >= min_id && min_id != -1 && max_id == -1) ||
          ((int)entry_id <= max_id && min_id == -1 && max_id != -1) ||
          ((int)entry_id >= min_id && (int)entry_id <= max_id && min_id != -1 && max_id != -1) ||
-         (min_id == -1 && max_id == -1))
+         (min_id == -1 && max_id == -1)) &&
+         inEntryMask(entry_id, entry_mask))
       {
         double value = - qvalue * dvalue; // minus sign for sorting trick
         
@@ -840,7 +922,8 @@ void TemplatedDatabase<TDescriptor, F>::queryL2(const BowVector &vec,
 
 template<class TDescriptor, class F>
 void TemplatedDatabase<TDescriptor, F>::queryChiSquare(const BowVector &vec, 
-  QueryResults &ret, int max_results, int min_id, int max_id) const
+  QueryResults &ret, int max_results, int min_id, int max_id,
+  const std::vector<bool> *entry_mask) const
 {
   BowVector::const_iterator vit;
   typename IFRow::const_iterator rit;
@@ -870,10 +953,11 @@ void TemplatedDatabase<TDescriptor, F>::queryChiSquare(const BowVector &vec,
       const EntryId entry_id = rit->entry_id;
       const WordValue& dvalue = rit->word_weight;
       
-      if(((int)entry_id >= min_id && min_id != -1 && max_id == -1) ||
+      if((((int)entry_id >= min_id && min_id != -1 && max_id == -1) ||
          ((int)entry_id <= max_id && min_id == -1 && max_id != -1) ||
          ((int)entry_id >= min_id && (int)entry_id <= max_id && min_id != -1 && max_id != -1) ||
-         (min_id == -1 && max_id == -1))
+         (min_id == -1 && max_id == -1)) &&
+         inEntryMask(entry_id, entry_mask))
       {
         // (v-w)^2/(v+w) - v - w = -4 vw/(v+w)
         // we move the 4 out
@@ -977,7 +1061,8 @@ void TemplatedDatabase<TDescriptor, F>::queryChiSquare(const BowVector &vec,
 
 template<class TDescriptor, class F>
 void TemplatedDatabase<TDescriptor, F>::queryKL(const BowVector &vec, 
-  QueryResults &ret, int max_results, int min_id, int max_id) const
+  QueryResults &ret, int max_results, int min_id, int max_id,
+  const std::vector<bool> *entry_mask) const
 {
   BowVector::const_iterator vit;
   typename IFRow::const_iterator rit;
@@ -999,10 +1084,11 @@ void TemplatedDatabase<TDescriptor, F>::queryKL(const BowVector &vec,
       const EntryId entry_id = rit->entry_id;
       const WordValue& wi = rit->word_weight;
       
-      if(((int)entry_id >= min_id && min_id != -1 && max_id == -1) ||
+      if((((int)entry_id >= min_id && min_id != -1 && max_id == -1) ||
          ((int)entry_id <= max_id && min_id == -1 && max_id != -1) ||
          ((int)entry_id >= min_id && (int)entry_id <= max_id && min_id != -1 && max_id != -1) ||
-         (min_id == -1 && max_id == -1))
+         (min_id == -1 && max_id == -1)) &&
+         inEntryMask(entry_id, entry_mask))
       {
         double value = 0;
         if(vi != 0 && wi != 0) value = vi * log(vi/wi);
@@ -1137,7 +1223,8 @@ void TemplatedDatabase<TDescriptor, F>::__queryJS(const BowVector &vec,
 
 template<class TDescriptor, class F>
 void TemplatedDatabase<TDescriptor, F>::queryBhattacharyya(
-  const BowVector &vec, QueryResults &ret, int max_results, int min_id, int max_id) const
+  const BowVector &vec, QueryResults &ret, int max_results, int min_id, int max_id,
+  const std::vector<bool> *entry_mask) const
 {
   BowVector::const_iterator vit;
   typename IFRow::const_iterator rit;
@@ -1162,10 +1249,11 @@ void TemplatedDatabase<TDescriptor, F>::queryBhattacharyya(
       const EntryId entry_id = rit->entry_id;
       const WordValue& dvalue = rit->word_weight;
       
-      if(((int)entry_id >= min_id && min_id != -1 && max_id == -1) ||
+      if((((int)entry_id >= min_id && min_id != -1 && max_id == -1) ||
          ((int)entry_id <= max_id && min_id == -1 && max_id != -1) ||
          ((int)entry_id >= min_id && (int)entry_id <= max_id && min_id != -1 && max_id != -1) ||
-         (min_id == -1 && max_id == -1))
+         (min_id == -1 && max_id == -1)) &&
+         inEntryMask(entry_id, entry_mask))
       {
         double value = sqrt(qvalue * dvalue);
         
@@ -1316,7 +1404,8 @@ void TemplatedDatabase<TDescriptor, F>::__queryBhatNorm(
 
 template<class TDescriptor, class F>
 void TemplatedDatabase<TDescriptor, F>::queryDotProduct(
-  const BowVector &vec, QueryResults &ret, int max_results, int min_id, int max_id) const
+  const BowVector &vec, QueryResults &ret, int max_results, int min_id, int max_id,
+  const std::vector<bool> *entry_mask) const
 {
   BowVector::const_iterator vit;
   typename IFRow::const_iterator rit;
@@ -1338,10 +1427,11 @@ void TemplatedDatabase<TDescriptor, F>::queryDotProduct(
       const EntryId entry_id = rit->entry_id;
       const WordValue& dvalue = rit->word_weight;
       
-      if(((int)entry_id >= min_id && min_id != -1 && max_id == -1) ||
+      if((((int)entry_id >= min_id && min_id != -1 && max_id == -1) ||
          ((int)entry_id <= max_id && min_id == -1 && max_id != -1) ||
          ((int)entry_id >= min_id && (int)entry_id <= max_id && min_id != -1 && max_id != -1) ||
-         (min_id == -1 && max_id == -1))
+         (min_id == -1 && max_id == -1)) &&
+         inEntryMask(entry_id, entry_mask))
       {
         //cout << "@@ qvalue: " << qvalue << ", dvalue: " << dvalue << endl;
         